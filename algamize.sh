@@ -13,6 +13,7 @@ PORTABLE_FILES=(portable8439)
 
 DST_HEADER="$DST_DIR/portable8439.h"
 DST_SOURCE="$DST_DIR/portable8439.c"
+DST_SINGLE="$DST_DIR/portable8439-single.h"
 
 
 function remove_header_guard() {
@@ -38,11 +39,11 @@ function remove_double_blank_lines() {
 function make_everything_static() {
     sed \
         -e $'s/^\([^\ \t\#{}()\/]\)/static \\1/' \
+        -e '/(/!s/static const/const/' \
         -e 's/static static/static/' \
         -e 's/static struct/struct/' \
         -e 's/static typedef/typedef/' \
-        -e 's/static extern/extern/' \
-        -e 's/static const/const/'
+        -e 's/static extern/extern/'
 }
 
 function add_decl_spec() {
@@ -50,7 +51,8 @@ function add_decl_spec() {
         -e 's/^static /static PORTABLE_8439_DECL /' \
         -e $'s/^\([^\ \t#{}()\/*]\)/PORTABLE_8439_DECL \\1/' \
         -e 's/^PORTABLE_8439_DECL static/static/' \
-        -e 's/^PORTABLE_8439_DECL typedef/typedef/'
+        -e 's/^PORTABLE_8439_DECL typedef/typedef/' \
+        -e 's/^PORTABLE_8439_DECL PORTABLE_8439_/PORTABLE_8439_/'
 }
 
 {
@@ -89,7 +91,7 @@ extern \"C\" {
 
 #include \"portable8439.h\""
 
-    for h in "chacha-portable/chacha-portable" "poly1305-donna/poly1305-donna"; do 
+    for h in "portable-endian" "portable-config" "chacha-portable/chacha-portable" "poly1305-donna/poly1305-donna"; do 
         echo "// ******* BEGIN: $h.h ********"
         cat "$SRC_DIR/$h.h" | remove_header_guard | \
             remove_local_imports | remove_double_blank_lines | \
@@ -112,7 +114,7 @@ extern \"C\" {
     DONNA_ROOT="$SRC_DIR/poly1305-donna"
     function merge_donna_src() {
         awk '
-        /#.*include "poly1305-donna-[0-9]+.h"/ { system("cat src/poly1305-donna/"$3); next; }
+        /#.*include "poly1305-donna-[0-9a-z-]+.h"/ { system("cat src/poly1305-donna/"$NF); next; }
         42
         ' "$DONNA_ROOT/poly1305-donna.c"
     }
@@ -128,4 +130,56 @@ extern \"C\" {
         remove_double_blank_lines | add_decl_spec
         echo "// ******* END:   $h.c ********"
     done
-} > "$DST_SOURCE"
\ No newline at end of file
+} > "$DST_SOURCE"
+
+# the stb-style header-only variant: the header & source from above in one
+# file. With PORTABLE_8439_IMPLEMENTATION the entry points are static inline,
+# so every call site can be specialized (constant sizes and the like)
+function use_api_spec() {
+    sed \
+        -e 's/^\([ \t]*\)PORTABLE_8439_DECL /\1PORTABLE_8439_API /' \
+        -e 's/__PORTABLE_8439_H$/__PORTABLE_8439_SINGLE_H/'
+}
+
+{
+    echo "// portable8439 $VERSION, header-only
+// Source: https://github.com/DavyLandman/portable8439
+// Licensed under CC0-1.0
+// Contains poly1305-donna e6ad6e091d30d7f4ec2d4f978be1fcfcbce72781 (Public Domain)
+//
+// Define PORTABLE_8439_IMPLEMENTATION before including this file (in C, not
+// C++) to get the implementation as static inline functions in this
+// translation unit, every one that does has its own copy (including the
+// selected poly1305 backend and the stats). Without it you get the
+// declarations, and link against the library."
+    tail -n +5 "$DST_HEADER" | sed '/^#define __PORTABLE_8439_H$/ {
+a\
+\
+#ifndef PORTABLE_8439_API\
+#   ifdef PORTABLE_8439_IMPLEMENTATION\
+#       define PORTABLE_8439_API static inline PORTABLE_8439_DECL\
+#   else\
+#       define PORTABLE_8439_API PORTABLE_8439_DECL\
+#   endif\
+#endif\
+
+}' | use_api_spec | sed '$d'
+    echo "
+#ifdef PORTABLE_8439_IMPLEMENTATION"
+    tail -n +5 "$DST_SOURCE" | sed '/^#include "portable8439.h"$/d' | use_api_spec
+    echo "#endif
+#endif"
+} > "$DST_SINGLE"
+
+# the C++ wrapper is header-only and includes portable8439.h
+cp "$SRC_DIR/portable8439.hpp" "$DST_DIR/portable8439.hpp"
+cp "$SRC_DIR/portable8439-stream.hpp" "$DST_DIR/portable8439-stream.hpp"
+
+# the offload service needs threads, so it stays outside of the amalgamation
+cp "$SRC_DIR/portable8439-offload.h" "$SRC_DIR/portable8439-offload.c" "$DST_DIR/"
+# the transport sessions need atomics, same story
+cp "$SRC_DIR/portable8439-transport.h" "$SRC_DIR/portable8439-transport.c" "$DST_DIR/"
+# the shared memory channel needs atomics too
+cp "$SRC_DIR/portable8439-channel.h" "$SRC_DIR/portable8439-channel.c" "$DST_DIR/"
+# and the socket frames need POSIX sockets
+cp "$SRC_DIR/portable8439-socket.h" "$SRC_DIR/portable8439-socket.c" "$DST_DIR/"
@@ -0,0 +1,721 @@
+#define _POSIX_C_SOURCE 200809L
+#include "portable8439-offload.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if !defined(__GNUC__)
+#   error "portable8439-offload needs the __atomic extensions of GCC or Clang"
+#endif
+
+#define CACHE_LINE (64)
+// jobs up to SMALL_JOB bytes are taken from the ring in batches of at most
+// BATCH_JOBS jobs or BATCH_BYTES bytes, larger jobs are taken one by one
+#define SMALL_JOB (2048)
+#define BATCH_JOBS (32)
+#define BATCH_BYTES (16 * 1024)
+// rounds of looking for work (yielding in between) before going to sleep
+#define SPINS_BEFORE_SLEEP (64)
+// batch open: records larger than SPLIT_SIZE are opened in parts, one part
+// checks the tag, the others decrypt SPLIT_SIZE bytes each, so one huge 
+// record can keep several threads busy. Batches smaller than 
+// INLINE_BATCH_BYTES are opened on the calling thread only.
+#define SPLIT_SIZE (256 * 1024)
+#define INLINE_BATCH_BYTES (64 * 1024)
+// the job that makes a worker join a batch open
+#define OPERATION_JOIN_BATCH ((portable_8439_offload_operation)2)
+
+
+// Dmitry Vyukov's bounded multi producer multi consumer queue: every cell
+// has a sequence number that tells whether it's ready to be written (equal
+// to the enqueue position) or read (one ahead of the dequeue position)
+typedef struct ring_cell {
+    size_t sequence;
+    portable_8439_job *job;
+} ring_cell;
+
+typedef struct ring {
+    ring_cell *cells;
+    size_t mask;
+    char pad0[CACHE_LINE];
+    size_t enqueue_position;
+    char pad1[CACHE_LINE];
+    size_t dequeue_position;
+    char pad2[CACHE_LINE];
+} ring;
+
+static int ring_init(ring *r, size_t size) {
+    size_t capacity = 2;
+    while (capacity < size) {
+        capacity <<= 1;
+    }
+    r->cells = malloc(capacity * sizeof(ring_cell));
+    if (r->cells == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        r->cells[i].sequence = i;
+    }
+    r->mask = capacity - 1;
+    r->enqueue_position = 0;
+    r->dequeue_position = 0;
+    return 1;
+}
+
+static int ring_push(ring *r, portable_8439_job *job) {
+    size_t position = __atomic_load_n(&r->enqueue_position, __ATOMIC_RELAXED);
+    for (;;) {
+        ring_cell *cell = &r->cells[position & r->mask];
+        size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(&r->enqueue_position, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                cell->job = job;
+                __atomic_store_n(&cell->sequence, position + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+        }
+        else if (difference < 0) {
+            return 0; // full
+        }
+        else {
+            position = __atomic_load_n(&r->enqueue_position, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static portable_8439_job *ring_pop(ring *r) {
+    size_t position = __atomic_load_n(&r->dequeue_position, __ATOMIC_RELAXED);
+    for (;;) {
+        ring_cell *cell = &r->cells[position & r->mask];
+        size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(&r->dequeue_position, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                portable_8439_job *job = cell->job;
+                __atomic_store_n(&cell->sequence, position + r->mask + 1, __ATOMIC_RELEASE);
+                return job;
+            }
+        }
+        else if (difference < 0) {
+            return NULL; // empty
+        }
+        else {
+            position = __atomic_load_n(&r->dequeue_position, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// only a hint, a push can be halfway, which the pusher covers by waking up sleepers afterwards
+static int ring_empty(ring *r) {
+    size_t position = __atomic_load_n(&r->dequeue_position, __ATOMIC_ACQUIRE);
+    size_t sequence = __atomic_load_n(&r->cells[position & r->mask].sequence, __ATOMIC_ACQUIRE);
+    return (intptr_t)sequence - (intptr_t)(position + 1) < 0;
+}
+
+
+// Chase-Lev work stealing deque (after the C11 version of Lê et al., with
+// seq_cst accesses instead of fences, so tsan can follow it). It's bounded:
+// the owner only refills it when it's empty, with at most BATCH_JOBS jobs.
+// The owner pushes and pops at the bottom, thieves take from the top.
+typedef struct deque {
+    int64_t top;
+    char pad0[CACHE_LINE];
+    int64_t bottom;
+    portable_8439_job *slots[BATCH_JOBS];
+    char pad1[CACHE_LINE];
+} deque;
+
+static void deque_push(deque *d, portable_8439_job *job) {
+    int64_t bottom = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->slots[bottom % BATCH_JOBS], job, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, bottom + 1, __ATOMIC_RELEASE);
+}
+
+static portable_8439_job *deque_pop(deque *d) {
+    int64_t bottom = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    // an exchange instead of a store, so the load of top can't move in front of it
+    __atomic_exchange_n(&d->bottom, bottom, __ATOMIC_SEQ_CST);
+    int64_t top = __atomic_load_n(&d->top, __ATOMIC_SEQ_CST);
+    if (top > bottom) {
+        __atomic_store_n(&d->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    portable_8439_job *job = __atomic_load_n(&d->slots[bottom % BATCH_JOBS], __ATOMIC_RELAXED);
+    if (top == bottom) {
+        // last one, race the thieves for it
+        if (!__atomic_compare_exchange_n(&d->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            job = NULL;
+        }
+        __atomic_store_n(&d->bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+    return job;
+}
+
+static portable_8439_job *deque_steal(deque *d) {
+    int64_t top = __atomic_load_n(&d->top, __ATOMIC_SEQ_CST);
+    int64_t bottom = __atomic_load_n(&d->bottom, __ATOMIC_SEQ_CST);
+    if (top >= bottom) {
+        return NULL;
+    }
+    portable_8439_job *job = __atomic_load_n(&d->slots[top % BATCH_JOBS], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&d->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL; // lost to the owner or another thief
+    }
+    return job;
+}
+
+
+// sleeping: the sleeper registers itself and then checks for work under the
+// lock, the waker publishes the work and then checks for sleepers. Both do
+// a read-modify-write on sleepers, which orders them: either the waker sees
+// the sleeper, or the sleeper sees the work
+typedef struct sleep_point {
+    unsigned int sleepers;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} sleep_point;
+
+static int sleep_point_init(sleep_point *point) {
+    point->sleepers = 0;
+    if (pthread_mutex_init(&point->lock, NULL) != 0) {
+        return 0;
+    }
+    if (pthread_cond_init(&point->wake, NULL) != 0) {
+        pthread_mutex_destroy(&point->lock);
+        return 0;
+    }
+    return 1;
+}
+
+static void sleep_point_destroy(sleep_point *point) {
+    pthread_cond_destroy(&point->wake);
+    pthread_mutex_destroy(&point->lock);
+}
+
+static void sleep_point_enter(sleep_point *point) {
+    pthread_mutex_lock(&point->lock);
+    __atomic_add_fetch(&point->sleepers, 1, __ATOMIC_SEQ_CST);
+}
+
+static void sleep_point_leave(sleep_point *point) {
+    __atomic_sub_fetch(&point->sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&point->lock);
+}
+
+static void sleep_point_wake(sleep_point *point) {
+    if (__atomic_fetch_add(&point->sleepers, 0, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&point->lock);
+        pthread_cond_signal(&point->wake);
+        pthread_mutex_unlock(&point->lock);
+    }
+}
+
+
+struct portable_8439_completion_queue {
+    ring completed;
+    size_t capacity;
+    size_t in_flight;
+    // workers between posting a job and waking the waiters
+    unsigned int posting;
+    sleep_point waiters;
+};
+
+typedef struct worker {
+    deque jobs;
+    struct portable_8439_offload *offload;
+    unsigned int index;
+    pthread_t thread;
+} worker;
+
+struct portable_8439_offload {
+    ring submitted;
+    worker *workers;
+    unsigned int worker_count;
+    int stopping;
+    sleep_point idle;
+};
+
+static void batch_join(portable_8439_job *job);
+
+static void run(portable_8439_job *job) {
+    if (job->operation == OPERATION_JOIN_BATCH) {
+        // not posted anywhere, the batch keeps its own count
+        batch_join(job);
+        return;
+    }
+    if (job->operation == PORTABLE_8439_OFFLOAD_SEAL) {
+        job->result = portable_chacha20_poly1305_encrypt_key(job->output, job->key, job->nonce,
+            job->ad, job->ad_size, job->input, job->input_size);
+    }
+    else {
+        job->result = portable_chacha20_poly1305_decrypt_key(job->output, job->key, job->nonce,
+            job->ad, job->ad_size, job->input, job->input_size);
+    }
+    portable_8439_completion_queue *queue = job->queue;
+    __atomic_add_fetch(&queue->posting, 1, __ATOMIC_ACQUIRE);
+    // the in flight limit guarantees room, this never spins
+    while (!ring_push(&queue->completed, job)) {
+        sched_yield();
+    }
+    sleep_point_wake(&queue->waiters);
+    __atomic_sub_fetch(&queue->posting, 1, __ATOMIC_RELEASE);
+}
+
+// take a batch of small jobs (or a single large one) from the shared ring,
+// the first is returned, the rest goes into the own deque for others to steal
+static portable_8439_job *take_batch(worker *self) {
+    portable_8439_job *first = ring_pop(&self->offload->submitted);
+    if (first == NULL || first->input_size > SMALL_JOB) {
+        return first;
+    }
+    size_t bytes = first->input_size;
+    for (unsigned int taken = 1; taken < BATCH_JOBS && bytes < BATCH_BYTES; taken++) {
+        portable_8439_job *next = ring_pop(&self->offload->submitted);
+        if (next == NULL) {
+            break;
+        }
+        // once pushed it can be stolen, finished & reused, so look at it first
+        size_t size = next->input_size;
+        deque_push(&self->jobs, next);
+        if (size > SMALL_JOB) {
+            break;
+        }
+        bytes += size;
+    }
+    return first;
+}
+
+static portable_8439_job *steal(worker *self) {
+    portable_8439_offload *offload = self->offload;
+    for (unsigned int i = 1; i < offload->worker_count; i++) {
+        worker *victim = &offload->workers[(self->index + i) % offload->worker_count];
+        portable_8439_job *job = deque_steal(&victim->jobs);
+        if (job != NULL) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
+// returns 0 when the pool is stopping and there is nothing left to do
+static int sleep_until_work(portable_8439_offload *offload) {
+    sleep_point_enter(&offload->idle);
+    while (ring_empty(&offload->submitted) && !offload->stopping) {
+        pthread_cond_wait(&offload->idle.wake, &offload->idle.lock);
+    }
+    int keep_going = !offload->stopping || !ring_empty(&offload->submitted);
+    sleep_point_leave(&offload->idle);
+    return keep_going;
+}
+
+static void *worker_main(void *arg) {
+    worker *self = arg;
+    unsigned int idle = 0;
+    for (;;) {
+        portable_8439_job *job = deque_pop(&self->jobs);
+        if (job == NULL) {
+            job = take_batch(self);
+        }
+        if (job == NULL) {
+            job = steal(self);
+        }
+        if (job != NULL) {
+            run(job);
+            idle = 0;
+        }
+        else if (++idle < SPINS_BEFORE_SLEEP) {
+            sched_yield();
+        }
+        else {
+            idle = 0;
+            if (!sleep_until_work(self->offload)) {
+                return NULL;
+            }
+        }
+    }
+}
+
+static void stop_workers(portable_8439_offload *offload, unsigned int started) {
+    pthread_mutex_lock(&offload->idle.lock);
+    offload->stopping = 1;
+    pthread_cond_broadcast(&offload->idle.wake);
+    pthread_mutex_unlock(&offload->idle.lock);
+    for (unsigned int i = 0; i < started; i++) {
+        pthread_join(offload->workers[i].thread, NULL);
+    }
+}
+
+portable_8439_offload *portable_8439_offload_create(unsigned int workers, size_t queue_size) {
+    if (workers == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (unsigned int)cpus : 1;
+    }
+    portable_8439_offload *offload = calloc(1, sizeof(portable_8439_offload));
+    if (offload == NULL) {
+        return NULL;
+    }
+    offload->workers = calloc(workers, sizeof(worker));
+    if (offload->workers == NULL || !ring_init(&offload->submitted, queue_size)) {
+        free(offload->workers);
+        free(offload);
+        return NULL;
+    }
+    if (!sleep_point_init(&offload->idle)) {
+        free(offload->submitted.cells);
+        free(offload->workers);
+        free(offload);
+        return NULL;
+    }
+    offload->worker_count = workers;
+    for (unsigned int i = 0; i < workers; i++) {
+        offload->workers[i].offload = offload;
+        offload->workers[i].index = i;
+        if (pthread_create(&offload->workers[i].thread, NULL, worker_main, &offload->workers[i]) != 0) {
+            stop_workers(offload, i);
+            sleep_point_destroy(&offload->idle);
+            free(offload->submitted.cells);
+            free(offload->workers);
+            free(offload);
+            return NULL;
+        }
+    }
+    return offload;
+}
+
+void portable_8439_offload_destroy(portable_8439_offload *offload) {
+    stop_workers(offload, offload->worker_count);
+    sleep_point_destroy(&offload->idle);
+    free(offload->submitted.cells);
+    free(offload->workers);
+    free(offload);
+}
+
+portable_8439_completion_queue *portable_8439_completion_queue_create(size_t capacity) {
+    portable_8439_completion_queue *queue = calloc(1, sizeof(portable_8439_completion_queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    if (!ring_init(&queue->completed, capacity)) {
+        free(queue);
+        return NULL;
+    }
+    if (!sleep_point_init(&queue->waiters)) {
+        free(queue->completed.cells);
+        free(queue);
+        return NULL;
+    }
+    queue->capacity = capacity;
+    return queue;
+}
+
+void portable_8439_completion_queue_destroy(portable_8439_completion_queue *queue) {
+    // the worker that posted the last job might still be waking us up
+    while (__atomic_load_n(&queue->posting, __ATOMIC_ACQUIRE) > 0) {
+        sched_yield();
+    }
+    sleep_point_destroy(&queue->waiters);
+    free(queue->completed.cells);
+    free(queue);
+}
+
+int portable_8439_offload_submit(
+    portable_8439_offload *offload,
+    portable_8439_job *job,
+    portable_8439_completion_queue *queue
+) {
+    if (__atomic_add_fetch(&queue->in_flight, 1, __ATOMIC_RELAXED) > queue->capacity) {
+        __atomic_sub_fetch(&queue->in_flight, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    job->queue = queue;
+    if (!ring_push(&offload->submitted, job)) {
+        __atomic_sub_fetch(&queue->in_flight, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    sleep_point_wake(&offload->idle);
+    return 1;
+}
+
+size_t portable_8439_completion_queue_poll(
+    portable_8439_completion_queue *queue,
+    portable_8439_job **completed,
+    size_t max
+) {
+    size_t count = 0;
+    while (count < max) {
+        portable_8439_job *job = ring_pop(&queue->completed);
+        if (job == NULL) {
+            break;
+        }
+        completed[count++] = job;
+    }
+    if (count > 0) {
+        __atomic_sub_fetch(&queue->in_flight, count, __ATOMIC_RELAXED);
+    }
+    return count;
+}
+
+size_t portable_8439_completion_queue_wait(
+    portable_8439_completion_queue *queue,
+    portable_8439_job **completed,
+    size_t max
+) {
+    for (unsigned int spins = 0; spins < SPINS_BEFORE_SLEEP; spins++) {
+        size_t count = portable_8439_completion_queue_poll(queue, completed, max);
+        if (count > 0) {
+            return count;
+        }
+        sched_yield();
+    }
+    for (;;) {
+        sleep_point_enter(&queue->waiters);
+        while (ring_empty(&queue->completed)) {
+            pthread_cond_wait(&queue->waiters.wake, &queue->waiters.lock);
+        }
+        sleep_point_leave(&queue->waiters);
+        // another waiter on the same queue could have been first
+        size_t count = portable_8439_completion_queue_poll(queue, completed, max);
+        if (count > 0) {
+            return count;
+        }
+    }
+}
+
+
+// Batch open. The records are cut into units (a whole record, or the tag
+// check or a decrypt part of a split record), and every participant (the
+// calling thread and the workers that join) starts with an equal range of
+// them. A participant takes units from the front of its own range, and when
+// that's empty steals the back half of the range of another. The batch is
+// reference counted, because a worker can join after all the work is done.
+#define UNIT_WHOLE ((size_t)-1)
+#define UNIT_VERIFY ((size_t)-2)
+#define NO_UNIT ((size_t)-1)
+
+typedef struct batch_unit {
+    size_t record;
+    // UNIT_WHOLE, UNIT_VERIFY or the offset of a decrypt part
+    size_t offset;
+} batch_unit;
+
+// the unclaimed units of a participant, begin in the low and end in the
+// high 32 bits, so the owner and thieves can update it with a single CAS
+#define RANGE(begin, end) (((uint64_t)(end) << 32) | (uint64_t)(begin))
+#define RANGE_BEGIN(range) ((uint32_t)(range))
+#define RANGE_END(range) ((uint32_t)((range) >> 32))
+
+typedef struct batch_participant {
+    // the job has to be first: the pool runs it, and we cast it back
+    portable_8439_job job;
+    struct open_batch *batch;
+    uint64_t range;
+    char pad[CACHE_LINE];
+} batch_participant;
+
+typedef struct open_batch {
+    const portable_8439_record *records;
+    uint8_t *verdicts;
+    batch_unit *units;
+    size_t units_left;
+    size_t opened;
+    // the caller sleeps here until the last unit is done
+    sleep_point done;
+    unsigned int references;
+    unsigned int participant_count;
+    batch_participant participants[];
+} open_batch;
+
+static size_t claim_own(batch_participant *self) {
+    uint64_t range = __atomic_load_n(&self->range, __ATOMIC_ACQUIRE);
+    while (RANGE_BEGIN(range) < RANGE_END(range)) {
+        if (__atomic_compare_exchange_n(&self->range, &range, RANGE(RANGE_BEGIN(range) + 1, RANGE_END(range)), 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return RANGE_BEGIN(range);
+        }
+    }
+    return NO_UNIT;
+}
+
+// take the back half of the range of another participant: the first unit
+// of it is returned, the rest becomes our own range
+static size_t steal_range(open_batch *batch, unsigned int index) {
+    batch_participant *self = &batch->participants[index];
+    for (unsigned int i = 1; i < batch->participant_count; i++) {
+        batch_participant *victim = &batch->participants[(index + i) % batch->participant_count];
+        uint64_t range = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+        while (RANGE_BEGIN(range) < RANGE_END(range)) {
+            uint32_t middle = RANGE_BEGIN(range) + (RANGE_END(range) - RANGE_BEGIN(range)) / 2;
+            if (__atomic_compare_exchange_n(&victim->range, &range, RANGE(RANGE_BEGIN(range), middle), 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                __atomic_store_n(&self->range, RANGE(middle + 1, RANGE_END(range)), __ATOMIC_RELEASE);
+                return middle;
+            }
+        }
+    }
+    return NO_UNIT;
+}
+
+static void mark_opened(open_batch *batch, size_t record) {
+    __atomic_fetch_or(&batch->verdicts[record / 8], (uint8_t)(1 << (record % 8)), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&batch->opened, 1, __ATOMIC_RELAXED);
+}
+
+static void run_unit(open_batch *batch, const batch_unit *unit) {
+    const portable_8439_record *record = &batch->records[unit->record];
+    size_t size = record->cipher_text_size - RFC_8439_TAG_SIZE;
+    if (unit->offset == UNIT_WHOLE) {
+        if (portable_chacha20_poly1305_decrypt_key(record->plain_text, record->key, record->nonce, 
+                record->ad, record->ad_size, record->cipher_text, record->cipher_text_size) == size) {
+            mark_opened(batch, unit->record);
+        }
+    }
+    else if (unit->offset == UNIT_VERIFY) {
+        if (portable_chacha20_poly1305_verify_key(record->key, record->nonce, record->ad, record->ad_size,
+                record->cipher_text, record->cipher_text_size)) {
+            mark_opened(batch, unit->record);
+        }
+    }
+    else {
+        size_t part = size - unit->offset < SPLIT_SIZE ? size - unit->offset : SPLIT_SIZE;
+        portable_chacha20_poly1305_xor_key(record->plain_text + unit->offset, record->key, record->nonce,
+            unit->offset, record->cipher_text + unit->offset, part);
+    }
+}
+
+static void batch_work(open_batch *batch, unsigned int index) {
+    for (;;) {
+        size_t unit = claim_own(&batch->participants[index]);
+        if (unit == NO_UNIT) {
+            unit = steal_range(batch, index);
+        }
+        if (unit == NO_UNIT) {
+            // every unit is claimed, the ones in flight are finished by their claimers
+            return;
+        }
+        run_unit(batch, &batch->units[unit]);
+        if (__atomic_sub_fetch(&batch->units_left, 1, __ATOMIC_SEQ_CST) == 0) {
+            sleep_point_wake(&batch->done);
+        }
+    }
+}
+
+static void batch_release(open_batch *batch) {
+    if (__atomic_sub_fetch(&batch->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        sleep_point_destroy(&batch->done);
+        free(batch);
+    }
+}
+
+static void batch_join(portable_8439_job *job) {
+    batch_participant *participant = (batch_participant *)job;
+    open_batch *batch = participant->batch;
+    batch_work(batch, (unsigned int)(participant - batch->participants));
+    batch_release(batch);
+}
+
+static int splittable(const portable_8439_record *record) {
+    return record->cipher_text_size > SPLIT_SIZE + RFC_8439_TAG_SIZE;
+}
+
+// records that can't be opened (too short, or overlapping buffers) get no units
+static size_t record_units(const portable_8439_record *record) {
+    if (record->cipher_text_size < RFC_8439_TAG_SIZE) {
+        return 0;
+    }
+    size_t size = record->cipher_text_size - RFC_8439_TAG_SIZE;
+    if (!splittable(record)) {
+        return 1;
+    }
+    uintptr_t plain = (uintptr_t)record->plain_text, cipher = (uintptr_t)record->cipher_text;
+    if (plain < cipher + record->cipher_text_size && cipher < plain + size) {
+        return 0;
+    }
+    return 1 + (size + SPLIT_SIZE - 1) / SPLIT_SIZE;
+}
+
+size_t portable_8439_offload_open_batch(
+    portable_8439_offload *offload,
+    const portable_8439_record *records,
+    size_t count,
+    uint8_t *verdicts
+) {
+    if (count > 0) {
+        memset(verdicts, 0, (count + 7) / 8);
+    }
+    size_t unit_count = 0, bytes = 0;
+    for (size_t r = 0; r < count; r++) {
+        unit_count += record_units(&records[r]);
+        bytes += records[r].cipher_text_size;
+    }
+    if (unit_count > UINT32_MAX - 1) {
+        return (size_t)-1;
+    }
+    unsigned int participants = offload == NULL || bytes < INLINE_BATCH_BYTES ? 1 : offload->worker_count + 1;
+    open_batch *batch = malloc(sizeof(open_batch) + participants * sizeof(batch_participant) + unit_count * sizeof(batch_unit));
+    if (batch == NULL) {
+        return (size_t)-1;
+    }
+    if (!sleep_point_init(&batch->done)) {
+        free(batch);
+        return (size_t)-1;
+    }
+    batch->records = records;
+    batch->verdicts = verdicts;
+    batch->units = (batch_unit *)(batch->participants + participants);
+    batch->units_left = unit_count;
+    batch->opened = 0;
+    batch->references = 1;
+    batch->participant_count = participants;
+
+    size_t unit = 0;
+    for (size_t r = 0; r < count; r++) {
+        size_t units = record_units(&records[r]);
+        if (units == 1) {
+            batch->units[unit++] = (batch_unit){ r, UNIT_WHOLE };
+        }
+        else if (units > 1) {
+            batch->units[unit++] = (batch_unit){ r, UNIT_VERIFY };
+            for (size_t offset = 0; offset < records[r].cipher_text_size - RFC_8439_TAG_SIZE; offset += SPLIT_SIZE) {
+                batch->units[unit++] = (batch_unit){ r, offset };
+            }
+        }
+    }
+    for (unsigned int p = 0; p < participants; p++) {
+        batch->participants[p].batch = batch;
+        batch->participants[p].range = RANGE((uint64_t)unit_count * p / participants, (uint64_t)unit_count * (p + 1) / participants);
+    }
+
+    // the workers join when they get to it, if they are busy the others steal their share
+    for (unsigned int p = 1; p < participants; p++) {
+        batch->participants[p].job = (portable_8439_job){ .operation = OPERATION_JOIN_BATCH };
+        __atomic_add_fetch(&batch->references, 1, __ATOMIC_RELAXED);
+        if (!ring_push(&offload->submitted, &batch->participants[p].job)) {
+            __atomic_sub_fetch(&batch->references, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        sleep_point_wake(&offload->idle);
+    }
+    batch_work(batch, 0);
+    // the units in flight are close to done, give them a few rounds before sleeping
+    for (unsigned int spins = 0; spins < SPINS_BEFORE_SLEEP && __atomic_load_n(&batch->units_left, __ATOMIC_ACQUIRE) > 0; spins++) {
+        sched_yield();
+    }
+    if (__atomic_load_n(&batch->units_left, __ATOMIC_ACQUIRE) > 0) {
+        sleep_point_enter(&batch->done);
+        while (__atomic_load_n(&batch->units_left, __ATOMIC_SEQ_CST) > 0) {
+            pthread_cond_wait(&batch->done.wake, &batch->done.lock);
+        }
+        sleep_point_leave(&batch->done);
+    }
+
+    // a split record that failed has been decrypted anyway, wipe it
+    for (size_t r = 0; r < count; r++) {
+        if (!(verdicts[r / 8] & (1 << (r % 8))) && record_units(&records[r]) > 1) {
+            memset(records[r].plain_text, 0, records[r].cipher_text_size - RFC_8439_TAG_SIZE);
+        }
+    }
+    size_t opened = __atomic_load_n(&batch->opened, __ATOMIC_RELAXED);
+    batch_release(batch);
+    return opened;
+}
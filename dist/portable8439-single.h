@@ -0,0 +1,5005 @@
+// portable8439 dev-version, header-only
+// Source: https://github.com/DavyLandman/portable8439
+// Licensed under CC0-1.0
+// Contains poly1305-donna e6ad6e091d30d7f4ec2d4f978be1fcfcbce72781 (Public Domain)
+//
+// Define PORTABLE_8439_IMPLEMENTATION before including this file (in C, not
+// C++) to get the implementation as static inline functions in this
+// translation unit, every one that does has its own copy (including the
+// selected poly1305 backend and the stats). Without it you get the
+// declarations, and link against the library.
+
+#ifndef __PORTABLE_8439_SINGLE_H
+#define __PORTABLE_8439_SINGLE_H
+
+#ifndef PORTABLE_8439_API
+#   ifdef PORTABLE_8439_IMPLEMENTATION
+#       define PORTABLE_8439_API static inline PORTABLE_8439_DECL
+#   else
+#       define PORTABLE_8439_API PORTABLE_8439_DECL
+#   endif
+#endif
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// provide your own decl specificier like -DPORTABLE_8439_DECL=ICACHE_RAM_ATTR
+#ifndef PORTABLE_8439_DECL
+#define PORTABLE_8439_DECL
+#endif
+
+/*
+ This library implements RFC 8439 a.k.a. ChaCha20-Poly1305 AEAD
+
+ You can use this library to avoid attackers mutating or reusing your
+ encrypted messages. This does assume you never reuse a nonce+key pair and, 
+ if possible, carefully pick your associated data.
+*/
+
+// Make sure we are either nested in C++ or running in a C99+ compiler
+#if !defined(__cplusplus) && \
+    !defined(_MSC_VER) && \
+    (!defined(__STDC_VERSION__) || __STDC_VERSION__ < 199901L)
+#    error "C99 or newer required"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if CHAR_BIT > 8
+#    error "Systems without native octals not suppoted"
+#endif
+
+#if defined(_MSC_VER) || defined(__cplusplus) 
+// add restrict support is possible
+#    if (defined(_MSC_VER) && _MSC_VER >= 1900) \
+            || defined(__clang__) || defined(__GNUC__)
+#       define restrict __restrict
+#    else
+#       define restrict
+#    endif
+#endif
+
+#ifndef PORTABLE_8439_DECL
+#define PORTABLE_8439_DECL
+#endif
+
+#define RFC_8439_TAG_SIZE (16)
+#define RFC_8439_KEY_SIZE (32)
+#define RFC_8439_NONCE_SIZE (12)
+
+/*
+    Encrypt/Seal plain text bytes into a cipher text that can only be 
+    decrypted by knowing the key, nonce and associated data.
+
+    input:
+        - key: RFC_8439_KEY_SIZE bytes that all parties have agreed 
+            upon beforehand
+        - nonce: RFC_8439_NONCE_SIZE bytes that should never be repeated 
+            for the same key. A counter or a pseudo-random value are fine.
+        - ad: associated data to include with calculating the tag of the 
+            cipher text. Can be null for empty.
+        - plain_text: data to be encrypted, pointer + size should not overlap 
+            with cipher_text pointer
+    
+    output:
+        - cipher_text: encrypted plain_text with a tag appended. Make sure to 
+            allocate at least plain_text_size + RFC_8439_TAG_SIZE
+    
+    returns:
+        - size of bytes written to cipher_text, can be -1 if overlapping 
+            pointers are passed for plain_text and cipher_text
+*/
+PORTABLE_8439_API size_t portable_chacha20_poly1305_encrypt(
+    uint8_t *restrict cipher_text, 
+    const uint8_t key[RFC_8439_KEY_SIZE],
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad, 
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+);
+
+/*
+    Decrypt/unseal cipher text given the right key, nonce, and additional data. 
+
+    input:
+        - key: RFC_8439_KEY_SIZE bytes that all parties have agreed 
+            upon beforehand
+        - nonce: RFC_8439_NONCE_SIZE bytes that should never be repeated for 
+            the same key. A counter or a pseudo-random value are fine.
+        - ad: associated data to include with calculating the tag of the 
+            cipher text. Can be null for empty.
+        - cipher_text: encrypted message. 
+
+    output:
+        - plain_text: data to be encrypted, pointer + size should not overlap 
+            with cipher_text pointer, leave at least enough room for  
+            cipher_text_size - RFC_8439_TAG_SIZE
+    
+    returns:
+        - size of bytes written to plain_text, -1 signals either:
+            - incorrect key/nonce/ad
+            - corrupted cipher_text
+            - overlapping pointers are passed for plain_text and cipher_text
+*/
+PORTABLE_8439_API size_t portable_chacha20_poly1305_decrypt(
+    uint8_t *restrict plain_text,
+    const uint8_t key[RFC_8439_KEY_SIZE],
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+);
+
+/*
+    Key context: loads the key once, for when you seal or open many messages
+    with the same key. Same semantics as the functions above, wipe the 
+    context when you are done with the key.
+*/
+typedef struct portable_8439_key {
+    uint32_t opaque[RFC_8439_KEY_SIZE / sizeof(uint32_t)];
+} portable_8439_key;
+
+PORTABLE_8439_API void portable_chacha20_poly1305_key_init(
+    portable_8439_key *ctx,
+    const uint8_t key[RFC_8439_KEY_SIZE]
+);
+
+PORTABLE_8439_API void portable_chacha20_poly1305_key_wipe(portable_8439_key *ctx);
+
+PORTABLE_8439_API size_t portable_chacha20_poly1305_encrypt_key(
+    uint8_t *restrict cipher_text, 
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad, 
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+);
+
+PORTABLE_8439_API size_t portable_chacha20_poly1305_decrypt_key(
+    uint8_t *restrict plain_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+);
+
+/*
+    XChaCha20-Poly1305 (draft-irtf-cfrg-xchacha): the same AEAD with a 
+    XCHACHA20_POLY1305_NONCE_SIZE (24 bytes) nonce. The first 16 bytes of 
+    the nonce derive a subkey (HChaCha20), the last 8 are the nonce of the 
+    message under that subkey. A nonce this large can be picked at random 
+    for every message, without a shared counter between the writers. The 
+    subkey costs one extra block function per message.
+    Key, tag, arguments and results are the same as the functions above.
+*/
+#define XCHACHA20_POLY1305_NONCE_SIZE (24)
+
+PORTABLE_8439_API size_t portable_xchacha20_poly1305_encrypt(
+    uint8_t *restrict cipher_text, 
+    const uint8_t key[RFC_8439_KEY_SIZE],
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad, 
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+);
+
+PORTABLE_8439_API size_t portable_xchacha20_poly1305_decrypt(
+    uint8_t *restrict plain_text,
+    const uint8_t key[RFC_8439_KEY_SIZE],
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+);
+
+PORTABLE_8439_API size_t portable_xchacha20_poly1305_encrypt_key(
+    uint8_t *restrict cipher_text, 
+    const portable_8439_key *key,
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad, 
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+);
+
+PORTABLE_8439_API size_t portable_xchacha20_poly1305_decrypt_key(
+    uint8_t *restrict plain_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+);
+
+/*
+    Reduced round variants: ChaCha12-Poly1305 and ChaCha8-Poly1305, the same
+    construction with 12 or 8 instead of 20 ChaCha rounds, for roughly 1.6x
+    and 2.3x the throughput of the cipher. They are NOT RFC 8439 and don't
+    interoperate with it. Fewer rounds means a smaller security margin, only
+    use them for data that isn't kept long (caches and the like).
+
+    For every X(name, rounds) in PORTABLE_8439_REDUCED_ROUNDS there is a:
+        portable_<name>_poly1305_encrypt
+        portable_<name>_poly1305_decrypt
+        portable_<name>_poly1305_encrypt_key
+        portable_<name>_poly1305_decrypt_key
+    with the same arguments & semantics as the chacha20 functions.
+*/
+#define PORTABLE_8439_REDUCED_ROUNDS(X) X(chacha12, 12) X(chacha8, 8)
+
+#define PORTABLE_8439_REDUCED_DECLARE(name, rounds) \
+    PORTABLE_8439_API size_t portable_##name##_poly1305_encrypt( \
+        uint8_t *restrict cipher_text, \
+        const uint8_t key[RFC_8439_KEY_SIZE], \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        size_t ad_size, \
+        const uint8_t *restrict plain_text, \
+        size_t plain_text_size \
+    ); \
+    PORTABLE_8439_API size_t portable_##name##_poly1305_decrypt( \
+        uint8_t *restrict plain_text, \
+        const uint8_t key[RFC_8439_KEY_SIZE], \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        size_t ad_size, \
+        const uint8_t *restrict cipher_text, \
+        size_t cipher_text_size \
+    ); \
+    PORTABLE_8439_API size_t portable_##name##_poly1305_encrypt_key( \
+        uint8_t *restrict cipher_text, \
+        const portable_8439_key *key, \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        size_t ad_size, \
+        const uint8_t *restrict plain_text, \
+        size_t plain_text_size \
+    ); \
+    PORTABLE_8439_API size_t portable_##name##_poly1305_decrypt_key( \
+        uint8_t *restrict plain_text, \
+        const portable_8439_key *key, \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        size_t ad_size, \
+        const uint8_t *restrict cipher_text, \
+        size_t cipher_text_size \
+    );
+
+PORTABLE_8439_REDUCED_ROUNDS(PORTABLE_8439_REDUCED_DECLARE)
+
+/*
+    QUIC header protection with ChaCha20 (RFC 9001 section 5.4.4): the 
+    mask for a packet is computed from the header protection key and a 
+    sample of its cipher text, the first PORTABLE_QUIC_HP_MASK_SIZE bytes of
+    it protect the header.
+
+    - hp_mask: the mask of one sample
+    - hp_mask_batch: count masks (written after each other to masks), for
+        the samples of many packets, several packets per SIMD register
+*/
+#define PORTABLE_QUIC_HP_SAMPLE_SIZE (16)
+#define PORTABLE_QUIC_HP_MASK_SIZE (5)
+
+PORTABLE_8439_API void portable_chacha20_quic_hp_mask(
+    uint8_t mask[PORTABLE_QUIC_HP_MASK_SIZE],
+    const portable_8439_key *hp_key,
+    const uint8_t sample[PORTABLE_QUIC_HP_SAMPLE_SIZE]
+);
+
+PORTABLE_8439_API void portable_chacha20_quic_hp_mask_batch(
+    uint8_t *masks,
+    const portable_8439_key *hp_key,
+    const uint8_t *const *samples,
+    size_t count
+);
+
+/*
+    TLS 1.3 record protection (RFC 8446 section 5.2) for
+    TLS_CHACHA20_POLY1305_SHA256, a whole flight of records per call. The 
+    nonce of a record is the iv xor its sequence number, the AD is its 5 
+    byte header. The records get consecutive sequence numbers, the first 
+    one gets sequence.
+
+    - tls_seal: input is the TLSInnerPlaintext (content, content type & 
+        padding), output gets the complete record: header, cipher text and
+        tag, so input_size + PORTABLE_TLS_RECORD_OVERHEAD bytes
+    - tls_open: input is a complete record, output gets the 
+        TLSInnerPlaintext, so input_size - PORTABLE_TLS_RECORD_OVERHEAD bytes
+
+    result is the size written, or -1 for a record that is overlapping, too 
+    large, malformed, or (for open) corrupted. Both return the number of 
+    records that succeeded, in TLS a single failure ends the connection.
+    The poly keys of the records are derived several per SIMD register.
+*/
+#define PORTABLE_TLS_HEADER_SIZE (5)
+#define PORTABLE_TLS_RECORD_OVERHEAD (PORTABLE_TLS_HEADER_SIZE + RFC_8439_TAG_SIZE)
+#define PORTABLE_TLS_MAX_CIPHER_TEXT ((1 << 14) + 256)
+
+typedef struct portable_8439_tls_record {
+    const uint8_t *input;
+    size_t input_size;
+    uint8_t *output;
+    size_t result;
+} portable_8439_tls_record;
+
+PORTABLE_8439_API size_t portable_chacha20_poly1305_tls_seal(
+    portable_8439_tls_record *records,
+    size_t count,
+    const portable_8439_key *key,
+    const uint8_t iv[RFC_8439_NONCE_SIZE],
+    uint64_t sequence
+);
+
+PORTABLE_8439_API size_t portable_chacha20_poly1305_tls_open(
+    portable_8439_tls_record *records,
+    size_t count,
+    const portable_8439_key *key,
+    const uint8_t iv[RFC_8439_NONCE_SIZE],
+    uint64_t sequence
+);
+
+/*
+    Incremental seal/open, for messages that don't fit in memory or arrive 
+    in pieces. The result is the same as the one-shot functions: the cipher
+    text is the concatenation of all the update outputs, and the tag is what
+    the one-shot functions append to it.
+
+    - stream_init: start a message, the AD has to be known upfront
+    - seal_update/open_update: en/decrypt the next size bytes, any size is 
+        fine, the chunks don't have to line up with anything. Output & input
+        should not overlap.
+    - seal_final: write the tag for everything passed to seal_update
+    - open_final: returns 1 if the tag matches everything passed to 
+        open_update, 0 otherwise
+    - stream_wipe: drop a stream without finishing it
+    Both final functions wipe the stream.
+
+    Warning: open_update hands out plain text before the tag is checked, so 
+    until open_final returned 1 treat everything it wrote as unauthenticated:
+    don't act on it and throw it away when the tag doesn't match.
+*/
+typedef struct portable_8439_stream {
+    uint64_t opaque[40];
+} portable_8439_stream;
+
+PORTABLE_8439_API void portable_chacha20_poly1305_stream_init(
+    portable_8439_stream *stream,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+);
+
+PORTABLE_8439_API void portable_chacha20_poly1305_seal_update(
+    portable_8439_stream *stream,
+    uint8_t *restrict cipher_text,
+    const uint8_t *restrict plain_text,
+    size_t size
+);
+
+PORTABLE_8439_API void portable_chacha20_poly1305_seal_final(
+    portable_8439_stream *stream,
+    uint8_t tag[RFC_8439_TAG_SIZE]
+);
+
+PORTABLE_8439_API void portable_chacha20_poly1305_open_update(
+    portable_8439_stream *stream,
+    uint8_t *restrict plain_text,
+    const uint8_t *restrict cipher_text,
+    size_t size
+);
+
+PORTABLE_8439_API int portable_chacha20_poly1305_open_final(
+    portable_8439_stream *stream,
+    const uint8_t tag[RFC_8439_TAG_SIZE]
+);
+
+PORTABLE_8439_API void portable_chacha20_poly1305_stream_wipe(portable_8439_stream *stream);
+
+/*
+    Seal/open a message in place in a ring buffer (capacity bytes at ring), 
+    without linearizing it first: the message starts at offset and wraps 
+    around from the end of the ring to its start when it has to. The tag 
+    follows the message in the ring, and wraps just the same.
+
+    - seal_ring: encrypts the plain_text_size bytes at offset and writes the
+        tag after them. Returns plain_text_size + RFC_8439_TAG_SIZE, or -1 if
+        that doesn't fit in the ring (or offset is outside of it).
+    - open_ring: checks the tag of the cipher_text_size bytes (tag included) 
+        at offset, and only if it matches decrypts them in place. Returns 
+        the size of the plain text, -1 when the tag doesn't match (the ring 
+        is left untouched) or the message doesn't fit.
+*/
+PORTABLE_8439_API size_t portable_chacha20_poly1305_seal_ring(
+    uint8_t *ring,
+    size_t capacity,
+    size_t offset,
+    size_t plain_text_size,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+);
+
+PORTABLE_8439_API size_t portable_chacha20_poly1305_open_ring(
+    uint8_t *ring,
+    size_t capacity,
+    size_t offset,
+    size_t cipher_text_size,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+);
+
+/*
+    Seal/open a message in place in one contiguous buffer, the cipher text 
+    overwrites the plain text (and the other way around). encrypt/decrypt 
+    reject overlapping buffers, use these instead.
+
+    - seal_in_place: encrypts the plain_text_size bytes at message and writes
+        the tag right after them, so message needs room for 
+        plain_text_size + RFC_8439_TAG_SIZE bytes. Returns that size.
+    - open_in_place: checks the tag at the end of the cipher_text_size bytes
+        at message, and only if it matches decrypts them in place. Returns 
+        the size of the plain text, or -1 when the tag doesn't match (the 
+        message is left untouched) or cipher_text_size is smaller than a tag.
+*/
+PORTABLE_8439_API size_t portable_chacha20_poly1305_seal_in_place(
+    uint8_t *message,
+    size_t plain_text_size,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+);
+
+PORTABLE_8439_API size_t portable_chacha20_poly1305_open_in_place(
+    uint8_t *message,
+    size_t cipher_text_size,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+);
+
+/*
+    Building blocks to open a large message in parallel (see the batch open
+    of portable8439-offload.h), with a key context:
+    - verify_key: check the tag at the end of cipher_text without decrypting,
+        returns 1 if it matches (0 also for a cipher_text shorter than a tag)
+    - xor_key: en/decrypt size bytes of a message body that start at byte 
+        offset of it, the tag is not involved. Any offset works, a multiple
+        of 64 (a chacha20 block) saves computing a partial block.
+
+    Only write the xor_key output to where it can't be used before the 
+    verify_key of the message returned 1.
+*/
+PORTABLE_8439_API int portable_chacha20_poly1305_verify_key(
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size,
+    const uint8_t *cipher_text,
+    size_t cipher_text_size
+);
+
+PORTABLE_8439_API void portable_chacha20_poly1305_xor_key(
+    uint8_t *restrict output,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    uint64_t offset,
+    const uint8_t *restrict input,
+    size_t size
+);
+
+/*
+    Bulk mode for huge buffers that won't be read again soon: the same as 
+    encrypt_key/decrypt_key, but above PORTABLE_8439_BULK_THRESHOLD bytes 
+    (1MiB by default, -D it to change) the output is written with 
+    non-temporal stores, so it doesn't push the working set of the rest of 
+    the program out of the caches. The mac is calculated on every chunk before
+    it is streamed out, so nothing is read back from memory. Without 
+    non-temporal stores (only SSE2 for now) they are plain encrypt/decrypt.
+*/
+PORTABLE_8439_API size_t portable_chacha20_poly1305_encrypt_key_bulk(
+    uint8_t *restrict cipher_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+);
+
+PORTABLE_8439_API size_t portable_chacha20_poly1305_decrypt_key_bulk(
+    uint8_t *restrict plain_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+);
+
+/*
+    Fixed size variants of the key context functions, for records of which 
+    the plain text and ad size are known at compile time. With the sizes 
+    as constants the compiler can drop the padding branches, fold the length
+    block of the mac, and unroll the tail of the key stream (most effective
+    in the amalgamated portable8439.c, where everything can be inlined).
+
+    For every X(size, ad_size) in PORTABLE_8439_FIXED_SIZES there is a:
+        portable_chacha20_poly1305_encrypt_<size>_<ad_size>
+        portable_chacha20_poly1305_decrypt_<size>_<ad_size>
+    with the same semantics as the _key variants, minus the size arguments.
+    Size is the plain text size, so the cipher text is size + 
+    RFC_8439_TAG_SIZE bytes. Define PORTABLE_8439_FIXED_SIZES yourself 
+    (for both the library and your code) to get other sizes, for example
+    -D'PORTABLE_8439_FIXED_SIZES(X)=X(64, 13) X(1024, 13)', or none at all
+    with -D'PORTABLE_8439_FIXED_SIZES(X)='.
+*/
+#ifndef PORTABLE_8439_FIXED_SIZES
+#define PORTABLE_8439_FIXED_SIZES(X) X(32, 0) X(48, 0) X(128, 0)
+#endif
+
+#define PORTABLE_8439_FIXED_DECLARE(size, ad_size) \
+    PORTABLE_8439_API size_t portable_chacha20_poly1305_encrypt_##size##_##ad_size( \
+        uint8_t *restrict cipher_text, \
+        const portable_8439_key *key, \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        const uint8_t *restrict plain_text \
+    ); \
+    PORTABLE_8439_API size_t portable_chacha20_poly1305_decrypt_##size##_##ad_size( \
+        uint8_t *restrict plain_text, \
+        const portable_8439_key *key, \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        const uint8_t *restrict cipher_text \
+    );
+
+PORTABLE_8439_FIXED_SIZES(PORTABLE_8439_FIXED_DECLARE)
+
+/*
+    Select the poly1305 implementation at runtime.
+
+    All poly1305-donna variants are compiled in: donna-8, donna-16, donna-32
+    and donna-32x2, plus donna-64 and donna-64x4 where 128 bit math is 
+    available. The compile time flags (-DPOLY1305_32BIT, -DPOLY1305_32X2, 
+    ...) only pick the default. These functions allow listing, selecting and
+    measuring them, so you can compare them on the target without 
+    rebuilding. Select a backend before using the library from multiple 
+    threads.
+
+    With PORTABLE_8439_SMALL only the default backend is compiled in (donna-64
+    rather than donna-64x4 on 64 bit), so these functions see a list of one.
+
+    - count & name: list the available backends (name is NULL when out of range)
+    - current: name of the backend new messages will use
+    - select: switch to the backend by name, returns 0 for an unknown name
+    - benchmark: MiB/s of `runs` macs over message with the given backend, 
+        negative for an unknown name
+*/
+PORTABLE_8439_API size_t portable_poly1305_backend_count(void);
+PORTABLE_8439_API const char *portable_poly1305_backend_name(size_t index);
+PORTABLE_8439_API const char *portable_poly1305_backend_current(void);
+PORTABLE_8439_API int portable_poly1305_backend_select(const char *name);
+PORTABLE_8439_API double portable_poly1305_backend_benchmark(
+    const char *name,
+    const uint8_t *message,
+    size_t message_size,
+    unsigned long runs
+);
+
+#ifdef PORTABLE_8439_STATS
+/*
+    Instrumentation counters, only available when compiled with 
+    -DPORTABLE_8439_STATS (needs GCC or Clang), without it they compile to
+    nothing.
+
+    Every thread counts into its own block (allocated on first use), so the 
+    hot path has no shared writes. portable_8439_stats_collect sums the 
+    blocks of all threads at the moment of the call. Blocks of threads that
+    have ended are kept, so their counts are not lost.
+
+    - calls: every call, including the failed ones
+    - bytes: plain text bytes of the successful calls (no tag or ad)
+    - auth_failures: decrypts that failed on the tag
+    - overlap_rejections: calls that failed on overlapping buffers
+    - size_histogram: plain text sizes of the successful calls, bucket 0 
+        counts empty messages, bucket i messages of 2^(i-1) up to 
+        2^i - 1 bytes, and the last bucket all messages larger than that
+*/
+#define PORTABLE_8439_STATS_BUCKETS (32)
+
+typedef struct portable_8439_stats {
+    uint64_t encrypt_calls;
+    uint64_t encrypt_bytes;
+    uint64_t decrypt_calls;
+    uint64_t decrypt_bytes;
+    uint64_t auth_failures;
+    uint64_t overlap_rejections;
+    uint64_t size_histogram[PORTABLE_8439_STATS_BUCKETS];
+} portable_8439_stats;
+
+PORTABLE_8439_API void portable_8439_stats_collect(portable_8439_stats *result);
+
+/*
+    Optional per call timing: when set, encrypt & decrypt read clock at the
+    start and end of every call and report the difference to hook, together
+    with the size of the input (plain text or cipher text).
+    The struct is not copied, it should stay alive until it is replaced,
+    pass NULL to disable the timing again.
+*/
+typedef enum portable_8439_operation {
+    PORTABLE_8439_ENCRYPT,
+    PORTABLE_8439_DECRYPT
+} portable_8439_operation;
+
+typedef struct portable_8439_timing {
+    uint64_t (*clock)(void);
+    void (*hook)(portable_8439_operation operation, size_t size, uint64_t elapsed, void *user_data);
+    void *user_data;
+} portable_8439_timing;
+
+PORTABLE_8439_API void portable_8439_stats_timing(const portable_8439_timing *timing);
+#endif
+#if defined(__cplusplus)
+}
+#endif
+
+#ifdef PORTABLE_8439_IMPLEMENTATION
+
+// ******* BEGIN: portable-endian.h ********
+// Shared platform detection for chacha-portable and poly1305-donna, it
+// decides how we can turn bytes into (little endian) words:
+//
+//  - PORTABLE_UNALIGNED_WORDS: known byte order and unaligned word access
+//      is fine, so always use word loads/stores (byte swapped on big endian)
+//  - PORTABLE_ALIGNED_WORDS: known byte order, but unaligned access might
+//      trap or be emulated, so check the pointer alignment once and only
+//      use word loads/stores on aligned buffers
+//  - neither: load & store byte by byte
+//
+// For testing, -DTEST_SLOW_PATH forces the byte path and -DTEST_SLOW_PATH=2
+// the alignment checking path.
+
+#include <stdint.h>
+#include <string.h>
+
+// based on https://sourceforge.net/p/predef/wiki/Endianness/
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__) && \
+        __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#   define __HAVE_LITTLE_ENDIAN 1
+#elif defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && \
+        __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#   define __HAVE_BIG_ENDIAN 1
+#elif defined(__LITTLE_ENDIAN__) || \
+        defined(__ARMEL__) || \
+        defined(__THUMBEL__) || \
+        defined(__AARCH64EL__) || \
+        defined(_MIPSEL) || \
+        defined(__MIPSEL) || \
+        defined(__MIPSEL__) || \
+        defined(__XTENSA_EL__) || \
+        defined(__AVR__) || \
+        defined(_WIN32) || \
+        defined(LITTLE_ENDIAN)
+#   define __HAVE_LITTLE_ENDIAN 1
+#elif defined(__BIG_ENDIAN__) || \
+        defined(__ARMEB__) || \
+        defined(__THUMBEB__) || \
+        defined(__AARCH64EB__) || \
+        defined(_MIPSEB) || \
+        defined(__MIPSEB) || \
+        defined(__MIPSEB__) || \
+        defined(__XTENSA_EB__)
+#   define __HAVE_BIG_ENDIAN 1
+#endif
+
+// architectures where an unaligned word access is as cheap as an aligned one
+#if defined(__i386__) || \
+        defined(__x86_64__) || \
+        defined(_M_IX86) || \
+        defined(_M_X64) || \
+        defined(__aarch64__) || \
+        defined(_M_ARM64) || \
+        defined(__ARM_FEATURE_UNALIGNED) || \
+        defined(__powerpc__) || \
+        defined(__powerpc64__) || \
+        defined(__s390__) || \
+        defined(__s390x__) || \
+        defined(__riscv_misaligned_fast) || \
+        defined(__AVR__)
+#   define __HAVE_UNALIGNED_ACCESS 1
+#endif
+
+#if defined(TEST_SLOW_PATH) && TEST_SLOW_PATH == 2
+#   undef __HAVE_UNALIGNED_ACCESS
+#elif defined(TEST_SLOW_PATH)
+#   undef __HAVE_LITTLE_ENDIAN
+#   undef __HAVE_BIG_ENDIAN
+#   undef __HAVE_UNALIGNED_ACCESS
+#endif
+
+#if defined(__HAVE_LITTLE_ENDIAN) || defined(__HAVE_BIG_ENDIAN)
+#   if defined(__HAVE_UNALIGNED_ACCESS)
+#       define PORTABLE_UNALIGNED_WORDS 1
+#   else
+#       define PORTABLE_ALIGNED_WORDS 1
+#   endif
+#endif
+
+#if defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 3)))
+#   define PORTABLE_BSWAP32(x) __builtin_bswap32(x)
+#   define PORTABLE_BSWAP64(x) __builtin_bswap64(x)
+#else
+#   define PORTABLE_BSWAP32(x) \
+        ((((x) & 0xFF) << 24) | (((x) & 0xFF00) << 8) | \
+         (((x) >> 8) & 0xFF00) | (((x) >> 24) & 0xFF))
+#   define PORTABLE_BSWAP64(x) \
+        (((uint64_t)PORTABLE_BSWAP32((uint32_t)(x)) << 32) | \
+         PORTABLE_BSWAP32((uint32_t)((x) >> 32)))
+#endif
+
+// convert between a native word and a little endian one (both directions)
+#if defined(__HAVE_BIG_ENDIAN)
+#   define PORTABLE_LE32(x) PORTABLE_BSWAP32(x)
+#   define PORTABLE_LE64(x) PORTABLE_BSWAP64(x)
+#else
+#   define PORTABLE_LE32(x) (x)
+#   define PORTABLE_LE64(x) (x)
+#endif
+
+#if defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 7)))
+#   define PORTABLE_ASSUME_ALIGNED(p, n) __builtin_assume_aligned((p), (n))
+#else
+#   define PORTABLE_ASSUME_ALIGNED(p, n) (p)
+#endif
+
+#define PORTABLE_IS_ALIGNED(p, n) ((((uintptr_t)(p)) % (n)) == 0)
+
+// ******* END:   portable-endian.h ********
+// ******* BEGIN: portable-config.h ********
+// Build configuration shared by chacha-portable and poly1305-donna: the
+// profiles and tuning knobs that are set with -D flags. The platform
+// detection is in portable-endian.h.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// -DPORTABLE_8439_SMALL is the profile for microcontrollers: small code and
+// a shallow stack over throughput. The chacha rounds run as a loop over a
+// table of quarter rounds, without SIMD or interleaved blocks and without
+// forcing the block functions inline, only the selected poly1305-donna
+// variant is compiled in (with a context sized for it), and the batch
+// functions derive one key at a time. `make size-report` shows the difference.
+#ifdef PORTABLE_8439_SMALL
+#   ifndef CHACHA20_NO_VECTORS
+#       define CHACHA20_NO_VECTORS 1
+#   endif
+#   undef CHACHA20_INTERLEAVE
+#   define CHACHA20_INTERLEAVE (1)
+#endif
+
+// Software prefetch for the bulk loops of both: -DPORTABLE_PREFETCH_DISTANCE=n
+// prefetches the input n bytes ahead of where the loop is (0, the default, 
+// leaves it to the hardware prefetcher). PORTABLE_PREFETCH_AHEAD prefetches
+// the cache lines of the size bytes that are the distance ahead of p, if 
+// they are still inside of the available bytes from p.
+#ifndef PORTABLE_PREFETCH_DISTANCE
+#   define PORTABLE_PREFETCH_DISTANCE (0)
+#endif
+
+#if PORTABLE_PREFETCH_DISTANCE > 0 && defined(__GNUC__)
+#   define PORTABLE_PREFETCH_AHEAD(p, size, available) \
+        if ((available) >= PORTABLE_PREFETCH_DISTANCE + (size)) { \
+            for (size_t __pf = 0; __pf < (size); __pf += 64) { \
+                __builtin_prefetch((const uint8_t *)(p) + PORTABLE_PREFETCH_DISTANCE + __pf); \
+            } \
+        }
+#else
+#   define PORTABLE_PREFETCH_AHEAD(p, size, available)
+#endif
+
+// ******* END:   portable-config.h ********
+// ******* BEGIN: chacha-portable/chacha-portable.h ********
+
+#if !defined(__cplusplus) && \
+    !defined(_MSC_VER) && \
+    (!defined(__STDC_VERSION__) || __STDC_VERSION__ < 199901L)
+#    error "C99 or newer required"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if CHAR_BIT > 8
+#    error "Systems without native octals not supported"
+#endif
+
+#define CHACHA20_KEY_SIZE (32)
+#define CHACHA20_NONCE_SIZE (12)
+#define HCHACHA20_NONCE_SIZE (16)
+#define QUIC_HP_SAMPLE_SIZE (16)
+#define QUIC_HP_MASK_SIZE (5)
+
+#if defined(_MSC_VER) || defined(__cplusplus) 
+// add restrict support
+#    if (defined(_MSC_VER) && _MSC_VER >= 1900) || defined(__clang__) || defined(__GNUC__)
+#       define restrict __restrict
+#    else
+#       define restrict
+#    endif
+#endif
+
+// the key words of the chacha20 state, loaded once to be reused for many nonces
+typedef struct chacha20_key {
+    uint32_t words[CHACHA20_KEY_SIZE / sizeof(uint32_t)];
+} chacha20_key;
+
+static PORTABLE_8439_DECL void chacha20_key_init(chacha20_key *expanded, const uint8_t key[CHACHA20_KEY_SIZE]);
+
+// xor data with a ChaCha20 keystream as per RFC8439, dest can be source (in
+// place) but should not overlap it otherwise
+static PORTABLE_8439_DECL void chacha20_xor_stream_key(
+        uint8_t *dest, 
+        const uint8_t *source, 
+        size_t length,
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE],
+        uint32_t counter
+);
+
+static PORTABLE_8439_DECL inline void chacha20_xor_stream(
+        uint8_t *dest, 
+        const uint8_t *source, 
+        size_t length,
+        const uint8_t key[CHACHA20_KEY_SIZE],
+        const uint8_t nonce[CHACHA20_NONCE_SIZE],
+        uint32_t counter
+) {
+    chacha20_key expanded;
+    chacha20_key_init(&expanded, key);
+    chacha20_xor_stream_key(dest, source, length, &expanded, nonce, counter);
+}
+
+// derive the XChaCha20 subkey from a key and the first 16 bytes of the nonce
+static PORTABLE_8439_DECL void hchacha20(
+        chacha20_key *subkey,
+        const chacha20_key *key,
+        const uint8_t nonce[HCHACHA20_NONCE_SIZE]
+);
+
+static PORTABLE_8439_DECL void rfc8439_keygen(
+        uint8_t poly_key[32],
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE]
+);
+
+// count poly keys (32 bytes each) for count nonces, both written after each
+// other, several nonces per SIMD register
+static PORTABLE_8439_DECL void rfc8439_keygen_batch(
+        uint8_t *poly_keys,
+        const chacha20_key *key,
+        const uint8_t *nonces,
+        size_t count
+);
+
+// the reduced round variants (ChaCha12 & ChaCha8) of chacha20_xor_stream_key
+// and rfc8439_keygen
+static PORTABLE_8439_DECL void chacha12_xor_stream_key(
+        uint8_t *dest, 
+        const uint8_t *source, 
+        size_t length,
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE],
+        uint32_t counter
+);
+
+static PORTABLE_8439_DECL void chacha12_keygen(
+        uint8_t poly_key[32],
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE]
+);
+
+static PORTABLE_8439_DECL void chacha8_xor_stream_key(
+        uint8_t *dest, 
+        const uint8_t *source, 
+        size_t length,
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE],
+        uint32_t counter
+);
+
+static PORTABLE_8439_DECL void chacha8_keygen(
+        uint8_t poly_key[32],
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE]
+);
+
+// QUIC header protection masks (RFC 9001 5.4.4), the batch version writes
+// count masks of QUIC_HP_MASK_SIZE bytes after each other
+static PORTABLE_8439_DECL void chacha20_quic_hp_mask(
+        uint8_t mask[QUIC_HP_MASK_SIZE],
+        const chacha20_key *key,
+        const uint8_t sample[QUIC_HP_SAMPLE_SIZE]
+);
+
+static PORTABLE_8439_DECL void chacha20_quic_hp_mask_batch(
+        uint8_t *masks,
+        const chacha20_key *key,
+        const uint8_t *const *samples,
+        size_t count
+);
+
+// ******* END:   chacha-portable/chacha-portable.h ********
+// ******* BEGIN: poly1305-donna/poly1305-donna.h ********
+
+#include <stddef.h>
+
+typedef struct poly1305_context {
+	size_t aligner;
+#if defined(PORTABLE_8439_SMALL)
+	/* only the selected variant is compiled in, at most donna-32 or donna-64 */
+	unsigned char opaque[14 * sizeof(unsigned long) + 24];
+#else
+	/* donna-64x4 is the biggest variant at 168 bytes: with the aligner
+	   word in front that ends exactly at the backend pointer */
+	unsigned char opaque[160];
+	const struct poly1305_backend *backend;
+#endif
+} poly1305_context;
+
+static PORTABLE_8439_DECL void poly1305_init(poly1305_context *ctx, const unsigned char key[32]);
+static PORTABLE_8439_DECL void poly1305_update(poly1305_context *ctx, const unsigned char *m, size_t bytes);
+static PORTABLE_8439_DECL void poly1305_finish(poly1305_context *ctx, unsigned char mac[16]);
+
+static PORTABLE_8439_DECL int poly1305_verify(const unsigned char mac1[16], const unsigned char mac2[16]);
+
+/*
+	All donna variants are compiled in, poly1305_init uses the selected one.
+	The default is picked at compile time (see POLY1305_8BIT & friends),
+	select another one before starting to use contexts from multiple threads.
+	With PORTABLE_8439_SMALL only the default is compiled in (donna-64 rather
+	than donna-64x4 on 64 bit), and called directly.
+static PORTABLE_8439_DECL */
+typedef struct poly1305_backend {
+	const char *name;
+	void (*init)(poly1305_context *ctx, const unsigned char key[32]);
+	void (*update)(poly1305_context *ctx, const unsigned char *m, size_t bytes);
+	void (*finish)(poly1305_context *ctx, unsigned char mac[16]);
+} poly1305_backend;
+
+static PORTABLE_8439_DECL size_t poly1305_backend_count(void);
+static PORTABLE_8439_DECL const poly1305_backend *poly1305_backend_at(size_t index);
+static PORTABLE_8439_DECL const poly1305_backend *poly1305_backend_find(const char *name);
+static PORTABLE_8439_DECL const poly1305_backend *poly1305_backend_selected(void);
+static PORTABLE_8439_DECL int poly1305_backend_select(const poly1305_backend *backend);
+
+/* returns the seconds (cpu time) it took to calculate runs macs of m */
+static PORTABLE_8439_DECL double poly1305_backend_benchmark(const poly1305_backend *backend, const unsigned char *m, size_t bytes, unsigned long runs);
+
+// ******* END:   poly1305-donna/poly1305-donna.h ********
+// ******* BEGIN: chacha-portable.c ********
+
+#include <string.h>
+#include <assert.h>
+
+// this is a fresh implementation of chacha20, based on the description in rfc8349
+// it's such a nice compact algorithm that it is easy to do.
+// In relationship to other c implementation this implementation:
+//  - pure c99
+//  - big & little endian support
+//  - safe for architectures that don't support unaligned reads
+//
+// Next to this, we try to be fast as possible without resorting inline assembly. 
+// On GCC & Clang we optionally use vector extensions (see __HAVE_VECTORS).
+
+// the endianness & alignment detection is shared with poly1305-donna, and so
+// are the build profile and the prefetch distance
+
+#define CHACHA20_STATE_WORDS (16)
+#define CHACHA20_BLOCK_SIZE (CHACHA20_STATE_WORDS * sizeof(uint32_t))
+
+#ifdef PORTABLE_UNALIGNED_WORDS
+#define store_32_le(target, source) \
+    memcpy(&(target), source, sizeof(uint32_t)); \
+    (target) = PORTABLE_LE32(target)
+#else
+#define store_32_le(target, source) \
+    target \
+        =  (uint32_t)(source)[0] \
+        | ((uint32_t)(source)[1]) << 8 \
+        | ((uint32_t)(source)[2]) << 16 \
+        | ((uint32_t)(source)[3]) << 24
+#endif
+
+static void chacha20_key_init(chacha20_key *expanded, const uint8_t key[CHACHA20_KEY_SIZE]) {
+    store_32_le(expanded->words[0], key);
+    store_32_le(expanded->words[1], key + 4);
+    store_32_le(expanded->words[2], key + 8);
+    store_32_le(expanded->words[3], key + 12);
+    store_32_le(expanded->words[4], key + 16);
+    store_32_le(expanded->words[5], key + 20);
+    store_32_le(expanded->words[6], key + 24);
+    store_32_le(expanded->words[7], key + 28);
+}
+
+static void initialize_state(
+        uint32_t state[CHACHA20_STATE_WORDS], 
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE],
+        uint32_t counter
+) {
+#ifdef static_assert 
+    static_assert(sizeof(uint32_t) == 4, "We don't support systems that do not conform to standard of uint32_t being exact 32bit wide");
+#endif
+    state[0]  = 0x61707865;
+    state[1]  = 0x3320646e;
+    state[2]  = 0x79622d32;
+    state[3]  = 0x6b206574;
+    memcpy(state + 4, key->words, sizeof(key->words));
+    state[12] = counter;
+    store_32_le(state[13], nonce);
+    store_32_le(state[14], nonce + 4);
+    store_32_le(state[15], nonce + 8);
+}
+
+#define increment_counter(state) (state)[12]++
+
+// source: http://blog.regehr.org/archives/1063
+#define rotl32a(x, n) ((x) << (n)) | ((x) >> (32 - (n)))
+
+#define Qround(a,b,c,d) \
+    a += b; d ^= a; d = rotl32a(d, 16); \
+    c += d; b ^= c; b = rotl32a(b, 12); \
+    a += b; d ^= a; d = rotl32a(d, 8); \
+    c += d; b ^= c; b = rotl32a(b, 7);
+
+#define TIMES16(x) \
+    x(0) x(1) x(2)  x(3)  x(4)  x(5)  x(6)  x(7) \
+    x(8) x(9) x(10) x(11) x(12) x(13) x(14) x(15)
+
+// the rounds in pairs of a column & a diagonal round, shared by all the block
+// functions, Q is their quarter round on the indexes of the state words.
+// ChaCha20 is 10 double rounds, the reduced variants 6 (ChaCha12) & 4 (ChaCha8)
+#define DOUBLE_ROUNDS(Q, double_rounds) \
+    for (unsigned int i = 0; i < (double_rounds); i++) { \
+        Q(0, 4,  8, 12); \
+        Q(1, 5,  9, 13); \
+        Q(2, 6, 10, 14); \
+        Q(3, 7, 11, 15); \
+        Q(0, 5, 10, 15); \
+        Q(1, 6, 11, 12); \
+        Q(2, 7,  8, 13); \
+        Q(3, 4,  9, 14); \
+    }
+
+// the round count is a parameter of all the block functions, the public 
+// functions of every variant get their own copy of the whole path (inlined
+// with the round count as a constant), so the round loops can be unrolled
+#if defined(PORTABLE_8439_SMALL)
+#   define CHACHA_INLINE
+#elif defined(__GNUC__)
+#   define CHACHA_INLINE inline __attribute__((always_inline))
+#else
+#   define CHACHA_INLINE inline
+#endif
+
+#ifdef PORTABLE_8439_SMALL
+// the 8 quarter rounds of a double round, the 4 state words of each packed
+// in a nibble. The rounds run on the output array, so no other copy of the
+// state is on the stack.
+static const uint16_t QUARTER_ROUNDS[8] = {
+    0x048c, 0x159d, 0x26ae, 0x37bf, 0x05af, 0x16bc, 0x278d, 0x349e
+};
+
+static CHACHA_INLINE void core_block(const uint32_t *restrict start, uint32_t *restrict output, unsigned int double_rounds) {
+    memcpy(output, start, CHACHA20_BLOCK_SIZE);
+    for (unsigned int q = 0; q < 8 * double_rounds; q++) {
+        unsigned int words = QUARTER_ROUNDS[q % 8];
+        uint32_t *a = output + (words >> 12), *b = output + ((words >> 8) & 0xF);
+        uint32_t *c = output + ((words >> 4) & 0xF), *d = output + (words & 0xF);
+        Qround(*a, *b, *c, *d)
+    }
+    for (unsigned int i = 0; i < CHACHA20_STATE_WORDS; i++) {
+        output[i] += start[i];
+    }
+}
+#else
+static CHACHA_INLINE void core_block(const uint32_t *restrict start, uint32_t *restrict output, unsigned int double_rounds) {
+    // instead of working on the output array, 
+    // we let the compiler allocate 16 local variables on the stack
+    #define __LV(i) uint32_t __s##i = start[i];
+    TIMES16(__LV)
+
+    #define __Q(a,b,c,d) Qround(__s##a, __s##b, __s##c, __s##d)
+
+    DOUBLE_ROUNDS(__Q, double_rounds)
+
+    #define __FIN(i) output[i] = start[i] + __s##i;
+    TIMES16(__FIN)
+}
+#endif
+
+// Interleaved path: core_block is one long dependency chain, on wide 
+// out-of-order cores without SIMD we calculate 2 (or 3) independent blocks
+// in the same loop, so that their chains overlap. This needs 32 (or 48) live 
+// words, so by default we only do it on ISAs with 32 registers. 
+// Use -DCHACHA20_INTERLEAVE=1|2|3 to override.
+#ifndef CHACHA20_INTERLEAVE
+#   if defined(__aarch64__) || \
+        defined(__powerpc__) || \
+        defined(__powerpc64__) || \
+        defined(__riscv) || \
+        defined(__mips__) || \
+        defined(__loongarch__) || \
+        defined(__sparc__) || \
+        defined(__alpha__)
+#       define CHACHA20_INTERLEAVE (2)
+#   else
+#       define CHACHA20_INTERLEAVE (1)
+#   endif
+#endif
+
+#if CHACHA20_INTERLEAVE == 2
+// calculates 2 consecutive blocks starting at the counter in start
+static CHACHA_INLINE void core_block_interleaved(const uint32_t *restrict start, uint32_t *restrict output, unsigned int double_rounds) {
+    #define __LV2(i) uint32_t __s##i = start[i], __t##i = start[i];
+    TIMES16(__LV2)
+    __t12++;
+
+    #define __Q2(a,b,c,d) \
+        Qround(__s##a, __s##b, __s##c, __s##d) \
+        Qround(__t##a, __t##b, __t##c, __t##d)
+
+    DOUBLE_ROUNDS(__Q2, double_rounds)
+
+    #define __FIN2(i) \
+        output[i] = start[i] + __s##i; \
+        output[CHACHA20_STATE_WORDS + i] = start[i] + __t##i;
+    TIMES16(__FIN2)
+    output[CHACHA20_STATE_WORDS + 12]++;
+}
+#elif CHACHA20_INTERLEAVE == 3
+// calculates 3 consecutive blocks starting at the counter in start
+static CHACHA_INLINE void core_block_interleaved(const uint32_t *restrict start, uint32_t *restrict output, unsigned int double_rounds) {
+    #define __LV3(i) uint32_t __s##i = start[i], __t##i = start[i], __u##i = start[i];
+    TIMES16(__LV3)
+    __t12 += 1;
+    __u12 += 2;
+
+    #define __Q3(a,b,c,d) \
+        Qround(__s##a, __s##b, __s##c, __s##d) \
+        Qround(__t##a, __t##b, __t##c, __t##d) \
+        Qround(__u##a, __u##b, __u##c, __u##d)
+
+    DOUBLE_ROUNDS(__Q3, double_rounds)
+
+    #define __FIN3(i) \
+        output[i] = start[i] + __s##i; \
+        output[CHACHA20_STATE_WORDS + i] = start[i] + __t##i; \
+        output[2 * CHACHA20_STATE_WORDS + i] = start[i] + __u##i;
+    TIMES16(__FIN3)
+    output[CHACHA20_STATE_WORDS + 12] += 1;
+    output[2 * CHACHA20_STATE_WORDS + 12] += 2;
+}
+#elif CHACHA20_INTERLEAVE != 1
+#   error "CHACHA20_INTERLEAVE should be 1, 2 or 3"
+#endif
+
+// Wide path: the GCC/Clang vector extensions let us calculate several blocks
+// at once without resorting to intrinsics or assembly, the compiler lowers
+// the vector operations to whatever SIMD unit the target has (SSE/AVX, NEON,
+// AltiVec/VSX, RISC-V V, ...). We only enable it when we know such a unit is
+// present, without one the vectors get lowered to scalar code that spills
+// all over the stack. The core_block above stays the C99 fallback.
+// Use -DCHACHA20_NO_VECTORS to disable and -DCHACHA20_VECTOR_WIDTH=4|8 to
+// pick the amount of blocks calculated in parallel.
+#if !defined(CHACHA20_NO_VECTORS) && defined(__GNUC__) && ( \
+        defined(__SSE2__) || \
+        defined(__ARM_NEON) || \
+        defined(__ARM_NEON__) || \
+        defined(__ALTIVEC__) || \
+        defined(__VSX__) || \
+        defined(__riscv_vector) || \
+        defined(__mips_msa) || \
+        defined(__wasm_simd128__))
+#   define __HAVE_VECTORS 1
+#   ifndef CHACHA20_VECTOR_WIDTH
+#       if defined(__AVX2__)
+#           define CHACHA20_VECTOR_WIDTH (8)
+#       else
+#           define CHACHA20_VECTOR_WIDTH (4)
+#       endif
+#   endif
+#endif
+
+#ifdef __HAVE_VECTORS
+typedef uint32_t chacha_vector __attribute__((vector_size(CHACHA20_VECTOR_WIDTH * sizeof(uint32_t))));
+
+#if CHACHA20_VECTOR_WIDTH == 8
+static const chacha_vector __LANES = { 0, 1, 2, 3, 4, 5, 6, 7 };
+#elif CHACHA20_VECTOR_WIDTH == 4
+static const chacha_vector __LANES = { 0, 1, 2, 3 };
+#else
+#   error "CHACHA20_VECTOR_WIDTH should be 4 or 8"
+#endif
+
+// calculates CHACHA20_VECTOR_WIDTH blocks, starting at the counter in start.
+// every lane of the vectors is a block, at the end we transpose them
+// so that output contains the key stream of the consecutive blocks
+static CHACHA_INLINE void core_block_wide(const uint32_t *restrict start, uint32_t *restrict output, unsigned int double_rounds) {
+    #define __LVW(i) chacha_vector __v##i = start[i] + (chacha_vector){ 0 };
+    TIMES16(__LVW)
+    __v12 += __LANES;
+
+    #define __QW(a,b,c,d) Qround(__v##a, __v##b, __v##c, __v##d)
+
+    DOUBLE_ROUNDS(__QW, double_rounds)
+
+    #define __FINW(i) __v##i += start[i];
+    TIMES16(__FINW)
+    __v12 += __LANES;
+
+    for (unsigned int b = 0; b < CHACHA20_VECTOR_WIDTH; b++) {
+        #define __OUTW(i) output[b * CHACHA20_STATE_WORDS + i] = __v##i[b];
+        TIMES16(__OUTW)
+    }
+}
+#endif
+
+// HChaCha20 (draft-irtf-cfrg-xchacha section 2.2): the rounds of a block
+// with the first 16 bytes of the nonce in place of the counter & nonce, 
+// without the final addition, words 0-3 & 12-15 are the subkey
+static void hchacha20(chacha20_key *subkey, const chacha20_key *key, const uint8_t nonce[HCHACHA20_NONCE_SIZE]) {
+    uint32_t state[CHACHA20_STATE_WORDS];
+    initialize_state(state, key, nonce + 4, 0);
+    store_32_le(state[12], nonce);
+
+#ifdef PORTABLE_8439_SMALL
+    // the rounds of the block, without its final addition
+    uint32_t result[CHACHA20_STATE_WORDS];
+    core_block(state, result, 10);
+    for (unsigned int i = 0; i < 4; i++) {
+        subkey->words[i] = result[i] - state[i];
+        subkey->words[4 + i] = result[12 + i] - state[12 + i];
+    }
+#else
+    #define __LVH(i) uint32_t __h##i = state[i];
+    TIMES16(__LVH)
+
+    #define __QH(a,b,c,d) Qround(__h##a, __h##b, __h##c, __h##d)
+    DOUBLE_ROUNDS(__QH, 10)
+
+    subkey->words[0] = __h0;
+    subkey->words[1] = __h1;
+    subkey->words[2] = __h2;
+    subkey->words[3] = __h3;
+    subkey->words[4] = __h12;
+    subkey->words[5] = __h13;
+    subkey->words[6] = __h14;
+    subkey->words[7] = __h15;
+#endif
+}
+
+#define U8(x) ((uint8_t)((x) & 0xFF))
+
+#define xor32_bytes(dst, src, pad) \
+    (dst)[0] = (src)[0] ^ U8(*(pad)); \
+    (dst)[1] = (src)[1] ^ U8(*(pad) >> 8); \
+    (dst)[2] = (src)[2] ^ U8(*(pad) >> 16); \
+    (dst)[3] = (src)[3] ^ U8(*(pad) >> 24);
+
+#if defined(PORTABLE_UNALIGNED_WORDS) || defined(PORTABLE_ALIGNED_WORDS)
+#   define xor32_word(dst, src, pad) \
+    uint32_t __value; \
+    memcpy(&__value, src, sizeof(uint32_t)); \
+    __value ^= PORTABLE_LE32(*(pad)); \
+    memcpy(dst, &__value, sizeof(uint32_t));
+#endif
+
+#define index8_32(a, ix) ((a) + ((ix) * sizeof(uint32_t)))
+
+#define xor32_loop(xor32, dest, source, pad, words) \
+    for (unsigned int __i = 0; __i < words; __i++) { \
+        xor32(index8_32(dest, __i), index8_32(source, __i), (pad) + __i) \
+    }
+
+// aligned is only used on the alignment checking path, it's calculated once
+// per stream, as we always advance dest & source with whole words
+#if defined(PORTABLE_UNALIGNED_WORDS)
+#   define xor32_blocks(dest, source, pad, words, aligned) \
+    xor32_loop(xor32_word, dest, source, pad, words)
+#elif defined(PORTABLE_ALIGNED_WORDS)
+#   define xor32_blocks(dest, source, pad, words, aligned) \
+    if (aligned) { \
+        uint8_t *__dst = PORTABLE_ASSUME_ALIGNED(dest, sizeof(uint32_t)); \
+        const uint8_t *__src = PORTABLE_ASSUME_ALIGNED(source, sizeof(uint32_t)); \
+        xor32_loop(xor32_word, __dst, __src, pad, words) \
+    } \
+    else { \
+        xor32_loop(xor32_bytes, dest, source, pad, words) \
+    }
+#else
+#   define xor32_blocks(dest, source, pad, words, aligned) \
+    xor32_loop(xor32_bytes, dest, source, pad, words)
+#endif
+
+static void xor_block(uint8_t *dest, const uint8_t *source, const uint32_t *restrict pad, unsigned int chunk_size, int aligned) {
+    unsigned int full_blocks = chunk_size / sizeof(uint32_t);
+    // have to be carefull, we are going back from uint32 to uint8, so endianess matters again
+    xor32_blocks(dest, source, pad, full_blocks, aligned)
+    (void)aligned;
+
+    dest += full_blocks * sizeof(uint32_t);
+    source += full_blocks * sizeof(uint32_t);
+    pad += full_blocks;
+
+    switch(chunk_size % sizeof(uint32_t)) {
+        case 1:
+            dest[0] = source[0] ^ U8(*pad);
+            break;
+        case 2:
+            dest[0] = source[0] ^ U8(*pad);
+            dest[1] = source[1] ^ U8(*pad >> 8);
+            break;
+        case 3:
+            dest[0] = source[0] ^ U8(*pad);
+            dest[1] = source[1] ^ U8(*pad >> 8);
+            dest[2] = source[2] ^ U8(*pad >> 16);
+            break;
+    }
+}
+
+static CHACHA_INLINE void xor_stream(
+        uint8_t *dest, 
+        const uint8_t *source, 
+        size_t length,
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE],
+        uint32_t counter,
+        unsigned int double_rounds
+) {
+    uint32_t state[CHACHA20_STATE_WORDS];
+    initialize_state(state, key, nonce, counter);
+#ifdef PORTABLE_ALIGNED_WORDS
+    const int aligned = PORTABLE_IS_ALIGNED(dest, sizeof(uint32_t))
+        && PORTABLE_IS_ALIGNED(source, sizeof(uint32_t));
+#else
+    const int aligned = 0;
+#endif
+
+    size_t full_blocks = length / CHACHA20_BLOCK_SIZE;
+#ifdef __HAVE_VECTORS
+    uint32_t wide_pad[CHACHA20_VECTOR_WIDTH * CHACHA20_STATE_WORDS];
+    for (; full_blocks >= CHACHA20_VECTOR_WIDTH; full_blocks -= CHACHA20_VECTOR_WIDTH) {
+        PORTABLE_PREFETCH_AHEAD(source, CHACHA20_VECTOR_WIDTH * CHACHA20_BLOCK_SIZE, full_blocks * CHACHA20_BLOCK_SIZE)
+        core_block_wide(state, wide_pad, double_rounds);
+        state[12] += CHACHA20_VECTOR_WIDTH;
+        xor32_blocks(dest, source, wide_pad, CHACHA20_VECTOR_WIDTH * CHACHA20_STATE_WORDS, aligned)
+        dest += CHACHA20_VECTOR_WIDTH * CHACHA20_BLOCK_SIZE;
+        source += CHACHA20_VECTOR_WIDTH * CHACHA20_BLOCK_SIZE;
+    }
+#endif
+#if CHACHA20_INTERLEAVE > 1
+    uint32_t interleaved_pad[CHACHA20_INTERLEAVE * CHACHA20_STATE_WORDS];
+    for (; full_blocks >= CHACHA20_INTERLEAVE; full_blocks -= CHACHA20_INTERLEAVE) {
+        PORTABLE_PREFETCH_AHEAD(source, CHACHA20_INTERLEAVE * CHACHA20_BLOCK_SIZE, full_blocks * CHACHA20_BLOCK_SIZE)
+        core_block_interleaved(state, interleaved_pad, double_rounds);
+        state[12] += CHACHA20_INTERLEAVE;
+        xor32_blocks(dest, source, interleaved_pad, CHACHA20_INTERLEAVE * CHACHA20_STATE_WORDS, aligned)
+        dest += CHACHA20_INTERLEAVE * CHACHA20_BLOCK_SIZE;
+        source += CHACHA20_INTERLEAVE * CHACHA20_BLOCK_SIZE;
+    }
+#endif
+    uint32_t pad[CHACHA20_STATE_WORDS];
+    for (size_t b = 0; b < full_blocks; b++) {
+        PORTABLE_PREFETCH_AHEAD(source, CHACHA20_BLOCK_SIZE, (full_blocks - b) * CHACHA20_BLOCK_SIZE)
+        core_block(state, pad, double_rounds);
+        increment_counter(state);
+        xor32_blocks(dest, source, pad, CHACHA20_STATE_WORDS, aligned)
+        dest += CHACHA20_BLOCK_SIZE;
+        source += CHACHA20_BLOCK_SIZE;
+    }
+    unsigned int last_block = (unsigned int)(length % CHACHA20_BLOCK_SIZE);
+    if (last_block > 0 ) {
+        core_block(state, pad, double_rounds);
+        xor_block(dest, source, pad, last_block, aligned);
+    }
+}
+
+#ifdef PORTABLE_UNALIGNED_WORDS
+#define store32_le(target, source) \
+    uint32_t __value = PORTABLE_LE32(*(source)); \
+    memcpy(target, &__value, sizeof(uint32_t));
+#else
+#define store32_le(target, source) \
+    (target)[0] = U8(*(source)); \
+    (target)[1] = U8(*(source) >> 8); \
+    (target)[2] = U8(*(source) >> 16); \
+    (target)[3] = U8(*(source) >> 24);
+#endif
+
+#define serialize(poly_key, result) \
+    for (unsigned int i = 0; i < 32 / sizeof(uint32_t); i++) { \
+        store32_le(index8_32(poly_key, i), result + i); \
+    }
+
+static CHACHA_INLINE void keygen(
+        uint8_t poly_key[32],
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE],
+        unsigned int double_rounds
+) {
+    uint32_t state[CHACHA20_STATE_WORDS];
+    uint32_t result[CHACHA20_STATE_WORDS];
+    initialize_state(state, key, nonce, 0);
+    core_block(state, result, double_rounds);
+    serialize(poly_key, result);
+}
+
+static void chacha20_xor_stream_key(
+        uint8_t *dest, 
+        const uint8_t *source, 
+        size_t length,
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE],
+        uint32_t counter
+) {
+    xor_stream(dest, source, length, key, nonce, counter, 10);
+}
+
+static void rfc8439_keygen(
+        uint8_t poly_key[32],
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE]
+) {
+    keygen(poly_key, key, nonce, 10);
+}
+
+static void chacha12_xor_stream_key(
+        uint8_t *dest, 
+        const uint8_t *source, 
+        size_t length,
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE],
+        uint32_t counter
+) {
+    xor_stream(dest, source, length, key, nonce, counter, 6);
+}
+
+static void chacha12_keygen(
+        uint8_t poly_key[32],
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE]
+) {
+    keygen(poly_key, key, nonce, 6);
+}
+
+static void chacha8_xor_stream_key(
+        uint8_t *dest, 
+        const uint8_t *source, 
+        size_t length,
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE],
+        uint32_t counter
+) {
+    xor_stream(dest, source, length, key, nonce, counter, 4);
+}
+
+static void chacha8_keygen(
+        uint8_t poly_key[32],
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE]
+) {
+    keygen(poly_key, key, nonce, 4);
+}
+
+#ifdef __HAVE_VECTORS
+// CHACHA20_VECTOR_WIDTH poly keys at once: block 0 of a different nonce in
+// every lane, only the 8 words of the poly key are finished
+static void keygen_wide(uint8_t *poly_keys, const chacha20_key *key, const uint8_t *nonces) {
+    uint32_t state[CHACHA20_STATE_WORDS];
+    initialize_state(state, key, nonces, 0);
+    uint32_t lanes[3][CHACHA20_VECTOR_WIDTH];
+    for (unsigned int b = 0; b < CHACHA20_VECTOR_WIDTH; b++) {
+        const uint8_t *nonce = nonces + b * CHACHA20_NONCE_SIZE;
+        store_32_le(lanes[0][b], nonce);
+        store_32_le(lanes[1][b], nonce + 4);
+        store_32_le(lanes[2][b], nonce + 8);
+    }
+
+    #define __LVK(i) chacha_vector __p##i = state[i] + (chacha_vector){ 0 };
+    TIMES16(__LVK)
+    memcpy(&__p13, lanes[0], sizeof(chacha_vector));
+    memcpy(&__p14, lanes[1], sizeof(chacha_vector));
+    memcpy(&__p15, lanes[2], sizeof(chacha_vector));
+
+    #define __QK(a,b,c,d) Qround(__p##a, __p##b, __p##c, __p##d)
+    DOUBLE_ROUNDS(__QK, 10)
+
+    #define __FINK(i) __p##i += state[i];
+    __FINK(0) __FINK(1) __FINK(2) __FINK(3) __FINK(4) __FINK(5) __FINK(6) __FINK(7)
+    for (unsigned int b = 0; b < CHACHA20_VECTOR_WIDTH; b++) {
+        uint32_t result[8];
+        #define __OUTK(i) result[i] = __p##i[b];
+        __OUTK(0) __OUTK(1) __OUTK(2) __OUTK(3) __OUTK(4) __OUTK(5) __OUTK(6) __OUTK(7)
+        uint8_t *poly_key = poly_keys + b * 32;
+        serialize(poly_key, result);
+    }
+}
+#endif
+
+static void rfc8439_keygen_batch(
+        uint8_t *poly_keys,
+        const chacha20_key *key,
+        const uint8_t *nonces,
+        size_t count
+) {
+#ifdef __HAVE_VECTORS
+    for (; count >= CHACHA20_VECTOR_WIDTH; count -= CHACHA20_VECTOR_WIDTH) {
+        keygen_wide(poly_keys, key, nonces);
+        poly_keys += CHACHA20_VECTOR_WIDTH * 32;
+        nonces += CHACHA20_VECTOR_WIDTH * CHACHA20_NONCE_SIZE;
+    }
+#endif
+    for (size_t i = 0; i < count; i++) {
+        keygen(poly_keys + i * 32, key, nonces + i * CHACHA20_NONCE_SIZE, 10);
+    }
+}
+
+// QUIC header protection (RFC 9001 section 5.4.4): the first 4 bytes of the
+// sample are the counter, the other 12 the nonce, and the mask is the first 
+// 5 bytes of that key stream block. No need to go through the xor path.
+static void chacha20_quic_hp_mask(
+        uint8_t mask[QUIC_HP_MASK_SIZE],
+        const chacha20_key *key,
+        const uint8_t sample[QUIC_HP_SAMPLE_SIZE]
+) {
+    uint32_t state[CHACHA20_STATE_WORDS];
+    uint32_t result[CHACHA20_STATE_WORDS];
+    initialize_state(state, key, sample + 4, 0);
+    store_32_le(state[12], sample);
+    core_block(state, result, 10);
+    store32_le(mask, result);
+    mask[4] = U8(result[1]);
+}
+
+#ifdef __HAVE_VECTORS
+// CHACHA20_VECTOR_WIDTH masks at once: every lane gets the counter & nonce
+// of its own sample, and only the words of the mask are finished
+static void quic_hp_mask_wide(uint8_t *masks, const chacha20_key *key, const uint8_t *const *samples) {
+    uint32_t state[CHACHA20_STATE_WORDS];
+    initialize_state(state, key, samples[0] + 4, 0);
+    uint32_t lanes[4][CHACHA20_VECTOR_WIDTH];
+    for (unsigned int b = 0; b < CHACHA20_VECTOR_WIDTH; b++) {
+        store_32_le(lanes[0][b], samples[b]);
+        store_32_le(lanes[1][b], samples[b] + 4);
+        store_32_le(lanes[2][b], samples[b] + 8);
+        store_32_le(lanes[3][b], samples[b] + 12);
+    }
+
+    #define __LVM(i) chacha_vector __m##i = state[i] + (chacha_vector){ 0 };
+    TIMES16(__LVM)
+    memcpy(&__m12, lanes[0], sizeof(chacha_vector));
+    memcpy(&__m13, lanes[1], sizeof(chacha_vector));
+    memcpy(&__m14, lanes[2], sizeof(chacha_vector));
+    memcpy(&__m15, lanes[3], sizeof(chacha_vector));
+
+    #define __QM(a,b,c,d) Qround(__m##a, __m##b, __m##c, __m##d)
+    DOUBLE_ROUNDS(__QM, 10)
+
+    __m0 += state[0];
+    __m1 += state[1];
+    for (unsigned int b = 0; b < CHACHA20_VECTOR_WIDTH; b++) {
+        uint32_t word = __m0[b];
+        store32_le(masks + b * QUIC_HP_MASK_SIZE, &word);
+        masks[b * QUIC_HP_MASK_SIZE + 4] = U8(__m1[b]);
+    }
+}
+#endif
+
+static void chacha20_quic_hp_mask_batch(
+        uint8_t *masks,
+        const chacha20_key *key,
+        const uint8_t *const *samples,
+        size_t count
+) {
+#ifdef __HAVE_VECTORS
+    for (; count >= CHACHA20_VECTOR_WIDTH; count -= CHACHA20_VECTOR_WIDTH) {
+        quic_hp_mask_wide(masks, key, samples);
+        masks += CHACHA20_VECTOR_WIDTH * QUIC_HP_MASK_SIZE;
+        samples += CHACHA20_VECTOR_WIDTH;
+    }
+#endif
+    for (size_t i = 0; i < count; i++) {
+        chacha20_quic_hp_mask(masks + i * QUIC_HP_MASK_SIZE, key, samples[i]);
+    }
+}
+// ******* END:   chacha-portable.c ********
+// ******* BEGIN: poly1305-donna.c ********
+
+#include <string.h>
+#include <time.h>
+
+/* shared with chacha-portable: word loads & stores when the platform allows it */
+
+/* and the build profile & prefetch distance */
+
+/* auto detect between 32bit / 64bit */
+#if /* uint128 available on 64bit system*/ \
+	(defined(__SIZEOF_INT128__) && defined(__LP64__)) \
+	/* MSVC 64bit compiler */ \
+	|| (defined(_MSC_VER) && defined(_M_X64)) \
+	/* gcc >= 4.4 64bit */ \
+	|| (defined(__GNUC__) && defined(__LP64__) && \
+		((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 4))))
+#	define __GUESS64
+#else
+#	define __GUESS32
+#endif
+
+/*
+	All variants are compiled in side by side, each one under its own suffix.
+	The compile time flags (POLY1305_8BIT, ...) only pick the default backend.
+	The 64 bit variant needs 128 bit math, so it's only available if we
+	guessed a 64bit system or the flag explicitly asks for it.
+static */
+#if defined(__GUESS64) || defined(POLY1305_64BIT)
+#	define __HAVE_POLY1305_64
+#endif
+
+/*
+	PORTABLE_8439_SMALL only compiles in the default variant, the widths
+	below identify it (322 is donna-32x2, 644 is donna-64x4).
+static */
+#if defined(POLY1305_8BIT)
+#	define __POLY1305_DEFAULT_BITS 8
+#elif defined(POLY1305_16BIT)
+#	define __POLY1305_DEFAULT_BITS 16
+#elif defined(POLY1305_32X2)
+#	define __POLY1305_DEFAULT_BITS 322
+#elif defined(POLY1305_32BIT) || (!defined(POLY1305_64BIT) && defined(__GUESS32))
+#	define __POLY1305_DEFAULT_BITS 32
+#elif defined(POLY1305_64BIT) || defined(PORTABLE_8439_SMALL)
+#	define __POLY1305_DEFAULT_BITS 64
+#else
+#	define __POLY1305_DEFAULT_BITS 644
+#endif
+
+#if defined(PORTABLE_8439_SMALL)
+#	define __WANT_POLY1305(bits) (__POLY1305_DEFAULT_BITS == (bits))
+#else
+#	define __WANT_POLY1305(bits) 1
+#endif
+
+#if __WANT_POLY1305(8)
+#define poly1305_state_internal_t poly1305_state_internal_8_t
+#define poly1305_init poly1305_init_8
+#define poly1305_blocks poly1305_blocks_8
+#define poly1305_update poly1305_update_8
+#define poly1305_finish poly1305_finish_8
+/*
+	poly1305 implementation using 8 bit * 8 bit = 16 bit multiplication and 32 bit addition
+
+	based on the public domain reference version in supercop by djb
+static */
+
+#if defined(_MSC_VER)
+	#define POLY1305_NOINLINE __declspec(noinline)
+#elif defined(__GNUC__)
+	#define POLY1305_NOINLINE __attribute__((noinline))
+#else
+	#define POLY1305_NOINLINE
+#endif
+
+#define poly1305_block_size 16
+
+/* 17 + sizeof(size_t) + 51*sizeof(unsigned char) */
+typedef struct poly1305_state_internal_t {
+	unsigned char buffer[poly1305_block_size];
+	size_t leftover;
+	unsigned char h[17];
+	unsigned char r[17];
+	unsigned char pad[17];
+	unsigned char final;
+} poly1305_state_internal_t;
+
+static void poly1305_init(poly1305_context *ctx, const unsigned char key[32]) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	size_t i;
+
+	st->leftover = 0;
+
+	/* h = 0 */
+	for (i = 0; i < 17; i++)
+		st->h[i] = 0;
+
+	/* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
+	st->r[ 0] = key[ 0] & 0xff;
+	st->r[ 1] = key[ 1] & 0xff;
+	st->r[ 2] = key[ 2] & 0xff;
+	st->r[ 3] = key[ 3] & 0x0f;
+	st->r[ 4] = key[ 4] & 0xfc;
+	st->r[ 5] = key[ 5] & 0xff;
+	st->r[ 6] = key[ 6] & 0xff;
+	st->r[ 7] = key[ 7] & 0x0f;
+	st->r[ 8] = key[ 8] & 0xfc;
+	st->r[ 9] = key[ 9] & 0xff;
+	st->r[10] = key[10] & 0xff;
+	st->r[11] = key[11] & 0x0f;
+	st->r[12] = key[12] & 0xfc;
+	st->r[13] = key[13] & 0xff;
+	st->r[14] = key[14] & 0xff;
+	st->r[15] = key[15] & 0x0f;
+	st->r[16] = 0;
+
+	/* save pad for later */
+	for (i = 0; i < 16; i++)
+		st->pad[i] = key[i + 16];
+	st->pad[16] = 0;
+
+	st->final = 0;
+}
+
+static void poly1305_add(unsigned char h[17], const unsigned char c[17]) {
+	unsigned short u;
+	unsigned int i;
+	for (u = 0, i = 0; i < 17; i++) {
+		u += (unsigned short)h[i] + (unsigned short)c[i];
+		h[i] = (unsigned char)u & 0xff;
+		u >>= 8;
+	}
+}
+
+static void poly1305_squeeze(unsigned char h[17], unsigned long hr[17]) {
+	unsigned long u;
+	unsigned int i;
+	u = 0;
+	for (i = 0; i < 16; i++) {
+		u += hr[i];
+		h[i] = (unsigned char)u & 0xff;
+		u >>= 8;
+	}
+	u += hr[16];
+	h[16] = (unsigned char)u & 0x03;
+	u >>= 2;
+	u += (u << 2); /* u *= 5; */
+	for (i = 0; i < 16; i++) {
+		u += h[i];
+		h[i] = (unsigned char)u & 0xff;
+		u >>= 8;
+	}
+	h[16] += (unsigned char)u;
+}
+
+static void poly1305_freeze(unsigned char h[17]) {
+	const unsigned char minusp[17] = {
+		0x05,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+		0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+		0xfc
+	};
+	unsigned char horig[17], negative;
+	unsigned int i;
+
+	/* compute h + -p */
+	for (i = 0; i < 17; i++)
+		horig[i] = h[i];
+	poly1305_add(h, minusp);
+
+	/* select h if h < p, or h + -p if h >= p */
+	negative = -(h[16] >> 7);
+	for (i = 0; i < 17; i++)
+		h[i] ^= negative & (horig[i] ^ h[i]);
+}
+
+static void poly1305_blocks(poly1305_state_internal_t *st, const unsigned char *m, size_t bytes) {
+	const unsigned char hibit = st->final ^ 1; /* 1 << 128 */
+
+	while (bytes >= poly1305_block_size) {
+		unsigned long hr[17], u;
+		unsigned char c[17];
+		unsigned int i, j;
+
+		/* h += m */
+		for (i = 0; i < 16; i++)
+			c[i] = m[i];
+		c[16] = hibit;
+		poly1305_add(st->h, c);
+
+		/* h *= r */
+		for (i = 0; i < 17; i++) {
+			u = 0;
+			for (j = 0; j <= i ; j++) {
+				u += (unsigned short)st->h[j] * st->r[i - j];
+			}
+			for (j = i + 1; j < 17; j++) {
+				unsigned long v = (unsigned short)st->h[j] * st->r[i + 17 - j];
+				v = ((v << 8) + (v << 6)); /* v *= (5 << 6); */
+				u += v;
+			}
+			hr[i] = u;
+		}
+
+		/* (partial) h %= p */
+		poly1305_squeeze(st->h, hr);
+
+		m += poly1305_block_size;
+		bytes -= poly1305_block_size;
+	}
+}
+
+static POLY1305_NOINLINE void poly1305_finish(poly1305_context *ctx, unsigned char mac[16]) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	size_t i;
+
+	/* process the remaining block */
+	if (st->leftover) {
+		size_t i = st->leftover;
+		st->buffer[i++] = 1;
+		for (; i < poly1305_block_size; i++)
+			st->buffer[i] = 0;
+		st->final = 1;
+		poly1305_blocks(st, st->buffer, poly1305_block_size);
+	}
+
+	/* fully reduce h */
+	poly1305_freeze(st->h);
+
+	/* h = (h + pad) % (1 << 128) */
+	poly1305_add(st->h, st->pad);
+	for (i = 0; i < 16; i++)
+		mac[i] = st->h[i];
+
+	/* zero out the state */
+	for (i = 0; i < 17; i++)
+		st->h[i] = 0;
+	for (i = 0; i < 17; i++)
+		st->r[i] = 0;
+	for (i = 0; i < 17; i++)
+		st->pad[i] = 0;
+}
+/*
+	generic streaming update on top of poly1305_blocks
+
+	this file is included once per variant by poly1305-donna.c, after that
+	variant has been included with its names mapped to a unique suffix
+static */
+
+#ifndef POLY1305_PREFETCH_SEGMENT
+#define POLY1305_PREFETCH_SEGMENT (256)
+#endif
+
+static void poly1305_update(poly1305_context *ctx, const unsigned char *m, size_t bytes) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	size_t i;
+
+	/* the state of every variant compiled in has to fit in front of the backend pointer */
+#if defined(PORTABLE_8439_SMALL)
+	(void)sizeof(char[sizeof(poly1305_context) >= sizeof(poly1305_state_internal_t) ? 1 : -1]);
+#else
+	(void)sizeof(char[offsetof(poly1305_context, backend) >= sizeof(poly1305_state_internal_t) ? 1 : -1]);
+#endif
+
+	/* handle leftover */
+	if (st->leftover) {
+		size_t want = (poly1305_block_size - st->leftover);
+		if (want > bytes)
+			want = bytes;
+		for (i = 0; i < want; i++)
+			st->buffer[st->leftover + i] = m[i];
+		bytes -= want;
+		m += want;
+		st->leftover += want;
+		if (st->leftover < poly1305_block_size)
+			return;
+		poly1305_blocks(st, st->buffer, poly1305_block_size);
+		st->leftover = 0;
+	}
+
+	/* process full blocks */
+	if (bytes >= poly1305_block_size) {
+		size_t want = (bytes & ~(poly1305_block_size - 1));
+#if PORTABLE_PREFETCH_DISTANCE > 0
+		/* in segments, so we can prefetch the input ahead of each of them */
+		for (; want > POLY1305_PREFETCH_SEGMENT; want -= POLY1305_PREFETCH_SEGMENT) {
+			PORTABLE_PREFETCH_AHEAD(m, POLY1305_PREFETCH_SEGMENT, bytes)
+			poly1305_blocks(st, m, POLY1305_PREFETCH_SEGMENT);
+			m += POLY1305_PREFETCH_SEGMENT;
+			bytes -= POLY1305_PREFETCH_SEGMENT;
+		}
+#endif
+		poly1305_blocks(st, m, want);
+		m += want;
+		bytes -= want;
+	}
+
+	/* store leftover */
+	if (bytes) {
+		for (i = 0; i < bytes; i++)
+			st->buffer[st->leftover + i] = m[i];
+		st->leftover += bytes;
+	}
+}
+#undef poly1305_state_internal_t
+#undef poly1305_init
+#undef poly1305_blocks
+#undef poly1305_update
+#undef poly1305_finish
+#undef poly1305_block_size
+#undef POLY1305_NOINLINE
+#endif
+
+#if __WANT_POLY1305(16)
+#define poly1305_state_internal_t poly1305_state_internal_16_t
+#define poly1305_init poly1305_init_16
+#define poly1305_blocks poly1305_blocks_16
+#define poly1305_update poly1305_update_16
+#define poly1305_finish poly1305_finish_16
+/*
+	poly1305 implementation using 16 bit * 16 bit = 32 bit multiplication and 32 bit addition
+static */
+
+#if defined(_MSC_VER)
+	#define POLY1305_NOINLINE __declspec(noinline)
+#elif defined(__GNUC__)
+	#define POLY1305_NOINLINE __attribute__((noinline))
+#else
+	#define POLY1305_NOINLINE
+#endif
+
+#define poly1305_block_size 16
+
+/* 17 + sizeof(size_t) + 18*sizeof(unsigned short) */
+typedef struct poly1305_state_internal_t {
+	unsigned char buffer[poly1305_block_size];
+	size_t leftover;
+	unsigned short r[10];
+	unsigned short h[10];
+	unsigned short pad[8];
+	unsigned char final;
+} poly1305_state_internal_t;
+
+/* interpret two 8 bit unsigned integers as a 16 bit unsigned integer in little endian */
+static unsigned short U8TO16(const unsigned char *p) {
+	return
+		(((unsigned short)(p[0] & 0xff)      ) |
+	     ((unsigned short)(p[1] & 0xff) <<  8));
+}
+
+/* store a 16 bit unsigned integer as two 8 bit unsigned integers in little endian */
+static void U16TO8(unsigned char *p, unsigned short v) {
+	p[0] = (v      ) & 0xff;
+	p[1] = (v >>  8) & 0xff;
+}
+
+static void poly1305_init(poly1305_context *ctx, const unsigned char key[32]) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	unsigned short t0,t1,t2,t3,t4,t5,t6,t7;
+	size_t i;
+
+	/* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
+	t0 = U8TO16(&key[ 0]); st->r[0] = ( t0                    ) & 0x1fff;
+	t1 = U8TO16(&key[ 2]); st->r[1] = ((t0 >> 13) | (t1 <<  3)) & 0x1fff;
+	t2 = U8TO16(&key[ 4]); st->r[2] = ((t1 >> 10) | (t2 <<  6)) & 0x1f03;
+	t3 = U8TO16(&key[ 6]); st->r[3] = ((t2 >>  7) | (t3 <<  9)) & 0x1fff;
+	t4 = U8TO16(&key[ 8]); st->r[4] = ((t3 >>  4) | (t4 << 12)) & 0x00ff;
+	                       st->r[5] = ((t4 >>  1)             ) & 0x1ffe;
+	t5 = U8TO16(&key[10]); st->r[6] = ((t4 >> 14) | (t5 <<  2)) & 0x1fff;
+	t6 = U8TO16(&key[12]); st->r[7] = ((t5 >> 11) | (t6 <<  5)) & 0x1f81;
+	t7 = U8TO16(&key[14]); st->r[8] = ((t6 >>  8) | (t7 <<  8)) & 0x1fff;
+	                       st->r[9] = ((t7 >>  5)             ) & 0x007f;
+
+	/* h = 0 */
+	for (i = 0; i < 10; i++)
+		st->h[i] = 0;
+
+	/* save pad for later */
+	for (i = 0; i < 8; i++)
+		st->pad[i] = U8TO16(&key[16 + (2 * i)]);
+
+	st->leftover = 0;
+	st->final = 0;
+}
+
+static void poly1305_blocks(poly1305_state_internal_t *st, const unsigned char *m, size_t bytes) {
+	const unsigned short hibit = (st->final) ? 0 : (1 << 11); /* 1 << 128 */
+	unsigned short t0,t1,t2,t3,t4,t5,t6,t7;
+	unsigned long d[10];
+	unsigned long c;
+
+	while (bytes >= poly1305_block_size) {
+		size_t i, j;
+
+		/* h += m[i] */
+		t0 = U8TO16(&m[ 0]); st->h[0] += ( t0                    ) & 0x1fff;
+		t1 = U8TO16(&m[ 2]); st->h[1] += ((t0 >> 13) | (t1 <<  3)) & 0x1fff;
+		t2 = U8TO16(&m[ 4]); st->h[2] += ((t1 >> 10) | (t2 <<  6)) & 0x1fff;
+		t3 = U8TO16(&m[ 6]); st->h[3] += ((t2 >>  7) | (t3 <<  9)) & 0x1fff;
+		t4 = U8TO16(&m[ 8]); st->h[4] += ((t3 >>  4) | (t4 << 12)) & 0x1fff;
+		                     st->h[5] += ((t4 >>  1)             ) & 0x1fff;
+		t5 = U8TO16(&m[10]); st->h[6] += ((t4 >> 14) | (t5 <<  2)) & 0x1fff;
+		t6 = U8TO16(&m[12]); st->h[7] += ((t5 >> 11) | (t6 <<  5)) & 0x1fff;
+		t7 = U8TO16(&m[14]); st->h[8] += ((t6 >>  8) | (t7 <<  8)) & 0x1fff;
+		                     st->h[9] += ((t7 >>  5)             ) | hibit;
+
+		/* h *= r, (partial) h %= p */
+		for (i = 0, c = 0; i < 10; i++) {
+			d[i] = c;
+			for (j = 0; j < 10; j++) {
+				d[i] += (unsigned long)st->h[j] * ((j <= i) ? st->r[i - j] : (5 * st->r[i + 10 - j]));
+				/* Sum(h[i] * r[i] * 5) will overflow slightly above 6 products with an unclamped r, so carry at 5 */
+				if (j == 4) {
+					c = (d[i] >> 13);
+					d[i] &= 0x1fff;
+				}
+			}
+			c += (d[i] >> 13);
+			d[i] &= 0x1fff;
+		}
+		c = ((c << 2) + c); /* c *= 5 */
+		c += d[0];
+		d[0] = ((unsigned short)c & 0x1fff);
+		c = (c >> 13);
+		d[1] += c;
+
+		for (i = 0; i < 10; i++)
+			st->h[i] = (unsigned short)d[i];
+
+		m += poly1305_block_size;
+		bytes -= poly1305_block_size;
+	}
+}
+
+static POLY1305_NOINLINE void poly1305_finish(poly1305_context *ctx, unsigned char mac[16]) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	unsigned short c;
+	unsigned short g[10];
+	unsigned short mask;
+	unsigned long f;
+	size_t i;
+
+	/* process the remaining block */
+	if (st->leftover) {
+		size_t i = st->leftover;
+		st->buffer[i++] = 1;
+		for (; i < poly1305_block_size; i++)
+			st->buffer[i] = 0;
+		st->final = 1;
+		poly1305_blocks(st, st->buffer, poly1305_block_size);
+	}
+
+	/* fully carry h */
+	c = st->h[1] >> 13;
+	st->h[1] &= 0x1fff;
+	for (i = 2; i < 10; i++) {
+		st->h[i] += c;
+		c = st->h[i] >> 13;
+		st->h[i] &= 0x1fff;
+	}
+	st->h[0] += (c * 5);
+	c = st->h[0] >> 13;
+	st->h[0] &= 0x1fff;
+	st->h[1] += c;
+	c = st->h[1] >> 13;
+	st->h[1] &= 0x1fff;
+	st->h[2] += c;
+
+	/* compute h + -p */
+	g[0] = st->h[0] + 5;
+	c = g[0] >> 13;
+	g[0] &= 0x1fff;
+	for (i = 1; i < 10; i++) {
+		g[i] = st->h[i] + c;
+		c = g[i] >> 13;
+		g[i] &= 0x1fff;
+	}
+
+	/* select h if h < p, or h + -p if h >= p */
+	mask = (c ^ 1) - 1;
+	for (i = 0; i < 10; i++)
+		g[i] &= mask;
+	mask = ~mask;
+	for (i = 0; i < 10; i++)
+		st->h[i] = (st->h[i] & mask) | g[i];
+
+	/* h = h % (2^128) */
+	st->h[0] = ((st->h[0]      ) | (st->h[1] << 13)                   ) & 0xffff;
+	st->h[1] = ((st->h[1] >>  3) | (st->h[2] << 10)                   ) & 0xffff;
+	st->h[2] = ((st->h[2] >>  6) | (st->h[3] <<  7)                   ) & 0xffff;
+	st->h[3] = ((st->h[3] >>  9) | (st->h[4] <<  4)                   ) & 0xffff;
+	st->h[4] = ((st->h[4] >> 12) | (st->h[5] <<  1) | (st->h[6] << 14)) & 0xffff;
+	st->h[5] = ((st->h[6] >>  2) | (st->h[7] << 11)                   ) & 0xffff;
+	st->h[6] = ((st->h[7] >>  5) | (st->h[8] <<  8)                   ) & 0xffff;
+	st->h[7] = ((st->h[8] >>  8) | (st->h[9] <<  5)                   ) & 0xffff;
+
+	/* mac = (h + pad) % (2^128) */
+	f = (unsigned long)st->h[0] + st->pad[0];
+	st->h[0] = (unsigned short)f;
+	for (i = 1; i < 8; i++) {
+		f = (unsigned long)st->h[i] + st->pad[i] + (f >> 16);
+		st->h[i] = (unsigned short)f;
+	}
+
+	for (i = 0; i < 8; i++)
+		U16TO8(mac + (i * 2), st->h[i]);
+
+	/* zero out the state */
+	for (i = 0; i < 10; i++)
+		st->h[i] = 0;
+	for (i = 0; i < 10; i++)
+		st->r[i] = 0;
+	for (i = 0; i < 8; i++)
+		st->pad[i] = 0;
+}
+/*
+	generic streaming update on top of poly1305_blocks
+
+	this file is included once per variant by poly1305-donna.c, after that
+	variant has been included with its names mapped to a unique suffix
+static */
+
+#ifndef POLY1305_PREFETCH_SEGMENT
+#define POLY1305_PREFETCH_SEGMENT (256)
+#endif
+
+static void poly1305_update(poly1305_context *ctx, const unsigned char *m, size_t bytes) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	size_t i;
+
+	/* the state of every variant compiled in has to fit in front of the backend pointer */
+#if defined(PORTABLE_8439_SMALL)
+	(void)sizeof(char[sizeof(poly1305_context) >= sizeof(poly1305_state_internal_t) ? 1 : -1]);
+#else
+	(void)sizeof(char[offsetof(poly1305_context, backend) >= sizeof(poly1305_state_internal_t) ? 1 : -1]);
+#endif
+
+	/* handle leftover */
+	if (st->leftover) {
+		size_t want = (poly1305_block_size - st->leftover);
+		if (want > bytes)
+			want = bytes;
+		for (i = 0; i < want; i++)
+			st->buffer[st->leftover + i] = m[i];
+		bytes -= want;
+		m += want;
+		st->leftover += want;
+		if (st->leftover < poly1305_block_size)
+			return;
+		poly1305_blocks(st, st->buffer, poly1305_block_size);
+		st->leftover = 0;
+	}
+
+	/* process full blocks */
+	if (bytes >= poly1305_block_size) {
+		size_t want = (bytes & ~(poly1305_block_size - 1));
+#if PORTABLE_PREFETCH_DISTANCE > 0
+		/* in segments, so we can prefetch the input ahead of each of them */
+		for (; want > POLY1305_PREFETCH_SEGMENT; want -= POLY1305_PREFETCH_SEGMENT) {
+			PORTABLE_PREFETCH_AHEAD(m, POLY1305_PREFETCH_SEGMENT, bytes)
+			poly1305_blocks(st, m, POLY1305_PREFETCH_SEGMENT);
+			m += POLY1305_PREFETCH_SEGMENT;
+			bytes -= POLY1305_PREFETCH_SEGMENT;
+		}
+#endif
+		poly1305_blocks(st, m, want);
+		m += want;
+		bytes -= want;
+	}
+
+	/* store leftover */
+	if (bytes) {
+		for (i = 0; i < bytes; i++)
+			st->buffer[st->leftover + i] = m[i];
+		st->leftover += bytes;
+	}
+}
+#undef poly1305_state_internal_t
+#undef poly1305_init
+#undef poly1305_blocks
+#undef poly1305_update
+#undef poly1305_finish
+#undef poly1305_block_size
+#undef POLY1305_NOINLINE
+#endif
+
+#if __WANT_POLY1305(32) || __WANT_POLY1305(322)
+/*
+	little endian word loads & stores shared by poly1305-donna-32.h and
+	poly1305-donna-32x2.h, included once before either of them
+static */
+
+/* interpret four 8 bit unsigned integers as a 32 bit unsigned integer in little endian */
+static unsigned long U8TO32(const unsigned char *p) {
+#if defined(PORTABLE_UNALIGNED_WORDS)
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return PORTABLE_LE32(v);
+#else
+	return
+		(((unsigned long)(p[0] & 0xff)      ) |
+	     ((unsigned long)(p[1] & 0xff) <<  8) |
+         ((unsigned long)(p[2] & 0xff) << 16) |
+         ((unsigned long)(p[3] & 0xff) << 24));
+#endif
+}
+
+/* store a 32 bit unsigned integer as four 8 bit unsigned integers in little endian */
+static void U32TO8(unsigned char *p, unsigned long v) {
+#if defined(PORTABLE_UNALIGNED_WORDS)
+	uint32_t w = PORTABLE_LE32((uint32_t)v);
+	memcpy(p, &w, sizeof(w));
+#else
+	p[0] = (v      ) & 0xff;
+	p[1] = (v >>  8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+#endif
+}
+#endif
+
+#if __WANT_POLY1305(32)
+#define poly1305_state_internal_t poly1305_state_internal_32_t
+#define poly1305_init poly1305_init_32
+#define poly1305_blocks poly1305_blocks_32
+#define poly1305_update poly1305_update_32
+#define poly1305_finish poly1305_finish_32
+/*
+	poly1305 implementation using 32 bit * 32 bit = 64 bit multiplication and 64 bit addition
+static */
+
+#if defined(_MSC_VER)
+	#define POLY1305_NOINLINE __declspec(noinline)
+#elif defined(__GNUC__)
+	#define POLY1305_NOINLINE __attribute__((noinline))
+#else
+	#define POLY1305_NOINLINE
+#endif
+
+#define poly1305_block_size 16
+
+/* 17 + sizeof(size_t) + 14*sizeof(unsigned long) */
+typedef struct poly1305_state_internal_t {
+	unsigned long r[5];
+	unsigned long h[5];
+	unsigned long pad[4];
+	size_t leftover;
+	unsigned char buffer[poly1305_block_size];
+	unsigned char final;
+} poly1305_state_internal_t;
+
+static void poly1305_init(poly1305_context *ctx, const unsigned char key[32]) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+
+	/* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
+	st->r[0] = (U8TO32(&key[ 0])     ) & 0x3ffffff;
+	st->r[1] = (U8TO32(&key[ 3]) >> 2) & 0x3ffff03;
+	st->r[2] = (U8TO32(&key[ 6]) >> 4) & 0x3ffc0ff;
+	st->r[3] = (U8TO32(&key[ 9]) >> 6) & 0x3f03fff;
+	st->r[4] = (U8TO32(&key[12]) >> 8) & 0x00fffff;
+
+	/* h = 0 */
+	st->h[0] = 0;
+	st->h[1] = 0;
+	st->h[2] = 0;
+	st->h[3] = 0;
+	st->h[4] = 0;
+
+	/* save pad for later */
+	st->pad[0] = U8TO32(&key[16]);
+	st->pad[1] = U8TO32(&key[20]);
+	st->pad[2] = U8TO32(&key[24]);
+	st->pad[3] = U8TO32(&key[28]);
+
+	st->leftover = 0;
+	st->final = 0;
+}
+
+static void poly1305_blocks(poly1305_state_internal_t *st, const unsigned char *m, size_t bytes) {
+	const unsigned long hibit = (st->final) ? 0 : (1UL << 24); /* 1 << 128 */
+	unsigned long r0,r1,r2,r3,r4;
+	unsigned long s1,s2,s3,s4;
+	unsigned long h0,h1,h2,h3,h4;
+	unsigned long long d0,d1,d2,d3,d4;
+	unsigned long c;
+
+	r0 = st->r[0];
+	r1 = st->r[1];
+	r2 = st->r[2];
+	r3 = st->r[3];
+	r4 = st->r[4];
+
+	s1 = r1 * 5;
+	s2 = r2 * 5;
+	s3 = r3 * 5;
+	s4 = r4 * 5;
+
+	h0 = st->h[0];
+	h1 = st->h[1];
+	h2 = st->h[2];
+	h3 = st->h[3];
+	h4 = st->h[4];
+
+	while (bytes >= poly1305_block_size) {
+		/* h += m[i] */
+		h0 += (U8TO32(m+ 0)     ) & 0x3ffffff;
+		h1 += (U8TO32(m+ 3) >> 2) & 0x3ffffff;
+		h2 += (U8TO32(m+ 6) >> 4) & 0x3ffffff;
+		h3 += (U8TO32(m+ 9) >> 6) & 0x3ffffff;
+		h4 += (U8TO32(m+12) >> 8) | hibit;
+
+		/* h *= r */
+		d0 = ((unsigned long long)h0 * r0) + ((unsigned long long)h1 * s4) + ((unsigned long long)h2 * s3) + ((unsigned long long)h3 * s2) + ((unsigned long long)h4 * s1);
+		d1 = ((unsigned long long)h0 * r1) + ((unsigned long long)h1 * r0) + ((unsigned long long)h2 * s4) + ((unsigned long long)h3 * s3) + ((unsigned long long)h4 * s2);
+		d2 = ((unsigned long long)h0 * r2) + ((unsigned long long)h1 * r1) + ((unsigned long long)h2 * r0) + ((unsigned long long)h3 * s4) + ((unsigned long long)h4 * s3);
+		d3 = ((unsigned long long)h0 * r3) + ((unsigned long long)h1 * r2) + ((unsigned long long)h2 * r1) + ((unsigned long long)h3 * r0) + ((unsigned long long)h4 * s4);
+		d4 = ((unsigned long long)h0 * r4) + ((unsigned long long)h1 * r3) + ((unsigned long long)h2 * r2) + ((unsigned long long)h3 * r1) + ((unsigned long long)h4 * r0);
+
+		/* (partial) h %= p */
+		              c = (unsigned long)(d0 >> 26); h0 = (unsigned long)d0 & 0x3ffffff;
+		d1 += c;      c = (unsigned long)(d1 >> 26); h1 = (unsigned long)d1 & 0x3ffffff;
+		d2 += c;      c = (unsigned long)(d2 >> 26); h2 = (unsigned long)d2 & 0x3ffffff;
+		d3 += c;      c = (unsigned long)(d3 >> 26); h3 = (unsigned long)d3 & 0x3ffffff;
+		d4 += c;      c = (unsigned long)(d4 >> 26); h4 = (unsigned long)d4 & 0x3ffffff;
+		h0 += c * 5;  c =                (h0 >> 26); h0 =                h0 & 0x3ffffff;
+		h1 += c;
+
+		m += poly1305_block_size;
+		bytes -= poly1305_block_size;
+	}
+
+	st->h[0] = h0;
+	st->h[1] = h1;
+	st->h[2] = h2;
+	st->h[3] = h3;
+	st->h[4] = h4;
+}
+
+static POLY1305_NOINLINE void poly1305_finish(poly1305_context *ctx, unsigned char mac[16]) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	unsigned long h0,h1,h2,h3,h4,c;
+	unsigned long g0,g1,g2,g3,g4;
+	unsigned long long f;
+	unsigned long mask;
+
+	/* process the remaining block */
+	if (st->leftover) {
+		size_t i = st->leftover;
+		st->buffer[i++] = 1;
+		for (; i < poly1305_block_size; i++)
+			st->buffer[i] = 0;
+		st->final = 1;
+		poly1305_blocks(st, st->buffer, poly1305_block_size);
+	}
+
+	/* fully carry h */
+	h0 = st->h[0];
+	h1 = st->h[1];
+	h2 = st->h[2];
+	h3 = st->h[3];
+	h4 = st->h[4];
+
+	             c = h1 >> 26; h1 = h1 & 0x3ffffff;
+	h2 +=     c; c = h2 >> 26; h2 = h2 & 0x3ffffff;
+	h3 +=     c; c = h3 >> 26; h3 = h3 & 0x3ffffff;
+	h4 +=     c; c = h4 >> 26; h4 = h4 & 0x3ffffff;
+	h0 += c * 5; c = h0 >> 26; h0 = h0 & 0x3ffffff;
+	h1 +=     c;
+
+	/* compute h + -p */
+	g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+	g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+	g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+	g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+	g4 = h4 + c - (1UL << 26);
+
+	/* select h if h < p, or h + -p if h >= p */
+	mask = (g4 >> ((sizeof(unsigned long) * 8) - 1)) - 1;
+	g0 &= mask;
+	g1 &= mask;
+	g2 &= mask;
+	g3 &= mask;
+	g4 &= mask;
+	mask = ~mask;
+	h0 = (h0 & mask) | g0;
+	h1 = (h1 & mask) | g1;
+	h2 = (h2 & mask) | g2;
+	h3 = (h3 & mask) | g3;
+	h4 = (h4 & mask) | g4;
+
+	/* h = h % (2^128) */
+	h0 = ((h0      ) | (h1 << 26)) & 0xffffffff;
+	h1 = ((h1 >>  6) | (h2 << 20)) & 0xffffffff;
+	h2 = ((h2 >> 12) | (h3 << 14)) & 0xffffffff;
+	h3 = ((h3 >> 18) | (h4 <<  8)) & 0xffffffff;
+
+	/* mac = (h + pad) % (2^128) */
+	f = (unsigned long long)h0 + st->pad[0]            ; h0 = (unsigned long)f;
+	f = (unsigned long long)h1 + st->pad[1] + (f >> 32); h1 = (unsigned long)f;
+	f = (unsigned long long)h2 + st->pad[2] + (f >> 32); h2 = (unsigned long)f;
+	f = (unsigned long long)h3 + st->pad[3] + (f >> 32); h3 = (unsigned long)f;
+
+	U32TO8(mac +  0, h0);
+	U32TO8(mac +  4, h1);
+	U32TO8(mac +  8, h2);
+	U32TO8(mac + 12, h3);
+
+	/* zero out the state */
+	st->h[0] = 0;
+	st->h[1] = 0;
+	st->h[2] = 0;
+	st->h[3] = 0;
+	st->h[4] = 0;
+	st->r[0] = 0;
+	st->r[1] = 0;
+	st->r[2] = 0;
+	st->r[3] = 0;
+	st->r[4] = 0;
+	st->pad[0] = 0;
+	st->pad[1] = 0;
+	st->pad[2] = 0;
+	st->pad[3] = 0;
+}
+
+/*
+	generic streaming update on top of poly1305_blocks
+
+	this file is included once per variant by poly1305-donna.c, after that
+	variant has been included with its names mapped to a unique suffix
+static */
+
+#ifndef POLY1305_PREFETCH_SEGMENT
+#define POLY1305_PREFETCH_SEGMENT (256)
+#endif
+
+static void poly1305_update(poly1305_context *ctx, const unsigned char *m, size_t bytes) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	size_t i;
+
+	/* the state of every variant compiled in has to fit in front of the backend pointer */
+#if defined(PORTABLE_8439_SMALL)
+	(void)sizeof(char[sizeof(poly1305_context) >= sizeof(poly1305_state_internal_t) ? 1 : -1]);
+#else
+	(void)sizeof(char[offsetof(poly1305_context, backend) >= sizeof(poly1305_state_internal_t) ? 1 : -1]);
+#endif
+
+	/* handle leftover */
+	if (st->leftover) {
+		size_t want = (poly1305_block_size - st->leftover);
+		if (want > bytes)
+			want = bytes;
+		for (i = 0; i < want; i++)
+			st->buffer[st->leftover + i] = m[i];
+		bytes -= want;
+		m += want;
+		st->leftover += want;
+		if (st->leftover < poly1305_block_size)
+			return;
+		poly1305_blocks(st, st->buffer, poly1305_block_size);
+		st->leftover = 0;
+	}
+
+	/* process full blocks */
+	if (bytes >= poly1305_block_size) {
+		size_t want = (bytes & ~(poly1305_block_size - 1));
+#if PORTABLE_PREFETCH_DISTANCE > 0
+		/* in segments, so we can prefetch the input ahead of each of them */
+		for (; want > POLY1305_PREFETCH_SEGMENT; want -= POLY1305_PREFETCH_SEGMENT) {
+			PORTABLE_PREFETCH_AHEAD(m, POLY1305_PREFETCH_SEGMENT, bytes)
+			poly1305_blocks(st, m, POLY1305_PREFETCH_SEGMENT);
+			m += POLY1305_PREFETCH_SEGMENT;
+			bytes -= POLY1305_PREFETCH_SEGMENT;
+		}
+#endif
+		poly1305_blocks(st, m, want);
+		m += want;
+		bytes -= want;
+	}
+
+	/* store leftover */
+	if (bytes) {
+		for (i = 0; i < bytes; i++)
+			st->buffer[st->leftover + i] = m[i];
+		st->leftover += bytes;
+	}
+}
+#undef poly1305_state_internal_t
+#undef poly1305_init
+#undef poly1305_blocks
+#undef poly1305_update
+#undef poly1305_finish
+#undef poly1305_block_size
+#undef POLY1305_NOINLINE
+#endif
+
+#if __WANT_POLY1305(322)
+#define poly1305_state_internal_t poly1305_state_internal_32x2_t
+#define poly1305_init poly1305_init_32x2
+#define poly1305_blocks poly1305_blocks_32x2
+#define poly1305_update poly1305_update_32x2
+#define poly1305_finish poly1305_finish_32x2
+/*
+	poly1305 implementation using 32 bit * 32 bit = 64 bit multiplication and 64 bit addition,
+	processing two blocks per iteration
+
+	donna-32 runs the full carry chain after every block, and every block
+	needs the reduced h of the previous one. Here we use r^2:
+
+		h = (h + m0) * r^2 + m1 * r
+
+	the products of m1 don't depend on h, so they overlap with the chain,
+	and the carries only run once per two blocks. Two blocks keep the
+	register pressure low enough for the 32 bit targets this is meant for.
+	A leftover block is handled with just r.
+
+	it only pays off where the carry chain is the limit (in-order cores with
+	pipelined multiply-accumulate), on x86 donna-32 is bound by the
+	multiplications and both are as fast. So it's not the default, select
+	it with POLY1305_32X2 or at runtime after measuring (make bench-32).
+
+	the limbs are stored as uint32_t, so the state has the same (small) size
+	on 64 bit targets. The sums of the two products reach 2^58, so the
+	carries are kept in 64 bits.
+
+	U8TO32/U32TO8 come from poly1305-donna-32-words.h, which has to be
+	included before this one.
+static */
+
+#if defined(_MSC_VER)
+	#define POLY1305_NOINLINE __declspec(noinline)
+#elif defined(__GNUC__)
+	#define POLY1305_NOINLINE __attribute__((noinline))
+#else
+	#define POLY1305_NOINLINE
+#endif
+
+#define poly1305_block_size 16
+
+#ifndef POLY1305_POWERS_MIN_BYTES
+#define POLY1305_POWERS_MIN_BYTES (8 * poly1305_block_size)
+#endif
+
+/* 18 + sizeof(size_t) + 19*sizeof(uint32_t) */
+typedef struct poly1305_state_internal_t {
+	uint32_t r[5];
+	uint32_t h[5];
+	uint32_t pad[4];
+	uint32_t r2[5];
+	size_t leftover;
+	unsigned char buffer[poly1305_block_size];
+	unsigned char final;
+	unsigned char powers;
+} poly1305_state_internal_t;
+
+typedef unsigned long long poly1305_wide_t;
+
+/* d = a * b, with sb = b * 5 to fold the top back in */
+#define POLY1305_MUL5(d, a, b, sb) \
+	d##0 = ((poly1305_wide_t)a##0 * b##0) + ((poly1305_wide_t)a##1 * sb##4) + ((poly1305_wide_t)a##2 * sb##3) + ((poly1305_wide_t)a##3 * sb##2) + ((poly1305_wide_t)a##4 * sb##1); \
+	d##1 = ((poly1305_wide_t)a##0 * b##1) + ((poly1305_wide_t)a##1 * b##0) + ((poly1305_wide_t)a##2 * sb##4) + ((poly1305_wide_t)a##3 * sb##3) + ((poly1305_wide_t)a##4 * sb##2); \
+	d##2 = ((poly1305_wide_t)a##0 * b##2) + ((poly1305_wide_t)a##1 * b##1) + ((poly1305_wide_t)a##2 * b##0) + ((poly1305_wide_t)a##3 * sb##4) + ((poly1305_wide_t)a##4 * sb##3); \
+	d##3 = ((poly1305_wide_t)a##0 * b##3) + ((poly1305_wide_t)a##1 * b##2) + ((poly1305_wide_t)a##2 * b##1) + ((poly1305_wide_t)a##3 * b##0) + ((poly1305_wide_t)a##4 * sb##4); \
+	d##4 = ((poly1305_wide_t)a##0 * b##4) + ((poly1305_wide_t)a##1 * b##3) + ((poly1305_wide_t)a##2 * b##2) + ((poly1305_wide_t)a##3 * b##1) + ((poly1305_wide_t)a##4 * b##0);
+
+/* d += a * b */
+#define POLY1305_MUL5_ADD(d, a, b, sb) \
+	d##0 += ((poly1305_wide_t)a##0 * b##0) + ((poly1305_wide_t)a##1 * sb##4) + ((poly1305_wide_t)a##2 * sb##3) + ((poly1305_wide_t)a##3 * sb##2) + ((poly1305_wide_t)a##4 * sb##1); \
+	d##1 += ((poly1305_wide_t)a##0 * b##1) + ((poly1305_wide_t)a##1 * b##0) + ((poly1305_wide_t)a##2 * sb##4) + ((poly1305_wide_t)a##3 * sb##3) + ((poly1305_wide_t)a##4 * sb##2); \
+	d##2 += ((poly1305_wide_t)a##0 * b##2) + ((poly1305_wide_t)a##1 * b##1) + ((poly1305_wide_t)a##2 * b##0) + ((poly1305_wide_t)a##3 * sb##4) + ((poly1305_wide_t)a##4 * sb##3); \
+	d##3 += ((poly1305_wide_t)a##0 * b##3) + ((poly1305_wide_t)a##1 * b##2) + ((poly1305_wide_t)a##2 * b##1) + ((poly1305_wide_t)a##3 * b##0) + ((poly1305_wide_t)a##4 * sb##4); \
+	d##4 += ((poly1305_wide_t)a##0 * b##4) + ((poly1305_wide_t)a##1 * b##3) + ((poly1305_wide_t)a##2 * b##2) + ((poly1305_wide_t)a##3 * b##1) + ((poly1305_wide_t)a##4 * b##0);
+
+/* split a 16 byte block into 26 bit limbs */
+#define POLY1305_LOAD5(x, p) \
+	x##0 = (uint32_t)((U8TO32((p)+ 0)     ) & 0x3ffffff); \
+	x##1 = (uint32_t)((U8TO32((p)+ 3) >> 2) & 0x3ffffff); \
+	x##2 = (uint32_t)((U8TO32((p)+ 6) >> 4) & 0x3ffffff); \
+	x##3 = (uint32_t)((U8TO32((p)+ 9) >> 6) & 0x3ffffff); \
+	x##4 = (uint32_t)((U8TO32((p)+12) >> 8) | hibit);
+
+/* (partial) h = d % p */
+#define POLY1305_REDUCE5(h, d) \
+	              c = (d##0 >> 26); h##0 = (uint32_t)d##0 & 0x3ffffff; \
+	d##1 += c;    c = (d##1 >> 26); h##1 = (uint32_t)d##1 & 0x3ffffff; \
+	d##2 += c;    c = (d##2 >> 26); h##2 = (uint32_t)d##2 & 0x3ffffff; \
+	d##3 += c;    c = (d##3 >> 26); h##3 = (uint32_t)d##3 & 0x3ffffff; \
+	d##4 += c;    c = (d##4 >> 26); h##4 = (uint32_t)d##4 & 0x3ffffff; \
+	c = h##0 + c * 5;               h##0 = (uint32_t)c   & 0x3ffffff; \
+	h##1 += (uint32_t)(c >> 26);
+
+static void poly1305_init(poly1305_context *ctx, const unsigned char key[32]) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+
+	/* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
+	st->r[0] = (uint32_t)((U8TO32(&key[ 0])     ) & 0x3ffffff);
+	st->r[1] = (uint32_t)((U8TO32(&key[ 3]) >> 2) & 0x3ffff03);
+	st->r[2] = (uint32_t)((U8TO32(&key[ 6]) >> 4) & 0x3ffc0ff);
+	st->r[3] = (uint32_t)((U8TO32(&key[ 9]) >> 6) & 0x3f03fff);
+	st->r[4] = (uint32_t)((U8TO32(&key[12]) >> 8) & 0x00fffff);
+
+	/* h = 0 */
+	st->h[0] = 0;
+	st->h[1] = 0;
+	st->h[2] = 0;
+	st->h[3] = 0;
+	st->h[4] = 0;
+
+	/* save pad for later */
+	st->pad[0] = (uint32_t)U8TO32(&key[16]);
+	st->pad[1] = (uint32_t)U8TO32(&key[20]);
+	st->pad[2] = (uint32_t)U8TO32(&key[24]);
+	st->pad[3] = (uint32_t)U8TO32(&key[28]);
+
+	st->leftover = 0;
+	st->final = 0;
+	st->powers = 0;
+}
+
+static void poly1305_blocks(poly1305_state_internal_t *st, const unsigned char *m, size_t bytes) {
+	const uint32_t hibit = (st->final) ? 0 : (1UL << 24); /* 1 << 128 */
+	uint32_t r0,r1,r2,r3,r4;
+	uint32_t s1,s2,s3,s4;
+	uint32_t h0,h1,h2,h3,h4;
+	poly1305_wide_t d0,d1,d2,d3,d4,c;
+
+	r0 = st->r[0];
+	r1 = st->r[1];
+	r2 = st->r[2];
+	r3 = st->r[3];
+	r4 = st->r[4];
+
+	s1 = r1 * 5;
+	s2 = r2 * 5;
+	s3 = r3 * 5;
+	s4 = r4 * 5;
+
+	/* r^2 costs a multiplication, short messages stay on the serial loop */
+	if (!st->powers && bytes >= POLY1305_POWERS_MIN_BYTES) {
+		uint32_t t0,t1,t2,t3,t4;
+
+		POLY1305_MUL5(d, r, r, s)
+		POLY1305_REDUCE5(t, d)
+		st->r2[0] = t0;
+		st->r2[1] = t1;
+		st->r2[2] = t2;
+		st->r2[3] = t3;
+		st->r2[4] = t4;
+		st->powers = 1;
+	}
+
+	h0 = st->h[0];
+	h1 = st->h[1];
+	h2 = st->h[2];
+	h3 = st->h[3];
+	h4 = st->h[4];
+
+	if (st->powers && bytes >= 2 * poly1305_block_size) {
+		const uint32_t u0 = st->r2[0], u1 = st->r2[1], u2 = st->r2[2], u3 = st->r2[3], u4 = st->r2[4];
+		const uint32_t su1 = u1 * 5, su2 = u2 * 5, su3 = u3 * 5, su4 = u4 * 5;
+
+		do {
+			uint32_t a0,a1,a2,a3,a4,b0,b1,b2,b3,b4;
+
+			POLY1305_LOAD5(a, m)
+			POLY1305_LOAD5(b, m + 16)
+
+			a0 += h0;
+			a1 += h1;
+			a2 += h2;
+			a3 += h3;
+			a4 += h4;
+
+			/* h = (h + m0) * r^2 + m1 * r */
+			POLY1305_MUL5(d, b, r, s)
+			POLY1305_MUL5_ADD(d, a, u, su)
+
+			POLY1305_REDUCE5(h, d)
+
+			m += 2 * poly1305_block_size;
+			bytes -= 2 * poly1305_block_size;
+		} while (bytes >= 2 * poly1305_block_size);
+	}
+
+	while (bytes >= poly1305_block_size) {
+		uint32_t a0,a1,a2,a3,a4;
+
+		/* h += m[i] */
+		POLY1305_LOAD5(a, m)
+		a0 += h0;
+		a1 += h1;
+		a2 += h2;
+		a3 += h3;
+		a4 += h4;
+
+		/* h *= r */
+		POLY1305_MUL5(d, a, r, s)
+		POLY1305_REDUCE5(h, d)
+
+		m += poly1305_block_size;
+		bytes -= poly1305_block_size;
+	}
+
+	st->h[0] = h0;
+	st->h[1] = h1;
+	st->h[2] = h2;
+	st->h[3] = h3;
+	st->h[4] = h4;
+}
+
+static POLY1305_NOINLINE void poly1305_finish(poly1305_context *ctx, unsigned char mac[16]) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	uint32_t h0,h1,h2,h3,h4,c;
+	uint32_t g0,g1,g2,g3,g4;
+	poly1305_wide_t f;
+	uint32_t mask;
+	size_t i;
+
+	/* process the remaining block */
+	if (st->leftover) {
+		i = st->leftover;
+		st->buffer[i++] = 1;
+		for (; i < poly1305_block_size; i++)
+			st->buffer[i] = 0;
+		st->final = 1;
+		poly1305_blocks(st, st->buffer, poly1305_block_size);
+	}
+
+	/* fully carry h */
+	h0 = st->h[0];
+	h1 = st->h[1];
+	h2 = st->h[2];
+	h3 = st->h[3];
+	h4 = st->h[4];
+
+	             c = h1 >> 26; h1 = h1 & 0x3ffffff;
+	h2 +=     c; c = h2 >> 26; h2 = h2 & 0x3ffffff;
+	h3 +=     c; c = h3 >> 26; h3 = h3 & 0x3ffffff;
+	h4 +=     c; c = h4 >> 26; h4 = h4 & 0x3ffffff;
+	h0 += c * 5; c = h0 >> 26; h0 = h0 & 0x3ffffff;
+	h1 +=     c;
+
+	/* compute h + -p */
+	g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+	g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+	g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+	g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+	g4 = h4 + c - (1UL << 26);
+
+	/* select h if h < p, or h + -p if h >= p */
+	mask = (g4 >> 31) - 1;
+	g0 &= mask;
+	g1 &= mask;
+	g2 &= mask;
+	g3 &= mask;
+	g4 &= mask;
+	mask = ~mask;
+	h0 = (h0 & mask) | g0;
+	h1 = (h1 & mask) | g1;
+	h2 = (h2 & mask) | g2;
+	h3 = (h3 & mask) | g3;
+	h4 = (h4 & mask) | g4;
+
+	/* h = h % (2^128) */
+	h0 = ((h0      ) | (h1 << 26));
+	h1 = ((h1 >>  6) | (h2 << 20));
+	h2 = ((h2 >> 12) | (h3 << 14));
+	h3 = ((h3 >> 18) | (h4 <<  8));
+
+	/* mac = (h + pad) % (2^128) */
+	f = (poly1305_wide_t)h0 + st->pad[0]            ; h0 = (uint32_t)f;
+	f = (poly1305_wide_t)h1 + st->pad[1] + (f >> 32); h1 = (uint32_t)f;
+	f = (poly1305_wide_t)h2 + st->pad[2] + (f >> 32); h2 = (uint32_t)f;
+	f = (poly1305_wide_t)h3 + st->pad[3] + (f >> 32); h3 = (uint32_t)f;
+
+	U32TO8(mac +  0, h0);
+	U32TO8(mac +  4, h1);
+	U32TO8(mac +  8, h2);
+	U32TO8(mac + 12, h3);
+
+	/* zero out the state */
+	for (i = 0; i < 5; i++) {
+		st->h[i] = 0;
+		st->r[i] = 0;
+		st->r2[i] = 0;
+	}
+	for (i = 0; i < 4; i++)
+		st->pad[i] = 0;
+}
+/*
+	generic streaming update on top of poly1305_blocks
+
+	this file is included once per variant by poly1305-donna.c, after that
+	variant has been included with its names mapped to a unique suffix
+static */
+
+#ifndef POLY1305_PREFETCH_SEGMENT
+#define POLY1305_PREFETCH_SEGMENT (256)
+#endif
+
+static void poly1305_update(poly1305_context *ctx, const unsigned char *m, size_t bytes) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	size_t i;
+
+	/* the state of every variant compiled in has to fit in front of the backend pointer */
+#if defined(PORTABLE_8439_SMALL)
+	(void)sizeof(char[sizeof(poly1305_context) >= sizeof(poly1305_state_internal_t) ? 1 : -1]);
+#else
+	(void)sizeof(char[offsetof(poly1305_context, backend) >= sizeof(poly1305_state_internal_t) ? 1 : -1]);
+#endif
+
+	/* handle leftover */
+	if (st->leftover) {
+		size_t want = (poly1305_block_size - st->leftover);
+		if (want > bytes)
+			want = bytes;
+		for (i = 0; i < want; i++)
+			st->buffer[st->leftover + i] = m[i];
+		bytes -= want;
+		m += want;
+		st->leftover += want;
+		if (st->leftover < poly1305_block_size)
+			return;
+		poly1305_blocks(st, st->buffer, poly1305_block_size);
+		st->leftover = 0;
+	}
+
+	/* process full blocks */
+	if (bytes >= poly1305_block_size) {
+		size_t want = (bytes & ~(poly1305_block_size - 1));
+#if PORTABLE_PREFETCH_DISTANCE > 0
+		/* in segments, so we can prefetch the input ahead of each of them */
+		for (; want > POLY1305_PREFETCH_SEGMENT; want -= POLY1305_PREFETCH_SEGMENT) {
+			PORTABLE_PREFETCH_AHEAD(m, POLY1305_PREFETCH_SEGMENT, bytes)
+			poly1305_blocks(st, m, POLY1305_PREFETCH_SEGMENT);
+			m += POLY1305_PREFETCH_SEGMENT;
+			bytes -= POLY1305_PREFETCH_SEGMENT;
+		}
+#endif
+		poly1305_blocks(st, m, want);
+		m += want;
+		bytes -= want;
+	}
+
+	/* store leftover */
+	if (bytes) {
+		for (i = 0; i < bytes; i++)
+			st->buffer[st->leftover + i] = m[i];
+		st->leftover += bytes;
+	}
+}
+#undef poly1305_state_internal_t
+#undef poly1305_init
+#undef poly1305_blocks
+#undef poly1305_update
+#undef poly1305_finish
+#undef poly1305_block_size
+#undef POLY1305_NOINLINE
+#endif
+
+#if defined(__HAVE_POLY1305_64) && __WANT_POLY1305(64)
+#define poly1305_state_internal_t poly1305_state_internal_64_t
+#define poly1305_init poly1305_init_64
+#define poly1305_blocks poly1305_blocks_64
+#define poly1305_update poly1305_update_64
+#define poly1305_finish poly1305_finish_64
+/*
+	poly1305 implementation using 64 bit * 64 bit = 128 bit multiplication and 128 bit addition
+static */
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+
+	typedef struct uint128_t {
+		unsigned long long lo;
+		unsigned long long hi;
+	} uint128_t;
+
+	#define MUL(out, x, y) out.lo = _umul128((x), (y), &out.hi)
+	#define ADD(out, in) { unsigned long long t = out.lo; out.lo += in.lo; out.hi += (out.lo < t) + in.hi; }
+	#define ADDLO(out, in) { unsigned long long t = out.lo; out.lo += in; out.hi += (out.lo < t); }
+	#define SHR(in, shift) (__shiftright128(in.lo, in.hi, (shift)))
+	#define LO(in) (in.lo)
+
+	#define POLY1305_NOINLINE __declspec(noinline)
+#elif defined(__GNUC__)
+	#if defined(__SIZEOF_INT128__)
+		typedef unsigned __int128 uint128_t;
+	#else
+		typedef unsigned uint128_t __attribute__((mode(TI)));
+	#endif
+
+	#define MUL(out, x, y) out = ((uint128_t)x * y)
+	#define ADD(out, in) out += in
+	#define ADDLO(out, in) out += in
+	#define SHR(in, shift) (unsigned long long)(in >> (shift))
+	#define LO(in) (unsigned long long)(in)
+
+	#define POLY1305_NOINLINE __attribute__((noinline))
+#endif
+
+#define poly1305_block_size 16
+
+/* 17 + sizeof(size_t) + 8*sizeof(unsigned long long) */
+typedef struct poly1305_state_internal_t {
+	unsigned long long r[3];
+	unsigned long long h[3];
+	unsigned long long pad[2];
+	size_t leftover;
+	unsigned char buffer[poly1305_block_size];
+	unsigned char final;
+} poly1305_state_internal_t;
+
+/* interpret eight 8 bit unsigned integers as a 64 bit unsigned integer in little endian */
+static unsigned long long U8TO64(const unsigned char *p) {
+#if defined(PORTABLE_UNALIGNED_WORDS)
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return PORTABLE_LE64(v);
+#else
+	return
+		(((unsigned long long)(p[0] & 0xff)      ) |
+		 ((unsigned long long)(p[1] & 0xff) <<  8) |
+		 ((unsigned long long)(p[2] & 0xff) << 16) |
+		 ((unsigned long long)(p[3] & 0xff) << 24) |
+		 ((unsigned long long)(p[4] & 0xff) << 32) |
+		 ((unsigned long long)(p[5] & 0xff) << 40) |
+		 ((unsigned long long)(p[6] & 0xff) << 48) |
+		 ((unsigned long long)(p[7] & 0xff) << 56));
+#endif
+}
+
+/* store a 64 bit unsigned integer as eight 8 bit unsigned integers in little endian */
+static void U64TO8(unsigned char *p, unsigned long long v) {
+#if defined(PORTABLE_UNALIGNED_WORDS)
+	uint64_t w = PORTABLE_LE64((uint64_t)v);
+	memcpy(p, &w, sizeof(w));
+#else
+	p[0] = (v      ) & 0xff;
+	p[1] = (v >>  8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+	p[4] = (v >> 32) & 0xff;
+	p[5] = (v >> 40) & 0xff;
+	p[6] = (v >> 48) & 0xff;
+	p[7] = (v >> 56) & 0xff;
+#endif
+}
+
+static void poly1305_init(poly1305_context *ctx, const unsigned char key[32]) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	unsigned long long t0,t1;
+
+	/* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
+	t0 = U8TO64(&key[0]);
+	t1 = U8TO64(&key[8]);
+
+	st->r[0] = ( t0                    ) & 0xffc0fffffff;
+	st->r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffff;
+	st->r[2] = ((t1 >> 24)             ) & 0x00ffffffc0f;
+
+	/* h = 0 */
+	st->h[0] = 0;
+	st->h[1] = 0;
+	st->h[2] = 0;
+
+	/* save pad for later */
+	st->pad[0] = U8TO64(&key[16]);
+	st->pad[1] = U8TO64(&key[24]);
+
+	st->leftover = 0;
+	st->final = 0;
+}
+
+static void poly1305_blocks(poly1305_state_internal_t *st, const unsigned char *m, size_t bytes) {
+	const unsigned long long hibit = (st->final) ? 0 : ((unsigned long long)1 << 40); /* 1 << 128 */
+	unsigned long long r0,r1,r2;
+	unsigned long long s1,s2;
+	unsigned long long h0,h1,h2;
+	unsigned long long c;
+	uint128_t d0,d1,d2,d;
+
+	r0 = st->r[0];
+	r1 = st->r[1];
+	r2 = st->r[2];
+
+	h0 = st->h[0];
+	h1 = st->h[1];
+	h2 = st->h[2];
+
+	s1 = r1 * (5 << 2);
+	s2 = r2 * (5 << 2);
+
+	while (bytes >= poly1305_block_size) {
+		unsigned long long t0,t1;
+
+		/* h += m[i] */
+		t0 = U8TO64(&m[0]);
+		t1 = U8TO64(&m[8]);
+
+		h0 += (( t0                    ) & 0xfffffffffff);
+		h1 += (((t0 >> 44) | (t1 << 20)) & 0xfffffffffff);
+		h2 += (((t1 >> 24)             ) & 0x3ffffffffff) | hibit;
+
+		/* h *= r */
+		MUL(d0, h0, r0); MUL(d, h1, s2); ADD(d0, d); MUL(d, h2, s1); ADD(d0, d);
+		MUL(d1, h0, r1); MUL(d, h1, r0); ADD(d1, d); MUL(d, h2, s2); ADD(d1, d);
+		MUL(d2, h0, r2); MUL(d, h1, r1); ADD(d2, d); MUL(d, h2, r0); ADD(d2, d);
+
+		/* (partial) h %= p */
+		              c = SHR(d0, 44); h0 = LO(d0) & 0xfffffffffff;
+		ADDLO(d1, c); c = SHR(d1, 44); h1 = LO(d1) & 0xfffffffffff;
+		ADDLO(d2, c); c = SHR(d2, 42); h2 = LO(d2) & 0x3ffffffffff;
+		h0  += c * 5; c = (h0 >> 44);  h0 =    h0  & 0xfffffffffff;
+		h1  += c;
+
+		m += poly1305_block_size;
+		bytes -= poly1305_block_size;
+	}
+
+	st->h[0] = h0;
+	st->h[1] = h1;
+	st->h[2] = h2;
+}
+
+static POLY1305_NOINLINE void poly1305_finish(poly1305_context *ctx, unsigned char mac[16]) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	unsigned long long h0,h1,h2,c;
+	unsigned long long g0,g1,g2;
+	unsigned long long t0,t1;
+
+	/* process the remaining block */
+	if (st->leftover) {
+		size_t i = st->leftover;
+		st->buffer[i] = 1;
+		for (i = i + 1; i < poly1305_block_size; i++)
+			st->buffer[i] = 0;
+		st->final = 1;
+		poly1305_blocks(st, st->buffer, poly1305_block_size);
+	}
+
+	/* fully carry h */
+	h0 = st->h[0];
+	h1 = st->h[1];
+	h2 = st->h[2];
+
+	             c = (h1 >> 44); h1 &= 0xfffffffffff;
+	h2 += c;     c = (h2 >> 42); h2 &= 0x3ffffffffff;
+	h0 += c * 5; c = (h0 >> 44); h0 &= 0xfffffffffff;
+	h1 += c;     c = (h1 >> 44); h1 &= 0xfffffffffff;
+	h2 += c;     c = (h2 >> 42); h2 &= 0x3ffffffffff;
+	h0 += c * 5; c = (h0 >> 44); h0 &= 0xfffffffffff;
+	h1 += c;
+
+	/* compute h + -p */
+	g0 = h0 + 5; c = (g0 >> 44); g0 &= 0xfffffffffff;
+	g1 = h1 + c; c = (g1 >> 44); g1 &= 0xfffffffffff;
+	g2 = h2 + c - ((unsigned long long)1 << 42);
+
+	/* select h if h < p, or h + -p if h >= p */
+	c = (g2 >> ((sizeof(unsigned long long) * 8) - 1)) - 1;
+	g0 &= c;
+	g1 &= c;
+	g2 &= c;
+	c = ~c;
+	h0 = (h0 & c) | g0;
+	h1 = (h1 & c) | g1;
+	h2 = (h2 & c) | g2;
+
+	/* h = (h + pad) */
+	t0 = st->pad[0];
+	t1 = st->pad[1];
+
+	h0 += (( t0                    ) & 0xfffffffffff)    ; c = (h0 >> 44); h0 &= 0xfffffffffff;
+	h1 += (((t0 >> 44) | (t1 << 20)) & 0xfffffffffff) + c; c = (h1 >> 44); h1 &= 0xfffffffffff;
+	h2 += (((t1 >> 24)             ) & 0x3ffffffffff) + c;                 h2 &= 0x3ffffffffff;
+
+	/* mac = h % (2^128) */
+	h0 = ((h0      ) | (h1 << 44));
+	h1 = ((h1 >> 20) | (h2 << 24));
+
+	U64TO8(&mac[0], h0);
+	U64TO8(&mac[8], h1);
+
+	/* zero out the state */
+	st->h[0] = 0;
+	st->h[1] = 0;
+	st->h[2] = 0;
+	st->r[0] = 0;
+	st->r[1] = 0;
+	st->r[2] = 0;
+	st->pad[0] = 0;
+	st->pad[1] = 0;
+}
+
+/*
+	generic streaming update on top of poly1305_blocks
+
+	this file is included once per variant by poly1305-donna.c, after that
+	variant has been included with its names mapped to a unique suffix
+static */
+
+#ifndef POLY1305_PREFETCH_SEGMENT
+#define POLY1305_PREFETCH_SEGMENT (256)
+#endif
+
+static void poly1305_update(poly1305_context *ctx, const unsigned char *m, size_t bytes) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	size_t i;
+
+	/* the state of every variant compiled in has to fit in front of the backend pointer */
+#if defined(PORTABLE_8439_SMALL)
+	(void)sizeof(char[sizeof(poly1305_context) >= sizeof(poly1305_state_internal_t) ? 1 : -1]);
+#else
+	(void)sizeof(char[offsetof(poly1305_context, backend) >= sizeof(poly1305_state_internal_t) ? 1 : -1]);
+#endif
+
+	/* handle leftover */
+	if (st->leftover) {
+		size_t want = (poly1305_block_size - st->leftover);
+		if (want > bytes)
+			want = bytes;
+		for (i = 0; i < want; i++)
+			st->buffer[st->leftover + i] = m[i];
+		bytes -= want;
+		m += want;
+		st->leftover += want;
+		if (st->leftover < poly1305_block_size)
+			return;
+		poly1305_blocks(st, st->buffer, poly1305_block_size);
+		st->leftover = 0;
+	}
+
+	/* process full blocks */
+	if (bytes >= poly1305_block_size) {
+		size_t want = (bytes & ~(poly1305_block_size - 1));
+#if PORTABLE_PREFETCH_DISTANCE > 0
+		/* in segments, so we can prefetch the input ahead of each of them */
+		for (; want > POLY1305_PREFETCH_SEGMENT; want -= POLY1305_PREFETCH_SEGMENT) {
+			PORTABLE_PREFETCH_AHEAD(m, POLY1305_PREFETCH_SEGMENT, bytes)
+			poly1305_blocks(st, m, POLY1305_PREFETCH_SEGMENT);
+			m += POLY1305_PREFETCH_SEGMENT;
+			bytes -= POLY1305_PREFETCH_SEGMENT;
+		}
+#endif
+		poly1305_blocks(st, m, want);
+		m += want;
+		bytes -= want;
+	}
+
+	/* store leftover */
+	if (bytes) {
+		for (i = 0; i < bytes; i++)
+			st->buffer[st->leftover + i] = m[i];
+		st->leftover += bytes;
+	}
+}
+#undef poly1305_state_internal_t
+#undef poly1305_init
+#undef poly1305_blocks
+#undef poly1305_update
+#undef poly1305_finish
+#undef poly1305_block_size
+#undef POLY1305_NOINLINE
+#endif
+
+#if defined(__HAVE_POLY1305_64) && __WANT_POLY1305(644)
+#define poly1305_state_internal_t poly1305_state_internal_64x4_t
+#define poly1305_init poly1305_init_64x4
+#define poly1305_blocks poly1305_blocks_64x4
+#define poly1305_update poly1305_update_64x4
+#define poly1305_finish poly1305_finish_64x4
+/*
+	poly1305 implementation using 64 bit * 64 bit = 128 bit multiplication and 128 bit addition,
+	processing up to four blocks per iteration
+
+	donna-64 has a single serial chain per block: every block needs the
+	reduced h of the previous one. Here we use precomputed powers of r:
+
+		h = (h + m0) * r^4 + m1 * r^3 + m2 * r^2 + m3 * r
+
+	only the first product depends on h, the other three can overlap with it,
+	and the carry chain only runs once per four blocks. Leftover blocks are
+	handled two at a time (r^2, r) and then one at a time (r).
+
+	calculating the powers costs three multiplications, so they are only
+	calculated once a single update brings at least POLY1305_POWERS_MIN_BYTES,
+	short messages stay on the serial loop and are as cheap as with donna-64.
+
+	reuses uint128_t, MUL & friends and U8TO64/U64TO8 from poly1305-donna-64.h,
+	so that file has to be included before this one.
+static */
+
+#if defined(_MSC_VER)
+	#define POLY1305_NOINLINE __declspec(noinline)
+#elif defined(__GNUC__)
+	#define POLY1305_NOINLINE __attribute__((noinline))
+#else
+	#define POLY1305_NOINLINE
+#endif
+
+#define poly1305_block_size 16
+
+#ifndef POLY1305_POWERS_MIN_BYTES
+#define POLY1305_POWERS_MIN_BYTES (8 * poly1305_block_size)
+#endif
+
+/* 18 + sizeof(size_t) + 17*sizeof(unsigned long long) */
+typedef struct poly1305_state_internal_t {
+	unsigned long long r[3];
+	unsigned long long h[3];
+	unsigned long long pad[2];
+	unsigned long long r2[3];
+	unsigned long long r3[3];
+	unsigned long long r4[3];
+	size_t leftover;
+	unsigned char buffer[poly1305_block_size];
+	unsigned char final;
+	unsigned char powers;
+} poly1305_state_internal_t;
+
+/* d = a * b, with sb1/sb2 = b1/b2 * (5 << 2) to fold the top back in */
+#define POLY1305_MUL3(d0, d1, d2, a0, a1, a2, b0, b1, b2, sb1, sb2) \
+	MUL(d0, a0, b0); MUL(d, a1, sb2); ADD(d0, d); MUL(d, a2, sb1); ADD(d0, d); \
+	MUL(d1, a0, b1); MUL(d, a1, b0); ADD(d1, d); MUL(d, a2, sb2); ADD(d1, d); \
+	MUL(d2, a0, b2); MUL(d, a1, b1); ADD(d2, d); MUL(d, a2, b0); ADD(d2, d);
+
+/* d += a * b */
+#define POLY1305_MUL3_ADD(d0, d1, d2, a0, a1, a2, b0, b1, b2, sb1, sb2) \
+	MUL(d, a0, b0); ADD(d0, d); MUL(d, a1, sb2); ADD(d0, d); MUL(d, a2, sb1); ADD(d0, d); \
+	MUL(d, a0, b1); ADD(d1, d); MUL(d, a1, b0); ADD(d1, d); MUL(d, a2, sb2); ADD(d1, d); \
+	MUL(d, a0, b2); ADD(d2, d); MUL(d, a1, b1); ADD(d2, d); MUL(d, a2, b0); ADD(d2, d);
+
+/* split a 16 byte block into 44/44/42 bit limbs */
+#define POLY1305_LOAD3(x0, x1, x2, p) \
+	t0 = U8TO64(&(p)[0]); \
+	t1 = U8TO64(&(p)[8]); \
+	x0 = (( t0                    ) & 0xfffffffffff); \
+	x1 = (((t0 >> 44) | (t1 << 20)) & 0xfffffffffff); \
+	x2 = (((t1 >> 24)             ) & 0x3ffffffffff) | hibit;
+
+/* (partial) h = d % p */
+#define POLY1305_REDUCE3(h0, h1, h2, d0, d1, d2) \
+	              c = SHR(d0, 44); h0 = LO(d0) & 0xfffffffffff; \
+	ADDLO(d1, c); c = SHR(d1, 44); h1 = LO(d1) & 0xfffffffffff; \
+	ADDLO(d2, c); c = SHR(d2, 42); h2 = LO(d2) & 0x3ffffffffff; \
+	h0  += c * 5; c = (h0 >> 44);  h0 =    h0  & 0xfffffffffff; \
+	h1  += c;
+
+/* out = a * b (partially reduced) */
+static void poly1305_power(unsigned long long out[3], const unsigned long long a[3], const unsigned long long b[3]) {
+	unsigned long long s1 = b[1] * (5 << 2);
+	unsigned long long s2 = b[2] * (5 << 2);
+	unsigned long long c;
+	uint128_t d0,d1,d2,d;
+
+	POLY1305_MUL3(d0, d1, d2, a[0], a[1], a[2], b[0], b[1], b[2], s1, s2)
+	POLY1305_REDUCE3(out[0], out[1], out[2], d0, d1, d2)
+}
+
+static void poly1305_init(poly1305_context *ctx, const unsigned char key[32]) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	unsigned long long t0,t1;
+
+	/* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
+	t0 = U8TO64(&key[0]);
+	t1 = U8TO64(&key[8]);
+
+	st->r[0] = ( t0                    ) & 0xffc0fffffff;
+	st->r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffff;
+	st->r[2] = ((t1 >> 24)             ) & 0x00ffffffc0f;
+
+	/* h = 0 */
+	st->h[0] = 0;
+	st->h[1] = 0;
+	st->h[2] = 0;
+
+	/* save pad for later */
+	st->pad[0] = U8TO64(&key[16]);
+	st->pad[1] = U8TO64(&key[24]);
+
+	st->leftover = 0;
+	st->final = 0;
+	st->powers = 0;
+}
+
+/* one block at a time, with just r */
+static void poly1305_blocks_serial(poly1305_state_internal_t *st, const unsigned char *m, size_t bytes) {
+	const unsigned long long hibit = (st->final) ? 0 : ((unsigned long long)1 << 40); /* 1 << 128 */
+	unsigned long long r0,r1,r2,s1,s2;
+	unsigned long long h0,h1,h2;
+	unsigned long long t0,t1,c;
+	uint128_t d0,d1,d2,d;
+
+	r0 = st->r[0];
+	r1 = st->r[1];
+	r2 = st->r[2];
+
+	s1 = r1 * (5 << 2);
+	s2 = r2 * (5 << 2);
+
+	h0 = st->h[0];
+	h1 = st->h[1];
+	h2 = st->h[2];
+
+	while (bytes >= poly1305_block_size) {
+		unsigned long long a0,a1,a2;
+
+		/* h += m[i] */
+		POLY1305_LOAD3(a0, a1, a2, m)
+		h0 += a0;
+		h1 += a1;
+		h2 += a2;
+
+		/* h *= r */
+		POLY1305_MUL3(d0, d1, d2, h0, h1, h2, r0, r1, r2, s1, s2)
+		POLY1305_REDUCE3(h0, h1, h2, d0, d1, d2)
+
+		m += poly1305_block_size;
+		bytes -= poly1305_block_size;
+	}
+
+	st->h[0] = h0;
+	st->h[1] = h1;
+	st->h[2] = h2;
+}
+
+static void poly1305_blocks(poly1305_state_internal_t *st, const unsigned char *m, size_t bytes) {
+	const unsigned long long hibit = (st->final) ? 0 : ((unsigned long long)1 << 40); /* 1 << 128 */
+	unsigned long long r0,r1,r2,s1,s2;
+	unsigned long long h0,h1,h2;
+	unsigned long long t0,t1,c;
+	uint128_t d0,d1,d2,d;
+
+	if (!st->powers) {
+		if (bytes < POLY1305_POWERS_MIN_BYTES) {
+			poly1305_blocks_serial(st, m, bytes);
+			return;
+		}
+		poly1305_power(st->r2, st->r, st->r);
+		poly1305_power(st->r3, st->r2, st->r);
+		poly1305_power(st->r4, st->r2, st->r2);
+		st->powers = 1;
+	}
+
+	r0 = st->r[0];
+	r1 = st->r[1];
+	r2 = st->r[2];
+
+	s1 = r1 * (5 << 2);
+	s2 = r2 * (5 << 2);
+
+	h0 = st->h[0];
+	h1 = st->h[1];
+	h2 = st->h[2];
+
+	if (bytes >= 4 * poly1305_block_size) {
+		const unsigned long long u0 = st->r2[0], u1 = st->r2[1], u2 = st->r2[2];
+		const unsigned long long v0 = st->r3[0], v1 = st->r3[1], v2 = st->r3[2];
+		const unsigned long long w0 = st->r4[0], w1 = st->r4[1], w2 = st->r4[2];
+		const unsigned long long su1 = u1 * (5 << 2), su2 = u2 * (5 << 2);
+		const unsigned long long sv1 = v1 * (5 << 2), sv2 = v2 * (5 << 2);
+		const unsigned long long sw1 = w1 * (5 << 2), sw2 = w2 * (5 << 2);
+
+		do {
+			unsigned long long a0,a1,a2,b0,b1,b2,e0,e1,e2,f0,f1,f2;
+
+			POLY1305_LOAD3(a0, a1, a2, m)
+			POLY1305_LOAD3(b0, b1, b2, m + 16)
+			POLY1305_LOAD3(e0, e1, e2, m + 32)
+			POLY1305_LOAD3(f0, f1, f2, m + 48)
+
+			a0 += h0;
+			a1 += h1;
+			a2 += h2;
+
+			/* h = (h + m0) * r^4 + m1 * r^3 + m2 * r^2 + m3 * r */
+			POLY1305_MUL3(d0, d1, d2, f0, f1, f2, r0, r1, r2, s1, s2)
+			POLY1305_MUL3_ADD(d0, d1, d2, e0, e1, e2, u0, u1, u2, su1, su2)
+			POLY1305_MUL3_ADD(d0, d1, d2, b0, b1, b2, v0, v1, v2, sv1, sv2)
+			POLY1305_MUL3_ADD(d0, d1, d2, a0, a1, a2, w0, w1, w2, sw1, sw2)
+
+			POLY1305_REDUCE3(h0, h1, h2, d0, d1, d2)
+
+			m += 4 * poly1305_block_size;
+			bytes -= 4 * poly1305_block_size;
+		} while (bytes >= 4 * poly1305_block_size);
+	}
+
+	if (bytes >= 2 * poly1305_block_size) {
+		const unsigned long long u0 = st->r2[0], u1 = st->r2[1], u2 = st->r2[2];
+		const unsigned long long su1 = u1 * (5 << 2), su2 = u2 * (5 << 2);
+		unsigned long long a0,a1,a2,b0,b1,b2;
+
+		POLY1305_LOAD3(a0, a1, a2, m)
+		POLY1305_LOAD3(b0, b1, b2, m + 16)
+
+		a0 += h0;
+		a1 += h1;
+		a2 += h2;
+
+		/* h = (h + m0) * r^2 + m1 * r */
+		POLY1305_MUL3(d0, d1, d2, b0, b1, b2, r0, r1, r2, s1, s2)
+		POLY1305_MUL3_ADD(d0, d1, d2, a0, a1, a2, u0, u1, u2, su1, su2)
+
+		POLY1305_REDUCE3(h0, h1, h2, d0, d1, d2)
+
+		m += 2 * poly1305_block_size;
+		bytes -= 2 * poly1305_block_size;
+	}
+
+	st->h[0] = h0;
+	st->h[1] = h1;
+	st->h[2] = h2;
+
+	if (bytes)
+		poly1305_blocks_serial(st, m, bytes);
+}
+
+static POLY1305_NOINLINE void poly1305_finish(poly1305_context *ctx, unsigned char mac[16]) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	unsigned long long h0,h1,h2,c;
+	unsigned long long g0,g1,g2;
+	unsigned long long t0,t1;
+	size_t i;
+
+	/* process the remaining block */
+	if (st->leftover) {
+		i = st->leftover;
+		st->buffer[i] = 1;
+		for (i = i + 1; i < poly1305_block_size; i++)
+			st->buffer[i] = 0;
+		st->final = 1;
+		poly1305_blocks(st, st->buffer, poly1305_block_size);
+	}
+
+	/* fully carry h */
+	h0 = st->h[0];
+	h1 = st->h[1];
+	h2 = st->h[2];
+
+	             c = (h1 >> 44); h1 &= 0xfffffffffff;
+	h2 += c;     c = (h2 >> 42); h2 &= 0x3ffffffffff;
+	h0 += c * 5; c = (h0 >> 44); h0 &= 0xfffffffffff;
+	h1 += c;     c = (h1 >> 44); h1 &= 0xfffffffffff;
+	h2 += c;     c = (h2 >> 42); h2 &= 0x3ffffffffff;
+	h0 += c * 5; c = (h0 >> 44); h0 &= 0xfffffffffff;
+	h1 += c;
+
+	/* compute h + -p */
+	g0 = h0 + 5; c = (g0 >> 44); g0 &= 0xfffffffffff;
+	g1 = h1 + c; c = (g1 >> 44); g1 &= 0xfffffffffff;
+	g2 = h2 + c - ((unsigned long long)1 << 42);
+
+	/* select h if h < p, or h + -p if h >= p */
+	c = (g2 >> ((sizeof(unsigned long long) * 8) - 1)) - 1;
+	g0 &= c;
+	g1 &= c;
+	g2 &= c;
+	c = ~c;
+	h0 = (h0 & c) | g0;
+	h1 = (h1 & c) | g1;
+	h2 = (h2 & c) | g2;
+
+	/* h = (h + pad) */
+	t0 = st->pad[0];
+	t1 = st->pad[1];
+
+	h0 += (( t0                    ) & 0xfffffffffff)    ; c = (h0 >> 44); h0 &= 0xfffffffffff;
+	h1 += (((t0 >> 44) | (t1 << 20)) & 0xfffffffffff) + c; c = (h1 >> 44); h1 &= 0xfffffffffff;
+	h2 += (((t1 >> 24)             ) & 0x3ffffffffff) + c;                 h2 &= 0x3ffffffffff;
+
+	/* mac = h % (2^128) */
+	h0 = ((h0      ) | (h1 << 44));
+	h1 = ((h1 >> 20) | (h2 << 24));
+
+	U64TO8(&mac[0], h0);
+	U64TO8(&mac[8], h1);
+
+	/* zero out the state */
+	for (i = 0; i < 3; i++) {
+		st->h[i] = 0;
+		st->r[i] = 0;
+		st->r2[i] = 0;
+		st->r3[i] = 0;
+		st->r4[i] = 0;
+	}
+	st->pad[0] = 0;
+	st->pad[1] = 0;
+}
+/*
+	generic streaming update on top of poly1305_blocks
+
+	this file is included once per variant by poly1305-donna.c, after that
+	variant has been included with its names mapped to a unique suffix
+static */
+
+#ifndef POLY1305_PREFETCH_SEGMENT
+#define POLY1305_PREFETCH_SEGMENT (256)
+#endif
+
+static void poly1305_update(poly1305_context *ctx, const unsigned char *m, size_t bytes) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	size_t i;
+
+	/* the state of every variant compiled in has to fit in front of the backend pointer */
+#if defined(PORTABLE_8439_SMALL)
+	(void)sizeof(char[sizeof(poly1305_context) >= sizeof(poly1305_state_internal_t) ? 1 : -1]);
+#else
+	(void)sizeof(char[offsetof(poly1305_context, backend) >= sizeof(poly1305_state_internal_t) ? 1 : -1]);
+#endif
+
+	/* handle leftover */
+	if (st->leftover) {
+		size_t want = (poly1305_block_size - st->leftover);
+		if (want > bytes)
+			want = bytes;
+		for (i = 0; i < want; i++)
+			st->buffer[st->leftover + i] = m[i];
+		bytes -= want;
+		m += want;
+		st->leftover += want;
+		if (st->leftover < poly1305_block_size)
+			return;
+		poly1305_blocks(st, st->buffer, poly1305_block_size);
+		st->leftover = 0;
+	}
+
+	/* process full blocks */
+	if (bytes >= poly1305_block_size) {
+		size_t want = (bytes & ~(poly1305_block_size - 1));
+#if PORTABLE_PREFETCH_DISTANCE > 0
+		/* in segments, so we can prefetch the input ahead of each of them */
+		for (; want > POLY1305_PREFETCH_SEGMENT; want -= POLY1305_PREFETCH_SEGMENT) {
+			PORTABLE_PREFETCH_AHEAD(m, POLY1305_PREFETCH_SEGMENT, bytes)
+			poly1305_blocks(st, m, POLY1305_PREFETCH_SEGMENT);
+			m += POLY1305_PREFETCH_SEGMENT;
+			bytes -= POLY1305_PREFETCH_SEGMENT;
+		}
+#endif
+		poly1305_blocks(st, m, want);
+		m += want;
+		bytes -= want;
+	}
+
+	/* store leftover */
+	if (bytes) {
+		for (i = 0; i < bytes; i++)
+			st->buffer[st->leftover + i] = m[i];
+		st->leftover += bytes;
+	}
+}
+#undef poly1305_state_internal_t
+#undef poly1305_init
+#undef poly1305_blocks
+#undef poly1305_update
+#undef poly1305_finish
+#undef poly1305_block_size
+#undef POLY1305_NOINLINE
+#endif
+
+#if __WANT_POLY1305(8)
+static const poly1305_backend poly1305_backend_8 = {
+	"donna-8", poly1305_init_8, poly1305_update_8, poly1305_finish_8
+};
+#endif
+
+#if __WANT_POLY1305(16)
+static const poly1305_backend poly1305_backend_16 = {
+	"donna-16", poly1305_init_16, poly1305_update_16, poly1305_finish_16
+};
+#endif
+
+#if __WANT_POLY1305(32)
+static const poly1305_backend poly1305_backend_32 = {
+	"donna-32", poly1305_init_32, poly1305_update_32, poly1305_finish_32
+};
+#endif
+
+#if __WANT_POLY1305(322)
+static const poly1305_backend poly1305_backend_32x2 = {
+	"donna-32x2", poly1305_init_32x2, poly1305_update_32x2, poly1305_finish_32x2
+};
+#endif
+
+#if defined(__HAVE_POLY1305_64) && __WANT_POLY1305(64)
+static const poly1305_backend poly1305_backend_64 = {
+	"donna-64", poly1305_init_64, poly1305_update_64, poly1305_finish_64
+};
+#endif
+
+#if defined(__HAVE_POLY1305_64) && __WANT_POLY1305(644)
+static const poly1305_backend poly1305_backend_64x4 = {
+	"donna-64x4", poly1305_init_64x4, poly1305_update_64x4, poly1305_finish_64x4
+};
+#endif
+
+/* ordered from (expected) fastest to slowest */
+static const poly1305_backend *const poly1305_backends[] = {
+#if defined(__HAVE_POLY1305_64) && __WANT_POLY1305(644)
+	&poly1305_backend_64x4,
+#endif
+#if defined(__HAVE_POLY1305_64) && __WANT_POLY1305(64)
+	&poly1305_backend_64,
+#endif
+#if __WANT_POLY1305(322)
+	&poly1305_backend_32x2,
+#endif
+#if __WANT_POLY1305(32)
+	&poly1305_backend_32,
+#endif
+#if __WANT_POLY1305(16)
+	&poly1305_backend_16,
+#endif
+#if __WANT_POLY1305(8)
+	&poly1305_backend_8
+#endif
+};
+
+#define POLY1305_BACKENDS (sizeof(poly1305_backends) / sizeof(poly1305_backends[0]))
+
+#if __POLY1305_DEFAULT_BITS == 8
+#	define POLY1305_DEFAULT_BACKEND poly1305_backend_8
+#elif __POLY1305_DEFAULT_BITS == 16
+#	define POLY1305_DEFAULT_BACKEND poly1305_backend_16
+#elif __POLY1305_DEFAULT_BITS == 32
+#	define POLY1305_DEFAULT_BACKEND poly1305_backend_32
+#elif __POLY1305_DEFAULT_BITS == 322
+#	define POLY1305_DEFAULT_BACKEND poly1305_backend_32x2
+#elif __POLY1305_DEFAULT_BITS == 64
+#	define POLY1305_DEFAULT_BACKEND poly1305_backend_64
+#else
+#	define POLY1305_DEFAULT_BACKEND poly1305_backend_64x4
+#endif
+
+static const poly1305_backend *poly1305_selected = &POLY1305_DEFAULT_BACKEND;
+
+#if defined(PORTABLE_8439_SMALL)
+/* a single backend, no pointer in the context */
+static void poly1305_init(poly1305_context *ctx, const unsigned char key[32]) {
+	POLY1305_DEFAULT_BACKEND.init(ctx, key);
+}
+
+static void poly1305_update(poly1305_context *ctx, const unsigned char *m, size_t bytes) {
+	POLY1305_DEFAULT_BACKEND.update(ctx, m, bytes);
+}
+
+static void poly1305_finish(poly1305_context *ctx, unsigned char mac[16]) {
+	POLY1305_DEFAULT_BACKEND.finish(ctx, mac);
+}
+#else
+static void poly1305_init(poly1305_context *ctx, const unsigned char key[32]) {
+	/* a context sticks to the backend it was started with */
+	ctx->backend = poly1305_selected;
+	ctx->backend->init(ctx, key);
+}
+
+static void poly1305_update(poly1305_context *ctx, const unsigned char *m, size_t bytes) {
+	ctx->backend->update(ctx, m, bytes);
+}
+
+static void poly1305_finish(poly1305_context *ctx, unsigned char mac[16]) {
+	ctx->backend->finish(ctx, mac);
+}
+#endif
+
+static int poly1305_verify(const unsigned char mac1[16], const unsigned char mac2[16]) {
+	size_t i;
+	unsigned int dif = 0;
+	for (i = 0; i < 16; i++)
+		dif |= (mac1[i] ^ mac2[i]);
+	dif = (dif - 1) >> ((sizeof(unsigned int) * 8) - 1);
+	return (dif & 1);
+}
+
+static size_t poly1305_backend_count(void) {
+	return POLY1305_BACKENDS;
+}
+
+static const poly1305_backend *poly1305_backend_at(size_t index) {
+	if (index >= POLY1305_BACKENDS)
+		return NULL;
+	return poly1305_backends[index];
+}
+
+static const poly1305_backend *poly1305_backend_find(const char *name) {
+	size_t i;
+	for (i = 0; i < POLY1305_BACKENDS; i++) {
+		if (strcmp(poly1305_backends[i]->name, name) == 0)
+			return poly1305_backends[i];
+	}
+	return NULL;
+}
+
+static const poly1305_backend *poly1305_backend_selected(void) {
+	return poly1305_selected;
+}
+
+static int poly1305_backend_select(const poly1305_backend *backend) {
+	size_t i;
+	for (i = 0; i < POLY1305_BACKENDS; i++) {
+		if (poly1305_backends[i] == backend) {
+			poly1305_selected = backend;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static double poly1305_backend_benchmark(const poly1305_backend *backend, const unsigned char *m, size_t bytes, unsigned long runs) {
+	poly1305_context ctx;
+	unsigned char key[32] = {0};
+	unsigned char mac[16] = {0};
+	unsigned long r;
+	clock_t start, took;
+
+	start = clock();
+	for (r = 0; r < runs; r++) {
+		/* feed the previous mac into the key so the runs depend on each other */
+		memcpy(key, mac, sizeof(mac));
+#if !defined(PORTABLE_8439_SMALL)
+		ctx.backend = backend;
+#endif
+		backend->init(&ctx, key);
+		backend->update(&ctx, m, bytes);
+		backend->finish(&ctx, mac);
+	}
+	took = clock() - start;
+	return (double)took / CLOCKS_PER_SEC;
+}
+// ******* END:   poly1305-donna.c ********
+// ******* BEGIN: portable8439.c ********
+
+#include <string.h>
+
+#define __CHACHA20_BLOCK_SIZE (64)
+#define __POLY1305_KEY_SIZE (32)
+
+static PORTABLE_8439_DECL uint8_t __ZEROES[16] = { 0 };
+static PORTABLE_8439_DECL void pad_if_needed(poly1305_context *ctx, size_t size) {
+    size_t padding = size % 16;
+    if (padding != 0) {
+        poly1305_update(ctx, __ZEROES, 16 - padding);
+    }
+}
+
+#define __u8(v) ((uint8_t)((v) & 0xFF))
+
+// TODO: make this depending on the unaligned/native read size possible
+static PORTABLE_8439_DECL void write_64bit_int(poly1305_context *ctx, uint64_t value) {
+    uint8_t result[8];
+    result[0] = __u8(value);
+    result[1] = __u8(value >> 8);
+    result[2] = __u8(value >> 16);
+    result[3] = __u8(value >> 24);
+    result[4] = __u8(value >> 32);
+    result[5] = __u8(value >> 40);
+    result[6] = __u8(value >> 48);
+    result[7] = __u8(value >> 56);
+    poly1305_update(ctx, result, 8);
+}
+
+// the AEAD is the same for the reduced round variants, only the chacha 
+// functions differ. Every caller passes a constant, so the switch folds away
+static PORTABLE_8439_DECL void chacha_xor_stream_key(
+    uint8_t *restrict dest,
+    const uint8_t *restrict source,
+    size_t length,
+    const chacha20_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    uint32_t counter,
+    unsigned int rounds
+) {
+    switch (rounds) {
+        case 8:
+            chacha8_xor_stream_key(dest, source, length, key, nonce, counter);
+            break;
+        case 12:
+            chacha12_xor_stream_key(dest, source, length, key, nonce, counter);
+            break;
+        default:
+            chacha20_xor_stream_key(dest, source, length, key, nonce, counter);
+            break;
+    }
+}
+
+static PORTABLE_8439_DECL void chacha_keygen(
+    uint8_t poly_key[__POLY1305_KEY_SIZE],
+    const chacha20_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    unsigned int rounds
+) {
+    switch (rounds) {
+        case 8:
+            chacha8_keygen(poly_key, key, nonce);
+            break;
+        case 12:
+            chacha12_keygen(poly_key, key, nonce);
+            break;
+        default:
+            rfc8439_keygen(poly_key, key, nonce);
+            break;
+    }
+}
+
+// start a mac: derive the poly key (section 2.6), unless it was already
+// derived in a batch, and write the padded AD
+static PORTABLE_8439_DECL void poly1305_begin_mac(
+    poly1305_context *poly_ctx,
+    const chacha20_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *derived_key,
+    const uint8_t *ad,
+    size_t ad_size,
+    unsigned int rounds
+) {
+    if (derived_key != NULL) {
+        poly1305_init(poly_ctx, derived_key);
+    }
+    else {
+        uint8_t poly_key[__POLY1305_KEY_SIZE] = {0}; 
+        chacha_keygen(poly_key, key, nonce, rounds);
+        poly1305_init(poly_ctx, poly_key);
+    }
+
+    if (ad != NULL && ad_size > 0) {
+        // write AD if present
+        poly1305_update(poly_ctx, ad, ad_size);
+        pad_if_needed(poly_ctx, ad_size);
+    }
+}
+
+// end a mac after all the cipher text has been written
+static PORTABLE_8439_DECL void poly1305_finish_mac(
+    poly1305_context *poly_ctx,
+    uint8_t *mac,
+    size_t ad_size,
+    uint64_t cipher_text_size
+) {
+    pad_if_needed(poly_ctx, (size_t)(cipher_text_size % 16));
+
+    // write sizes
+    write_64bit_int(poly_ctx, ad_size);
+    write_64bit_int(poly_ctx, cipher_text_size);
+    
+    // calculate MAC
+    poly1305_finish(poly_ctx, mac);
+}
+
+static PORTABLE_8439_DECL void poly1305_calculate_mac(
+    uint8_t *mac,
+    const uint8_t *cipher_text,
+    size_t cipher_text_size,
+    const chacha20_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *derived_key,
+    const uint8_t *ad,
+    size_t ad_size,
+    unsigned int rounds
+) {
+    poly1305_context poly_ctx;
+    poly1305_begin_mac(&poly_ctx, key, nonce, derived_key, ad, ad_size, rounds);
+    poly1305_update(&poly_ctx, cipher_text, cipher_text_size);
+    poly1305_finish_mac(&poly_ctx, mac, ad_size, cipher_text_size);
+}
+
+// USDT probes for perf, bpftrace & systemtap, enable with -DPORTABLE_8439_USDT
+// (needs <sys/sdt.h>, on debian/ubuntu: systemtap-sdt-dev). A probe is a 
+// single nop until a tracer attaches to it.
+#ifdef PORTABLE_8439_USDT
+#   if defined(__has_include)
+#       if __has_include(<sys/sdt.h>)
+#           include <sys/sdt.h>
+#           define __HAVE_USDT 1
+#       endif
+#   endif
+#   ifndef __HAVE_USDT
+#       error "PORTABLE_8439_USDT needs <sys/sdt.h>"
+#   endif
+#endif
+
+#ifdef __HAVE_USDT
+#   define TRACE_ENTRY(operation, size, ad_size) DTRACE_PROBE2(portable8439, operation##_entry, size, ad_size)
+#   define TRACE_RETURN(operation, result) DTRACE_PROBE1(portable8439, operation##_return, result)
+#   define TRACE_AUTH_FAILURE(size) DTRACE_PROBE1(portable8439, auth_failure, size)
+#else
+#   define TRACE_ENTRY(operation, size, ad_size)
+#   define TRACE_RETURN(operation, result)
+#   define TRACE_AUTH_FAILURE(size)
+#endif
+
+#ifdef PORTABLE_8439_STATS
+#if !defined(__GNUC__)
+#   error "PORTABLE_8439_STATS needs the __thread and __atomic extensions of GCC or Clang"
+#endif
+#include <stdlib.h>
+
+typedef struct stats_block {
+    portable_8439_stats counters;
+    struct stats_block *next;
+} stats_block;
+
+// lock-free list of all the thread blocks, it only grows
+static PORTABLE_8439_DECL stats_block *stats_blocks = NULL;
+// fallback for threads that failed to allocate their own block
+static PORTABLE_8439_DECL stats_block stats_shared;
+static PORTABLE_8439_DECL __thread stats_block *stats_local = NULL;
+static PORTABLE_8439_DECL const portable_8439_timing *stats_current_timing = NULL;
+
+static PORTABLE_8439_DECL stats_block *stats_thread_block(void) {
+    stats_block *block = stats_local;
+    if (block == NULL) {
+        block = calloc(1, sizeof(stats_block));
+        if (block == NULL) {
+            return &stats_shared;
+        }
+        block->next = __atomic_load_n(&stats_blocks, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&stats_blocks, &block->next, block, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+        stats_local = block;
+    }
+    return block;
+}
+
+// only the owning thread writes to its block, so we don't need a locked
+// add, the atomic load & store only make sure collect never sees torn values
+static PORTABLE_8439_DECL void stats_add(stats_block *block, uint64_t *counter, uint64_t value) {
+    if (block == &stats_shared) {
+        __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+    }
+    else {
+        __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+    }
+}
+
+static PORTABLE_8439_DECL unsigned int stats_bucket(size_t size) {
+    unsigned int bucket = size == 0 ? 0 : 64 - __builtin_clzll((unsigned long long)size);
+    return bucket < PORTABLE_8439_STATS_BUCKETS ? bucket : PORTABLE_8439_STATS_BUCKETS - 1;
+}
+
+typedef struct stats_call {
+    stats_block *block;
+    const portable_8439_timing *timing;
+    portable_8439_operation operation;
+    size_t size;
+    uint64_t start;
+} stats_call;
+
+static PORTABLE_8439_DECL void stats_begin(stats_call *call, portable_8439_operation operation, size_t size) {
+    call->block = stats_thread_block();
+    call->operation = operation;
+    call->size = size;
+    stats_add(call->block, operation == PORTABLE_8439_ENCRYPT 
+            ? &call->block->counters.encrypt_calls : &call->block->counters.decrypt_calls, 1);
+    call->timing = __atomic_load_n(&stats_current_timing, __ATOMIC_ACQUIRE);
+    call->start = call->timing != NULL ? call->timing->clock() : 0;
+}
+
+static PORTABLE_8439_DECL void stats_end(stats_call *call) {
+    if (call->timing != NULL) {
+        call->timing->hook(call->operation, call->size, call->timing->clock() - call->start, call->timing->user_data);
+    }
+}
+
+static PORTABLE_8439_DECL void stats_done(stats_call *call, size_t plain_text_size) {
+    stats_add(call->block, call->operation == PORTABLE_8439_ENCRYPT 
+            ? &call->block->counters.encrypt_bytes : &call->block->counters.decrypt_bytes, plain_text_size);
+    stats_add(call->block, &call->block->counters.size_histogram[stats_bucket(plain_text_size)], 1);
+    stats_end(call);
+}
+
+#define STATS_BEGIN(operation, size) \
+    stats_call __stats; \
+    stats_begin(&__stats, operation, size);
+#define STATS_FAILED(counter) \
+    stats_add(__stats.block, &__stats.block->counters.counter, 1); \
+    stats_end(&__stats);
+#define STATS_DONE(plain_text_size) stats_done(&__stats, plain_text_size);
+
+static PORTABLE_8439_DECL void stats_sum(portable_8439_stats *result, const portable_8439_stats *counters) {
+    #define __SUM(field) result->field += __atomic_load_n(&counters->field, __ATOMIC_RELAXED);
+    __SUM(encrypt_calls)
+    __SUM(encrypt_bytes)
+    __SUM(decrypt_calls)
+    __SUM(decrypt_bytes)
+    __SUM(auth_failures)
+    __SUM(overlap_rejections)
+    for (unsigned int i = 0; i < PORTABLE_8439_STATS_BUCKETS; i++) {
+        __SUM(size_histogram[i])
+    }
+    #undef __SUM
+}
+
+PORTABLE_8439_API void portable_8439_stats_collect(portable_8439_stats *result) {
+    memset(result, 0, sizeof(portable_8439_stats));
+    stats_sum(result, &stats_shared.counters);
+    for (const stats_block *block = __atomic_load_n(&stats_blocks, __ATOMIC_ACQUIRE); block != NULL; block = block->next) {
+        stats_sum(result, &block->counters);
+    }
+}
+
+PORTABLE_8439_API void portable_8439_stats_timing(const portable_8439_timing *timing) {
+    __atomic_store_n(&stats_current_timing, timing, __ATOMIC_RELEASE);
+}
+#else
+#define STATS_BEGIN(operation, size)
+#define STATS_FAILED(counter)
+#define STATS_DONE(plain_text_size)
+#endif
+
+#define PM(p) ((uintptr_t)(p))
+
+// pointers overlap if the smaller either ahead of the end, 
+// or its end is before the start of the other
+//
+// s_size should be smaller or equal to b_size
+#define OVERLAPPING(s, s_size, b, b_size) \
+       (PM(s) < PM((b) + (b_size))) \
+    && (PM(b) < PM((s) + (s_size)))
+
+static PORTABLE_8439_DECL size_t encrypt_with_key(
+    uint8_t *restrict cipher_text,
+    const chacha20_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *derived_key,
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size,
+    unsigned int rounds
+) {
+    TRACE_ENTRY(encrypt, plain_text_size, ad_size);
+    STATS_BEGIN(PORTABLE_8439_ENCRYPT, plain_text_size)
+    size_t new_size = plain_text_size + RFC_8439_TAG_SIZE;
+    if (OVERLAPPING(plain_text, plain_text_size, cipher_text, new_size)) {
+        STATS_FAILED(overlap_rejections)
+        TRACE_RETURN(encrypt, -1);
+        return -1;
+    }
+    chacha_xor_stream_key(cipher_text, plain_text, plain_text_size, key, nonce, 1, rounds);
+    poly1305_calculate_mac(cipher_text + plain_text_size, cipher_text, plain_text_size, key, nonce, derived_key, ad, ad_size, rounds);
+    STATS_DONE(plain_text_size)
+    TRACE_RETURN(encrypt, new_size);
+    return new_size;
+}
+
+static PORTABLE_8439_DECL size_t decrypt_with_key(
+    uint8_t *restrict plain_text,
+    const chacha20_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *derived_key,
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size,
+    unsigned int rounds
+) {
+    TRACE_ENTRY(decrypt, cipher_text_size, ad_size);
+    STATS_BEGIN(PORTABLE_8439_DECRYPT, cipher_text_size)
+    // first we calculate the mac and see if it lines up, only then do we decrypt
+    uint8_t actual_mac[RFC_8439_TAG_SIZE];
+    size_t actual_size = cipher_text_size - RFC_8439_TAG_SIZE;
+    if (OVERLAPPING(plain_text, actual_size, cipher_text, cipher_text_size)) {
+        STATS_FAILED(overlap_rejections)
+        TRACE_RETURN(decrypt, -1);
+        return -1;
+    }
+
+    poly1305_calculate_mac(actual_mac, cipher_text, actual_size, key, nonce, derived_key, ad, ad_size, rounds);
+
+    if (poly1305_verify(cipher_text + actual_size, actual_mac)) {
+        // valid mac, so decrypt cipher_text
+        chacha_xor_stream_key(plain_text, cipher_text, actual_size, key, nonce, 1, rounds);
+        STATS_DONE(actual_size)
+        TRACE_RETURN(decrypt, actual_size);
+        return actual_size;
+    }
+    TRACE_AUTH_FAILURE(cipher_text_size);
+    STATS_FAILED(auth_failures)
+    TRACE_RETURN(decrypt, -1);
+    return -1;
+}
+
+// wipes a key expanded on the stack, volatile so the stores aren't dropped
+static PORTABLE_8439_DECL void wipe_subkey(chacha20_key *subkey) {
+    volatile uint32_t *words = subkey->words;
+    for (size_t i = 0; i < sizeof(subkey->words) / sizeof(subkey->words[0]); i++) {
+        words[i] = 0;
+    }
+}
+
+PORTABLE_8439_API size_t portable_chacha20_poly1305_encrypt(
+    uint8_t *restrict cipher_text,
+    const uint8_t key[RFC_8439_KEY_SIZE],
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+) {
+    chacha20_key expanded;
+    chacha20_key_init(&expanded, key);
+    size_t result = encrypt_with_key(cipher_text, &expanded, nonce, NULL, ad, ad_size, plain_text, plain_text_size, 20);
+    wipe_subkey(&expanded);
+    return result;
+}
+
+PORTABLE_8439_API size_t portable_chacha20_poly1305_decrypt(
+    uint8_t *restrict plain_text,
+    const uint8_t key[RFC_8439_KEY_SIZE],
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+) {
+    chacha20_key expanded;
+    chacha20_key_init(&expanded, key);
+    size_t result = decrypt_with_key(plain_text, &expanded, nonce, NULL, ad, ad_size, cipher_text, cipher_text_size, 20);
+    wipe_subkey(&expanded);
+    return result;
+}
+
+// the public struct hides the chacha20_key, since the header can't include chacha-portable.h
+#define KEY_WORDS(ctx) ((const chacha20_key *)(ctx)->opaque)
+typedef char __check_key_size[sizeof(((portable_8439_key *)0)->opaque) >= sizeof(chacha20_key) ? 1 : -1];
+
+PORTABLE_8439_API void portable_chacha20_poly1305_key_init(portable_8439_key *ctx, const uint8_t key[RFC_8439_KEY_SIZE]) {
+    chacha20_key_init((chacha20_key *)ctx->opaque, key);
+}
+
+PORTABLE_8439_API void portable_chacha20_poly1305_key_wipe(portable_8439_key *ctx) {
+    // volatile, so the compiler can't drop the stores to an object that is about to die
+    volatile uint32_t *words = ctx->opaque;
+    for (size_t i = 0; i < sizeof(ctx->opaque) / sizeof(ctx->opaque[0]); i++) {
+        words[i] = 0;
+    }
+}
+
+PORTABLE_8439_API size_t portable_chacha20_poly1305_encrypt_key(
+    uint8_t *restrict cipher_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+) {
+    return encrypt_with_key(cipher_text, KEY_WORDS(key), nonce, NULL, ad, ad_size, plain_text, plain_text_size, 20);
+}
+
+PORTABLE_8439_API size_t portable_chacha20_poly1305_decrypt_key(
+    uint8_t *restrict plain_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+) {
+    return decrypt_with_key(plain_text, KEY_WORDS(key), nonce, NULL, ad, ad_size, cipher_text, cipher_text_size, 20);
+}
+
+// XChaCha20: the subkey from the first 16 bytes of the nonce, and the last 8
+// bytes (after 4 zero bytes) as the nonce for it
+static PORTABLE_8439_DECL void xchacha_subkey(
+    chacha20_key *subkey,
+    uint8_t inner_nonce[RFC_8439_NONCE_SIZE],
+    const chacha20_key *key,
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE]
+) {
+    hchacha20(subkey, key, nonce);
+    memset(inner_nonce, 0, 4);
+    memcpy(inner_nonce + 4, nonce + HCHACHA20_NONCE_SIZE, 8);
+}
+
+static PORTABLE_8439_DECL size_t xchacha_encrypt_with_key(
+    uint8_t *restrict cipher_text,
+    const chacha20_key *key,
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+) {
+    chacha20_key subkey;
+    uint8_t inner_nonce[RFC_8439_NONCE_SIZE];
+    xchacha_subkey(&subkey, inner_nonce, key, nonce);
+    size_t result = encrypt_with_key(cipher_text, &subkey, inner_nonce, NULL, ad, ad_size, plain_text, plain_text_size, 20);
+    wipe_subkey(&subkey);
+    return result;
+}
+
+static PORTABLE_8439_DECL size_t xchacha_decrypt_with_key(
+    uint8_t *restrict plain_text,
+    const chacha20_key *key,
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+) {
+    chacha20_key subkey;
+    uint8_t inner_nonce[RFC_8439_NONCE_SIZE];
+    xchacha_subkey(&subkey, inner_nonce, key, nonce);
+    size_t result = decrypt_with_key(plain_text, &subkey, inner_nonce, NULL, ad, ad_size, cipher_text, cipher_text_size, 20);
+    wipe_subkey(&subkey);
+    return result;
+}
+
+PORTABLE_8439_API size_t portable_xchacha20_poly1305_encrypt(
+    uint8_t *restrict cipher_text,
+    const uint8_t key[RFC_8439_KEY_SIZE],
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+) {
+    chacha20_key expanded;
+    chacha20_key_init(&expanded, key);
+    size_t result = xchacha_encrypt_with_key(cipher_text, &expanded, nonce, ad, ad_size, plain_text, plain_text_size);
+    wipe_subkey(&expanded);
+    return result;
+}
+
+PORTABLE_8439_API size_t portable_xchacha20_poly1305_decrypt(
+    uint8_t *restrict plain_text,
+    const uint8_t key[RFC_8439_KEY_SIZE],
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+) {
+    chacha20_key expanded;
+    chacha20_key_init(&expanded, key);
+    size_t result = xchacha_decrypt_with_key(plain_text, &expanded, nonce, ad, ad_size, cipher_text, cipher_text_size);
+    wipe_subkey(&expanded);
+    return result;
+}
+
+PORTABLE_8439_API size_t portable_xchacha20_poly1305_encrypt_key(
+    uint8_t *restrict cipher_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+) {
+    return xchacha_encrypt_with_key(cipher_text, KEY_WORDS(key), nonce, ad, ad_size, plain_text, plain_text_size);
+}
+
+PORTABLE_8439_API size_t portable_xchacha20_poly1305_decrypt_key(
+    uint8_t *restrict plain_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+) {
+    return xchacha_decrypt_with_key(plain_text, KEY_WORDS(key), nonce, ad, ad_size, cipher_text, cipher_text_size);
+}
+
+#define REDUCED_DEFINE(name, rounds) \
+    PORTABLE_8439_API size_t portable_##name##_poly1305_encrypt( \
+        uint8_t *restrict cipher_text, \
+        const uint8_t key[RFC_8439_KEY_SIZE], \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        size_t ad_size, \
+        const uint8_t *restrict plain_text, \
+        size_t plain_text_size \
+    ) { \
+        chacha20_key expanded; \
+        chacha20_key_init(&expanded, key); \
+        size_t result = encrypt_with_key(cipher_text, &expanded, nonce, NULL, ad, ad_size, plain_text, plain_text_size, rounds); \
+        wipe_subkey(&expanded); \
+        return result; \
+    } \
+    PORTABLE_8439_API size_t portable_##name##_poly1305_decrypt( \
+        uint8_t *restrict plain_text, \
+        const uint8_t key[RFC_8439_KEY_SIZE], \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        size_t ad_size, \
+        const uint8_t *restrict cipher_text, \
+        size_t cipher_text_size \
+    ) { \
+        chacha20_key expanded; \
+        chacha20_key_init(&expanded, key); \
+        size_t result = decrypt_with_key(plain_text, &expanded, nonce, NULL, ad, ad_size, cipher_text, cipher_text_size, rounds); \
+        wipe_subkey(&expanded); \
+        return result; \
+    } \
+    PORTABLE_8439_API size_t portable_##name##_poly1305_encrypt_key( \
+        uint8_t *restrict cipher_text, \
+        const portable_8439_key *key, \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        size_t ad_size, \
+        const uint8_t *restrict plain_text, \
+        size_t plain_text_size \
+    ) { \
+        return encrypt_with_key(cipher_text, KEY_WORDS(key), nonce, NULL, ad, ad_size, plain_text, plain_text_size, rounds); \
+    } \
+    PORTABLE_8439_API size_t portable_##name##_poly1305_decrypt_key( \
+        uint8_t *restrict plain_text, \
+        const portable_8439_key *key, \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        size_t ad_size, \
+        const uint8_t *restrict cipher_text, \
+        size_t cipher_text_size \
+    ) { \
+        return decrypt_with_key(plain_text, KEY_WORDS(key), nonce, NULL, ad, ad_size, cipher_text, cipher_text_size, rounds); \
+    }
+
+PORTABLE_8439_REDUCED_ROUNDS(REDUCED_DEFINE)
+
+PORTABLE_8439_API int portable_chacha20_poly1305_verify_key(
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size,
+    const uint8_t *cipher_text,
+    size_t cipher_text_size
+) {
+    if (cipher_text_size < RFC_8439_TAG_SIZE) {
+        return 0;
+    }
+    uint8_t actual_mac[RFC_8439_TAG_SIZE];
+    size_t actual_size = cipher_text_size - RFC_8439_TAG_SIZE;
+    poly1305_calculate_mac(actual_mac, cipher_text, actual_size, KEY_WORDS(key), nonce, NULL, ad, ad_size, 20);
+    if (poly1305_verify(cipher_text + actual_size, actual_mac)) {
+        return 1;
+    }
+    TRACE_AUTH_FAILURE(cipher_text_size);
+    return 0;
+}
+
+PORTABLE_8439_API void portable_chacha20_poly1305_xor_key(
+    uint8_t *restrict output,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    uint64_t offset,
+    const uint8_t *restrict input,
+    size_t size
+) {
+    // block 0 is the poly key, the body starts at block 1
+    uint32_t counter = (uint32_t)(1 + offset / __CHACHA20_BLOCK_SIZE);
+    size_t skip = (size_t)(offset % __CHACHA20_BLOCK_SIZE);
+    if (skip > 0 && size > 0) {
+        // an unaligned offset starts in the middle of a block
+        static const uint8_t zero_block[__CHACHA20_BLOCK_SIZE] = { 0 };
+        uint8_t keystream[__CHACHA20_BLOCK_SIZE];
+        chacha20_xor_stream_key(keystream, zero_block, __CHACHA20_BLOCK_SIZE, KEY_WORDS(key), nonce, counter++);
+        size_t head = size < __CHACHA20_BLOCK_SIZE - skip ? size : __CHACHA20_BLOCK_SIZE - skip;
+        for (size_t i = 0; i < head; i++) {
+            output[i] = input[i] ^ keystream[skip + i];
+        }
+        volatile uint8_t *wipe = keystream;
+        for (size_t i = 0; i < sizeof(keystream); i++) {
+            wipe[i] = 0;
+        }
+        output += head;
+        input += head;
+        size -= head;
+    }
+    chacha20_xor_stream_key(output, input, size, KEY_WORDS(key), nonce, counter);
+}
+
+// Bulk mode: every chunk is xor-ed into a buffer that stays in L1, mac-ed 
+// from there, and only then streamed out to the output around the caches
+#ifndef PORTABLE_8439_BULK_THRESHOLD
+#define PORTABLE_8439_BULK_THRESHOLD (1 << 20)
+#endif
+#ifdef PORTABLE_8439_SMALL
+// the chunk lives on the stack
+#define BULK_CHUNK (256)
+#else
+#define BULK_CHUNK (4096)
+#endif
+
+#if !defined(PORTABLE_8439_SMALL) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define __HAVE_NONTEMPORAL 1
+#endif
+
+#ifdef __HAVE_NONTEMPORAL
+static PORTABLE_8439_DECL void stream_out(uint8_t *restrict dest, const uint8_t *restrict source, size_t size) {
+    // the non-temporal stores need an aligned target, the head & tail are
+    // stored normally
+    size_t head = (16 - PM(dest) % 16) % 16;
+    head = head > size ? size : head;
+    memcpy(dest, source, head);
+    size_t i = head;
+    for (; i + 64 <= size; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(source + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(source + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(source + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(source + i + 48));
+        _mm_stream_si128((__m128i *)(dest + i), a);
+        _mm_stream_si128((__m128i *)(dest + i + 16), b);
+        _mm_stream_si128((__m128i *)(dest + i + 32), c);
+        _mm_stream_si128((__m128i *)(dest + i + 48), d);
+    }
+    for (; i + 16 <= size; i += 16) {
+        _mm_stream_si128((__m128i *)(dest + i), _mm_loadu_si128((const __m128i *)(source + i)));
+    }
+    memcpy(dest + i, source + i, size - i);
+}
+
+static PORTABLE_8439_DECL size_t encrypt_bulk(
+    uint8_t *restrict cipher_text,
+    const chacha20_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+) {
+    TRACE_ENTRY(encrypt, plain_text_size, ad_size);
+    STATS_BEGIN(PORTABLE_8439_ENCRYPT, plain_text_size)
+    size_t new_size = plain_text_size + RFC_8439_TAG_SIZE;
+    if (OVERLAPPING(plain_text, plain_text_size, cipher_text, new_size)) {
+        STATS_FAILED(overlap_rejections)
+        TRACE_RETURN(encrypt, -1);
+        return -1;
+    }
+    uint8_t chunk[BULK_CHUNK];
+    poly1305_context poly_ctx;
+    poly1305_begin_mac(&poly_ctx, key, nonce, NULL, ad, ad_size, 20);
+    for (size_t done = 0; done < plain_text_size; done += BULK_CHUNK) {
+        size_t size = plain_text_size - done < BULK_CHUNK ? plain_text_size - done : BULK_CHUNK;
+        chacha20_xor_stream_key(chunk, plain_text + done, size, key, nonce, (uint32_t)(1 + done / __CHACHA20_BLOCK_SIZE));
+        poly1305_update(&poly_ctx, chunk, size);
+        stream_out(cipher_text + done, chunk, size);
+    }
+    poly1305_finish_mac(&poly_ctx, cipher_text + plain_text_size, ad_size, plain_text_size);
+    // the non-temporal stores are weakly ordered, make them visible before we return
+    _mm_sfence();
+    STATS_DONE(plain_text_size)
+    TRACE_RETURN(encrypt, new_size);
+    return new_size;
+}
+
+static PORTABLE_8439_DECL size_t decrypt_bulk(
+    uint8_t *restrict plain_text,
+    const chacha20_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+) {
+    TRACE_ENTRY(decrypt, cipher_text_size, ad_size);
+    STATS_BEGIN(PORTABLE_8439_DECRYPT, cipher_text_size)
+    uint8_t actual_mac[RFC_8439_TAG_SIZE];
+    size_t actual_size = cipher_text_size - RFC_8439_TAG_SIZE;
+    if (OVERLAPPING(plain_text, actual_size, cipher_text, cipher_text_size)) {
+        STATS_FAILED(overlap_rejections)
+        TRACE_RETURN(decrypt, -1);
+        return -1;
+    }
+    poly1305_calculate_mac(actual_mac, cipher_text, actual_size, key, nonce, NULL, ad, ad_size, 20);
+    if (!poly1305_verify(cipher_text + actual_size, actual_mac)) {
+        TRACE_AUTH_FAILURE(cipher_text_size);
+        STATS_FAILED(auth_failures)
+        TRACE_RETURN(decrypt, -1);
+        return -1;
+    }
+    uint8_t chunk[BULK_CHUNK];
+    for (size_t done = 0; done < actual_size; done += BULK_CHUNK) {
+        size_t size = actual_size - done < BULK_CHUNK ? actual_size - done : BULK_CHUNK;
+        chacha20_xor_stream_key(chunk, cipher_text + done, size, key, nonce, (uint32_t)(1 + done / __CHACHA20_BLOCK_SIZE));
+        stream_out(plain_text + done, chunk, size);
+    }
+    _mm_sfence();
+    // the last chunk of plain text is still on the stack
+    volatile uint8_t *wipe = chunk;
+    for (size_t i = 0; i < sizeof(chunk); i++) {
+        wipe[i] = 0;
+    }
+    STATS_DONE(actual_size)
+    TRACE_RETURN(decrypt, actual_size);
+    return actual_size;
+}
+#endif
+
+PORTABLE_8439_API size_t portable_chacha20_poly1305_encrypt_key_bulk(
+    uint8_t *restrict cipher_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+) {
+#ifdef __HAVE_NONTEMPORAL
+    if (plain_text_size >= PORTABLE_8439_BULK_THRESHOLD) {
+        return encrypt_bulk(cipher_text, KEY_WORDS(key), nonce, ad, ad_size, plain_text, plain_text_size);
+    }
+#endif
+    return encrypt_with_key(cipher_text, KEY_WORDS(key), nonce, NULL, ad, ad_size, plain_text, plain_text_size, 20);
+}
+
+PORTABLE_8439_API size_t portable_chacha20_poly1305_decrypt_key_bulk(
+    uint8_t *restrict plain_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+) {
+#ifdef __HAVE_NONTEMPORAL
+    if (cipher_text_size >= PORTABLE_8439_BULK_THRESHOLD + RFC_8439_TAG_SIZE) {
+        return decrypt_bulk(plain_text, KEY_WORDS(key), nonce, ad, ad_size, cipher_text, cipher_text_size);
+    }
+#endif
+    return decrypt_with_key(plain_text, KEY_WORDS(key), nonce, NULL, ad, ad_size, cipher_text, cipher_text_size, 20);
+}
+
+PORTABLE_8439_API void portable_chacha20_quic_hp_mask(
+    uint8_t mask[PORTABLE_QUIC_HP_MASK_SIZE],
+    const portable_8439_key *hp_key,
+    const uint8_t sample[PORTABLE_QUIC_HP_SAMPLE_SIZE]
+) {
+    chacha20_quic_hp_mask(mask, KEY_WORDS(hp_key), sample);
+}
+
+PORTABLE_8439_API void portable_chacha20_quic_hp_mask_batch(
+    uint8_t *masks,
+    const portable_8439_key *hp_key,
+    const uint8_t *const *samples,
+    size_t count
+) {
+    chacha20_quic_hp_mask_batch(masks, KEY_WORDS(hp_key), samples, count);
+}
+
+// TLS 1.3 records: the nonces & poly keys of a group of records are derived
+// together, then every record is sealed or opened with its own poly key
+#ifdef PORTABLE_8439_SMALL
+#define TLS_GROUP (1)
+#else
+#define TLS_GROUP (8)
+#endif
+#define TLS_APPLICATION_DATA (23)
+
+static PORTABLE_8439_DECL void tls_nonce(uint8_t nonce[RFC_8439_NONCE_SIZE], const uint8_t iv[RFC_8439_NONCE_SIZE], uint64_t sequence) {
+    memcpy(nonce, iv, RFC_8439_NONCE_SIZE);
+    for (unsigned int i = 0; i < 8; i++) {
+        nonce[RFC_8439_NONCE_SIZE - 1 - i] ^= __u8(sequence >> (8 * i));
+    }
+}
+
+static PORTABLE_8439_DECL size_t tls_seal_record(
+    portable_8439_tls_record *record,
+    const chacha20_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t poly_key[__POLY1305_KEY_SIZE]
+) {
+    size_t size = record->input_size;
+    if (size > PORTABLE_TLS_MAX_CIPHER_TEXT - RFC_8439_TAG_SIZE
+        || (OVERLAPPING(record->input, size, record->output, size + PORTABLE_TLS_RECORD_OVERHEAD))) {
+        return -1;
+    }
+    uint8_t *header = record->output;
+    header[0] = TLS_APPLICATION_DATA;
+    header[1] = 0x03;
+    header[2] = 0x03;
+    header[3] = __u8((size + RFC_8439_TAG_SIZE) >> 8);
+    header[4] = __u8(size + RFC_8439_TAG_SIZE);
+    size_t result = encrypt_with_key(header + PORTABLE_TLS_HEADER_SIZE, key, nonce, poly_key, 
+        header, PORTABLE_TLS_HEADER_SIZE, record->input, size, 20);
+    return result == (size_t)-1 ? result : result + PORTABLE_TLS_HEADER_SIZE;
+}
+
+static PORTABLE_8439_DECL size_t tls_open_record(
+    portable_8439_tls_record *record,
+    const chacha20_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t poly_key[__POLY1305_KEY_SIZE]
+) {
+    // the version is covered by the tag, like the rest of the header
+    const uint8_t *header = record->input;
+    size_t size = record->input_size;
+    if (size < PORTABLE_TLS_RECORD_OVERHEAD 
+        || size - PORTABLE_TLS_HEADER_SIZE > PORTABLE_TLS_MAX_CIPHER_TEXT
+        || header[0] != TLS_APPLICATION_DATA
+        || (((size_t)header[3] << 8) | header[4]) != size - PORTABLE_TLS_HEADER_SIZE
+        || (OVERLAPPING(record->output, size - PORTABLE_TLS_RECORD_OVERHEAD, record->input, size))) {
+        return -1;
+    }
+    return decrypt_with_key(record->output, key, nonce, poly_key, header, PORTABLE_TLS_HEADER_SIZE,
+        header + PORTABLE_TLS_HEADER_SIZE, size - PORTABLE_TLS_HEADER_SIZE, 20);
+}
+
+static PORTABLE_8439_DECL size_t tls_records(
+    portable_8439_tls_record *records,
+    size_t count,
+    const chacha20_key *key,
+    const uint8_t iv[RFC_8439_NONCE_SIZE],
+    uint64_t sequence,
+    int open
+) {
+    uint8_t nonces[TLS_GROUP][RFC_8439_NONCE_SIZE];
+    uint8_t poly_keys[TLS_GROUP][__POLY1305_KEY_SIZE];
+    size_t succeeded = 0;
+    for (size_t first = 0; first < count; first += TLS_GROUP) {
+        size_t group = count - first < TLS_GROUP ? count - first : TLS_GROUP;
+        for (size_t i = 0; i < group; i++) {
+            tls_nonce(nonces[i], iv, sequence + first + i);
+        }
+        rfc8439_keygen_batch(poly_keys[0], key, nonces[0], group);
+        for (size_t i = 0; i < group; i++) {
+            portable_8439_tls_record *record = &records[first + i];
+            if (first + i > UINT64_MAX - sequence) {
+                // the sequence number wrapped, rekey long before that
+                record->result = -1;
+            }
+            else if (open) {
+                record->result = tls_open_record(record, key, nonces[i], poly_keys[i]);
+            }
+            else {
+                record->result = tls_seal_record(record, key, nonces[i], poly_keys[i]);
+            }
+            succeeded += record->result != (size_t)-1;
+        }
+    }
+    volatile uint8_t *wipe = poly_keys[0];
+    for (size_t i = 0; i < sizeof(poly_keys); i++) {
+        wipe[i] = 0;
+    }
+    return succeeded;
+}
+
+PORTABLE_8439_API size_t portable_chacha20_poly1305_tls_seal(
+    portable_8439_tls_record *records,
+    size_t count,
+    const portable_8439_key *key,
+    const uint8_t iv[RFC_8439_NONCE_SIZE],
+    uint64_t sequence
+) {
+    return tls_records(records, count, KEY_WORDS(key), iv, sequence, 0);
+}
+
+PORTABLE_8439_API size_t portable_chacha20_poly1305_tls_open(
+    portable_8439_tls_record *records,
+    size_t count,
+    const portable_8439_key *key,
+    const uint8_t iv[RFC_8439_NONCE_SIZE],
+    uint64_t sequence
+) {
+    return tls_records(records, count, KEY_WORDS(key), iv, sequence, 1);
+}
+
+PORTABLE_8439_API size_t portable_poly1305_backend_count(void) {
+    return poly1305_backend_count();
+}
+
+PORTABLE_8439_API const char *portable_poly1305_backend_name(size_t index) {
+    const poly1305_backend *backend = poly1305_backend_at(index);
+    return backend == NULL ? NULL : backend->name;
+}
+
+PORTABLE_8439_API const char *portable_poly1305_backend_current(void) {
+    return poly1305_backend_selected()->name;
+}
+
+PORTABLE_8439_API int portable_poly1305_backend_select(const char *name) {
+    const poly1305_backend *backend = poly1305_backend_find(name);
+    return backend != NULL && poly1305_backend_select(backend);
+}
+
+PORTABLE_8439_API double portable_poly1305_backend_benchmark(
+    const char *name,
+    const uint8_t *message,
+    size_t message_size,
+    unsigned long runs
+) {
+    const poly1305_backend *backend = poly1305_backend_find(name);
+    if (backend == NULL) {
+        return -1;
+    }
+    double took = poly1305_backend_benchmark(backend, message, message_size, runs);
+    if (took <= 0) {
+        // clock resolution too coarse for the amount of work
+        return 0;
+    }
+    return (((double)runs * message_size) / took) / (1024 * 1024);
+}
+
+// the fixed size variants are flattened: every call that can be inlined 
+// (in the amalgamation that includes chacha20) is inlined with the constant
+// sizes. The poly1305 backends are called through a pointer, so they stay calls.
+#if defined(__GNUC__) && !defined(PORTABLE_8439_SMALL)
+#   define FIXED_ATTRIBUTES __attribute__((flatten))
+#else
+#   define FIXED_ATTRIBUTES
+#endif
+
+#define FIXED_DEFINE(size, ad_size) \
+    PORTABLE_8439_API FIXED_ATTRIBUTES size_t portable_chacha20_poly1305_encrypt_##size##_##ad_size( \
+        uint8_t *restrict cipher_text, \
+        const portable_8439_key *key, \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        const uint8_t *restrict plain_text \
+    ) { \
+        return encrypt_with_key(cipher_text, KEY_WORDS(key), nonce, NULL, ad, ad_size, plain_text, size, 20); \
+    } \
+    PORTABLE_8439_API FIXED_ATTRIBUTES size_t portable_chacha20_poly1305_decrypt_##size##_##ad_size( \
+        uint8_t *restrict plain_text, \
+        const portable_8439_key *key, \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        const uint8_t *restrict cipher_text \
+    ) { \
+        return decrypt_with_key(plain_text, KEY_WORDS(key), nonce, NULL, ad, ad_size, cipher_text, size + RFC_8439_TAG_SIZE, 20); \
+    }
+
+PORTABLE_8439_FIXED_SIZES(FIXED_DEFINE)
+
+// the incremental api, the public struct hides the state for the same reason
+// as the key context
+typedef struct stream_state {
+    chacha20_key key;
+    uint8_t nonce[RFC_8439_NONCE_SIZE];
+    uint32_t counter;
+    poly1305_context poly;
+    uint64_t ad_size;
+    uint64_t text_size;
+    // key stream left over from the last partial block, starts at keystream_used
+    uint8_t keystream[__CHACHA20_BLOCK_SIZE];
+    uint32_t keystream_used;
+} stream_state;
+
+#define STREAM_STATE(stream) ((stream_state *)(stream)->opaque)
+typedef char __check_stream_size[sizeof(((portable_8439_stream *)0)->opaque) >= sizeof(stream_state) ? 1 : -1];
+
+PORTABLE_8439_API void portable_chacha20_poly1305_stream_init(
+    portable_8439_stream *stream,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+) {
+    stream_state *state = STREAM_STATE(stream);
+    state->key = *KEY_WORDS(key);
+    memcpy(state->nonce, nonce, RFC_8439_NONCE_SIZE);
+    state->counter = 1;
+    state->ad_size = ad_size;
+    state->text_size = 0;
+    state->keystream_used = __CHACHA20_BLOCK_SIZE;
+    poly1305_begin_mac(&state->poly, &state->key, nonce, NULL, ad, ad_size, 20);
+}
+
+// same as chacha20_xor_stream_key, but continues where the last call 
+// stopped, also in the middle of a block
+// dest can be source, the rings below en/decrypt in place
+static PORTABLE_8439_DECL void stream_xor(stream_state *state, uint8_t *dest, const uint8_t *source, size_t size) {
+    while (size > 0 && state->keystream_used < __CHACHA20_BLOCK_SIZE) {
+        *dest++ = *source++ ^ state->keystream[state->keystream_used++];
+        size--;
+    }
+    size_t full_blocks = size / __CHACHA20_BLOCK_SIZE;
+    if (full_blocks > 0) {
+        chacha20_xor_stream_key(dest, source, full_blocks * __CHACHA20_BLOCK_SIZE, &state->key, state->nonce, state->counter);
+        state->counter += (uint32_t)full_blocks;
+        dest += full_blocks * __CHACHA20_BLOCK_SIZE;
+        source += full_blocks * __CHACHA20_BLOCK_SIZE;
+        size -= full_blocks * __CHACHA20_BLOCK_SIZE;
+    }
+    if (size > 0) {
+        static const uint8_t zero_block[__CHACHA20_BLOCK_SIZE] = { 0 };
+        chacha20_xor_stream_key(state->keystream, zero_block, __CHACHA20_BLOCK_SIZE, &state->key, state->nonce, state->counter++);
+        for (state->keystream_used = 0; state->keystream_used < size; state->keystream_used++) {
+            dest[state->keystream_used] = source[state->keystream_used] ^ state->keystream[state->keystream_used];
+        }
+    }
+}
+
+PORTABLE_8439_API void portable_chacha20_poly1305_stream_wipe(portable_8439_stream *stream) {
+    volatile uint64_t *words = stream->opaque;
+    for (size_t i = 0; i < sizeof(stream->opaque) / sizeof(stream->opaque[0]); i++) {
+        words[i] = 0;
+    }
+}
+
+PORTABLE_8439_API void portable_chacha20_poly1305_seal_update(
+    portable_8439_stream *stream,
+    uint8_t *restrict cipher_text,
+    const uint8_t *restrict plain_text,
+    size_t size
+) {
+    stream_state *state = STREAM_STATE(stream);
+    stream_xor(state, cipher_text, plain_text, size);
+    poly1305_update(&state->poly, cipher_text, size);
+    state->text_size += size;
+}
+
+PORTABLE_8439_API void portable_chacha20_poly1305_seal_final(
+    portable_8439_stream *stream,
+    uint8_t tag[RFC_8439_TAG_SIZE]
+) {
+    stream_state *state = STREAM_STATE(stream);
+    poly1305_finish_mac(&state->poly, tag, state->ad_size, state->text_size);
+    portable_chacha20_poly1305_stream_wipe(stream);
+}
+
+PORTABLE_8439_API void portable_chacha20_poly1305_open_update(
+    portable_8439_stream *stream,
+    uint8_t *restrict plain_text,
+    const uint8_t *restrict cipher_text,
+    size_t size
+) {
+    stream_state *state = STREAM_STATE(stream);
+    poly1305_update(&state->poly, cipher_text, size);
+    stream_xor(state, plain_text, cipher_text, size);
+    state->text_size += size;
+}
+
+PORTABLE_8439_API int portable_chacha20_poly1305_open_final(
+    portable_8439_stream *stream,
+    const uint8_t tag[RFC_8439_TAG_SIZE]
+) {
+    stream_state *state = STREAM_STATE(stream);
+    uint8_t actual_mac[RFC_8439_TAG_SIZE];
+    uint64_t size = state->text_size;
+    poly1305_finish_mac(&state->poly, actual_mac, state->ad_size, size);
+    portable_chacha20_poly1305_stream_wipe(stream);
+    if (poly1305_verify(tag, actual_mac)) {
+        return 1;
+    }
+    TRACE_AUTH_FAILURE(size);
+    return 0;
+}
+
+// a message in a ring is at most two segments: from offset to the end of the
+// ring, and the rest from the start of it
+#define RING_FIRST(capacity, offset, size) ((size) < (capacity) - (offset) ? (size) : (capacity) - (offset))
+
+// the tag can wrap as well
+static PORTABLE_8439_DECL void ring_read_tag(uint8_t tag[RFC_8439_TAG_SIZE], const uint8_t *ring, size_t capacity, size_t offset) {
+    size_t first = RING_FIRST(capacity, offset, RFC_8439_TAG_SIZE);
+    memcpy(tag, ring + offset, first);
+    memcpy(tag + first, ring, RFC_8439_TAG_SIZE - first);
+}
+
+static PORTABLE_8439_DECL void ring_write_tag(uint8_t *ring, size_t capacity, size_t offset, const uint8_t tag[RFC_8439_TAG_SIZE]) {
+    size_t first = RING_FIRST(capacity, offset, RFC_8439_TAG_SIZE);
+    memcpy(ring + offset, tag, first);
+    memcpy(ring, tag + first, RFC_8439_TAG_SIZE - first);
+}
+
+PORTABLE_8439_API size_t portable_chacha20_poly1305_seal_ring(
+    uint8_t *ring,
+    size_t capacity,
+    size_t offset,
+    size_t plain_text_size,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+) {
+    if (offset >= capacity || capacity < RFC_8439_TAG_SIZE || plain_text_size > capacity - RFC_8439_TAG_SIZE) {
+        return -1;
+    }
+    portable_8439_stream stream;
+    portable_chacha20_poly1305_stream_init(&stream, key, nonce, ad, ad_size);
+    stream_state *state = STREAM_STATE(&stream);
+    size_t first = RING_FIRST(capacity, offset, plain_text_size);
+    stream_xor(state, ring + offset, ring + offset, first);
+    poly1305_update(&state->poly, ring + offset, first);
+    stream_xor(state, ring, ring, plain_text_size - first);
+    poly1305_update(&state->poly, ring, plain_text_size - first);
+
+    uint8_t tag[RFC_8439_TAG_SIZE];
+    poly1305_finish_mac(&state->poly, tag, ad_size, plain_text_size);
+    portable_chacha20_poly1305_stream_wipe(&stream);
+    ring_write_tag(ring, capacity, (offset + plain_text_size) % capacity, tag);
+    return plain_text_size + RFC_8439_TAG_SIZE;
+}
+
+PORTABLE_8439_API size_t portable_chacha20_poly1305_open_ring(
+    uint8_t *ring,
+    size_t capacity,
+    size_t offset,
+    size_t cipher_text_size,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+) {
+    if (offset >= capacity || cipher_text_size < RFC_8439_TAG_SIZE || cipher_text_size > capacity) {
+        return -1;
+    }
+    size_t size = cipher_text_size - RFC_8439_TAG_SIZE;
+    portable_8439_stream stream;
+    portable_chacha20_poly1305_stream_init(&stream, key, nonce, ad, ad_size);
+    stream_state *state = STREAM_STATE(&stream);
+    // first the mac over both segments, only decrypt when it matches
+    size_t first = RING_FIRST(capacity, offset, size);
+    poly1305_update(&state->poly, ring + offset, first);
+    poly1305_update(&state->poly, ring, size - first);
+    uint8_t actual_mac[RFC_8439_TAG_SIZE], tag[RFC_8439_TAG_SIZE];
+    poly1305_finish_mac(&state->poly, actual_mac, ad_size, size);
+    ring_read_tag(tag, ring, capacity, (offset + size) % capacity);
+    if (!poly1305_verify(tag, actual_mac)) {
+        portable_chacha20_poly1305_stream_wipe(&stream);
+        TRACE_AUTH_FAILURE(cipher_text_size);
+        return -1;
+    }
+    stream_xor(state, ring + offset, ring + offset, first);
+    stream_xor(state, ring, ring, size - first);
+    portable_chacha20_poly1305_stream_wipe(&stream);
+    return size;
+}
+
+// chacha20_xor_stream_key allows dest == source, the mac is written behind
+// the message, so neither needs the overlap check of encrypt/decrypt
+PORTABLE_8439_API size_t portable_chacha20_poly1305_seal_in_place(
+    uint8_t *message,
+    size_t plain_text_size,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+) {
+    TRACE_ENTRY(encrypt, plain_text_size, ad_size);
+    STATS_BEGIN(PORTABLE_8439_ENCRYPT, plain_text_size)
+    chacha20_xor_stream_key(message, message, plain_text_size, KEY_WORDS(key), nonce, 1);
+    poly1305_calculate_mac(message + plain_text_size, message, plain_text_size, KEY_WORDS(key), nonce, NULL, ad, ad_size, 20);
+    STATS_DONE(plain_text_size)
+    TRACE_RETURN(encrypt, plain_text_size + RFC_8439_TAG_SIZE);
+    return plain_text_size + RFC_8439_TAG_SIZE;
+}
+
+PORTABLE_8439_API size_t portable_chacha20_poly1305_open_in_place(
+    uint8_t *message,
+    size_t cipher_text_size,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+) {
+    TRACE_ENTRY(decrypt, cipher_text_size, ad_size);
+    STATS_BEGIN(PORTABLE_8439_DECRYPT, cipher_text_size)
+    if (cipher_text_size < RFC_8439_TAG_SIZE) {
+        STATS_FAILED(auth_failures)
+        TRACE_RETURN(decrypt, -1);
+        return -1;
+    }
+    size_t size = cipher_text_size - RFC_8439_TAG_SIZE;
+    uint8_t actual_mac[RFC_8439_TAG_SIZE];
+    poly1305_calculate_mac(actual_mac, message, size, KEY_WORDS(key), nonce, NULL, ad, ad_size, 20);
+    if (!poly1305_verify(message + size, actual_mac)) {
+        TRACE_AUTH_FAILURE(cipher_text_size);
+        STATS_FAILED(auth_failures)
+        TRACE_RETURN(decrypt, -1);
+        return -1;
+    }
+    chacha20_xor_stream_key(message, message, size, KEY_WORDS(key), nonce, 1);
+    STATS_DONE(size)
+    TRACE_RETURN(decrypt, size);
+    return size;
+}
+// ******* END:   portable8439.c ********
+#endif
+#endif
@@ -0,0 +1,327 @@
+#define _DEFAULT_SOURCE
+#include "portable8439-socket.h"
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#if defined(__linux__)
+#   include <linux/errqueue.h>
+#   include <netinet/in.h>
+#endif
+
+#if defined(__linux__) && defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#   define __HAVE_ZEROCOPY
+#endif
+
+#ifndef MSG_NOSIGNAL
+#   define MSG_NOSIGNAL (0)
+#endif
+
+#define FRAME_MAX (UINT32_MAX)
+
+// same nonce as the transport sessions: 4 zero bytes and the little endian
+// counter of the frame
+static void make_nonce(uint8_t nonce[RFC_8439_NONCE_SIZE], uint64_t counter) {
+    memset(nonce, 0, 4);
+    for (unsigned int i = 0; i < 8; i++) {
+        nonce[4 + i] = (uint8_t)(counter >> (8 * i));
+    }
+}
+
+static void write_header(uint8_t header[PORTABLE_8439_FRAME_HEADER_SIZE], size_t size) {
+    header[0] = (uint8_t)(size >> 24);
+    header[1] = (uint8_t)(size >> 16);
+    header[2] = (uint8_t)(size >> 8);
+    header[3] = (uint8_t)size;
+}
+
+static size_t read_header(const uint8_t header[PORTABLE_8439_FRAME_HEADER_SIZE]) {
+    return (size_t)header[0] << 24 | (size_t)header[1] << 16 | (size_t)header[2] << 8 | (size_t)header[3];
+}
+
+void portable_8439_socket_writer_init(
+    portable_8439_socket_writer *writer,
+    int fd,
+    const uint8_t key[RFC_8439_KEY_SIZE],
+    uint8_t *buffer,
+    size_t buffer_size,
+    int flags
+) {
+    memset(writer, 0, sizeof(portable_8439_socket_writer));
+    portable_chacha20_poly1305_key_init(&writer->key, key);
+    writer->fd = fd;
+    writer->buffer = buffer;
+    writer->buffer_size = buffer_size;
+#ifdef __HAVE_ZEROCOPY
+    if (flags & PORTABLE_8439_SOCKET_ZEROCOPY) {
+        int enable = 1;
+        writer->zerocopy = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) == 0;
+    }
+#else
+    (void)flags;
+#endif
+}
+
+int portable_8439_socket_writer_zerocopy_active(const portable_8439_socket_writer *writer) {
+    return writer->zerocopy;
+}
+
+// block until the kernel doesn't need the buffer anymore, the completions
+// of MSG_ZEROCOPY come in through the error queue of the socket
+static int wait_zerocopy(portable_8439_socket_writer *writer) {
+#ifdef __HAVE_ZEROCOPY
+    while (writer->zerocopy_done != writer->zerocopy_sent) {
+        uint8_t control[128];
+        struct msghdr message = { .msg_control = control, .msg_controllen = sizeof(control) };
+        if (recvmsg(writer->fd, &message, MSG_ERRQUEUE) < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                // POLLERR is reported without asking for it
+                struct pollfd error_queue = { .fd = writer->fd, .events = 0 };
+                if (poll(&error_queue, 1, -1) < 0 && errno != EINTR) {
+                    return 0;
+                }
+                if ((error_queue.revents & (POLLERR | POLLHUP)) == POLLHUP) {
+                    errno = EPIPE;
+                    return 0;
+                }
+                continue;
+            }
+            return 0;
+        }
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&message); c != NULL; c = CMSG_NXTHDR(&message, c)) {
+            if ((c->cmsg_level == SOL_IP && c->cmsg_type == IP_RECVERR)
+                || (c->cmsg_level == SOL_IPV6 && c->cmsg_type == IPV6_RECVERR)) {
+                struct sock_extended_err error;
+                memcpy(&error, CMSG_DATA(c), sizeof(error));
+                if (error.ee_origin == SO_EE_ORIGIN_ZEROCOPY && error.ee_errno == 0) {
+                    // ee_info to ee_data (inclusive) are done, they complete in order
+                    writer->zerocopy_done = error.ee_data + 1;
+                }
+            }
+        }
+    }
+#else
+    (void)writer;
+#endif
+    return 1;
+}
+
+void portable_8439_socket_writer_wipe(portable_8439_socket_writer *writer) {
+    wait_zerocopy(writer);
+    portable_chacha20_poly1305_key_wipe(&writer->key);
+    memset(writer, 0, sizeof(portable_8439_socket_writer));
+}
+
+// sendmsg until all of it is out, the iovecs are updated on the way
+static int send_all(portable_8439_socket_writer *writer, struct iovec *parts, size_t count) {
+    int flags = MSG_NOSIGNAL;
+#ifdef __HAVE_ZEROCOPY
+    flags |= writer->zerocopy ? MSG_ZEROCOPY : 0;
+#endif
+    while (count > 0) {
+        struct msghdr message = { .msg_iov = parts, .msg_iovlen = count };
+        ssize_t sent = sendmsg(writer->fd, &message, flags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        writer->zerocopy_sent += writer->zerocopy;
+        size_t left = (size_t)sent;
+        while (count > 0 && left >= parts->iov_len) {
+            left -= parts->iov_len;
+            parts++;
+            count--;
+        }
+        if (count > 0) {
+            parts->iov_base = (uint8_t *)parts->iov_base + left;
+            parts->iov_len -= left;
+        }
+    }
+    return 1;
+}
+
+// seals the plain text pieces into cipher_text, and sets up the header &
+// tag of frame index of the batch
+static void seal_frame(
+    portable_8439_socket_writer *writer,
+    size_t index,
+    uint8_t *cipher_text,
+    size_t size,
+    const struct iovec *plain_text,
+    int count
+) {
+    uint8_t nonce[RFC_8439_NONCE_SIZE];
+    make_nonce(nonce, writer->counter++);
+    write_header(writer->headers[index], size);
+    portable_8439_stream stream;
+    portable_chacha20_poly1305_stream_init(&stream, &writer->key, nonce, writer->headers[index], PORTABLE_8439_FRAME_HEADER_SIZE);
+    for (int i = 0; i < count; i++) {
+        portable_chacha20_poly1305_seal_update(&stream, cipher_text, plain_text[i].iov_base, plain_text[i].iov_len);
+        cipher_text += plain_text[i].iov_len;
+    }
+    portable_chacha20_poly1305_seal_final(&stream, writer->tags[index]);
+}
+
+static size_t total_size(const struct iovec *pieces, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (pieces[i].iov_len > FRAME_MAX - total) {
+            return (size_t)-1;
+        }
+        total += pieces[i].iov_len;
+    }
+    return total;
+}
+
+size_t portable_8439_socket_writev(
+    portable_8439_socket_writer *writer,
+    const struct iovec *plain_text,
+    int count
+) {
+    size_t size = total_size(plain_text, count < 0 ? 0 : (size_t)count);
+    if (size == (size_t)-1 || size > writer->buffer_size) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (!wait_zerocopy(writer)) {
+        return -1;
+    }
+    seal_frame(writer, 0, writer->buffer, size, plain_text, count);
+    struct iovec parts[3] = {
+        { writer->headers[0], PORTABLE_8439_FRAME_HEADER_SIZE },
+        { writer->buffer, size },
+        { writer->tags[0], RFC_8439_TAG_SIZE }
+    };
+    return send_all(writer, parts, 3) ? size : (size_t)-1;
+}
+
+size_t portable_8439_socket_write(
+    portable_8439_socket_writer *writer,
+    const uint8_t *plain_text,
+    size_t size
+) {
+    struct iovec piece = { (void *)plain_text, size };
+    return portable_8439_socket_writev(writer, &piece, 1);
+}
+
+size_t portable_8439_socket_write_frames(
+    portable_8439_socket_writer *writer,
+    const struct iovec *messages,
+    size_t count
+) {
+    if (count > PORTABLE_8439_SOCKET_BATCH) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (messages[i].iov_len > FRAME_MAX || messages[i].iov_len > writer->buffer_size - total) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        total += messages[i].iov_len;
+    }
+    if (!wait_zerocopy(writer)) {
+        return -1;
+    }
+    struct iovec parts[3 * PORTABLE_8439_SOCKET_BATCH];
+    uint8_t *cipher_text = writer->buffer;
+    for (size_t i = 0; i < count; i++) {
+        seal_frame(writer, i, cipher_text, messages[i].iov_len, &messages[i], 1);
+        parts[3 * i] = (struct iovec){ writer->headers[i], PORTABLE_8439_FRAME_HEADER_SIZE };
+        parts[3 * i + 1] = (struct iovec){ cipher_text, messages[i].iov_len };
+        parts[3 * i + 2] = (struct iovec){ writer->tags[i], RFC_8439_TAG_SIZE };
+        cipher_text += messages[i].iov_len;
+    }
+    return send_all(writer, parts, 3 * count) ? count : (size_t)-1;
+}
+
+void portable_8439_socket_reader_init(
+    portable_8439_socket_reader *reader,
+    int fd,
+    const uint8_t key[RFC_8439_KEY_SIZE],
+    uint8_t *buffer,
+    size_t buffer_size
+) {
+    memset(reader, 0, sizeof(portable_8439_socket_reader));
+    portable_chacha20_poly1305_key_init(&reader->key, key);
+    reader->fd = fd;
+    reader->buffer = buffer;
+    reader->buffer_size = buffer_size;
+}
+
+void portable_8439_socket_reader_wipe(portable_8439_socket_reader *reader) {
+    portable_chacha20_poly1305_key_wipe(&reader->key);
+    if (reader->buffer != NULL) {
+        memset(reader->buffer, 0, reader->buffer_size);
+    }
+    memset(reader, 0, sizeof(portable_8439_socket_reader));
+}
+
+int portable_8439_socket_read(
+    portable_8439_socket_reader *reader,
+    const uint8_t **message,
+    size_t *size
+) {
+    *message = NULL;
+    *size = 0;
+    if (reader->buffer_size < PORTABLE_8439_FRAME_OVERHEAD) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    for (;;) {
+        size_t available = reader->end - reader->start;
+        size_t needed = PORTABLE_8439_FRAME_HEADER_SIZE;
+        if (available >= PORTABLE_8439_FRAME_HEADER_SIZE) {
+            size_t plain_size = read_header(reader->buffer + reader->start);
+            if (plain_size > reader->buffer_size - PORTABLE_8439_FRAME_OVERHEAD) {
+                errno = EMSGSIZE;
+                return -1;
+            }
+            needed = plain_size + PORTABLE_8439_FRAME_OVERHEAD;
+            if (available >= needed) {
+                // the whole frame is here, open it where it is
+                uint8_t *frame = reader->buffer + reader->start;
+                uint8_t nonce[RFC_8439_NONCE_SIZE];
+                make_nonce(nonce, reader->counter);
+                if (portable_chacha20_poly1305_open_in_place(frame + PORTABLE_8439_FRAME_HEADER_SIZE, plain_size + RFC_8439_TAG_SIZE,
+                        &reader->key, nonce, frame, PORTABLE_8439_FRAME_HEADER_SIZE) != plain_size) {
+                    errno = EBADMSG;
+                    return -1;
+                }
+                reader->counter++;
+                reader->start += needed;
+                *message = frame + PORTABLE_8439_FRAME_HEADER_SIZE;
+                *size = plain_size;
+                return 1;
+            }
+        }
+        // make room for the rest of the frame at the end of the buffer
+        if (available == 0) {
+            reader->start = reader->end = 0;
+        }
+        else if (reader->start + needed > reader->buffer_size) {
+            memmove(reader->buffer, reader->buffer + reader->start, available);
+            reader->start = 0;
+            reader->end = available;
+        }
+        ssize_t received = read(reader->fd, reader->buffer + reader->end, reader->buffer_size - reader->end);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (received == 0) {
+            if (available == 0) {
+                return 0;
+            }
+            errno = EPIPE;
+            return -1;
+        }
+        reader->end += (size_t)received;
+    }
+}
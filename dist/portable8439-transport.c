@@ -0,0 +1,210 @@
+#include "portable8439-transport.h"
+#include <string.h>
+
+#if !defined(__GNUC__)
+#   error "portable8439-transport needs the __atomic extensions of GCC or Clang"
+#endif
+
+// like WireGuard, stop well before the counter wraps
+#define REJECT_AFTER_MESSAGES (UINT64_MAX - (1 << 13))
+
+#define SLOT_BITS (32)
+#define SLOT_BLOCK(slot) ((uint32_t)((slot) >> 32))
+#define SLOT_SEEN(slot) ((uint32_t)(slot))
+#define SLOT(block, seen) (((uint64_t)(block) << 32) | (uint64_t)(seen))
+
+static void make_nonce(uint8_t nonce[RFC_8439_NONCE_SIZE], uint64_t counter) {
+    memset(nonce, 0, 4);
+    for (unsigned int i = 0; i < 8; i++) {
+        nonce[4 + i] = (uint8_t)(counter >> (8 * i));
+    }
+}
+
+void portable_8439_transport_init(
+    portable_8439_transport *transport,
+    const uint8_t send_key[RFC_8439_KEY_SIZE],
+    const uint8_t receive_key[RFC_8439_KEY_SIZE]
+) {
+    memset(transport, 0, sizeof(portable_8439_transport));
+    portable_chacha20_poly1305_key_init(&transport->send_key, send_key);
+    portable_chacha20_poly1305_key_init(&transport->receive_key, receive_key);
+}
+
+void portable_8439_transport_wipe(portable_8439_transport *transport) {
+    portable_chacha20_poly1305_key_wipe(&transport->send_key);
+    portable_chacha20_poly1305_key_wipe(&transport->receive_key);
+    memset(transport, 0, sizeof(portable_8439_transport));
+}
+
+static size_t seal_with_counter(
+    portable_8439_transport *transport,
+    uint8_t *restrict cipher_text,
+    uint64_t counter,
+    const uint8_t *restrict ad,
+    size_t ad_size,
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+) {
+    if (counter >= REJECT_AFTER_MESSAGES) {
+        return -1;
+    }
+    uint8_t nonce[RFC_8439_NONCE_SIZE];
+    make_nonce(nonce, counter);
+    return portable_chacha20_poly1305_encrypt_key(cipher_text, &transport->send_key, nonce, ad, ad_size, plain_text, plain_text_size);
+}
+
+size_t portable_8439_transport_seal(
+    portable_8439_transport *transport,
+    uint8_t *restrict cipher_text,
+    uint64_t *counter,
+    const uint8_t *restrict ad,
+    size_t ad_size,
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+) {
+    *counter = __atomic_fetch_add(&transport->send_counter, 1, __ATOMIC_RELAXED);
+    return seal_with_counter(transport, cipher_text, *counter, ad, ad_size, plain_text, plain_text_size);
+}
+
+size_t portable_8439_transport_seal_burst(
+    portable_8439_transport *transport,
+    portable_8439_packet *packets,
+    size_t count
+) {
+    uint64_t counter = __atomic_fetch_add(&transport->send_counter, count, __ATOMIC_RELAXED);
+    size_t sealed = 0;
+    for (size_t i = 0; i < count; i++) {
+        portable_8439_packet *packet = &packets[i];
+        packet->counter = counter + i;
+        packet->result = seal_with_counter(transport, packet->output, packet->counter,
+            packet->ad, packet->ad_size, packet->input, packet->input_size);
+        sealed += packet->result != (size_t)-1;
+    }
+    return sealed;
+}
+
+// The anti-replay window. Every slot tracks one block of 32 counters, and
+// holds the number of that block together with the bits of the counters
+// seen, so a single CAS both checks & marks a counter, or recycles the slot
+// for a newer block. A slot that holds a newer block than the counter means
+// the counter is too old. This alone already rejects every replay, the
+// largest counter only limits how far behind a packet can be.
+static int too_old(const portable_8439_transport *transport, uint64_t counter) {
+    uint64_t largest = __atomic_load_n(&transport->receive_largest, __ATOMIC_RELAXED);
+    return counter >= REJECT_AFTER_MESSAGES
+        || (largest >= PORTABLE_8439_REPLAY_WINDOW && counter <= largest - PORTABLE_8439_REPLAY_WINDOW);
+}
+
+// cheap check before decrypting, mark_seen has the final word
+static int maybe_fresh(const portable_8439_transport *transport, uint64_t counter) {
+    if (too_old(transport, counter)) {
+        return 0;
+    }
+    uint32_t block = (uint32_t)(counter / SLOT_BITS);
+    uint64_t slot = __atomic_load_n(&transport->replay[block % PORTABLE_8439_REPLAY_SLOTS], __ATOMIC_RELAXED);
+    int32_t age = (int32_t)(block - SLOT_BLOCK(slot));
+    return age > 0 || (age == 0 && !(SLOT_SEEN(slot) & ((uint32_t)1 << (counter % SLOT_BITS))));
+}
+
+static int mark_seen(portable_8439_transport *transport, uint64_t counter) {
+    if (too_old(transport, counter)) {
+        return 0;
+    }
+    // the block number is truncated to 32 bits, the difference with the
+    // block in the slot is small enough (the window) to survive that
+    uint32_t block = (uint32_t)(counter / SLOT_BITS);
+    uint32_t bit = (uint32_t)1 << (counter % SLOT_BITS);
+    uint64_t *target = &transport->replay[block % PORTABLE_8439_REPLAY_SLOTS];
+    uint64_t slot = __atomic_load_n(target, __ATOMIC_RELAXED);
+    for (;;) {
+        int32_t age = (int32_t)(block - SLOT_BLOCK(slot));
+        uint64_t next;
+        if (age > 0) {
+            next = SLOT(block, bit);
+        }
+        else if (age == 0 && !(SLOT_SEEN(slot) & bit)) {
+            next = slot | bit;
+        }
+        else {
+            return 0;
+        }
+        if (__atomic_compare_exchange_n(target, &slot, next, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    return 1;
+}
+
+static void advance_largest(portable_8439_transport *transport, uint64_t counter) {
+    uint64_t largest = __atomic_load_n(&transport->receive_largest, __ATOMIC_RELAXED);
+    while (counter > largest
+        && !__atomic_compare_exchange_n(&transport->receive_largest, &largest, counter, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// decrypts and marks the counter, without moving the window
+static size_t open_packet(
+    portable_8439_transport *transport,
+    uint8_t *restrict plain_text,
+    uint64_t counter,
+    const uint8_t *restrict ad,
+    size_t ad_size,
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+) {
+    if (!maybe_fresh(transport, counter)) {
+        return -1;
+    }
+    uint8_t nonce[RFC_8439_NONCE_SIZE];
+    make_nonce(nonce, counter);
+    size_t result = portable_chacha20_poly1305_decrypt_key(plain_text, &transport->receive_key, nonce, ad, ad_size, cipher_text, cipher_text_size);
+    if (result == (size_t)-1) {
+        return -1;
+    }
+    if (!mark_seen(transport, counter)) {
+        // another thread opened the same counter in the meantime
+        memset(plain_text, 0, result);
+        return -1;
+    }
+    return result;
+}
+
+size_t portable_8439_transport_open(
+    portable_8439_transport *transport,
+    uint8_t *restrict plain_text,
+    uint64_t counter,
+    const uint8_t *restrict ad,
+    size_t ad_size,
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+) {
+    size_t result = open_packet(transport, plain_text, counter, ad, ad_size, cipher_text, cipher_text_size);
+    if (result != (size_t)-1) {
+        advance_largest(transport, counter);
+    }
+    return result;
+}
+
+size_t portable_8439_transport_open_burst(
+    portable_8439_transport *transport,
+    portable_8439_packet *packets,
+    size_t count
+) {
+    // the window only moves once per burst, the slots still catch the
+    // replays inside of the burst
+    size_t opened = 0;
+    uint64_t largest = 0;
+    for (size_t i = 0; i < count; i++) {
+        portable_8439_packet *packet = &packets[i];
+        packet->result = open_packet(transport, packet->output, packet->counter,
+            packet->ad, packet->ad_size, packet->input, packet->input_size);
+        if (packet->result != (size_t)-1) {
+            opened++;
+            largest = packet->counter > largest ? packet->counter : largest;
+        }
+    }
+    if (opened > 0) {
+        advance_largest(transport, largest);
+    }
+    return opened;
+}
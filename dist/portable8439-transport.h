@@ -0,0 +1,111 @@
+#ifndef PORTABLE_8439_TRANSPORT_H
+#define PORTABLE_8439_TRANSPORT_H
+/*
+ Transport sessions in the style of WireGuard: a pair of key contexts (one
+ per direction), a 64-bit message counter as the nonce for sealing, and a
+ sliding window anti-replay filter for opening. Needs GCC/Clang (atomics),
+ it's not part of the portable8439 library itself, compile
+ portable8439-transport.c next to it.
+
+ - seal takes the next counter (an atomic add, so any number of threads can
+     seal on the same session), the nonce is 4 zero bytes followed by the
+     little endian counter. Send the counter along with the cipher text.
+ - open checks the counter of the packet against the window before and
+     after decrypting, a counter is accepted once and only when it's not too
+     far behind the largest counter seen. The window is lock-free, any
+     number of threads can open on the same session.
+ - the burst variants handle many packets in one call, seal takes all the
+     counters at once.
+*/
+
+#include "portable8439.h"
+
+// how far behind the largest counter seen a packet can arrive and still be
+// accepted, the window is tracked in slots of 32 counters
+#define PORTABLE_8439_REPLAY_SLOTS (64)
+#define PORTABLE_8439_REPLAY_WINDOW ((PORTABLE_8439_REPLAY_SLOTS - 1) * 32)
+
+typedef struct portable_8439_transport {
+    // private
+    portable_8439_key send_key;
+    portable_8439_key receive_key;
+    uint64_t send_counter;
+    uint64_t receive_largest;
+    // per slot: the upper 32 bits are the number of the block of 32 counters
+    // in it, the lower 32 bits which counters of that block were seen
+    uint64_t replay[PORTABLE_8439_REPLAY_SLOTS];
+} portable_8439_transport;
+
+/*
+    Start a session, the counters start at 0. Wipe it when you are done.
+*/
+void portable_8439_transport_init(
+    portable_8439_transport *transport,
+    const uint8_t send_key[RFC_8439_KEY_SIZE],
+    const uint8_t receive_key[RFC_8439_KEY_SIZE]
+);
+
+void portable_8439_transport_wipe(portable_8439_transport *transport);
+
+/*
+    Seal plain_text with the next counter of the session, the counter is
+    written to counter. Returns the size written to cipher_text
+    (plain_text_size + RFC_8439_TAG_SIZE), -1 for overlapping buffers or when
+    the session ran out of counters (rekey long before that).
+*/
+size_t portable_8439_transport_seal(
+    portable_8439_transport *transport,
+    uint8_t *restrict cipher_text,
+    uint64_t *counter,
+    const uint8_t *restrict ad,
+    size_t ad_size,
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+);
+
+/*
+    Open a packet that was sealed with counter. Returns the size written to
+    plain_text, -1 when the packet is corrupted, replayed, or too old.
+*/
+size_t portable_8439_transport_open(
+    portable_8439_transport *transport,
+    uint8_t *restrict plain_text,
+    uint64_t counter,
+    const uint8_t *restrict ad,
+    size_t ad_size,
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+);
+
+/*
+    A packet of a burst: for seal the input is the plain text and counter
+    is written, for open the input is the cipher text and counter is read.
+    result is the return value of the single packet variant.
+*/
+typedef struct portable_8439_packet {
+    uint64_t counter;
+    const uint8_t *ad;
+    size_t ad_size;
+    const uint8_t *input;
+    size_t input_size;
+    uint8_t *output;
+    size_t result;
+} portable_8439_packet;
+
+/*
+    Seal or open count packets, returns the number of packets that succeeded,
+    the result of every packet tells which.
+*/
+size_t portable_8439_transport_seal_burst(
+    portable_8439_transport *transport,
+    portable_8439_packet *packets,
+    size_t count
+);
+
+size_t portable_8439_transport_open_burst(
+    portable_8439_transport *transport,
+    portable_8439_packet *packets,
+    size_t count
+);
+
+#endif
@@ -10,38 +10,22 @@
 //  - safe for architectures that don't support unaligned reads
 //
 // Next to this, we try to be fast as possible without resorting inline assembly. 
+// On GCC & Clang we optionally use vector extensions (see __HAVE_VECTORS).
 
-// based on https://sourceforge.net/p/predef/wiki/Endianness/
-#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__) && \
-        __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-#   define __HAVE_LITTLE_ENDIAN 1
-#elif defined(__LITTLE_ENDIAN__) || \
-        defined(__ARMEL__) || \
-        defined(__THUMBEL__) || \
-        defined(__AARCH64EL__) || \
-        defined(_MIPSEL) || \
-        defined(__MIPSEL) || \
-        defined(__MIPSEL__) || \
-        defined(__XTENSA_EL__) || \
-        defined(__AVR__) || \
-        defined(LITTLE_ENDIAN)
-#   define __HAVE_LITTLE_ENDIAN 1
-#endif
-
-#ifndef TEST_SLOW_PATH
-#   if defined(__HAVE_LITTLE_ENDIAN)
-#       define FAST_PATH
-#   endif
-#endif
+// the endianness & alignment detection is shared with poly1305-donna, and so
+// are the build profile and the prefetch distance
+#include "portable-endian.h"
+#include "portable-config.h"
 
 
 #define CHACHA20_STATE_WORDS (16)
 #define CHACHA20_BLOCK_SIZE (CHACHA20_STATE_WORDS * sizeof(uint32_t))
 
 
-#ifdef FAST_PATH
+#ifdef PORTABLE_UNALIGNED_WORDS
 #define store_32_le(target, source) \
-    memcpy(&(target), source, sizeof(uint32_t))
+    memcpy(&(target), source, sizeof(uint32_t)); \
+    (target) = PORTABLE_LE32(target)
 #else
 #define store_32_le(target, source) \
     target \
@@ -53,9 +37,20 @@
 
 
 
+void chacha20_key_init(chacha20_key *expanded, const uint8_t key[CHACHA20_KEY_SIZE]) {
+    store_32_le(expanded->words[0], key);
+    store_32_le(expanded->words[1], key + 4);
+    store_32_le(expanded->words[2], key + 8);
+    store_32_le(expanded->words[3], key + 12);
+    store_32_le(expanded->words[4], key + 16);
+    store_32_le(expanded->words[5], key + 20);
+    store_32_le(expanded->words[6], key + 24);
+    store_32_le(expanded->words[7], key + 28);
+}
+
 static void initialize_state(
         uint32_t state[CHACHA20_STATE_WORDS], 
-        const uint8_t key[CHACHA20_KEY_SIZE],
+        const chacha20_key *key,
         const uint8_t nonce[CHACHA20_NONCE_SIZE],
         uint32_t counter
 ) {
@@ -66,14 +61,7 @@ static void initialize_state(
     state[1]  = 0x3320646e;
     state[2]  = 0x79622d32;
     state[3]  = 0x6b206574;
-    store_32_le(state[4], key);
-    store_32_le(state[5], key + 4);
-    store_32_le(state[6], key + 8);
-    store_32_le(state[7], key + 12);
-    store_32_le(state[8], key + 16);
-    store_32_le(state[9], key + 20);
-    store_32_le(state[10], key + 24);
-    store_32_le(state[11], key + 28);
+    memcpy(state + 4, key->words, sizeof(key->words));
     state[12] = counter;
     store_32_le(state[13], nonce);
     store_32_le(state[14], nonce + 4);
@@ -95,7 +83,54 @@ static void initialize_state(
     x(0) x(1) x(2)  x(3)  x(4)  x(5)  x(6)  x(7) \
     x(8) x(9) x(10) x(11) x(12) x(13) x(14) x(15)
 
-static void core_block(const uint32_t *restrict start, uint32_t *restrict output) {
+// the rounds in pairs of a column & a diagonal round, shared by all the block
+// functions, Q is their quarter round on the indexes of the state words.
+// ChaCha20 is 10 double rounds, the reduced variants 6 (ChaCha12) & 4 (ChaCha8)
+#define DOUBLE_ROUNDS(Q, double_rounds) \
+    for (unsigned int i = 0; i < (double_rounds); i++) { \
+        Q(0, 4,  8, 12); \
+        Q(1, 5,  9, 13); \
+        Q(2, 6, 10, 14); \
+        Q(3, 7, 11, 15); \
+        Q(0, 5, 10, 15); \
+        Q(1, 6, 11, 12); \
+        Q(2, 7,  8, 13); \
+        Q(3, 4,  9, 14); \
+    }
+
+// the round count is a parameter of all the block functions, the public 
+// functions of every variant get their own copy of the whole path (inlined
+// with the round count as a constant), so the round loops can be unrolled
+#if defined(PORTABLE_8439_SMALL)
+#   define CHACHA_INLINE
+#elif defined(__GNUC__)
+#   define CHACHA_INLINE inline __attribute__((always_inline))
+#else
+#   define CHACHA_INLINE inline
+#endif
+
+#ifdef PORTABLE_8439_SMALL
+// the 8 quarter rounds of a double round, the 4 state words of each packed
+// in a nibble. The rounds run on the output array, so no other copy of the
+// state is on the stack.
+static const uint16_t QUARTER_ROUNDS[8] = {
+    0x048c, 0x159d, 0x26ae, 0x37bf, 0x05af, 0x16bc, 0x278d, 0x349e
+};
+
+static CHACHA_INLINE void core_block(const uint32_t *restrict start, uint32_t *restrict output, unsigned int double_rounds) {
+    memcpy(output, start, CHACHA20_BLOCK_SIZE);
+    for (unsigned int q = 0; q < 8 * double_rounds; q++) {
+        unsigned int words = QUARTER_ROUNDS[q % 8];
+        uint32_t *a = output + (words >> 12), *b = output + ((words >> 8) & 0xF);
+        uint32_t *c = output + ((words >> 4) & 0xF), *d = output + (words & 0xF);
+        Qround(*a, *b, *c, *d)
+    }
+    for (unsigned int i = 0; i < CHACHA20_STATE_WORDS; i++) {
+        output[i] += start[i];
+    }
+}
+#else
+static CHACHA_INLINE void core_block(const uint32_t *restrict start, uint32_t *restrict output, unsigned int double_rounds) {
     // instead of working on the output array, 
     // we let the compiler allocate 16 local variables on the stack
     #define __LV(i) uint32_t __s##i = start[i];
@@ -103,50 +138,224 @@ static void core_block(const uint32_t *restrict start, uint32_t *restrict output
 
     #define __Q(a,b,c,d) Qround(__s##a, __s##b, __s##c, __s##d)
 
-    for (int i = 0; i < 10; i++) {
-        __Q(0, 4,  8, 12);
-        __Q(1, 5,  9, 13);
-        __Q(2, 6, 10, 14);
-        __Q(3, 7, 11, 15);
-        __Q(0, 5, 10, 15);
-        __Q(1, 6, 11, 12);
-        __Q(2, 7,  8, 13);
-        __Q(3, 4,  9, 14);
-    }
+    DOUBLE_ROUNDS(__Q, double_rounds)
 
     #define __FIN(i) output[i] = start[i] + __s##i;
     TIMES16(__FIN)
 }
+#endif
 
-#define U8(x) ((uint8_t)((x) & 0xFF))
+// Interleaved path: core_block is one long dependency chain, on wide 
+// out-of-order cores without SIMD we calculate 2 (or 3) independent blocks
+// in the same loop, so that their chains overlap. This needs 32 (or 48) live 
+// words, so by default we only do it on ISAs with 32 registers. 
+// Use -DCHACHA20_INTERLEAVE=1|2|3 to override.
+#ifndef CHACHA20_INTERLEAVE
+#   if defined(__aarch64__) || \
+        defined(__powerpc__) || \
+        defined(__powerpc64__) || \
+        defined(__riscv) || \
+        defined(__mips__) || \
+        defined(__loongarch__) || \
+        defined(__sparc__) || \
+        defined(__alpha__)
+#       define CHACHA20_INTERLEAVE (2)
+#   else
+#       define CHACHA20_INTERLEAVE (1)
+#   endif
+#endif
 
+#if CHACHA20_INTERLEAVE == 2
+// calculates 2 consecutive blocks starting at the counter in start
+static CHACHA_INLINE void core_block_interleaved(const uint32_t *restrict start, uint32_t *restrict output, unsigned int double_rounds) {
+    #define __LV2(i) uint32_t __s##i = start[i], __t##i = start[i];
+    TIMES16(__LV2)
+    __t12++;
 
-#ifdef FAST_PATH
-#   define xor32_le(dst, src, pad) \
-    uint32_t __value; \
-    memcpy(&__value, src, sizeof(uint32_t)); \
-    __value ^= *(pad); \
-    memcpy(dst, &__value, sizeof(uint32_t));
+    #define __Q2(a,b,c,d) \
+        Qround(__s##a, __s##b, __s##c, __s##d) \
+        Qround(__t##a, __t##b, __t##c, __t##d)
+
+    DOUBLE_ROUNDS(__Q2, double_rounds)
+
+    #define __FIN2(i) \
+        output[i] = start[i] + __s##i; \
+        output[CHACHA20_STATE_WORDS + i] = start[i] + __t##i;
+    TIMES16(__FIN2)
+    output[CHACHA20_STATE_WORDS + 12]++;
+}
+#elif CHACHA20_INTERLEAVE == 3
+// calculates 3 consecutive blocks starting at the counter in start
+static CHACHA_INLINE void core_block_interleaved(const uint32_t *restrict start, uint32_t *restrict output, unsigned int double_rounds) {
+    #define __LV3(i) uint32_t __s##i = start[i], __t##i = start[i], __u##i = start[i];
+    TIMES16(__LV3)
+    __t12 += 1;
+    __u12 += 2;
+
+    #define __Q3(a,b,c,d) \
+        Qround(__s##a, __s##b, __s##c, __s##d) \
+        Qround(__t##a, __t##b, __t##c, __t##d) \
+        Qround(__u##a, __u##b, __u##c, __u##d)
+
+    DOUBLE_ROUNDS(__Q3, double_rounds)
+
+    #define __FIN3(i) \
+        output[i] = start[i] + __s##i; \
+        output[CHACHA20_STATE_WORDS + i] = start[i] + __t##i; \
+        output[2 * CHACHA20_STATE_WORDS + i] = start[i] + __u##i;
+    TIMES16(__FIN3)
+    output[CHACHA20_STATE_WORDS + 12] += 1;
+    output[2 * CHACHA20_STATE_WORDS + 12] += 2;
+}
+#elif CHACHA20_INTERLEAVE != 1
+#   error "CHACHA20_INTERLEAVE should be 1, 2 or 3"
+#endif
+
+// Wide path: the GCC/Clang vector extensions let us calculate several blocks
+// at once without resorting to intrinsics or assembly, the compiler lowers
+// the vector operations to whatever SIMD unit the target has (SSE/AVX, NEON,
+// AltiVec/VSX, RISC-V V, ...). We only enable it when we know such a unit is
+// present, without one the vectors get lowered to scalar code that spills
+// all over the stack. The core_block above stays the C99 fallback.
+// Use -DCHACHA20_NO_VECTORS to disable and -DCHACHA20_VECTOR_WIDTH=4|8 to
+// pick the amount of blocks calculated in parallel.
+#if !defined(CHACHA20_NO_VECTORS) && defined(__GNUC__) && ( \
+        defined(__SSE2__) || \
+        defined(__ARM_NEON) || \
+        defined(__ARM_NEON__) || \
+        defined(__ALTIVEC__) || \
+        defined(__VSX__) || \
+        defined(__riscv_vector) || \
+        defined(__mips_msa) || \
+        defined(__wasm_simd128__))
+#   define __HAVE_VECTORS 1
+#   ifndef CHACHA20_VECTOR_WIDTH
+#       if defined(__AVX2__)
+#           define CHACHA20_VECTOR_WIDTH (8)
+#       else
+#           define CHACHA20_VECTOR_WIDTH (4)
+#       endif
+#   endif
+#endif
+
+#ifdef __HAVE_VECTORS
+typedef uint32_t chacha_vector __attribute__((vector_size(CHACHA20_VECTOR_WIDTH * sizeof(uint32_t))));
+
+#if CHACHA20_VECTOR_WIDTH == 8
+static const chacha_vector __LANES = { 0, 1, 2, 3, 4, 5, 6, 7 };
+#elif CHACHA20_VECTOR_WIDTH == 4
+static const chacha_vector __LANES = { 0, 1, 2, 3 };
+#else
+#   error "CHACHA20_VECTOR_WIDTH should be 4 or 8"
+#endif
+
+// calculates CHACHA20_VECTOR_WIDTH blocks, starting at the counter in start.
+// every lane of the vectors is a block, at the end we transpose them
+// so that output contains the key stream of the consecutive blocks
+static CHACHA_INLINE void core_block_wide(const uint32_t *restrict start, uint32_t *restrict output, unsigned int double_rounds) {
+    #define __LVW(i) chacha_vector __v##i = start[i] + (chacha_vector){ 0 };
+    TIMES16(__LVW)
+    __v12 += __LANES;
+
+    #define __QW(a,b,c,d) Qround(__v##a, __v##b, __v##c, __v##d)
+
+    DOUBLE_ROUNDS(__QW, double_rounds)
+
+    #define __FINW(i) __v##i += start[i];
+    TIMES16(__FINW)
+    __v12 += __LANES;
+
+    for (unsigned int b = 0; b < CHACHA20_VECTOR_WIDTH; b++) {
+        #define __OUTW(i) output[b * CHACHA20_STATE_WORDS + i] = __v##i[b];
+        TIMES16(__OUTW)
+    }
+}
+#endif
+
+// HChaCha20 (draft-irtf-cfrg-xchacha section 2.2): the rounds of a block
+// with the first 16 bytes of the nonce in place of the counter & nonce, 
+// without the final addition, words 0-3 & 12-15 are the subkey
+void hchacha20(chacha20_key *subkey, const chacha20_key *key, const uint8_t nonce[HCHACHA20_NONCE_SIZE]) {
+    uint32_t state[CHACHA20_STATE_WORDS];
+    initialize_state(state, key, nonce + 4, 0);
+    store_32_le(state[12], nonce);
+
+#ifdef PORTABLE_8439_SMALL
+    // the rounds of the block, without its final addition
+    uint32_t result[CHACHA20_STATE_WORDS];
+    core_block(state, result, 10);
+    for (unsigned int i = 0; i < 4; i++) {
+        subkey->words[i] = result[i] - state[i];
+        subkey->words[4 + i] = result[12 + i] - state[12 + i];
+    }
 #else
-#   define xor32_le(dst, src, pad) \
+    #define __LVH(i) uint32_t __h##i = state[i];
+    TIMES16(__LVH)
+
+    #define __QH(a,b,c,d) Qround(__h##a, __h##b, __h##c, __h##d)
+    DOUBLE_ROUNDS(__QH, 10)
+
+    subkey->words[0] = __h0;
+    subkey->words[1] = __h1;
+    subkey->words[2] = __h2;
+    subkey->words[3] = __h3;
+    subkey->words[4] = __h12;
+    subkey->words[5] = __h13;
+    subkey->words[6] = __h14;
+    subkey->words[7] = __h15;
+#endif
+}
+
+#define U8(x) ((uint8_t)((x) & 0xFF))
+
+
+#define xor32_bytes(dst, src, pad) \
     (dst)[0] = (src)[0] ^ U8(*(pad)); \
     (dst)[1] = (src)[1] ^ U8(*(pad) >> 8); \
     (dst)[2] = (src)[2] ^ U8(*(pad) >> 16); \
     (dst)[3] = (src)[3] ^ U8(*(pad) >> 24);
+
+#if defined(PORTABLE_UNALIGNED_WORDS) || defined(PORTABLE_ALIGNED_WORDS)
+#   define xor32_word(dst, src, pad) \
+    uint32_t __value; \
+    memcpy(&__value, src, sizeof(uint32_t)); \
+    __value ^= PORTABLE_LE32(*(pad)); \
+    memcpy(dst, &__value, sizeof(uint32_t));
 #endif
 
 #define index8_32(a, ix) ((a) + ((ix) * sizeof(uint32_t)))
 
-#define xor32_blocks(dest, source, pad, words) \
+#define xor32_loop(xor32, dest, source, pad, words) \
     for (unsigned int __i = 0; __i < words; __i++) { \
-        xor32_le(index8_32(dest, __i), index8_32(source, __i), (pad) + __i) \
+        xor32(index8_32(dest, __i), index8_32(source, __i), (pad) + __i) \
     }
 
+// aligned is only used on the alignment checking path, it's calculated once
+// per stream, as we always advance dest & source with whole words
+#if defined(PORTABLE_UNALIGNED_WORDS)
+#   define xor32_blocks(dest, source, pad, words, aligned) \
+    xor32_loop(xor32_word, dest, source, pad, words)
+#elif defined(PORTABLE_ALIGNED_WORDS)
+#   define xor32_blocks(dest, source, pad, words, aligned) \
+    if (aligned) { \
+        uint8_t *__dst = PORTABLE_ASSUME_ALIGNED(dest, sizeof(uint32_t)); \
+        const uint8_t *__src = PORTABLE_ASSUME_ALIGNED(source, sizeof(uint32_t)); \
+        xor32_loop(xor32_word, __dst, __src, pad, words) \
+    } \
+    else { \
+        xor32_loop(xor32_bytes, dest, source, pad, words) \
+    }
+#else
+#   define xor32_blocks(dest, source, pad, words, aligned) \
+    xor32_loop(xor32_bytes, dest, source, pad, words)
+#endif
+
 
-static void xor_block(uint8_t *restrict dest, const uint8_t *restrict source, const uint32_t *restrict pad, unsigned int chunk_size) {
+static void xor_block(uint8_t *dest, const uint8_t *source, const uint32_t *restrict pad, unsigned int chunk_size, int aligned) {
     unsigned int full_blocks = chunk_size / sizeof(uint32_t);
     // have to be carefull, we are going back from uint32 to uint8, so endianess matters again
-    xor32_blocks(dest, source, pad, full_blocks)
+    xor32_blocks(dest, source, pad, full_blocks, aligned)
+    (void)aligned;
 
     dest += full_blocks * sizeof(uint32_t);
     source += full_blocks * sizeof(uint32_t);
@@ -168,59 +377,271 @@ static void xor_block(uint8_t *restrict dest, const uint8_t *restrict source, co
     }
 }
 
-void chacha20_xor_stream(
-        uint8_t *restrict dest, 
-        const uint8_t *restrict source, 
+static CHACHA_INLINE void xor_stream(
+        uint8_t *dest, 
+        const uint8_t *source, 
         size_t length,
-        const uint8_t key[CHACHA20_KEY_SIZE],
+        const chacha20_key *key,
         const uint8_t nonce[CHACHA20_NONCE_SIZE],
-        uint32_t counter
+        uint32_t counter,
+        unsigned int double_rounds
 ) {
     uint32_t state[CHACHA20_STATE_WORDS];
     initialize_state(state, key, nonce, counter);
+#ifdef PORTABLE_ALIGNED_WORDS
+    const int aligned = PORTABLE_IS_ALIGNED(dest, sizeof(uint32_t))
+        && PORTABLE_IS_ALIGNED(source, sizeof(uint32_t));
+#else
+    const int aligned = 0;
+#endif
 
-    uint32_t pad[CHACHA20_STATE_WORDS];
     size_t full_blocks = length / CHACHA20_BLOCK_SIZE;
+#ifdef __HAVE_VECTORS
+    uint32_t wide_pad[CHACHA20_VECTOR_WIDTH * CHACHA20_STATE_WORDS];
+    for (; full_blocks >= CHACHA20_VECTOR_WIDTH; full_blocks -= CHACHA20_VECTOR_WIDTH) {
+        PORTABLE_PREFETCH_AHEAD(source, CHACHA20_VECTOR_WIDTH * CHACHA20_BLOCK_SIZE, full_blocks * CHACHA20_BLOCK_SIZE)
+        core_block_wide(state, wide_pad, double_rounds);
+        state[12] += CHACHA20_VECTOR_WIDTH;
+        xor32_blocks(dest, source, wide_pad, CHACHA20_VECTOR_WIDTH * CHACHA20_STATE_WORDS, aligned)
+        dest += CHACHA20_VECTOR_WIDTH * CHACHA20_BLOCK_SIZE;
+        source += CHACHA20_VECTOR_WIDTH * CHACHA20_BLOCK_SIZE;
+    }
+#endif
+#if CHACHA20_INTERLEAVE > 1
+    uint32_t interleaved_pad[CHACHA20_INTERLEAVE * CHACHA20_STATE_WORDS];
+    for (; full_blocks >= CHACHA20_INTERLEAVE; full_blocks -= CHACHA20_INTERLEAVE) {
+        PORTABLE_PREFETCH_AHEAD(source, CHACHA20_INTERLEAVE * CHACHA20_BLOCK_SIZE, full_blocks * CHACHA20_BLOCK_SIZE)
+        core_block_interleaved(state, interleaved_pad, double_rounds);
+        state[12] += CHACHA20_INTERLEAVE;
+        xor32_blocks(dest, source, interleaved_pad, CHACHA20_INTERLEAVE * CHACHA20_STATE_WORDS, aligned)
+        dest += CHACHA20_INTERLEAVE * CHACHA20_BLOCK_SIZE;
+        source += CHACHA20_INTERLEAVE * CHACHA20_BLOCK_SIZE;
+    }
+#endif
+    uint32_t pad[CHACHA20_STATE_WORDS];
     for (size_t b = 0; b < full_blocks; b++) {
-        core_block(state, pad);
+        PORTABLE_PREFETCH_AHEAD(source, CHACHA20_BLOCK_SIZE, (full_blocks - b) * CHACHA20_BLOCK_SIZE)
+        core_block(state, pad, double_rounds);
         increment_counter(state);
-        xor32_blocks(dest, source, pad, CHACHA20_STATE_WORDS)
+        xor32_blocks(dest, source, pad, CHACHA20_STATE_WORDS, aligned)
         dest += CHACHA20_BLOCK_SIZE;
         source += CHACHA20_BLOCK_SIZE;
     }
     unsigned int last_block = (unsigned int)(length % CHACHA20_BLOCK_SIZE);
     if (last_block > 0 ) {
-        core_block(state, pad);
-        xor_block(dest, source, pad, last_block);
+        core_block(state, pad, double_rounds);
+        xor_block(dest, source, pad, last_block, aligned);
     }
 }
 
 
-#ifdef FAST_PATH
-#define serialize(poly_key, result) memcpy(poly_key, result, 32)
+#ifdef PORTABLE_UNALIGNED_WORDS
+#define store32_le(target, source) \
+    uint32_t __value = PORTABLE_LE32(*(source)); \
+    memcpy(target, &__value, sizeof(uint32_t));
 #else
 #define store32_le(target, source) \
     (target)[0] = U8(*(source)); \
     (target)[1] = U8(*(source) >> 8); \
     (target)[2] = U8(*(source) >> 16); \
     (target)[3] = U8(*(source) >> 24);
+#endif
 
 #define serialize(poly_key, result) \
     for (unsigned int i = 0; i < 32 / sizeof(uint32_t); i++) { \
         store32_le(index8_32(poly_key, i), result + i); \
     }
-#endif
 
 
 
-void rfc8439_keygen(
+static CHACHA_INLINE void keygen(
         uint8_t poly_key[32],
-        const uint8_t key[CHACHA20_KEY_SIZE],
-        const uint8_t nonce[CHACHA20_NONCE_SIZE]
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE],
+        unsigned int double_rounds
 ) {
     uint32_t state[CHACHA20_STATE_WORDS];
     uint32_t result[CHACHA20_STATE_WORDS];
     initialize_state(state, key, nonce, 0);
-    core_block(state, result);
+    core_block(state, result, double_rounds);
     serialize(poly_key, result);
 }
+
+void chacha20_xor_stream_key(
+        uint8_t *dest, 
+        const uint8_t *source, 
+        size_t length,
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE],
+        uint32_t counter
+) {
+    xor_stream(dest, source, length, key, nonce, counter, 10);
+}
+
+void rfc8439_keygen(
+        uint8_t poly_key[32],
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE]
+) {
+    keygen(poly_key, key, nonce, 10);
+}
+
+void chacha12_xor_stream_key(
+        uint8_t *dest, 
+        const uint8_t *source, 
+        size_t length,
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE],
+        uint32_t counter
+) {
+    xor_stream(dest, source, length, key, nonce, counter, 6);
+}
+
+void chacha12_keygen(
+        uint8_t poly_key[32],
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE]
+) {
+    keygen(poly_key, key, nonce, 6);
+}
+
+void chacha8_xor_stream_key(
+        uint8_t *dest, 
+        const uint8_t *source, 
+        size_t length,
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE],
+        uint32_t counter
+) {
+    xor_stream(dest, source, length, key, nonce, counter, 4);
+}
+
+void chacha8_keygen(
+        uint8_t poly_key[32],
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE]
+) {
+    keygen(poly_key, key, nonce, 4);
+}
+
+#ifdef __HAVE_VECTORS
+// CHACHA20_VECTOR_WIDTH poly keys at once: block 0 of a different nonce in
+// every lane, only the 8 words of the poly key are finished
+static void keygen_wide(uint8_t *poly_keys, const chacha20_key *key, const uint8_t *nonces) {
+    uint32_t state[CHACHA20_STATE_WORDS];
+    initialize_state(state, key, nonces, 0);
+    uint32_t lanes[3][CHACHA20_VECTOR_WIDTH];
+    for (unsigned int b = 0; b < CHACHA20_VECTOR_WIDTH; b++) {
+        const uint8_t *nonce = nonces + b * CHACHA20_NONCE_SIZE;
+        store_32_le(lanes[0][b], nonce);
+        store_32_le(lanes[1][b], nonce + 4);
+        store_32_le(lanes[2][b], nonce + 8);
+    }
+
+    #define __LVK(i) chacha_vector __p##i = state[i] + (chacha_vector){ 0 };
+    TIMES16(__LVK)
+    memcpy(&__p13, lanes[0], sizeof(chacha_vector));
+    memcpy(&__p14, lanes[1], sizeof(chacha_vector));
+    memcpy(&__p15, lanes[2], sizeof(chacha_vector));
+
+    #define __QK(a,b,c,d) Qround(__p##a, __p##b, __p##c, __p##d)
+    DOUBLE_ROUNDS(__QK, 10)
+
+    #define __FINK(i) __p##i += state[i];
+    __FINK(0) __FINK(1) __FINK(2) __FINK(3) __FINK(4) __FINK(5) __FINK(6) __FINK(7)
+    for (unsigned int b = 0; b < CHACHA20_VECTOR_WIDTH; b++) {
+        uint32_t result[8];
+        #define __OUTK(i) result[i] = __p##i[b];
+        __OUTK(0) __OUTK(1) __OUTK(2) __OUTK(3) __OUTK(4) __OUTK(5) __OUTK(6) __OUTK(7)
+        uint8_t *poly_key = poly_keys + b * 32;
+        serialize(poly_key, result);
+    }
+}
+#endif
+
+void rfc8439_keygen_batch(
+        uint8_t *poly_keys,
+        const chacha20_key *key,
+        const uint8_t *nonces,
+        size_t count
+) {
+#ifdef __HAVE_VECTORS
+    for (; count >= CHACHA20_VECTOR_WIDTH; count -= CHACHA20_VECTOR_WIDTH) {
+        keygen_wide(poly_keys, key, nonces);
+        poly_keys += CHACHA20_VECTOR_WIDTH * 32;
+        nonces += CHACHA20_VECTOR_WIDTH * CHACHA20_NONCE_SIZE;
+    }
+#endif
+    for (size_t i = 0; i < count; i++) {
+        keygen(poly_keys + i * 32, key, nonces + i * CHACHA20_NONCE_SIZE, 10);
+    }
+}
+
+// QUIC header protection (RFC 9001 section 5.4.4): the first 4 bytes of the
+// sample are the counter, the other 12 the nonce, and the mask is the first 
+// 5 bytes of that key stream block. No need to go through the xor path.
+void chacha20_quic_hp_mask(
+        uint8_t mask[QUIC_HP_MASK_SIZE],
+        const chacha20_key *key,
+        const uint8_t sample[QUIC_HP_SAMPLE_SIZE]
+) {
+    uint32_t state[CHACHA20_STATE_WORDS];
+    uint32_t result[CHACHA20_STATE_WORDS];
+    initialize_state(state, key, sample + 4, 0);
+    store_32_le(state[12], sample);
+    core_block(state, result, 10);
+    store32_le(mask, result);
+    mask[4] = U8(result[1]);
+}
+
+#ifdef __HAVE_VECTORS
+// CHACHA20_VECTOR_WIDTH masks at once: every lane gets the counter & nonce
+// of its own sample, and only the words of the mask are finished
+static void quic_hp_mask_wide(uint8_t *masks, const chacha20_key *key, const uint8_t *const *samples) {
+    uint32_t state[CHACHA20_STATE_WORDS];
+    initialize_state(state, key, samples[0] + 4, 0);
+    uint32_t lanes[4][CHACHA20_VECTOR_WIDTH];
+    for (unsigned int b = 0; b < CHACHA20_VECTOR_WIDTH; b++) {
+        store_32_le(lanes[0][b], samples[b]);
+        store_32_le(lanes[1][b], samples[b] + 4);
+        store_32_le(lanes[2][b], samples[b] + 8);
+        store_32_le(lanes[3][b], samples[b] + 12);
+    }
+
+    #define __LVM(i) chacha_vector __m##i = state[i] + (chacha_vector){ 0 };
+    TIMES16(__LVM)
+    memcpy(&__m12, lanes[0], sizeof(chacha_vector));
+    memcpy(&__m13, lanes[1], sizeof(chacha_vector));
+    memcpy(&__m14, lanes[2], sizeof(chacha_vector));
+    memcpy(&__m15, lanes[3], sizeof(chacha_vector));
+
+    #define __QM(a,b,c,d) Qround(__m##a, __m##b, __m##c, __m##d)
+    DOUBLE_ROUNDS(__QM, 10)
+
+    __m0 += state[0];
+    __m1 += state[1];
+    for (unsigned int b = 0; b < CHACHA20_VECTOR_WIDTH; b++) {
+        uint32_t word = __m0[b];
+        store32_le(masks + b * QUIC_HP_MASK_SIZE, &word);
+        masks[b * QUIC_HP_MASK_SIZE + 4] = U8(__m1[b]);
+    }
+}
+#endif
+
+void chacha20_quic_hp_mask_batch(
+        uint8_t *masks,
+        const chacha20_key *key,
+        const uint8_t *const *samples,
+        size_t count
+) {
+#ifdef __HAVE_VECTORS
+    for (; count >= CHACHA20_VECTOR_WIDTH; count -= CHACHA20_VECTOR_WIDTH) {
+        quic_hp_mask_wide(masks, key, samples);
+        masks += CHACHA20_VECTOR_WIDTH * QUIC_HP_MASK_SIZE;
+        samples += CHACHA20_VECTOR_WIDTH;
+    }
+#endif
+    for (size_t i = 0; i < count; i++) {
+        chacha20_quic_hp_mask(masks + i * QUIC_HP_MASK_SIZE, key, samples[i]);
+    }
+}
@@ -16,6 +16,9 @@
 
 #define CHACHA20_KEY_SIZE (32)
 #define CHACHA20_NONCE_SIZE (12)
+#define HCHACHA20_NONCE_SIZE (16)
+#define QUIC_HP_SAMPLE_SIZE (16)
+#define QUIC_HP_MASK_SIZE (5)
 
 #if defined(_MSC_VER) || defined(__cplusplus) 
 // add restrict support
@@ -26,20 +29,104 @@
 #    endif
 #endif
 
-// xor data with a ChaCha20 keystream as per RFC8439
-void chacha20_xor_stream(
-        uint8_t *restrict dest, 
-        const uint8_t *restrict source, 
+// the key words of the chacha20 state, loaded once to be reused for many nonces
+typedef struct chacha20_key {
+    uint32_t words[CHACHA20_KEY_SIZE / sizeof(uint32_t)];
+} chacha20_key;
+
+void chacha20_key_init(chacha20_key *expanded, const uint8_t key[CHACHA20_KEY_SIZE]);
+
+// xor data with a ChaCha20 keystream as per RFC8439, dest can be source (in
+// place) but should not overlap it otherwise
+void chacha20_xor_stream_key(
+        uint8_t *dest, 
+        const uint8_t *source, 
+        size_t length,
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE],
+        uint32_t counter
+);
+
+static inline void chacha20_xor_stream(
+        uint8_t *dest, 
+        const uint8_t *source, 
         size_t length,
         const uint8_t key[CHACHA20_KEY_SIZE],
         const uint8_t nonce[CHACHA20_NONCE_SIZE],
         uint32_t counter
+) {
+    chacha20_key expanded;
+    chacha20_key_init(&expanded, key);
+    chacha20_xor_stream_key(dest, source, length, &expanded, nonce, counter);
+}
+
+// derive the XChaCha20 subkey from a key and the first 16 bytes of the nonce
+void hchacha20(
+        chacha20_key *subkey,
+        const chacha20_key *key,
+        const uint8_t nonce[HCHACHA20_NONCE_SIZE]
 );
 
 void rfc8439_keygen(
         uint8_t poly_key[32],
-        const uint8_t key[CHACHA20_KEY_SIZE],
+        const chacha20_key *key,
         const uint8_t nonce[CHACHA20_NONCE_SIZE]
 );
 
+// count poly keys (32 bytes each) for count nonces, both written after each
+// other, several nonces per SIMD register
+void rfc8439_keygen_batch(
+        uint8_t *poly_keys,
+        const chacha20_key *key,
+        const uint8_t *nonces,
+        size_t count
+);
+
+// the reduced round variants (ChaCha12 & ChaCha8) of chacha20_xor_stream_key
+// and rfc8439_keygen
+void chacha12_xor_stream_key(
+        uint8_t *dest, 
+        const uint8_t *source, 
+        size_t length,
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE],
+        uint32_t counter
+);
+
+void chacha12_keygen(
+        uint8_t poly_key[32],
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE]
+);
+
+void chacha8_xor_stream_key(
+        uint8_t *dest, 
+        const uint8_t *source, 
+        size_t length,
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE],
+        uint32_t counter
+);
+
+void chacha8_keygen(
+        uint8_t poly_key[32],
+        const chacha20_key *key,
+        const uint8_t nonce[CHACHA20_NONCE_SIZE]
+);
+
+// QUIC header protection masks (RFC 9001 5.4.4), the batch version writes
+// count masks of QUIC_HP_MASK_SIZE bytes after each other
+void chacha20_quic_hp_mask(
+        uint8_t mask[QUIC_HP_MASK_SIZE],
+        const chacha20_key *key,
+        const uint8_t sample[QUIC_HP_SAMPLE_SIZE]
+);
+
+void chacha20_quic_hp_mask_batch(
+        uint8_t *masks,
+        const chacha20_key *key,
+        const uint8_t *const *samples,
+        size_t count
+);
+
 #endif
@@ -0,0 +1,32 @@
+/*
+	little endian word loads & stores shared by poly1305-donna-32.h and
+	poly1305-donna-32x2.h, included once before either of them
+*/
+
+/* interpret four 8 bit unsigned integers as a 32 bit unsigned integer in little endian */
+static unsigned long U8TO32(const unsigned char *p) {
+#if defined(PORTABLE_UNALIGNED_WORDS)
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return PORTABLE_LE32(v);
+#else
+	return
+		(((unsigned long)(p[0] & 0xff)      ) |
+	     ((unsigned long)(p[1] & 0xff) <<  8) |
+         ((unsigned long)(p[2] & 0xff) << 16) |
+         ((unsigned long)(p[3] & 0xff) << 24));
+#endif
+}
+
+/* store a 32 bit unsigned integer as four 8 bit unsigned integers in little endian */
+static void U32TO8(unsigned char *p, unsigned long v) {
+#if defined(PORTABLE_UNALIGNED_WORDS)
+	uint32_t w = PORTABLE_LE32((uint32_t)v);
+	memcpy(p, &w, sizeof(w));
+#else
+	p[0] = (v      ) & 0xff;
+	p[1] = (v >>  8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+#endif
+}
@@ -0,0 +1,287 @@
+/*
+	poly1305 implementation using 32 bit * 32 bit = 64 bit multiplication and 64 bit addition,
+	processing two blocks per iteration
+
+	donna-32 runs the full carry chain after every block, and every block
+	needs the reduced h of the previous one. Here we use r^2:
+
+		h = (h + m0) * r^2 + m1 * r
+
+	the products of m1 don't depend on h, so they overlap with the chain,
+	and the carries only run once per two blocks. Two blocks keep the
+	register pressure low enough for the 32 bit targets this is meant for.
+	A leftover block is handled with just r.
+
+	it only pays off where the carry chain is the limit (in-order cores with
+	pipelined multiply-accumulate), on x86 donna-32 is bound by the
+	multiplications and both are as fast. So it's not the default, select
+	it with POLY1305_32X2 or at runtime after measuring (make bench-32).
+
+	the limbs are stored as uint32_t, so the state has the same (small) size
+	on 64 bit targets. The sums of the two products reach 2^58, so the
+	carries are kept in 64 bits.
+
+	U8TO32/U32TO8 come from poly1305-donna-32-words.h, which has to be
+	included before this one.
+*/
+
+#if defined(_MSC_VER)
+	#define POLY1305_NOINLINE __declspec(noinline)
+#elif defined(__GNUC__)
+	#define POLY1305_NOINLINE __attribute__((noinline))
+#else
+	#define POLY1305_NOINLINE
+#endif
+
+#define poly1305_block_size 16
+
+#ifndef POLY1305_POWERS_MIN_BYTES
+#define POLY1305_POWERS_MIN_BYTES (8 * poly1305_block_size)
+#endif
+
+/* 18 + sizeof(size_t) + 19*sizeof(uint32_t) */
+typedef struct poly1305_state_internal_t {
+	uint32_t r[5];
+	uint32_t h[5];
+	uint32_t pad[4];
+	uint32_t r2[5];
+	size_t leftover;
+	unsigned char buffer[poly1305_block_size];
+	unsigned char final;
+	unsigned char powers;
+} poly1305_state_internal_t;
+
+typedef unsigned long long poly1305_wide_t;
+
+/* d = a * b, with sb = b * 5 to fold the top back in */
+#define POLY1305_MUL5(d, a, b, sb) \
+	d##0 = ((poly1305_wide_t)a##0 * b##0) + ((poly1305_wide_t)a##1 * sb##4) + ((poly1305_wide_t)a##2 * sb##3) + ((poly1305_wide_t)a##3 * sb##2) + ((poly1305_wide_t)a##4 * sb##1); \
+	d##1 = ((poly1305_wide_t)a##0 * b##1) + ((poly1305_wide_t)a##1 * b##0) + ((poly1305_wide_t)a##2 * sb##4) + ((poly1305_wide_t)a##3 * sb##3) + ((poly1305_wide_t)a##4 * sb##2); \
+	d##2 = ((poly1305_wide_t)a##0 * b##2) + ((poly1305_wide_t)a##1 * b##1) + ((poly1305_wide_t)a##2 * b##0) + ((poly1305_wide_t)a##3 * sb##4) + ((poly1305_wide_t)a##4 * sb##3); \
+	d##3 = ((poly1305_wide_t)a##0 * b##3) + ((poly1305_wide_t)a##1 * b##2) + ((poly1305_wide_t)a##2 * b##1) + ((poly1305_wide_t)a##3 * b##0) + ((poly1305_wide_t)a##4 * sb##4); \
+	d##4 = ((poly1305_wide_t)a##0 * b##4) + ((poly1305_wide_t)a##1 * b##3) + ((poly1305_wide_t)a##2 * b##2) + ((poly1305_wide_t)a##3 * b##1) + ((poly1305_wide_t)a##4 * b##0);
+
+/* d += a * b */
+#define POLY1305_MUL5_ADD(d, a, b, sb) \
+	d##0 += ((poly1305_wide_t)a##0 * b##0) + ((poly1305_wide_t)a##1 * sb##4) + ((poly1305_wide_t)a##2 * sb##3) + ((poly1305_wide_t)a##3 * sb##2) + ((poly1305_wide_t)a##4 * sb##1); \
+	d##1 += ((poly1305_wide_t)a##0 * b##1) + ((poly1305_wide_t)a##1 * b##0) + ((poly1305_wide_t)a##2 * sb##4) + ((poly1305_wide_t)a##3 * sb##3) + ((poly1305_wide_t)a##4 * sb##2); \
+	d##2 += ((poly1305_wide_t)a##0 * b##2) + ((poly1305_wide_t)a##1 * b##1) + ((poly1305_wide_t)a##2 * b##0) + ((poly1305_wide_t)a##3 * sb##4) + ((poly1305_wide_t)a##4 * sb##3); \
+	d##3 += ((poly1305_wide_t)a##0 * b##3) + ((poly1305_wide_t)a##1 * b##2) + ((poly1305_wide_t)a##2 * b##1) + ((poly1305_wide_t)a##3 * b##0) + ((poly1305_wide_t)a##4 * sb##4); \
+	d##4 += ((poly1305_wide_t)a##0 * b##4) + ((poly1305_wide_t)a##1 * b##3) + ((poly1305_wide_t)a##2 * b##2) + ((poly1305_wide_t)a##3 * b##1) + ((poly1305_wide_t)a##4 * b##0);
+
+/* split a 16 byte block into 26 bit limbs */
+#define POLY1305_LOAD5(x, p) \
+	x##0 = (uint32_t)((U8TO32((p)+ 0)     ) & 0x3ffffff); \
+	x##1 = (uint32_t)((U8TO32((p)+ 3) >> 2) & 0x3ffffff); \
+	x##2 = (uint32_t)((U8TO32((p)+ 6) >> 4) & 0x3ffffff); \
+	x##3 = (uint32_t)((U8TO32((p)+ 9) >> 6) & 0x3ffffff); \
+	x##4 = (uint32_t)((U8TO32((p)+12) >> 8) | hibit);
+
+/* (partial) h = d % p */
+#define POLY1305_REDUCE5(h, d) \
+	              c = (d##0 >> 26); h##0 = (uint32_t)d##0 & 0x3ffffff; \
+	d##1 += c;    c = (d##1 >> 26); h##1 = (uint32_t)d##1 & 0x3ffffff; \
+	d##2 += c;    c = (d##2 >> 26); h##2 = (uint32_t)d##2 & 0x3ffffff; \
+	d##3 += c;    c = (d##3 >> 26); h##3 = (uint32_t)d##3 & 0x3ffffff; \
+	d##4 += c;    c = (d##4 >> 26); h##4 = (uint32_t)d##4 & 0x3ffffff; \
+	c = h##0 + c * 5;               h##0 = (uint32_t)c   & 0x3ffffff; \
+	h##1 += (uint32_t)(c >> 26);
+
+void poly1305_init(poly1305_context *ctx, const unsigned char key[32]) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+
+	/* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
+	st->r[0] = (uint32_t)((U8TO32(&key[ 0])     ) & 0x3ffffff);
+	st->r[1] = (uint32_t)((U8TO32(&key[ 3]) >> 2) & 0x3ffff03);
+	st->r[2] = (uint32_t)((U8TO32(&key[ 6]) >> 4) & 0x3ffc0ff);
+	st->r[3] = (uint32_t)((U8TO32(&key[ 9]) >> 6) & 0x3f03fff);
+	st->r[4] = (uint32_t)((U8TO32(&key[12]) >> 8) & 0x00fffff);
+
+	/* h = 0 */
+	st->h[0] = 0;
+	st->h[1] = 0;
+	st->h[2] = 0;
+	st->h[3] = 0;
+	st->h[4] = 0;
+
+	/* save pad for later */
+	st->pad[0] = (uint32_t)U8TO32(&key[16]);
+	st->pad[1] = (uint32_t)U8TO32(&key[20]);
+	st->pad[2] = (uint32_t)U8TO32(&key[24]);
+	st->pad[3] = (uint32_t)U8TO32(&key[28]);
+
+	st->leftover = 0;
+	st->final = 0;
+	st->powers = 0;
+}
+
+static void poly1305_blocks(poly1305_state_internal_t *st, const unsigned char *m, size_t bytes) {
+	const uint32_t hibit = (st->final) ? 0 : (1UL << 24); /* 1 << 128 */
+	uint32_t r0,r1,r2,r3,r4;
+	uint32_t s1,s2,s3,s4;
+	uint32_t h0,h1,h2,h3,h4;
+	poly1305_wide_t d0,d1,d2,d3,d4,c;
+
+	r0 = st->r[0];
+	r1 = st->r[1];
+	r2 = st->r[2];
+	r3 = st->r[3];
+	r4 = st->r[4];
+
+	s1 = r1 * 5;
+	s2 = r2 * 5;
+	s3 = r3 * 5;
+	s4 = r4 * 5;
+
+	/* r^2 costs a multiplication, short messages stay on the serial loop */
+	if (!st->powers && bytes >= POLY1305_POWERS_MIN_BYTES) {
+		uint32_t t0,t1,t2,t3,t4;
+
+		POLY1305_MUL5(d, r, r, s)
+		POLY1305_REDUCE5(t, d)
+		st->r2[0] = t0;
+		st->r2[1] = t1;
+		st->r2[2] = t2;
+		st->r2[3] = t3;
+		st->r2[4] = t4;
+		st->powers = 1;
+	}
+
+	h0 = st->h[0];
+	h1 = st->h[1];
+	h2 = st->h[2];
+	h3 = st->h[3];
+	h4 = st->h[4];
+
+	if (st->powers && bytes >= 2 * poly1305_block_size) {
+		const uint32_t u0 = st->r2[0], u1 = st->r2[1], u2 = st->r2[2], u3 = st->r2[3], u4 = st->r2[4];
+		const uint32_t su1 = u1 * 5, su2 = u2 * 5, su3 = u3 * 5, su4 = u4 * 5;
+
+		do {
+			uint32_t a0,a1,a2,a3,a4,b0,b1,b2,b3,b4;
+
+			POLY1305_LOAD5(a, m)
+			POLY1305_LOAD5(b, m + 16)
+
+			a0 += h0;
+			a1 += h1;
+			a2 += h2;
+			a3 += h3;
+			a4 += h4;
+
+			/* h = (h + m0) * r^2 + m1 * r */
+			POLY1305_MUL5(d, b, r, s)
+			POLY1305_MUL5_ADD(d, a, u, su)
+
+			POLY1305_REDUCE5(h, d)
+
+			m += 2 * poly1305_block_size;
+			bytes -= 2 * poly1305_block_size;
+		} while (bytes >= 2 * poly1305_block_size);
+	}
+
+	while (bytes >= poly1305_block_size) {
+		uint32_t a0,a1,a2,a3,a4;
+
+		/* h += m[i] */
+		POLY1305_LOAD5(a, m)
+		a0 += h0;
+		a1 += h1;
+		a2 += h2;
+		a3 += h3;
+		a4 += h4;
+
+		/* h *= r */
+		POLY1305_MUL5(d, a, r, s)
+		POLY1305_REDUCE5(h, d)
+
+		m += poly1305_block_size;
+		bytes -= poly1305_block_size;
+	}
+
+	st->h[0] = h0;
+	st->h[1] = h1;
+	st->h[2] = h2;
+	st->h[3] = h3;
+	st->h[4] = h4;
+}
+
+POLY1305_NOINLINE void poly1305_finish(poly1305_context *ctx, unsigned char mac[16]) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	uint32_t h0,h1,h2,h3,h4,c;
+	uint32_t g0,g1,g2,g3,g4;
+	poly1305_wide_t f;
+	uint32_t mask;
+	size_t i;
+
+	/* process the remaining block */
+	if (st->leftover) {
+		i = st->leftover;
+		st->buffer[i++] = 1;
+		for (; i < poly1305_block_size; i++)
+			st->buffer[i] = 0;
+		st->final = 1;
+		poly1305_blocks(st, st->buffer, poly1305_block_size);
+	}
+
+	/* fully carry h */
+	h0 = st->h[0];
+	h1 = st->h[1];
+	h2 = st->h[2];
+	h3 = st->h[3];
+	h4 = st->h[4];
+
+	             c = h1 >> 26; h1 = h1 & 0x3ffffff;
+	h2 +=     c; c = h2 >> 26; h2 = h2 & 0x3ffffff;
+	h3 +=     c; c = h3 >> 26; h3 = h3 & 0x3ffffff;
+	h4 +=     c; c = h4 >> 26; h4 = h4 & 0x3ffffff;
+	h0 += c * 5; c = h0 >> 26; h0 = h0 & 0x3ffffff;
+	h1 +=     c;
+
+	/* compute h + -p */
+	g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+	g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+	g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+	g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+	g4 = h4 + c - (1UL << 26);
+
+	/* select h if h < p, or h + -p if h >= p */
+	mask = (g4 >> 31) - 1;
+	g0 &= mask;
+	g1 &= mask;
+	g2 &= mask;
+	g3 &= mask;
+	g4 &= mask;
+	mask = ~mask;
+	h0 = (h0 & mask) | g0;
+	h1 = (h1 & mask) | g1;
+	h2 = (h2 & mask) | g2;
+	h3 = (h3 & mask) | g3;
+	h4 = (h4 & mask) | g4;
+
+	/* h = h % (2^128) */
+	h0 = ((h0      ) | (h1 << 26));
+	h1 = ((h1 >>  6) | (h2 << 20));
+	h2 = ((h2 >> 12) | (h3 << 14));
+	h3 = ((h3 >> 18) | (h4 <<  8));
+
+	/* mac = (h + pad) % (2^128) */
+	f = (poly1305_wide_t)h0 + st->pad[0]            ; h0 = (uint32_t)f;
+	f = (poly1305_wide_t)h1 + st->pad[1] + (f >> 32); h1 = (uint32_t)f;
+	f = (poly1305_wide_t)h2 + st->pad[2] + (f >> 32); h2 = (uint32_t)f;
+	f = (poly1305_wide_t)h3 + st->pad[3] + (f >> 32); h3 = (uint32_t)f;
+
+	U32TO8(mac +  0, h0);
+	U32TO8(mac +  4, h1);
+	U32TO8(mac +  8, h2);
+	U32TO8(mac + 12, h3);
+
+	/* zero out the state */
+	for (i = 0; i < 5; i++) {
+		st->h[i] = 0;
+		st->r[i] = 0;
+		st->r2[i] = 0;
+	}
+	for (i = 0; i < 4; i++)
+		st->pad[i] = 0;
+}
@@ -47,6 +47,11 @@ typedef struct poly1305_state_internal_t {
 
 /* interpret eight 8 bit unsigned integers as a 64 bit unsigned integer in little endian */
 static unsigned long long U8TO64(const unsigned char *p) {
+#if defined(PORTABLE_UNALIGNED_WORDS)
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return PORTABLE_LE64(v);
+#else
 	return
 		(((unsigned long long)(p[0] & 0xff)      ) |
 		 ((unsigned long long)(p[1] & 0xff) <<  8) |
@@ -56,10 +61,15 @@ static unsigned long long U8TO64(const unsigned char *p) {
 		 ((unsigned long long)(p[5] & 0xff) << 40) |
 		 ((unsigned long long)(p[6] & 0xff) << 48) |
 		 ((unsigned long long)(p[7] & 0xff) << 56));
+#endif
 }
 
 /* store a 64 bit unsigned integer as eight 8 bit unsigned integers in little endian */
 static void U64TO8(unsigned char *p, unsigned long long v) {
+#if defined(PORTABLE_UNALIGNED_WORDS)
+	uint64_t w = PORTABLE_LE64((uint64_t)v);
+	memcpy(p, &w, sizeof(w));
+#else
 	p[0] = (v      ) & 0xff;
 	p[1] = (v >>  8) & 0xff;
 	p[2] = (v >> 16) & 0xff;
@@ -68,6 +78,7 @@ static void U64TO8(unsigned char *p, unsigned long long v) {
 	p[5] = (v >> 40) & 0xff;
 	p[6] = (v >> 48) & 0xff;
 	p[7] = (v >> 56) & 0xff;
+#endif
 }
 
 void poly1305_init(poly1305_context *ctx, const unsigned char key[32]) {
@@ -0,0 +1,319 @@
+/*
+	poly1305 implementation using 64 bit * 64 bit = 128 bit multiplication and 128 bit addition,
+	processing up to four blocks per iteration
+
+	donna-64 has a single serial chain per block: every block needs the
+	reduced h of the previous one. Here we use precomputed powers of r:
+
+		h = (h + m0) * r^4 + m1 * r^3 + m2 * r^2 + m3 * r
+
+	only the first product depends on h, the other three can overlap with it,
+	and the carry chain only runs once per four blocks. Leftover blocks are
+	handled two at a time (r^2, r) and then one at a time (r).
+
+	calculating the powers costs three multiplications, so they are only
+	calculated once a single update brings at least POLY1305_POWERS_MIN_BYTES,
+	short messages stay on the serial loop and are as cheap as with donna-64.
+
+	reuses uint128_t, MUL & friends and U8TO64/U64TO8 from poly1305-donna-64.h,
+	so that file has to be included before this one.
+*/
+
+#if defined(_MSC_VER)
+	#define POLY1305_NOINLINE __declspec(noinline)
+#elif defined(__GNUC__)
+	#define POLY1305_NOINLINE __attribute__((noinline))
+#else
+	#define POLY1305_NOINLINE
+#endif
+
+#define poly1305_block_size 16
+
+#ifndef POLY1305_POWERS_MIN_BYTES
+#define POLY1305_POWERS_MIN_BYTES (8 * poly1305_block_size)
+#endif
+
+/* 18 + sizeof(size_t) + 17*sizeof(unsigned long long) */
+typedef struct poly1305_state_internal_t {
+	unsigned long long r[3];
+	unsigned long long h[3];
+	unsigned long long pad[2];
+	unsigned long long r2[3];
+	unsigned long long r3[3];
+	unsigned long long r4[3];
+	size_t leftover;
+	unsigned char buffer[poly1305_block_size];
+	unsigned char final;
+	unsigned char powers;
+} poly1305_state_internal_t;
+
+/* d = a * b, with sb1/sb2 = b1/b2 * (5 << 2) to fold the top back in */
+#define POLY1305_MUL3(d0, d1, d2, a0, a1, a2, b0, b1, b2, sb1, sb2) \
+	MUL(d0, a0, b0); MUL(d, a1, sb2); ADD(d0, d); MUL(d, a2, sb1); ADD(d0, d); \
+	MUL(d1, a0, b1); MUL(d, a1, b0); ADD(d1, d); MUL(d, a2, sb2); ADD(d1, d); \
+	MUL(d2, a0, b2); MUL(d, a1, b1); ADD(d2, d); MUL(d, a2, b0); ADD(d2, d);
+
+/* d += a * b */
+#define POLY1305_MUL3_ADD(d0, d1, d2, a0, a1, a2, b0, b1, b2, sb1, sb2) \
+	MUL(d, a0, b0); ADD(d0, d); MUL(d, a1, sb2); ADD(d0, d); MUL(d, a2, sb1); ADD(d0, d); \
+	MUL(d, a0, b1); ADD(d1, d); MUL(d, a1, b0); ADD(d1, d); MUL(d, a2, sb2); ADD(d1, d); \
+	MUL(d, a0, b2); ADD(d2, d); MUL(d, a1, b1); ADD(d2, d); MUL(d, a2, b0); ADD(d2, d);
+
+/* split a 16 byte block into 44/44/42 bit limbs */
+#define POLY1305_LOAD3(x0, x1, x2, p) \
+	t0 = U8TO64(&(p)[0]); \
+	t1 = U8TO64(&(p)[8]); \
+	x0 = (( t0                    ) & 0xfffffffffff); \
+	x1 = (((t0 >> 44) | (t1 << 20)) & 0xfffffffffff); \
+	x2 = (((t1 >> 24)             ) & 0x3ffffffffff) | hibit;
+
+/* (partial) h = d % p */
+#define POLY1305_REDUCE3(h0, h1, h2, d0, d1, d2) \
+	              c = SHR(d0, 44); h0 = LO(d0) & 0xfffffffffff; \
+	ADDLO(d1, c); c = SHR(d1, 44); h1 = LO(d1) & 0xfffffffffff; \
+	ADDLO(d2, c); c = SHR(d2, 42); h2 = LO(d2) & 0x3ffffffffff; \
+	h0  += c * 5; c = (h0 >> 44);  h0 =    h0  & 0xfffffffffff; \
+	h1  += c;
+
+/* out = a * b (partially reduced) */
+static void poly1305_power(unsigned long long out[3], const unsigned long long a[3], const unsigned long long b[3]) {
+	unsigned long long s1 = b[1] * (5 << 2);
+	unsigned long long s2 = b[2] * (5 << 2);
+	unsigned long long c;
+	uint128_t d0,d1,d2,d;
+
+	POLY1305_MUL3(d0, d1, d2, a[0], a[1], a[2], b[0], b[1], b[2], s1, s2)
+	POLY1305_REDUCE3(out[0], out[1], out[2], d0, d1, d2)
+}
+
+void poly1305_init(poly1305_context *ctx, const unsigned char key[32]) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	unsigned long long t0,t1;
+
+	/* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
+	t0 = U8TO64(&key[0]);
+	t1 = U8TO64(&key[8]);
+
+	st->r[0] = ( t0                    ) & 0xffc0fffffff;
+	st->r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffff;
+	st->r[2] = ((t1 >> 24)             ) & 0x00ffffffc0f;
+
+	/* h = 0 */
+	st->h[0] = 0;
+	st->h[1] = 0;
+	st->h[2] = 0;
+
+	/* save pad for later */
+	st->pad[0] = U8TO64(&key[16]);
+	st->pad[1] = U8TO64(&key[24]);
+
+	st->leftover = 0;
+	st->final = 0;
+	st->powers = 0;
+}
+
+/* one block at a time, with just r */
+static void poly1305_blocks_serial(poly1305_state_internal_t *st, const unsigned char *m, size_t bytes) {
+	const unsigned long long hibit = (st->final) ? 0 : ((unsigned long long)1 << 40); /* 1 << 128 */
+	unsigned long long r0,r1,r2,s1,s2;
+	unsigned long long h0,h1,h2;
+	unsigned long long t0,t1,c;
+	uint128_t d0,d1,d2,d;
+
+	r0 = st->r[0];
+	r1 = st->r[1];
+	r2 = st->r[2];
+
+	s1 = r1 * (5 << 2);
+	s2 = r2 * (5 << 2);
+
+	h0 = st->h[0];
+	h1 = st->h[1];
+	h2 = st->h[2];
+
+	while (bytes >= poly1305_block_size) {
+		unsigned long long a0,a1,a2;
+
+		/* h += m[i] */
+		POLY1305_LOAD3(a0, a1, a2, m)
+		h0 += a0;
+		h1 += a1;
+		h2 += a2;
+
+		/* h *= r */
+		POLY1305_MUL3(d0, d1, d2, h0, h1, h2, r0, r1, r2, s1, s2)
+		POLY1305_REDUCE3(h0, h1, h2, d0, d1, d2)
+
+		m += poly1305_block_size;
+		bytes -= poly1305_block_size;
+	}
+
+	st->h[0] = h0;
+	st->h[1] = h1;
+	st->h[2] = h2;
+}
+
+static void poly1305_blocks(poly1305_state_internal_t *st, const unsigned char *m, size_t bytes) {
+	const unsigned long long hibit = (st->final) ? 0 : ((unsigned long long)1 << 40); /* 1 << 128 */
+	unsigned long long r0,r1,r2,s1,s2;
+	unsigned long long h0,h1,h2;
+	unsigned long long t0,t1,c;
+	uint128_t d0,d1,d2,d;
+
+	if (!st->powers) {
+		if (bytes < POLY1305_POWERS_MIN_BYTES) {
+			poly1305_blocks_serial(st, m, bytes);
+			return;
+		}
+		poly1305_power(st->r2, st->r, st->r);
+		poly1305_power(st->r3, st->r2, st->r);
+		poly1305_power(st->r4, st->r2, st->r2);
+		st->powers = 1;
+	}
+
+	r0 = st->r[0];
+	r1 = st->r[1];
+	r2 = st->r[2];
+
+	s1 = r1 * (5 << 2);
+	s2 = r2 * (5 << 2);
+
+	h0 = st->h[0];
+	h1 = st->h[1];
+	h2 = st->h[2];
+
+	if (bytes >= 4 * poly1305_block_size) {
+		const unsigned long long u0 = st->r2[0], u1 = st->r2[1], u2 = st->r2[2];
+		const unsigned long long v0 = st->r3[0], v1 = st->r3[1], v2 = st->r3[2];
+		const unsigned long long w0 = st->r4[0], w1 = st->r4[1], w2 = st->r4[2];
+		const unsigned long long su1 = u1 * (5 << 2), su2 = u2 * (5 << 2);
+		const unsigned long long sv1 = v1 * (5 << 2), sv2 = v2 * (5 << 2);
+		const unsigned long long sw1 = w1 * (5 << 2), sw2 = w2 * (5 << 2);
+
+		do {
+			unsigned long long a0,a1,a2,b0,b1,b2,e0,e1,e2,f0,f1,f2;
+
+			POLY1305_LOAD3(a0, a1, a2, m)
+			POLY1305_LOAD3(b0, b1, b2, m + 16)
+			POLY1305_LOAD3(e0, e1, e2, m + 32)
+			POLY1305_LOAD3(f0, f1, f2, m + 48)
+
+			a0 += h0;
+			a1 += h1;
+			a2 += h2;
+
+			/* h = (h + m0) * r^4 + m1 * r^3 + m2 * r^2 + m3 * r */
+			POLY1305_MUL3(d0, d1, d2, f0, f1, f2, r0, r1, r2, s1, s2)
+			POLY1305_MUL3_ADD(d0, d1, d2, e0, e1, e2, u0, u1, u2, su1, su2)
+			POLY1305_MUL3_ADD(d0, d1, d2, b0, b1, b2, v0, v1, v2, sv1, sv2)
+			POLY1305_MUL3_ADD(d0, d1, d2, a0, a1, a2, w0, w1, w2, sw1, sw2)
+
+			POLY1305_REDUCE3(h0, h1, h2, d0, d1, d2)
+
+			m += 4 * poly1305_block_size;
+			bytes -= 4 * poly1305_block_size;
+		} while (bytes >= 4 * poly1305_block_size);
+	}
+
+	if (bytes >= 2 * poly1305_block_size) {
+		const unsigned long long u0 = st->r2[0], u1 = st->r2[1], u2 = st->r2[2];
+		const unsigned long long su1 = u1 * (5 << 2), su2 = u2 * (5 << 2);
+		unsigned long long a0,a1,a2,b0,b1,b2;
+
+		POLY1305_LOAD3(a0, a1, a2, m)
+		POLY1305_LOAD3(b0, b1, b2, m + 16)
+
+		a0 += h0;
+		a1 += h1;
+		a2 += h2;
+
+		/* h = (h + m0) * r^2 + m1 * r */
+		POLY1305_MUL3(d0, d1, d2, b0, b1, b2, r0, r1, r2, s1, s2)
+		POLY1305_MUL3_ADD(d0, d1, d2, a0, a1, a2, u0, u1, u2, su1, su2)
+
+		POLY1305_REDUCE3(h0, h1, h2, d0, d1, d2)
+
+		m += 2 * poly1305_block_size;
+		bytes -= 2 * poly1305_block_size;
+	}
+
+	st->h[0] = h0;
+	st->h[1] = h1;
+	st->h[2] = h2;
+
+	if (bytes)
+		poly1305_blocks_serial(st, m, bytes);
+}
+
+
+POLY1305_NOINLINE void poly1305_finish(poly1305_context *ctx, unsigned char mac[16]) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	unsigned long long h0,h1,h2,c;
+	unsigned long long g0,g1,g2;
+	unsigned long long t0,t1;
+	size_t i;
+
+	/* process the remaining block */
+	if (st->leftover) {
+		i = st->leftover;
+		st->buffer[i] = 1;
+		for (i = i + 1; i < poly1305_block_size; i++)
+			st->buffer[i] = 0;
+		st->final = 1;
+		poly1305_blocks(st, st->buffer, poly1305_block_size);
+	}
+
+	/* fully carry h */
+	h0 = st->h[0];
+	h1 = st->h[1];
+	h2 = st->h[2];
+
+	             c = (h1 >> 44); h1 &= 0xfffffffffff;
+	h2 += c;     c = (h2 >> 42); h2 &= 0x3ffffffffff;
+	h0 += c * 5; c = (h0 >> 44); h0 &= 0xfffffffffff;
+	h1 += c;     c = (h1 >> 44); h1 &= 0xfffffffffff;
+	h2 += c;     c = (h2 >> 42); h2 &= 0x3ffffffffff;
+	h0 += c * 5; c = (h0 >> 44); h0 &= 0xfffffffffff;
+	h1 += c;
+
+	/* compute h + -p */
+	g0 = h0 + 5; c = (g0 >> 44); g0 &= 0xfffffffffff;
+	g1 = h1 + c; c = (g1 >> 44); g1 &= 0xfffffffffff;
+	g2 = h2 + c - ((unsigned long long)1 << 42);
+
+	/* select h if h < p, or h + -p if h >= p */
+	c = (g2 >> ((sizeof(unsigned long long) * 8) - 1)) - 1;
+	g0 &= c;
+	g1 &= c;
+	g2 &= c;
+	c = ~c;
+	h0 = (h0 & c) | g0;
+	h1 = (h1 & c) | g1;
+	h2 = (h2 & c) | g2;
+
+	/* h = (h + pad) */
+	t0 = st->pad[0];
+	t1 = st->pad[1];
+
+	h0 += (( t0                    ) & 0xfffffffffff)    ; c = (h0 >> 44); h0 &= 0xfffffffffff;
+	h1 += (((t0 >> 44) | (t1 << 20)) & 0xfffffffffff) + c; c = (h1 >> 44); h1 &= 0xfffffffffff;
+	h2 += (((t1 >> 24)             ) & 0x3ffffffffff) + c;                 h2 &= 0x3ffffffffff;
+
+	/* mac = h % (2^128) */
+	h0 = ((h0      ) | (h1 << 44));
+	h1 = ((h1 >> 20) | (h2 << 24));
+
+	U64TO8(&mac[0], h0);
+	U64TO8(&mac[8], h1);
+
+	/* zero out the state */
+	for (i = 0; i < 3; i++) {
+		st->h[i] = 0;
+		st->r[i] = 0;
+		st->r2[i] = 0;
+		st->r3[i] = 0;
+		st->r4[i] = 0;
+	}
+	st->pad[0] = 0;
+	st->pad[1] = 0;
+}
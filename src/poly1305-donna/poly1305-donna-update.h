@@ -0,0 +1,62 @@
+/*
+	generic streaming update on top of poly1305_blocks
+
+	this file is included once per variant by poly1305-donna.c, after that
+	variant has been included with its names mapped to a unique suffix
+*/
+
+#ifndef POLY1305_PREFETCH_SEGMENT
+#define POLY1305_PREFETCH_SEGMENT (256)
+#endif
+
+static void poly1305_update(poly1305_context *ctx, const unsigned char *m, size_t bytes) {
+	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
+	size_t i;
+
+	/* the state of every variant compiled in has to fit in front of the backend pointer */
+#if defined(PORTABLE_8439_SMALL)
+	(void)sizeof(char[sizeof(poly1305_context) >= sizeof(poly1305_state_internal_t) ? 1 : -1]);
+#else
+	(void)sizeof(char[offsetof(poly1305_context, backend) >= sizeof(poly1305_state_internal_t) ? 1 : -1]);
+#endif
+
+	/* handle leftover */
+	if (st->leftover) {
+		size_t want = (poly1305_block_size - st->leftover);
+		if (want > bytes)
+			want = bytes;
+		for (i = 0; i < want; i++)
+			st->buffer[st->leftover + i] = m[i];
+		bytes -= want;
+		m += want;
+		st->leftover += want;
+		if (st->leftover < poly1305_block_size)
+			return;
+		poly1305_blocks(st, st->buffer, poly1305_block_size);
+		st->leftover = 0;
+	}
+
+	/* process full blocks */
+	if (bytes >= poly1305_block_size) {
+		size_t want = (bytes & ~(poly1305_block_size - 1));
+#if PORTABLE_PREFETCH_DISTANCE > 0
+		/* in segments, so we can prefetch the input ahead of each of them */
+		for (; want > POLY1305_PREFETCH_SEGMENT; want -= POLY1305_PREFETCH_SEGMENT) {
+			PORTABLE_PREFETCH_AHEAD(m, POLY1305_PREFETCH_SEGMENT, bytes)
+			poly1305_blocks(st, m, POLY1305_PREFETCH_SEGMENT);
+			m += POLY1305_PREFETCH_SEGMENT;
+			bytes -= POLY1305_PREFETCH_SEGMENT;
+		}
+#endif
+		poly1305_blocks(st, m, want);
+		m += want;
+		bytes -= want;
+	}
+
+	/* store leftover */
+	if (bytes) {
+		for (i = 0; i < bytes; i++)
+			st->buffer[st->leftover + i] = m[i];
+		st->leftover += bytes;
+	}
+}
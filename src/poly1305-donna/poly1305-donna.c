@@ -1,4 +1,11 @@
 #include "poly1305-donna.h"
+#include <string.h>
+#include <time.h>
+
+/* shared with chacha-portable: word loads & stores when the platform allows it */
+#include "portable-endian.h"
+/* and the build profile & prefetch distance */
+#include "portable-config.h"
 
 /* auto detect between 32bit / 64bit */
 #if /* uint128 available on 64bit system*/ \
@@ -7,57 +14,256 @@
 	|| (defined(_MSC_VER) && defined(_M_X64)) \
 	/* gcc >= 4.4 64bit */ \
 	|| (defined(__GNUC__) && defined(__LP64__) && \
-		((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 4)))) 
+		((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 4))))
 #	define __GUESS64
 #else
 #	define __GUESS32
 #endif
 
+/*
+	All variants are compiled in side by side, each one under its own suffix.
+	The compile time flags (POLY1305_8BIT, ...) only pick the default backend.
+	The 64 bit variant needs 128 bit math, so it's only available if we
+	guessed a 64bit system or the flag explicitly asks for it.
+*/
+#if defined(__GUESS64) || defined(POLY1305_64BIT)
+#	define __HAVE_POLY1305_64
+#endif
+
+/*
+	PORTABLE_8439_SMALL only compiles in the default variant, the widths
+	below identify it (322 is donna-32x2, 644 is donna-64x4).
+*/
 #if defined(POLY1305_8BIT)
-#	include "poly1305-donna-8.h"
+#	define __POLY1305_DEFAULT_BITS 8
 #elif defined(POLY1305_16BIT)
-#	include "poly1305-donna-16.h"
+#	define __POLY1305_DEFAULT_BITS 16
+#elif defined(POLY1305_32X2)
+#	define __POLY1305_DEFAULT_BITS 322
 #elif defined(POLY1305_32BIT) || (!defined(POLY1305_64BIT) && defined(__GUESS32))
-#	include "poly1305-donna-32.h"
+#	define __POLY1305_DEFAULT_BITS 32
+#elif defined(POLY1305_64BIT) || defined(PORTABLE_8439_SMALL)
+#	define __POLY1305_DEFAULT_BITS 64
 #else
+#	define __POLY1305_DEFAULT_BITS 644
+#endif
+
+#if defined(PORTABLE_8439_SMALL)
+#	define __WANT_POLY1305(bits) (__POLY1305_DEFAULT_BITS == (bits))
+#else
+#	define __WANT_POLY1305(bits) 1
+#endif
+
+#if __WANT_POLY1305(8)
+#define poly1305_state_internal_t poly1305_state_internal_8_t
+#define poly1305_init poly1305_init_8
+#define poly1305_blocks poly1305_blocks_8
+#define poly1305_update poly1305_update_8
+#define poly1305_finish poly1305_finish_8
+#	include "poly1305-donna-8.h"
+#	include "poly1305-donna-update.h"
+#undef poly1305_state_internal_t
+#undef poly1305_init
+#undef poly1305_blocks
+#undef poly1305_update
+#undef poly1305_finish
+#undef poly1305_block_size
+#undef POLY1305_NOINLINE
+#endif
+
+#if __WANT_POLY1305(16)
+#define poly1305_state_internal_t poly1305_state_internal_16_t
+#define poly1305_init poly1305_init_16
+#define poly1305_blocks poly1305_blocks_16
+#define poly1305_update poly1305_update_16
+#define poly1305_finish poly1305_finish_16
+#	include "poly1305-donna-16.h"
+#	include "poly1305-donna-update.h"
+#undef poly1305_state_internal_t
+#undef poly1305_init
+#undef poly1305_blocks
+#undef poly1305_update
+#undef poly1305_finish
+#undef poly1305_block_size
+#undef POLY1305_NOINLINE
+#endif
+
+#if __WANT_POLY1305(32) || __WANT_POLY1305(322)
+#	include "poly1305-donna-32-words.h"
+#endif
+
+#if __WANT_POLY1305(32)
+#define poly1305_state_internal_t poly1305_state_internal_32_t
+#define poly1305_init poly1305_init_32
+#define poly1305_blocks poly1305_blocks_32
+#define poly1305_update poly1305_update_32
+#define poly1305_finish poly1305_finish_32
+#	include "poly1305-donna-32.h"
+#	include "poly1305-donna-update.h"
+#undef poly1305_state_internal_t
+#undef poly1305_init
+#undef poly1305_blocks
+#undef poly1305_update
+#undef poly1305_finish
+#undef poly1305_block_size
+#undef POLY1305_NOINLINE
+#endif
+
+#if __WANT_POLY1305(322)
+#define poly1305_state_internal_t poly1305_state_internal_32x2_t
+#define poly1305_init poly1305_init_32x2
+#define poly1305_blocks poly1305_blocks_32x2
+#define poly1305_update poly1305_update_32x2
+#define poly1305_finish poly1305_finish_32x2
+#	include "poly1305-donna-32x2.h"
+#	include "poly1305-donna-update.h"
+#undef poly1305_state_internal_t
+#undef poly1305_init
+#undef poly1305_blocks
+#undef poly1305_update
+#undef poly1305_finish
+#undef poly1305_block_size
+#undef POLY1305_NOINLINE
+#endif
+
+#if defined(__HAVE_POLY1305_64) && __WANT_POLY1305(64)
+#define poly1305_state_internal_t poly1305_state_internal_64_t
+#define poly1305_init poly1305_init_64
+#define poly1305_blocks poly1305_blocks_64
+#define poly1305_update poly1305_update_64
+#define poly1305_finish poly1305_finish_64
 #	include "poly1305-donna-64.h"
+#	include "poly1305-donna-update.h"
+#undef poly1305_state_internal_t
+#undef poly1305_init
+#undef poly1305_blocks
+#undef poly1305_update
+#undef poly1305_finish
+#undef poly1305_block_size
+#undef POLY1305_NOINLINE
+#endif
+
+#if defined(__HAVE_POLY1305_64) && __WANT_POLY1305(644)
+#define poly1305_state_internal_t poly1305_state_internal_64x4_t
+#define poly1305_init poly1305_init_64x4
+#define poly1305_blocks poly1305_blocks_64x4
+#define poly1305_update poly1305_update_64x4
+#define poly1305_finish poly1305_finish_64x4
+#	include "poly1305-donna-64x4.h"
+#	include "poly1305-donna-update.h"
+#undef poly1305_state_internal_t
+#undef poly1305_init
+#undef poly1305_blocks
+#undef poly1305_update
+#undef poly1305_finish
+#undef poly1305_block_size
+#undef POLY1305_NOINLINE
+#endif
+
+#if __WANT_POLY1305(8)
+static const poly1305_backend poly1305_backend_8 = {
+	"donna-8", poly1305_init_8, poly1305_update_8, poly1305_finish_8
+};
+#endif
+
+#if __WANT_POLY1305(16)
+static const poly1305_backend poly1305_backend_16 = {
+	"donna-16", poly1305_init_16, poly1305_update_16, poly1305_finish_16
+};
+#endif
+
+#if __WANT_POLY1305(32)
+static const poly1305_backend poly1305_backend_32 = {
+	"donna-32", poly1305_init_32, poly1305_update_32, poly1305_finish_32
+};
+#endif
+
+#if __WANT_POLY1305(322)
+static const poly1305_backend poly1305_backend_32x2 = {
+	"donna-32x2", poly1305_init_32x2, poly1305_update_32x2, poly1305_finish_32x2
+};
+#endif
+
+#if defined(__HAVE_POLY1305_64) && __WANT_POLY1305(64)
+static const poly1305_backend poly1305_backend_64 = {
+	"donna-64", poly1305_init_64, poly1305_update_64, poly1305_finish_64
+};
+#endif
+
+#if defined(__HAVE_POLY1305_64) && __WANT_POLY1305(644)
+static const poly1305_backend poly1305_backend_64x4 = {
+	"donna-64x4", poly1305_init_64x4, poly1305_update_64x4, poly1305_finish_64x4
+};
+#endif
+
+/* ordered from (expected) fastest to slowest */
+static const poly1305_backend *const poly1305_backends[] = {
+#if defined(__HAVE_POLY1305_64) && __WANT_POLY1305(644)
+	&poly1305_backend_64x4,
+#endif
+#if defined(__HAVE_POLY1305_64) && __WANT_POLY1305(64)
+	&poly1305_backend_64,
 #endif
+#if __WANT_POLY1305(322)
+	&poly1305_backend_32x2,
+#endif
+#if __WANT_POLY1305(32)
+	&poly1305_backend_32,
+#endif
+#if __WANT_POLY1305(16)
+	&poly1305_backend_16,
+#endif
+#if __WANT_POLY1305(8)
+	&poly1305_backend_8
+#endif
+};
+
+#define POLY1305_BACKENDS (sizeof(poly1305_backends) / sizeof(poly1305_backends[0]))
+
+#if __POLY1305_DEFAULT_BITS == 8
+#	define POLY1305_DEFAULT_BACKEND poly1305_backend_8
+#elif __POLY1305_DEFAULT_BITS == 16
+#	define POLY1305_DEFAULT_BACKEND poly1305_backend_16
+#elif __POLY1305_DEFAULT_BITS == 32
+#	define POLY1305_DEFAULT_BACKEND poly1305_backend_32
+#elif __POLY1305_DEFAULT_BITS == 322
+#	define POLY1305_DEFAULT_BACKEND poly1305_backend_32x2
+#elif __POLY1305_DEFAULT_BITS == 64
+#	define POLY1305_DEFAULT_BACKEND poly1305_backend_64
+#else
+#	define POLY1305_DEFAULT_BACKEND poly1305_backend_64x4
+#endif
+
+static const poly1305_backend *poly1305_selected = &POLY1305_DEFAULT_BACKEND;
+
+#if defined(PORTABLE_8439_SMALL)
+/* a single backend, no pointer in the context */
+void poly1305_init(poly1305_context *ctx, const unsigned char key[32]) {
+	POLY1305_DEFAULT_BACKEND.init(ctx, key);
+}
 
 void poly1305_update(poly1305_context *ctx, const unsigned char *m, size_t bytes) {
-	poly1305_state_internal_t *st = (poly1305_state_internal_t *)ctx;
-	size_t i;
+	POLY1305_DEFAULT_BACKEND.update(ctx, m, bytes);
+}
 
-	/* handle leftover */
-	if (st->leftover) {
-		size_t want = (poly1305_block_size - st->leftover);
-		if (want > bytes)
-			want = bytes;
-		for (i = 0; i < want; i++)
-			st->buffer[st->leftover + i] = m[i];
-		bytes -= want;
-		m += want;
-		st->leftover += want;
-		if (st->leftover < poly1305_block_size)
-			return;
-		poly1305_blocks(st, st->buffer, poly1305_block_size);
-		st->leftover = 0;
-	}
+void poly1305_finish(poly1305_context *ctx, unsigned char mac[16]) {
+	POLY1305_DEFAULT_BACKEND.finish(ctx, mac);
+}
+#else
+void poly1305_init(poly1305_context *ctx, const unsigned char key[32]) {
+	/* a context sticks to the backend it was started with */
+	ctx->backend = poly1305_selected;
+	ctx->backend->init(ctx, key);
+}
 
-	/* process full blocks */
-	if (bytes >= poly1305_block_size) {
-		size_t want = (bytes & ~(poly1305_block_size - 1));
-		poly1305_blocks(st, m, want);
-		m += want;
-		bytes -= want;
-	}
+void poly1305_update(poly1305_context *ctx, const unsigned char *m, size_t bytes) {
+	ctx->backend->update(ctx, m, bytes);
+}
 
-	/* store leftover */
-	if (bytes) {
-		for (i = 0; i < bytes; i++)
-			st->buffer[st->leftover + i] = m[i];
-		st->leftover += bytes;
-	}
+void poly1305_finish(poly1305_context *ctx, unsigned char mac[16]) {
+	ctx->backend->finish(ctx, mac);
 }
+#endif
 
 int poly1305_verify(const unsigned char mac1[16], const unsigned char mac2[16]) {
 	size_t i;
@@ -67,3 +273,59 @@ int poly1305_verify(const unsigned char mac1[16], const unsigned char mac2[16])
 	dif = (dif - 1) >> ((sizeof(unsigned int) * 8) - 1);
 	return (dif & 1);
 }
+
+size_t poly1305_backend_count(void) {
+	return POLY1305_BACKENDS;
+}
+
+const poly1305_backend *poly1305_backend_at(size_t index) {
+	if (index >= POLY1305_BACKENDS)
+		return NULL;
+	return poly1305_backends[index];
+}
+
+const poly1305_backend *poly1305_backend_find(const char *name) {
+	size_t i;
+	for (i = 0; i < POLY1305_BACKENDS; i++) {
+		if (strcmp(poly1305_backends[i]->name, name) == 0)
+			return poly1305_backends[i];
+	}
+	return NULL;
+}
+
+const poly1305_backend *poly1305_backend_selected(void) {
+	return poly1305_selected;
+}
+
+int poly1305_backend_select(const poly1305_backend *backend) {
+	size_t i;
+	for (i = 0; i < POLY1305_BACKENDS; i++) {
+		if (poly1305_backends[i] == backend) {
+			poly1305_selected = backend;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+double poly1305_backend_benchmark(const poly1305_backend *backend, const unsigned char *m, size_t bytes, unsigned long runs) {
+	poly1305_context ctx;
+	unsigned char key[32] = {0};
+	unsigned char mac[16] = {0};
+	unsigned long r;
+	clock_t start, took;
+
+	start = clock();
+	for (r = 0; r < runs; r++) {
+		/* feed the previous mac into the key so the runs depend on each other */
+		memcpy(key, mac, sizeof(mac));
+#if !defined(PORTABLE_8439_SMALL)
+		ctx.backend = backend;
+#endif
+		backend->init(&ctx, key);
+		backend->update(&ctx, m, bytes);
+		backend->finish(&ctx, mac);
+	}
+	took = clock() - start;
+	return (double)took / CLOCKS_PER_SEC;
+}
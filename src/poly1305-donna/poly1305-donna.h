@@ -5,7 +5,15 @@
 
 typedef struct poly1305_context {
 	size_t aligner;
-	unsigned char opaque[136];
+#if defined(PORTABLE_8439_SMALL)
+	/* only the selected variant is compiled in, at most donna-32 or donna-64 */
+	unsigned char opaque[14 * sizeof(unsigned long) + 24];
+#else
+	/* donna-64x4 is the biggest variant at 168 bytes: with the aligner
+	   word in front that ends exactly at the backend pointer */
+	unsigned char opaque[160];
+	const struct poly1305_backend *backend;
+#endif
 } poly1305_context;
 
 void poly1305_init(poly1305_context *ctx, const unsigned char key[32]);
@@ -14,5 +22,27 @@ void poly1305_finish(poly1305_context *ctx, unsigned char mac[16]);
 
 int poly1305_verify(const unsigned char mac1[16], const unsigned char mac2[16]);
 
-#endif /* POLY1305_DONNA_H */
+/*
+	All donna variants are compiled in, poly1305_init uses the selected one.
+	The default is picked at compile time (see POLY1305_8BIT & friends),
+	select another one before starting to use contexts from multiple threads.
+	With PORTABLE_8439_SMALL only the default is compiled in (donna-64 rather
+	than donna-64x4 on 64 bit), and called directly.
+*/
+typedef struct poly1305_backend {
+	const char *name;
+	void (*init)(poly1305_context *ctx, const unsigned char key[32]);
+	void (*update)(poly1305_context *ctx, const unsigned char *m, size_t bytes);
+	void (*finish)(poly1305_context *ctx, unsigned char mac[16]);
+} poly1305_backend;
+
+size_t poly1305_backend_count(void);
+const poly1305_backend *poly1305_backend_at(size_t index);
+const poly1305_backend *poly1305_backend_find(const char *name);
+const poly1305_backend *poly1305_backend_selected(void);
+int poly1305_backend_select(const poly1305_backend *backend);
 
+/* returns the seconds (cpu time) it took to calculate runs macs of m */
+double poly1305_backend_benchmark(const poly1305_backend *backend, const unsigned char *m, size_t bytes, unsigned long runs);
+
+#endif /* POLY1305_DONNA_H */
@@ -0,0 +1,44 @@
+#ifndef PORTABLE_CONFIG_H
+#define PORTABLE_CONFIG_H
+// Build configuration shared by chacha-portable and poly1305-donna: the
+// profiles and tuning knobs that are set with -D flags. The platform
+// detection is in portable-endian.h.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// -DPORTABLE_8439_SMALL is the profile for microcontrollers: small code and
+// a shallow stack over throughput. The chacha rounds run as a loop over a
+// table of quarter rounds, without SIMD or interleaved blocks and without
+// forcing the block functions inline, only the selected poly1305-donna
+// variant is compiled in (with a context sized for it), and the batch
+// functions derive one key at a time. `make size-report` shows the difference.
+#ifdef PORTABLE_8439_SMALL
+#   ifndef CHACHA20_NO_VECTORS
+#       define CHACHA20_NO_VECTORS 1
+#   endif
+#   undef CHACHA20_INTERLEAVE
+#   define CHACHA20_INTERLEAVE (1)
+#endif
+
+// Software prefetch for the bulk loops of both: -DPORTABLE_PREFETCH_DISTANCE=n
+// prefetches the input n bytes ahead of where the loop is (0, the default, 
+// leaves it to the hardware prefetcher). PORTABLE_PREFETCH_AHEAD prefetches
+// the cache lines of the size bytes that are the distance ahead of p, if 
+// they are still inside of the available bytes from p.
+#ifndef PORTABLE_PREFETCH_DISTANCE
+#   define PORTABLE_PREFETCH_DISTANCE (0)
+#endif
+
+#if PORTABLE_PREFETCH_DISTANCE > 0 && defined(__GNUC__)
+#   define PORTABLE_PREFETCH_AHEAD(p, size, available) \
+        if ((available) >= PORTABLE_PREFETCH_DISTANCE + (size)) { \
+            for (size_t __pf = 0; __pf < (size); __pf += 64) { \
+                __builtin_prefetch((const uint8_t *)(p) + PORTABLE_PREFETCH_DISTANCE + __pf); \
+            } \
+        }
+#else
+#   define PORTABLE_PREFETCH_AHEAD(p, size, available)
+#endif
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef PORTABLE_ENDIAN_H
+#define PORTABLE_ENDIAN_H
+// Shared platform detection for chacha-portable and poly1305-donna, it
+// decides how we can turn bytes into (little endian) words:
+//
+//  - PORTABLE_UNALIGNED_WORDS: known byte order and unaligned word access
+//      is fine, so always use word loads/stores (byte swapped on big endian)
+//  - PORTABLE_ALIGNED_WORDS: known byte order, but unaligned access might
+//      trap or be emulated, so check the pointer alignment once and only
+//      use word loads/stores on aligned buffers
+//  - neither: load & store byte by byte
+//
+// For testing, -DTEST_SLOW_PATH forces the byte path and -DTEST_SLOW_PATH=2
+// the alignment checking path.
+
+#include <stdint.h>
+#include <string.h>
+
+// based on https://sourceforge.net/p/predef/wiki/Endianness/
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__) && \
+        __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#   define __HAVE_LITTLE_ENDIAN 1
+#elif defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && \
+        __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#   define __HAVE_BIG_ENDIAN 1
+#elif defined(__LITTLE_ENDIAN__) || \
+        defined(__ARMEL__) || \
+        defined(__THUMBEL__) || \
+        defined(__AARCH64EL__) || \
+        defined(_MIPSEL) || \
+        defined(__MIPSEL) || \
+        defined(__MIPSEL__) || \
+        defined(__XTENSA_EL__) || \
+        defined(__AVR__) || \
+        defined(_WIN32) || \
+        defined(LITTLE_ENDIAN)
+#   define __HAVE_LITTLE_ENDIAN 1
+#elif defined(__BIG_ENDIAN__) || \
+        defined(__ARMEB__) || \
+        defined(__THUMBEB__) || \
+        defined(__AARCH64EB__) || \
+        defined(_MIPSEB) || \
+        defined(__MIPSEB) || \
+        defined(__MIPSEB__) || \
+        defined(__XTENSA_EB__)
+#   define __HAVE_BIG_ENDIAN 1
+#endif
+
+// architectures where an unaligned word access is as cheap as an aligned one
+#if defined(__i386__) || \
+        defined(__x86_64__) || \
+        defined(_M_IX86) || \
+        defined(_M_X64) || \
+        defined(__aarch64__) || \
+        defined(_M_ARM64) || \
+        defined(__ARM_FEATURE_UNALIGNED) || \
+        defined(__powerpc__) || \
+        defined(__powerpc64__) || \
+        defined(__s390__) || \
+        defined(__s390x__) || \
+        defined(__riscv_misaligned_fast) || \
+        defined(__AVR__)
+#   define __HAVE_UNALIGNED_ACCESS 1
+#endif
+
+#if defined(TEST_SLOW_PATH) && TEST_SLOW_PATH == 2
+#   undef __HAVE_UNALIGNED_ACCESS
+#elif defined(TEST_SLOW_PATH)
+#   undef __HAVE_LITTLE_ENDIAN
+#   undef __HAVE_BIG_ENDIAN
+#   undef __HAVE_UNALIGNED_ACCESS
+#endif
+
+#if defined(__HAVE_LITTLE_ENDIAN) || defined(__HAVE_BIG_ENDIAN)
+#   if defined(__HAVE_UNALIGNED_ACCESS)
+#       define PORTABLE_UNALIGNED_WORDS 1
+#   else
+#       define PORTABLE_ALIGNED_WORDS 1
+#   endif
+#endif
+
+#if defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 3)))
+#   define PORTABLE_BSWAP32(x) __builtin_bswap32(x)
+#   define PORTABLE_BSWAP64(x) __builtin_bswap64(x)
+#else
+#   define PORTABLE_BSWAP32(x) \
+        ((((x) & 0xFF) << 24) | (((x) & 0xFF00) << 8) | \
+         (((x) >> 8) & 0xFF00) | (((x) >> 24) & 0xFF))
+#   define PORTABLE_BSWAP64(x) \
+        (((uint64_t)PORTABLE_BSWAP32((uint32_t)(x)) << 32) | \
+         PORTABLE_BSWAP32((uint32_t)((x) >> 32)))
+#endif
+
+// convert between a native word and a little endian one (both directions)
+#if defined(__HAVE_BIG_ENDIAN)
+#   define PORTABLE_LE32(x) PORTABLE_BSWAP32(x)
+#   define PORTABLE_LE64(x) PORTABLE_BSWAP64(x)
+#else
+#   define PORTABLE_LE32(x) (x)
+#   define PORTABLE_LE64(x) (x)
+#endif
+
+#if defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 7)))
+#   define PORTABLE_ASSUME_ALIGNED(p, n) __builtin_assume_aligned((p), (n))
+#else
+#   define PORTABLE_ASSUME_ALIGNED(p, n) (p)
+#endif
+
+#define PORTABLE_IS_ALIGNED(p, n) ((((uintptr_t)(p)) % (n)) == 0)
+
+#endif
@@ -0,0 +1,229 @@
+#include "portable8439-channel.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(__GNUC__)
+#   error "portable8439-channel needs the __atomic extensions of GCC or Clang"
+#endif
+
+#define CHANNEL_MAGIC (UINT64_C(0x38343339636e6c31))
+#define CACHE_LINE (64)
+
+// the counters of both sides each get their own cache line, the consumer
+// only touches the line of the producer when it runs out of messages (and
+// the other way around)
+struct portable_8439_channel_header {
+    uint64_t magic;
+    uint64_t slot_count;
+    uint64_t message_size;
+    uint8_t _pad0[CACHE_LINE - 3 * sizeof(uint64_t)];
+    uint64_t produced;
+    uint8_t _pad1[CACHE_LINE - sizeof(uint64_t)];
+    uint64_t consumed;
+    uint8_t _pad2[CACHE_LINE - sizeof(uint64_t)];
+};
+
+// a slot is the size of the message in it, followed by the message and its
+// tag, rounded up to whole cache lines
+#define SLOT_PAYLOAD (sizeof(uint64_t))
+
+static size_t slot_stride(size_t message_size) {
+    size_t stride = SLOT_PAYLOAD + message_size + RFC_8439_TAG_SIZE;
+    return (stride + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+}
+
+size_t portable_8439_channel_segment_size(size_t slot_count, size_t message_size) {
+    if (slot_count == 0 || message_size > SIZE_MAX / 2
+        || slot_count > (SIZE_MAX - sizeof(struct portable_8439_channel_header)) / slot_stride(message_size)) {
+        return 0;
+    }
+    return sizeof(struct portable_8439_channel_header) + slot_count * slot_stride(message_size);
+}
+
+int portable_8439_channel_format(
+    void *segment,
+    size_t segment_size,
+    size_t slot_count,
+    size_t message_size
+) {
+    size_t needed = portable_8439_channel_segment_size(slot_count, message_size);
+    if (needed == 0 || segment_size < needed) {
+        return 0;
+    }
+    struct portable_8439_channel_header *header = segment;
+    header->slot_count = slot_count;
+    header->message_size = message_size;
+    header->produced = 0;
+    header->consumed = 0;
+    __atomic_store_n(&header->magic, CHANNEL_MAGIC, __ATOMIC_RELEASE);
+    return 1;
+}
+
+int portable_8439_channel_attach(
+    portable_8439_channel *channel,
+    portable_8439_channel_side side,
+    void *segment,
+    size_t segment_size,
+    const uint8_t key[RFC_8439_KEY_SIZE]
+) {
+    struct portable_8439_channel_header *header = segment;
+    if (segment_size < sizeof(struct portable_8439_channel_header)
+        || __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != CHANNEL_MAGIC
+        || header->slot_count > SIZE_MAX || header->message_size > SIZE_MAX) {
+        return 0;
+    }
+    size_t slot_count = (size_t)header->slot_count;
+    size_t message_size = (size_t)header->message_size;
+    size_t needed = portable_8439_channel_segment_size(slot_count, message_size);
+    if (needed == 0 || segment_size < needed) {
+        return 0;
+    }
+    memset(channel, 0, sizeof(portable_8439_channel));
+    if (side == PORTABLE_8439_CHANNEL_CONSUMER) {
+        channel->opened = malloc(message_size + RFC_8439_TAG_SIZE);
+        if (channel->opened == NULL) {
+            return 0;
+        }
+    }
+    portable_chacha20_poly1305_key_init(&channel->key, key);
+    channel->header = header;
+    channel->slots = (uint8_t *)segment + sizeof(struct portable_8439_channel_header);
+    channel->slot_count = slot_count;
+    channel->slot_stride = slot_stride(message_size);
+    channel->message_size = message_size;
+    channel->side = side;
+    channel->position = __atomic_load_n(side == PORTABLE_8439_CHANNEL_PRODUCER ? &header->produced : &header->consumed, __ATOMIC_ACQUIRE);
+    channel->other = __atomic_load_n(side == PORTABLE_8439_CHANNEL_PRODUCER ? &header->consumed : &header->produced, __ATOMIC_ACQUIRE);
+    return 1;
+}
+
+void portable_8439_channel_wipe(portable_8439_channel *channel) {
+    portable_chacha20_poly1305_key_wipe(&channel->key);
+    if (channel->opened != NULL) {
+        memset(channel->opened, 0, channel->message_size + RFC_8439_TAG_SIZE);
+        free(channel->opened);
+    }
+    memset(channel, 0, sizeof(portable_8439_channel));
+}
+
+static uint8_t *current_slot(const portable_8439_channel *channel) {
+    return channel->slots + (size_t)(channel->position % channel->slot_count) * channel->slot_stride;
+}
+
+// same nonce as the transport sessions: 4 zero bytes and the little endian
+// counter of the message
+static void make_nonce(uint8_t nonce[RFC_8439_NONCE_SIZE], uint64_t counter) {
+    memset(nonce, 0, 4);
+    for (unsigned int i = 0; i < 8; i++) {
+        nonce[4 + i] = (uint8_t)(counter >> (8 * i));
+    }
+}
+
+uint8_t *portable_8439_channel_reserve(portable_8439_channel *channel) {
+    if (channel->side != PORTABLE_8439_CHANNEL_PRODUCER) {
+        return NULL;
+    }
+    if (!channel->holding) {
+        if (channel->position - channel->other >= channel->slot_count) {
+            // pairs with the release in portable_8439_channel_release, the
+            // consumer is done with (and wiped) the slot
+            channel->other = __atomic_load_n(&channel->header->consumed, __ATOMIC_ACQUIRE);
+            if (channel->position - channel->other >= channel->slot_count) {
+                return NULL;
+            }
+        }
+        channel->holding = 1;
+    }
+    return current_slot(channel) + SLOT_PAYLOAD;
+}
+
+static void publish_slot(portable_8439_channel *channel, uint8_t *slot, size_t size) {
+    uint64_t stored_size = size;
+    memcpy(slot, &stored_size, sizeof(stored_size));
+    channel->holding = 0;
+    channel->position++;
+    __atomic_store_n(&channel->header->produced, channel->position, __ATOMIC_RELEASE);
+}
+
+int portable_8439_channel_publish(portable_8439_channel *channel, size_t size) {
+    if (!channel->holding || size > channel->message_size) {
+        return 0;
+    }
+    uint8_t nonce[RFC_8439_NONCE_SIZE];
+    make_nonce(nonce, channel->position);
+    uint8_t *slot = current_slot(channel);
+    portable_chacha20_poly1305_seal_in_place(slot + SLOT_PAYLOAD, size, &channel->key, nonce, NULL, 0);
+    publish_slot(channel, slot, size);
+    return 1;
+}
+
+int portable_8439_channel_send(
+    portable_8439_channel *channel,
+    const uint8_t *message,
+    size_t size
+) {
+    if (size > channel->message_size || channel->holding || portable_8439_channel_reserve(channel) == NULL) {
+        return 0;
+    }
+    uint8_t nonce[RFC_8439_NONCE_SIZE];
+    make_nonce(nonce, channel->position);
+    uint8_t *slot = current_slot(channel);
+    if (portable_chacha20_poly1305_encrypt_key(slot + SLOT_PAYLOAD, &channel->key, nonce, NULL, 0, message, size) == (size_t)-1) {
+        // the message is in the segment itself
+        channel->holding = 0;
+        return 0;
+    }
+    publish_slot(channel, slot, size);
+    return 1;
+}
+
+int portable_8439_channel_receive(
+    portable_8439_channel *channel,
+    const uint8_t **message,
+    size_t *size
+) {
+    *message = NULL;
+    *size = 0;
+    if (channel->side != PORTABLE_8439_CHANNEL_CONSUMER || channel->holding) {
+        return -1;
+    }
+    if (channel->position == channel->other) {
+        // pairs with the release in publish_slot, the slot is sealed
+        channel->other = __atomic_load_n(&channel->header->produced, __ATOMIC_ACQUIRE);
+        if (channel->position == channel->other) {
+            return 0;
+        }
+    }
+    uint8_t *slot = current_slot(channel);
+    uint64_t stored_size;
+    memcpy(&stored_size, slot, sizeof(stored_size));
+    channel->holding = 1;
+    channel->held_size = 0;
+    if (stored_size > channel->message_size) {
+        return -1;
+    }
+    uint8_t nonce[RFC_8439_NONCE_SIZE];
+    make_nonce(nonce, channel->position);
+    // the segment is shared: take a snapshot and only work on that, so the
+    // bytes that are decrypted are the ones the tag was checked over
+    memcpy(channel->opened, slot + SLOT_PAYLOAD, (size_t)stored_size + RFC_8439_TAG_SIZE);
+    size_t opened = portable_chacha20_poly1305_open_in_place(channel->opened, (size_t)stored_size + RFC_8439_TAG_SIZE,
+        &channel->key, nonce, NULL, 0);
+    if (opened == (size_t)-1) {
+        return -1;
+    }
+    channel->held_size = opened;
+    *message = channel->opened;
+    *size = opened;
+    return 1;
+}
+
+void portable_8439_channel_release(portable_8439_channel *channel) {
+    if (channel->side != PORTABLE_8439_CHANNEL_CONSUMER || !channel->holding) {
+        return;
+    }
+    memset(channel->opened, 0, channel->held_size);
+    channel->holding = 0;
+    channel->position++;
+    __atomic_store_n(&channel->header->consumed, channel->position, __ATOMIC_RELEASE);
+}
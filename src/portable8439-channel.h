@@ -0,0 +1,127 @@
+#ifndef PORTABLE_8439_CHANNEL_H
+#define PORTABLE_8439_CHANNEL_H
+/*
+ A single-producer/single-consumer channel through shared memory, with the
+ messages sealed while they sit in the segment. Needs GCC/Clang (atomics),
+ it's not part of the portable8439 library itself, compile
+ portable8439-channel.c next to it.
+
+ - the segment (shared memory, mapped by both processes: shm_open & mmap,
+     or an anonymous shared mapping before a fork) is a header with the
+     positions of both sides, followed by a ring of fixed size slots
+ - both sides attach with the same key, the producer fills the next slot
+     and seals it in place, the consumer copies it into its own memory and
+     opens it there. The nonce of a slot is its message counter, the
+     consumer expects the counters in order, so a slot that was replaced,
+     replayed or reordered doesn't open.
+ - the consumer never reads a slot twice: whoever else can write to the
+     segment can't change the cipher text between the check of the tag and
+     the decryption, what it opened is what was authenticated.
+ - the fast path is a few atomic loads & stores in the segment, no system
+     calls, both sides return right away on a full or empty channel (spin,
+     yield or sleep as you see fit).
+
+ The key stays in the memory of the processes, never put the channel struct
+ itself in the segment.
+*/
+
+#include "portable8439.h"
+
+typedef enum portable_8439_channel_side {
+    PORTABLE_8439_CHANNEL_PRODUCER,
+    PORTABLE_8439_CHANNEL_CONSUMER
+} portable_8439_channel_side;
+
+typedef struct portable_8439_channel {
+    // private
+    portable_8439_key key;
+    struct portable_8439_channel_header *header;
+    uint8_t *slots;
+    size_t slot_count;
+    size_t slot_stride;
+    size_t message_size;
+    portable_8439_channel_side side;
+    // the message counter of this side, and the last seen counter of the
+    // other side (so the shared line is only read when it has to)
+    uint64_t position;
+    uint64_t other;
+    // the slot reserved/received but not yet published/released
+    int holding;
+    size_t held_size;
+    // consumer: the private copy of the received slot, opened in there
+    uint8_t *opened;
+} portable_8439_channel;
+
+/*
+    Bytes of shared memory needed for slot_count slots that each hold a
+    message of at most message_size bytes.
+*/
+size_t portable_8439_channel_segment_size(size_t slot_count, size_t message_size);
+
+/*
+    Format a zeroed segment of segment_size bytes, once, before either
+    side attaches. Returns 0 if the segment is too small.
+*/
+int portable_8439_channel_format(
+    void *segment,
+    size_t segment_size,
+    size_t slot_count,
+    size_t message_size
+);
+
+/*
+    Attach one side (one producer and one consumer per channel) to a
+    formatted segment. Returns 0 if the segment isn't a formatted channel or
+    is smaller than its header claims (or the consumer can't allocate its
+    copy of a slot). Use a different key for every channel (so also for the
+    way back), the nonces only count the messages of one channel. Wipe the
+    channel when you are done.
+*/
+int portable_8439_channel_attach(
+    portable_8439_channel *channel,
+    portable_8439_channel_side side,
+    void *segment,
+    size_t segment_size,
+    const uint8_t key[RFC_8439_KEY_SIZE]
+);
+
+void portable_8439_channel_wipe(portable_8439_channel *channel);
+
+/*
+    Producer: reserve returns the slot to write a message into (at most the
+    message_size of the channel), NULL when the channel is full. publish
+    seals the first size bytes of it in place and hands it to the consumer,
+    returns 0 if size is too large or nothing was reserved.
+
+    Until it's published the plain text is in the segment, use send (which
+    seals while copying into the slot) if that's not fine. send returns 0
+    when the channel is full or the message too large.
+*/
+uint8_t *portable_8439_channel_reserve(portable_8439_channel *channel);
+
+int portable_8439_channel_publish(portable_8439_channel *channel, size_t size);
+
+int portable_8439_channel_send(
+    portable_8439_channel *channel,
+    const uint8_t *message,
+    size_t size
+);
+
+/*
+    Consumer: receive copies the next slot out of the segment, opens the
+    copy, and points message to the plain text in it (memory of the
+    consumer, not the segment). Returns 1 when a message was opened, 0 when
+    the channel is empty, -1 when the slot didn't open (tampered with or out
+    of order). The message stays valid until release, which wipes it and
+    hands the slot back to the producer, call it after both 1 and -1
+    (receive returns -1 as long as a slot is held).
+*/
+int portable_8439_channel_receive(
+    portable_8439_channel *channel,
+    const uint8_t **message,
+    size_t *size
+);
+
+void portable_8439_channel_release(portable_8439_channel *channel);
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef PORTABLE_8439_OFFLOAD_H
+#define PORTABLE_8439_OFFLOAD_H
+/*
+ In-process crypto offload: a pool of worker threads that seal & open
+ messages for other threads. Needs POSIX threads and GCC/Clang (atomics),
+ it's not part of the portable8439 library itself, compile
+ portable8439-offload.c next to it and link with -pthread.
+
+ - producers submit jobs (operation, key context, nonce, ad, in & output),
+     they go into a lock-free bounded ring shared by all workers
+ - a worker takes a batch of small jobs (or one large job) from the ring
+     into its own deque, idle workers steal from the deques of the others
+ - a finished job is posted to the completion queue it was submitted with,
+     where the producer (or any other thread) polls or waits for it
+
+ Nothing is copied: the job, key, nonce, ad and buffers should stay alive and
+ unchanged until the job comes out of its completion queue.
+*/
+
+#include "portable8439.h"
+
+typedef enum portable_8439_offload_operation {
+    PORTABLE_8439_OFFLOAD_SEAL,
+    PORTABLE_8439_OFFLOAD_OPEN
+} portable_8439_offload_operation;
+
+typedef struct portable_8439_job {
+    // filled in by the caller
+    portable_8439_offload_operation operation;
+    const portable_8439_key *key;
+    const uint8_t *nonce;
+    const uint8_t *ad;
+    size_t ad_size;
+    const uint8_t *input;
+    size_t input_size;
+    uint8_t *output;
+    void *user_data;
+
+    // filled in by the worker, the return value of
+    // portable_chacha20_poly1305_encrypt_key/_decrypt_key
+    size_t result;
+
+    // private
+    struct portable_8439_completion_queue *queue;
+} portable_8439_job;
+
+typedef struct portable_8439_offload portable_8439_offload;
+typedef struct portable_8439_completion_queue portable_8439_completion_queue;
+
+/*
+    Start a pool, workers 0 means one per online cpu, queue_size is the
+    number of jobs the shared ring can hold (rounded up to a power of 2).
+    Returns NULL if the memory or threads couldn't be allocated.
+*/
+portable_8439_offload *portable_8439_offload_create(unsigned int workers, size_t queue_size);
+
+/*
+    Stops the pool, the jobs that were already submitted are finished first
+    (and posted to their queues).
+*/
+void portable_8439_offload_destroy(portable_8439_offload *offload);
+
+/*
+    A completion queue can hold capacity finished jobs, and it limits the
+    jobs that are in flight for it (submitted, but not yet polled) to the
+    same number, so a worker can always post to it. Destroy it only after all
+    its jobs have been taken out.
+*/
+portable_8439_completion_queue *portable_8439_completion_queue_create(size_t capacity);
+void portable_8439_completion_queue_destroy(portable_8439_completion_queue *queue);
+
+/*
+    Queue a job, returns 0 (without queueing) when the ring or the
+    completion queue is full (the ring can also look full for a moment 
+    when it's nearly full), poll some completions or yield, and try again.
+*/
+int portable_8439_offload_submit(
+    portable_8439_offload *offload,
+    portable_8439_job *job,
+    portable_8439_completion_queue *queue
+);
+
+/*
+    Take up to max finished jobs out of the queue, poll returns right away,
+    wait blocks until there is at least one (don't wait on a queue without
+    jobs in flight). Returns the number of jobs written to completed.
+*/
+size_t portable_8439_completion_queue_poll(
+    portable_8439_completion_queue *queue,
+    portable_8439_job **completed,
+    size_t max
+);
+size_t portable_8439_completion_queue_wait(
+    portable_8439_completion_queue *queue,
+    portable_8439_job **completed,
+    size_t max
+);
+
+/*
+    A record for portable_8439_offload_open_batch: the cipher text (with the
+    tag) and the slot its plain text (cipher_text_size - tag bytes) goes to.
+*/
+typedef struct portable_8439_record {
+    const portable_8439_key *key;
+    const uint8_t *nonce;
+    const uint8_t *ad;
+    size_t ad_size;
+    const uint8_t *cipher_text;
+    size_t cipher_text_size;
+    uint8_t *plain_text;
+} portable_8439_record;
+
+/*
+    Open a batch of records with the calling thread and the workers of the
+    pool (offload can be NULL, then only the calling thread works), and
+    return when all are done. Records larger than 256KiB are split, so a few
+    huge records still spread over the workers. A worker that is busy
+    joins late, the others steal its share in the meantime.
+
+    verdicts should hold (count + 7) / 8 bytes, bit i % 8 of byte i / 8 is
+    set when record i opened. A record that didn't open (bad tag, too
+    short, or a large record with overlapping cipher & plain text) has
+    nothing or zeros in its plain text. Returns the number of records that
+    opened, or (size_t)-1 if the memory couldn't be allocated.
+*/
+size_t portable_8439_offload_open_batch(
+    portable_8439_offload *offload,
+    const portable_8439_record *records,
+    size_t count,
+    uint8_t *verdicts
+);
+
+#endif
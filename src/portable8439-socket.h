@@ -0,0 +1,146 @@
+#ifndef PORTABLE_8439_SOCKET_H
+#define PORTABLE_8439_SOCKET_H
+/*
+ Sealed frames over a stream socket. The writer sends them without
+ concatenating them first, the reader opens them where they were read.
+ Needs POSIX sockets, it's not part of the portable8439 library itself,
+ compile portable8439-socket.c next to it.
+
+ A frame is a 4 byte big endian length (of the plain text), the cipher text
+ and the tag. The length is the AD, the nonce is the number of the frame
+ (4 zero bytes and the little endian counter, like the transport sessions),
+ so every direction of a connection needs its own key.
+
+ - the writer seals into a buffer that belongs to the connection (register
+     it once, for instance with MSG_ZEROCOPY or io_uring) and hands the
+     headers, cipher texts and tags to a single sendmsg, optionally with
+     MSG_ZEROCOPY on Linux. Many frames can go out in one call.
+ - the reader read()s whatever is available into the end of one contiguous
+     buffer, and opens every complete frame in there in place
+     (portable_chacha20_poly1305_open_in_place), no copy. A frame that
+     arrived partially is moved to the front when it wouldn't fit behind
+     it. A read of many small frames is one system call.
+
+ Both expect a blocking socket, they retry on EINTR and partial writes.
+*/
+
+#include "portable8439.h"
+#include <sys/uio.h>
+
+#define PORTABLE_8439_FRAME_HEADER_SIZE (4)
+#define PORTABLE_8439_FRAME_OVERHEAD (PORTABLE_8439_FRAME_HEADER_SIZE + RFC_8439_TAG_SIZE)
+// frames per call of portable_8439_socket_write_frames
+#define PORTABLE_8439_SOCKET_BATCH (64)
+
+// send with MSG_ZEROCOPY (Linux 4.14+, TCP), ignored when not available
+#define PORTABLE_8439_SOCKET_ZEROCOPY (1)
+
+typedef struct portable_8439_socket_writer {
+    // private
+    portable_8439_key key;
+    int fd;
+    int zerocopy;
+    uint64_t counter;
+    uint8_t *buffer;
+    size_t buffer_size;
+    // sendmsg calls with MSG_ZEROCOPY, and how many of them the kernel is
+    // done with (the buffer can only be reused after that)
+    uint32_t zerocopy_sent;
+    uint32_t zerocopy_done;
+    uint8_t headers[PORTABLE_8439_SOCKET_BATCH][PORTABLE_8439_FRAME_HEADER_SIZE];
+    uint8_t tags[PORTABLE_8439_SOCKET_BATCH][RFC_8439_TAG_SIZE];
+} portable_8439_socket_writer;
+
+typedef struct portable_8439_socket_reader {
+    // private
+    portable_8439_key key;
+    int fd;
+    uint64_t counter;
+    uint8_t *buffer;
+    size_t buffer_size;
+    // the received bytes that aren't handed out yet
+    size_t start;
+    size_t end;
+} portable_8439_socket_reader;
+
+/*
+    Start a writer on the connected socket fd. buffer (buffer_size bytes)
+    holds the cipher texts while they are sent, so it bounds the size of a
+    frame and the total of a batch. flags is 0 or
+    PORTABLE_8439_SOCKET_ZEROCOPY, check zerocopy_active to see if the socket
+    took it. Wipe the writer when you are done, the buffer stays yours.
+*/
+void portable_8439_socket_writer_init(
+    portable_8439_socket_writer *writer,
+    int fd,
+    const uint8_t key[RFC_8439_KEY_SIZE],
+    uint8_t *buffer,
+    size_t buffer_size,
+    int flags
+);
+
+int portable_8439_socket_writer_zerocopy_active(const portable_8439_socket_writer *writer);
+
+void portable_8439_socket_writer_wipe(portable_8439_socket_writer *writer);
+
+/*
+    Seal one frame, the plain text is gathered from count pieces (without
+    copying them together first), and send it. Returns the size of the
+    plain text, -1 with errno set when sending failed (EMSGSIZE when it
+    doesn't fit in the buffer). After a failure the connection is unusable,
+    the other side has part of a frame.
+*/
+size_t portable_8439_socket_writev(
+    portable_8439_socket_writer *writer,
+    const struct iovec *plain_text,
+    int count
+);
+
+size_t portable_8439_socket_write(
+    portable_8439_socket_writer *writer,
+    const uint8_t *plain_text,
+    size_t size
+);
+
+/*
+    Seal count (at most PORTABLE_8439_SOCKET_BATCH) messages as consecutive
+    frames, and send them in one go. Returns the number of frames sent,
+    -1 with errno set like writev.
+*/
+size_t portable_8439_socket_write_frames(
+    portable_8439_socket_writer *writer,
+    const struct iovec *messages,
+    size_t count
+);
+
+/*
+    Start a reader on the connected socket fd, a frame has to fit in buffer
+    (plain text size + PORTABLE_8439_FRAME_OVERHEAD). Wipe the reader when
+    you are done.
+*/
+void portable_8439_socket_reader_init(
+    portable_8439_socket_reader *reader,
+    int fd,
+    const uint8_t key[RFC_8439_KEY_SIZE],
+    uint8_t *buffer,
+    size_t buffer_size
+);
+
+void portable_8439_socket_reader_wipe(portable_8439_socket_reader *reader);
+
+/*
+    Open the next frame, reading from the socket only when the buffer
+    doesn't hold it completely yet. message points to the plain text in the
+    buffer, until the next read. Returns 1 for a frame, 0 when the other
+    side closed the connection between two frames, -1 with errno set:
+    EBADMSG for a frame that doesn't open, EMSGSIZE when it's larger than
+    the buffer, EPIPE when the connection closed in the middle of one, or
+    the error of the read. Don't read on after -1.
+*/
+int portable_8439_socket_read(
+    portable_8439_socket_reader *reader,
+    const uint8_t **message,
+    size_t *size
+);
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef PORTABLE_8439_STREAM_HPP
+#define PORTABLE_8439_STREAM_HPP
+/*
+ C++20 coroutine adapters on top of the incremental functions, for messages
+ that are too large to hold in memory (files, sockets, pipes).
+
+ - seal_stream: pulls chunks from an async source, seals them and pushes
+     them to an async sink, followed by the tag
+ - open_stream: the reverse, holds back the last tag_size bytes of the
+     source as the tag
+ - task: the lazy coroutine type they return, co_await it from another
+     coroutine, or block on it with sync_wait
+
+ Memory use is bounded by the chunk size, no matter how long the stream is:
+ there is one input and one output chunk, and the next chunk is only read
+ after the sink accepted the previous one.
+
+ A source has `read(span<std::uint8_t>)` that returns an awaitable with the
+ number of bytes read (0 at the end), a sink has `write(span<const
+ std::uint8_t>)` that returns an awaitable that completes when the sink is
+ done with the bytes. The key, ad, source & sink should outlive the task.
+*/
+#if !defined(__cpp_impl_coroutine)
+#    error "C++20 coroutines required"
+#endif
+
+#include "portable8439.hpp"
+#include <condition_variable>
+#include <coroutine>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+
+namespace portable8439 {
+
+template <typename T>
+class task;
+
+namespace detail {
+// sync_wait blocks on this until the task finished, on whatever thread
+// that happens
+struct sync_state {
+    std::mutex lock;
+    std::condition_variable changed;
+    bool finished = false;
+};
+}
+
+template <typename T>
+class [[nodiscard]] task {
+public:
+    struct promise_type {
+        std::coroutine_handle<> continuation = std::noop_coroutine();
+        detail::sync_state *sync = nullptr;
+        std::optional<T> value;
+        std::exception_ptr error;
+
+        task get_return_object() noexcept {
+            return task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct final_awaiter {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> self) noexcept {
+                detail::sync_state *sync = self.promise().sync;
+                if (sync != nullptr) {
+                    // notify under the lock, so sync_wait can't return (and
+                    // destroy the state) before we are done with it
+                    std::lock_guard<std::mutex> guard(sync->lock);
+                    sync->finished = true;
+                    sync->changed.notify_all();
+                    return std::noop_coroutine();
+                }
+                return self.promise().continuation;
+            }
+            void await_resume() noexcept {}
+        };
+        final_awaiter final_suspend() noexcept { return {}; }
+
+        void return_value(T result) { value.emplace(std::move(result)); }
+        void unhandled_exception() noexcept { error = std::current_exception(); }
+    };
+
+    task(const task &) = delete;
+    task &operator=(const task &) = delete;
+    task(task &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    task &operator=(task &&other) noexcept {
+        if (this != &other) {
+            if (handle_) {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    ~task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    // awaiting a task starts it, and resumes the awaiting coroutine when it's done
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+    T await_resume() { return result(); }
+
+    // run the task from non-coroutine code, blocks until it finished (the
+    // source and sink may resume it on another thread). Throws
+    // std::invalid_argument for a task without a coroutine (moved from)
+    friend T sync_wait(task t) {
+        if (!t.handle_) {
+            throw std::invalid_argument("sync_wait of a task without a coroutine");
+        }
+        detail::sync_state sync;
+        t.handle_.promise().sync = &sync;
+        t.handle_.resume();
+        std::unique_lock<std::mutex> guard(sync.lock);
+        sync.changed.wait(guard, [&sync] { return sync.finished; });
+        return t.result();
+    }
+
+private:
+    explicit task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+    T result() {
+        promise_type &promise = handle_.promise();
+        if (promise.error) {
+            std::rethrow_exception(promise.error);
+        }
+        return std::move(*promise.value);
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+constexpr std::size_t default_chunk_size = 64 * 1024;
+
+// seal everything from source into sink, returns the number of bytes
+// written to the sink (the size of the source + tag_size)
+template <typename Source, typename Sink>
+task<std::uint64_t> seal_stream(
+    const key &k,
+    nonce n,
+    span<const std::uint8_t> ad,
+    Source &source,
+    Sink &sink,
+    std::size_t chunk_size = default_chunk_size
+) {
+    std::unique_ptr<std::uint8_t[]> input(new std::uint8_t[chunk_size]);
+    std::unique_ptr<std::uint8_t[]> output(new std::uint8_t[chunk_size]);
+    stream state(k, n, ad);
+    std::uint64_t written = 0;
+    for (;;) {
+        std::size_t size = co_await source.read(span<std::uint8_t>(input.get(), chunk_size));
+        if (size == 0) {
+            break;
+        }
+        state.seal_update(span<std::uint8_t>(output.get(), size), span<const std::uint8_t>(input.get(), size));
+        co_await sink.write(span<const std::uint8_t>(output.get(), size));
+        written += size;
+    }
+    std::array<std::uint8_t, tag_size> tag;
+    state.seal_final(tag);
+    co_await sink.write(span<const std::uint8_t>(tag.data(), tag.size()));
+    co_return written + tag_size;
+}
+
+// open everything from source into sink, returns true if the tag matched.
+// The sink receives the plain text before the tag is checked: only trust
+// (act on, commit, forward) what it received once the task returned true.
+template <typename Source, typename Sink>
+task<bool> open_stream(
+    const key &k,
+    nonce n,
+    span<const std::uint8_t> ad,
+    Source &source,
+    Sink &sink,
+    std::size_t chunk_size = default_chunk_size
+) {
+    // the input keeps the last tag_size bytes in front of the next read,
+    // they are only cipher text if more bytes follow
+    std::unique_ptr<std::uint8_t[]> input(new std::uint8_t[tag_size + chunk_size]);
+    std::unique_ptr<std::uint8_t[]> output(new std::uint8_t[tag_size + chunk_size]);
+    stream state(k, n, ad);
+    std::size_t held = 0;
+    for (;;) {
+        std::size_t size = co_await source.read(span<std::uint8_t>(input.get() + held, chunk_size));
+        if (size == 0) {
+            break;
+        }
+        held += size;
+        if (held <= tag_size) {
+            continue;
+        }
+        std::size_t ready = held - tag_size;
+        state.open_update(span<std::uint8_t>(output.get(), ready), span<const std::uint8_t>(input.get(), ready));
+        co_await sink.write(span<const std::uint8_t>(output.get(), ready));
+        std::memmove(input.get(), input.get() + ready, tag_size);
+        held = tag_size;
+    }
+    std::array<std::uint8_t, tag_size> tag{};
+    std::memcpy(tag.data(), input.get(), held);
+    // a source shorter than a tag can't be valid, but still finish the stream to wipe it
+    bool valid = state.open_final(tag);
+    co_return valid && held == tag_size;
+}
+
+}
+#endif
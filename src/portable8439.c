@@ -1,6 +1,7 @@
 #include "portable8439.h"
 #include "chacha-portable/chacha-portable.h"
 #include "poly1305-donna/poly1305-donna.h"
+#include <string.h>
 
 #define __CHACHA20_BLOCK_SIZE (64)
 #define __POLY1305_KEY_SIZE (32)
@@ -29,40 +30,256 @@ static void write_64bit_int(poly1305_context *ctx, uint64_t value) {
     poly1305_update(ctx, result, 8);
 }
 
-static void poly1305_calculate_mac(
-    uint8_t *mac,
-    const uint8_t *cipher_text,
-    size_t cipher_text_size,
-    const uint8_t key[RFC_8439_KEY_SIZE],
+// the AEAD is the same for the reduced round variants, only the chacha 
+// functions differ. Every caller passes a constant, so the switch folds away
+static void chacha_xor_stream_key(
+    uint8_t *restrict dest,
+    const uint8_t *restrict source,
+    size_t length,
+    const chacha20_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    uint32_t counter,
+    unsigned int rounds
+) {
+    switch (rounds) {
+        case 8:
+            chacha8_xor_stream_key(dest, source, length, key, nonce, counter);
+            break;
+        case 12:
+            chacha12_xor_stream_key(dest, source, length, key, nonce, counter);
+            break;
+        default:
+            chacha20_xor_stream_key(dest, source, length, key, nonce, counter);
+            break;
+    }
+}
+
+static void chacha_keygen(
+    uint8_t poly_key[__POLY1305_KEY_SIZE],
+    const chacha20_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    unsigned int rounds
+) {
+    switch (rounds) {
+        case 8:
+            chacha8_keygen(poly_key, key, nonce);
+            break;
+        case 12:
+            chacha12_keygen(poly_key, key, nonce);
+            break;
+        default:
+            rfc8439_keygen(poly_key, key, nonce);
+            break;
+    }
+}
+
+// start a mac: derive the poly key (section 2.6), unless it was already
+// derived in a batch, and write the padded AD
+static void poly1305_begin_mac(
+    poly1305_context *poly_ctx,
+    const chacha20_key *key,
     const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *derived_key,
     const uint8_t *ad,
-    size_t ad_size
+    size_t ad_size,
+    unsigned int rounds
 ) {
-    // init poly key (section 2.6)
-    uint8_t poly_key[__POLY1305_KEY_SIZE] = {0}; 
-    rfc8439_keygen(poly_key, key, nonce);
-    // start poly1305 mac
-    poly1305_context poly_ctx;
-    poly1305_init(&poly_ctx, poly_key);
+    if (derived_key != NULL) {
+        poly1305_init(poly_ctx, derived_key);
+    }
+    else {
+        uint8_t poly_key[__POLY1305_KEY_SIZE] = {0}; 
+        chacha_keygen(poly_key, key, nonce, rounds);
+        poly1305_init(poly_ctx, poly_key);
+    }
 
     if (ad != NULL && ad_size > 0) {
         // write AD if present
-        poly1305_update(&poly_ctx, ad, ad_size);
-        pad_if_needed(&poly_ctx, ad_size);
+        poly1305_update(poly_ctx, ad, ad_size);
+        pad_if_needed(poly_ctx, ad_size);
     }
+}
 
-    // now write the cipher text
-    poly1305_update(&poly_ctx, cipher_text, cipher_text_size);
-    pad_if_needed(&poly_ctx, cipher_text_size);
+// end a mac after all the cipher text has been written
+static void poly1305_finish_mac(
+    poly1305_context *poly_ctx,
+    uint8_t *mac,
+    size_t ad_size,
+    uint64_t cipher_text_size
+) {
+    pad_if_needed(poly_ctx, (size_t)(cipher_text_size % 16));
 
     // write sizes
-    write_64bit_int(&poly_ctx, ad_size);
-    write_64bit_int(&poly_ctx, cipher_text_size);
+    write_64bit_int(poly_ctx, ad_size);
+    write_64bit_int(poly_ctx, cipher_text_size);
     
     // calculate MAC
-    poly1305_finish(&poly_ctx, mac);
+    poly1305_finish(poly_ctx, mac);
+}
+
+static void poly1305_calculate_mac(
+    uint8_t *mac,
+    const uint8_t *cipher_text,
+    size_t cipher_text_size,
+    const chacha20_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *derived_key,
+    const uint8_t *ad,
+    size_t ad_size,
+    unsigned int rounds
+) {
+    poly1305_context poly_ctx;
+    poly1305_begin_mac(&poly_ctx, key, nonce, derived_key, ad, ad_size, rounds);
+    poly1305_update(&poly_ctx, cipher_text, cipher_text_size);
+    poly1305_finish_mac(&poly_ctx, mac, ad_size, cipher_text_size);
+}
+
+
+// USDT probes for perf, bpftrace & systemtap, enable with -DPORTABLE_8439_USDT
+// (needs <sys/sdt.h>, on debian/ubuntu: systemtap-sdt-dev). A probe is a 
+// single nop until a tracer attaches to it.
+#ifdef PORTABLE_8439_USDT
+#   if defined(__has_include)
+#       if __has_include(<sys/sdt.h>)
+#           include <sys/sdt.h>
+#           define __HAVE_USDT 1
+#       endif
+#   endif
+#   ifndef __HAVE_USDT
+#       error "PORTABLE_8439_USDT needs <sys/sdt.h>"
+#   endif
+#endif
+
+#ifdef __HAVE_USDT
+#   define TRACE_ENTRY(operation, size, ad_size) DTRACE_PROBE2(portable8439, operation##_entry, size, ad_size)
+#   define TRACE_RETURN(operation, result) DTRACE_PROBE1(portable8439, operation##_return, result)
+#   define TRACE_AUTH_FAILURE(size) DTRACE_PROBE1(portable8439, auth_failure, size)
+#else
+#   define TRACE_ENTRY(operation, size, ad_size)
+#   define TRACE_RETURN(operation, result)
+#   define TRACE_AUTH_FAILURE(size)
+#endif
+
+
+#ifdef PORTABLE_8439_STATS
+#if !defined(__GNUC__)
+#   error "PORTABLE_8439_STATS needs the __thread and __atomic extensions of GCC or Clang"
+#endif
+#include <stdlib.h>
+
+typedef struct stats_block {
+    portable_8439_stats counters;
+    struct stats_block *next;
+} stats_block;
+
+// lock-free list of all the thread blocks, it only grows
+static stats_block *stats_blocks = NULL;
+// fallback for threads that failed to allocate their own block
+static stats_block stats_shared;
+static __thread stats_block *stats_local = NULL;
+static const portable_8439_timing *stats_current_timing = NULL;
+
+static stats_block *stats_thread_block(void) {
+    stats_block *block = stats_local;
+    if (block == NULL) {
+        block = calloc(1, sizeof(stats_block));
+        if (block == NULL) {
+            return &stats_shared;
+        }
+        block->next = __atomic_load_n(&stats_blocks, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&stats_blocks, &block->next, block, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+        stats_local = block;
+    }
+    return block;
+}
+
+// only the owning thread writes to its block, so we don't need a locked
+// add, the atomic load & store only make sure collect never sees torn values
+static void stats_add(stats_block *block, uint64_t *counter, uint64_t value) {
+    if (block == &stats_shared) {
+        __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+    }
+    else {
+        __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+    }
 }
 
+static unsigned int stats_bucket(size_t size) {
+    unsigned int bucket = size == 0 ? 0 : 64 - __builtin_clzll((unsigned long long)size);
+    return bucket < PORTABLE_8439_STATS_BUCKETS ? bucket : PORTABLE_8439_STATS_BUCKETS - 1;
+}
+
+typedef struct stats_call {
+    stats_block *block;
+    const portable_8439_timing *timing;
+    portable_8439_operation operation;
+    size_t size;
+    uint64_t start;
+} stats_call;
+
+static void stats_begin(stats_call *call, portable_8439_operation operation, size_t size) {
+    call->block = stats_thread_block();
+    call->operation = operation;
+    call->size = size;
+    stats_add(call->block, operation == PORTABLE_8439_ENCRYPT 
+            ? &call->block->counters.encrypt_calls : &call->block->counters.decrypt_calls, 1);
+    call->timing = __atomic_load_n(&stats_current_timing, __ATOMIC_ACQUIRE);
+    call->start = call->timing != NULL ? call->timing->clock() : 0;
+}
+
+static void stats_end(stats_call *call) {
+    if (call->timing != NULL) {
+        call->timing->hook(call->operation, call->size, call->timing->clock() - call->start, call->timing->user_data);
+    }
+}
+
+static void stats_done(stats_call *call, size_t plain_text_size) {
+    stats_add(call->block, call->operation == PORTABLE_8439_ENCRYPT 
+            ? &call->block->counters.encrypt_bytes : &call->block->counters.decrypt_bytes, plain_text_size);
+    stats_add(call->block, &call->block->counters.size_histogram[stats_bucket(plain_text_size)], 1);
+    stats_end(call);
+}
+
+#define STATS_BEGIN(operation, size) \
+    stats_call __stats; \
+    stats_begin(&__stats, operation, size);
+#define STATS_FAILED(counter) \
+    stats_add(__stats.block, &__stats.block->counters.counter, 1); \
+    stats_end(&__stats);
+#define STATS_DONE(plain_text_size) stats_done(&__stats, plain_text_size);
+
+static void stats_sum(portable_8439_stats *result, const portable_8439_stats *counters) {
+    #define __SUM(field) result->field += __atomic_load_n(&counters->field, __ATOMIC_RELAXED);
+    __SUM(encrypt_calls)
+    __SUM(encrypt_bytes)
+    __SUM(decrypt_calls)
+    __SUM(decrypt_bytes)
+    __SUM(auth_failures)
+    __SUM(overlap_rejections)
+    for (unsigned int i = 0; i < PORTABLE_8439_STATS_BUCKETS; i++) {
+        __SUM(size_histogram[i])
+    }
+    #undef __SUM
+}
+
+void portable_8439_stats_collect(portable_8439_stats *result) {
+    memset(result, 0, sizeof(portable_8439_stats));
+    stats_sum(result, &stats_shared.counters);
+    for (const stats_block *block = __atomic_load_n(&stats_blocks, __ATOMIC_ACQUIRE); block != NULL; block = block->next) {
+        stats_sum(result, &block->counters);
+    }
+}
+
+void portable_8439_stats_timing(const portable_8439_timing *timing) {
+    __atomic_store_n(&stats_current_timing, timing, __ATOMIC_RELEASE);
+}
+#else
+#define STATS_BEGIN(operation, size)
+#define STATS_FAILED(counter)
+#define STATS_DONE(plain_text_size)
+#endif
+
 
 #define PM(p) ((uintptr_t)(p))
 
@@ -74,46 +291,954 @@ static void poly1305_calculate_mac(
        (PM(s) < PM((b) + (b_size))) \
     && (PM(b) < PM((s) + (s_size)))
 
-size_t portable_chacha20_poly1305_encrypt(
+static size_t encrypt_with_key(
     uint8_t *restrict cipher_text,
-    const uint8_t key[RFC_8439_KEY_SIZE],
+    const chacha20_key *key,
     const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *derived_key,
     const uint8_t *restrict ad,
     size_t ad_size,  
     const uint8_t *restrict plain_text,
-    size_t plain_text_size
+    size_t plain_text_size,
+    unsigned int rounds
 ) {
+    TRACE_ENTRY(encrypt, plain_text_size, ad_size);
+    STATS_BEGIN(PORTABLE_8439_ENCRYPT, plain_text_size)
     size_t new_size = plain_text_size + RFC_8439_TAG_SIZE;
     if (OVERLAPPING(plain_text, plain_text_size, cipher_text, new_size)) {
+        STATS_FAILED(overlap_rejections)
+        TRACE_RETURN(encrypt, -1);
         return -1;
     }
-    chacha20_xor_stream(cipher_text, plain_text, plain_text_size, key, nonce, 1);
-    poly1305_calculate_mac(cipher_text + plain_text_size, cipher_text, plain_text_size, key, nonce, ad, ad_size);
+    chacha_xor_stream_key(cipher_text, plain_text, plain_text_size, key, nonce, 1, rounds);
+    poly1305_calculate_mac(cipher_text + plain_text_size, cipher_text, plain_text_size, key, nonce, derived_key, ad, ad_size, rounds);
+    STATS_DONE(plain_text_size)
+    TRACE_RETURN(encrypt, new_size);
     return new_size;
 }
 
-size_t portable_chacha20_poly1305_decrypt(
+static size_t decrypt_with_key(
     uint8_t *restrict plain_text,
-    const uint8_t key[RFC_8439_KEY_SIZE],
+    const chacha20_key *key,
     const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *derived_key,
     const uint8_t *restrict ad,
     size_t ad_size,  
     const uint8_t *restrict cipher_text,
-    size_t cipher_text_size
+    size_t cipher_text_size,
+    unsigned int rounds
 ) {
+    TRACE_ENTRY(decrypt, cipher_text_size, ad_size);
+    STATS_BEGIN(PORTABLE_8439_DECRYPT, cipher_text_size)
     // first we calculate the mac and see if it lines up, only then do we decrypt
     uint8_t actual_mac[RFC_8439_TAG_SIZE];
     size_t actual_size = cipher_text_size - RFC_8439_TAG_SIZE;
     if (OVERLAPPING(plain_text, actual_size, cipher_text, cipher_text_size)) {
+        STATS_FAILED(overlap_rejections)
+        TRACE_RETURN(decrypt, -1);
         return -1;
     }
 
-    poly1305_calculate_mac(actual_mac, cipher_text, actual_size, key, nonce, ad, ad_size);
+    poly1305_calculate_mac(actual_mac, cipher_text, actual_size, key, nonce, derived_key, ad, ad_size, rounds);
 
     if (poly1305_verify(cipher_text + actual_size, actual_mac)) {
         // valid mac, so decrypt cipher_text
-        chacha20_xor_stream(plain_text, cipher_text, actual_size, key, nonce, 1);
+        chacha_xor_stream_key(plain_text, cipher_text, actual_size, key, nonce, 1, rounds);
+        STATS_DONE(actual_size)
+        TRACE_RETURN(decrypt, actual_size);
         return actual_size;
     }
+    TRACE_AUTH_FAILURE(cipher_text_size);
+    STATS_FAILED(auth_failures)
+    TRACE_RETURN(decrypt, -1);
     return -1;
 }
+
+// wipes a key expanded on the stack, volatile so the stores aren't dropped
+static void wipe_subkey(chacha20_key *subkey) {
+    volatile uint32_t *words = subkey->words;
+    for (size_t i = 0; i < sizeof(subkey->words) / sizeof(subkey->words[0]); i++) {
+        words[i] = 0;
+    }
+}
+
+size_t portable_chacha20_poly1305_encrypt(
+    uint8_t *restrict cipher_text,
+    const uint8_t key[RFC_8439_KEY_SIZE],
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+) {
+    chacha20_key expanded;
+    chacha20_key_init(&expanded, key);
+    size_t result = encrypt_with_key(cipher_text, &expanded, nonce, NULL, ad, ad_size, plain_text, plain_text_size, 20);
+    wipe_subkey(&expanded);
+    return result;
+}
+
+size_t portable_chacha20_poly1305_decrypt(
+    uint8_t *restrict plain_text,
+    const uint8_t key[RFC_8439_KEY_SIZE],
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+) {
+    chacha20_key expanded;
+    chacha20_key_init(&expanded, key);
+    size_t result = decrypt_with_key(plain_text, &expanded, nonce, NULL, ad, ad_size, cipher_text, cipher_text_size, 20);
+    wipe_subkey(&expanded);
+    return result;
+}
+
+// the public struct hides the chacha20_key, since the header can't include chacha-portable.h
+#define KEY_WORDS(ctx) ((const chacha20_key *)(ctx)->opaque)
+typedef char __check_key_size[sizeof(((portable_8439_key *)0)->opaque) >= sizeof(chacha20_key) ? 1 : -1];
+
+void portable_chacha20_poly1305_key_init(portable_8439_key *ctx, const uint8_t key[RFC_8439_KEY_SIZE]) {
+    chacha20_key_init((chacha20_key *)ctx->opaque, key);
+}
+
+void portable_chacha20_poly1305_key_wipe(portable_8439_key *ctx) {
+    // volatile, so the compiler can't drop the stores to an object that is about to die
+    volatile uint32_t *words = ctx->opaque;
+    for (size_t i = 0; i < sizeof(ctx->opaque) / sizeof(ctx->opaque[0]); i++) {
+        words[i] = 0;
+    }
+}
+
+size_t portable_chacha20_poly1305_encrypt_key(
+    uint8_t *restrict cipher_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+) {
+    return encrypt_with_key(cipher_text, KEY_WORDS(key), nonce, NULL, ad, ad_size, plain_text, plain_text_size, 20);
+}
+
+size_t portable_chacha20_poly1305_decrypt_key(
+    uint8_t *restrict plain_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+) {
+    return decrypt_with_key(plain_text, KEY_WORDS(key), nonce, NULL, ad, ad_size, cipher_text, cipher_text_size, 20);
+}
+
+// XChaCha20: the subkey from the first 16 bytes of the nonce, and the last 8
+// bytes (after 4 zero bytes) as the nonce for it
+static void xchacha_subkey(
+    chacha20_key *subkey,
+    uint8_t inner_nonce[RFC_8439_NONCE_SIZE],
+    const chacha20_key *key,
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE]
+) {
+    hchacha20(subkey, key, nonce);
+    memset(inner_nonce, 0, 4);
+    memcpy(inner_nonce + 4, nonce + HCHACHA20_NONCE_SIZE, 8);
+}
+
+static size_t xchacha_encrypt_with_key(
+    uint8_t *restrict cipher_text,
+    const chacha20_key *key,
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+) {
+    chacha20_key subkey;
+    uint8_t inner_nonce[RFC_8439_NONCE_SIZE];
+    xchacha_subkey(&subkey, inner_nonce, key, nonce);
+    size_t result = encrypt_with_key(cipher_text, &subkey, inner_nonce, NULL, ad, ad_size, plain_text, plain_text_size, 20);
+    wipe_subkey(&subkey);
+    return result;
+}
+
+static size_t xchacha_decrypt_with_key(
+    uint8_t *restrict plain_text,
+    const chacha20_key *key,
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+) {
+    chacha20_key subkey;
+    uint8_t inner_nonce[RFC_8439_NONCE_SIZE];
+    xchacha_subkey(&subkey, inner_nonce, key, nonce);
+    size_t result = decrypt_with_key(plain_text, &subkey, inner_nonce, NULL, ad, ad_size, cipher_text, cipher_text_size, 20);
+    wipe_subkey(&subkey);
+    return result;
+}
+
+size_t portable_xchacha20_poly1305_encrypt(
+    uint8_t *restrict cipher_text,
+    const uint8_t key[RFC_8439_KEY_SIZE],
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+) {
+    chacha20_key expanded;
+    chacha20_key_init(&expanded, key);
+    size_t result = xchacha_encrypt_with_key(cipher_text, &expanded, nonce, ad, ad_size, plain_text, plain_text_size);
+    wipe_subkey(&expanded);
+    return result;
+}
+
+size_t portable_xchacha20_poly1305_decrypt(
+    uint8_t *restrict plain_text,
+    const uint8_t key[RFC_8439_KEY_SIZE],
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+) {
+    chacha20_key expanded;
+    chacha20_key_init(&expanded, key);
+    size_t result = xchacha_decrypt_with_key(plain_text, &expanded, nonce, ad, ad_size, cipher_text, cipher_text_size);
+    wipe_subkey(&expanded);
+    return result;
+}
+
+size_t portable_xchacha20_poly1305_encrypt_key(
+    uint8_t *restrict cipher_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+) {
+    return xchacha_encrypt_with_key(cipher_text, KEY_WORDS(key), nonce, ad, ad_size, plain_text, plain_text_size);
+}
+
+size_t portable_xchacha20_poly1305_decrypt_key(
+    uint8_t *restrict plain_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+) {
+    return xchacha_decrypt_with_key(plain_text, KEY_WORDS(key), nonce, ad, ad_size, cipher_text, cipher_text_size);
+}
+
+#define REDUCED_DEFINE(name, rounds) \
+    PORTABLE_8439_DECL size_t portable_##name##_poly1305_encrypt( \
+        uint8_t *restrict cipher_text, \
+        const uint8_t key[RFC_8439_KEY_SIZE], \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        size_t ad_size, \
+        const uint8_t *restrict plain_text, \
+        size_t plain_text_size \
+    ) { \
+        chacha20_key expanded; \
+        chacha20_key_init(&expanded, key); \
+        size_t result = encrypt_with_key(cipher_text, &expanded, nonce, NULL, ad, ad_size, plain_text, plain_text_size, rounds); \
+        wipe_subkey(&expanded); \
+        return result; \
+    } \
+    PORTABLE_8439_DECL size_t portable_##name##_poly1305_decrypt( \
+        uint8_t *restrict plain_text, \
+        const uint8_t key[RFC_8439_KEY_SIZE], \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        size_t ad_size, \
+        const uint8_t *restrict cipher_text, \
+        size_t cipher_text_size \
+    ) { \
+        chacha20_key expanded; \
+        chacha20_key_init(&expanded, key); \
+        size_t result = decrypt_with_key(plain_text, &expanded, nonce, NULL, ad, ad_size, cipher_text, cipher_text_size, rounds); \
+        wipe_subkey(&expanded); \
+        return result; \
+    } \
+    PORTABLE_8439_DECL size_t portable_##name##_poly1305_encrypt_key( \
+        uint8_t *restrict cipher_text, \
+        const portable_8439_key *key, \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        size_t ad_size, \
+        const uint8_t *restrict plain_text, \
+        size_t plain_text_size \
+    ) { \
+        return encrypt_with_key(cipher_text, KEY_WORDS(key), nonce, NULL, ad, ad_size, plain_text, plain_text_size, rounds); \
+    } \
+    PORTABLE_8439_DECL size_t portable_##name##_poly1305_decrypt_key( \
+        uint8_t *restrict plain_text, \
+        const portable_8439_key *key, \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        size_t ad_size, \
+        const uint8_t *restrict cipher_text, \
+        size_t cipher_text_size \
+    ) { \
+        return decrypt_with_key(plain_text, KEY_WORDS(key), nonce, NULL, ad, ad_size, cipher_text, cipher_text_size, rounds); \
+    }
+
+PORTABLE_8439_REDUCED_ROUNDS(REDUCED_DEFINE)
+
+int portable_chacha20_poly1305_verify_key(
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size,
+    const uint8_t *cipher_text,
+    size_t cipher_text_size
+) {
+    if (cipher_text_size < RFC_8439_TAG_SIZE) {
+        return 0;
+    }
+    uint8_t actual_mac[RFC_8439_TAG_SIZE];
+    size_t actual_size = cipher_text_size - RFC_8439_TAG_SIZE;
+    poly1305_calculate_mac(actual_mac, cipher_text, actual_size, KEY_WORDS(key), nonce, NULL, ad, ad_size, 20);
+    if (poly1305_verify(cipher_text + actual_size, actual_mac)) {
+        return 1;
+    }
+    TRACE_AUTH_FAILURE(cipher_text_size);
+    return 0;
+}
+
+void portable_chacha20_poly1305_xor_key(
+    uint8_t *restrict output,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    uint64_t offset,
+    const uint8_t *restrict input,
+    size_t size
+) {
+    // block 0 is the poly key, the body starts at block 1
+    uint32_t counter = (uint32_t)(1 + offset / __CHACHA20_BLOCK_SIZE);
+    size_t skip = (size_t)(offset % __CHACHA20_BLOCK_SIZE);
+    if (skip > 0 && size > 0) {
+        // an unaligned offset starts in the middle of a block
+        static const uint8_t zero_block[__CHACHA20_BLOCK_SIZE] = { 0 };
+        uint8_t keystream[__CHACHA20_BLOCK_SIZE];
+        chacha20_xor_stream_key(keystream, zero_block, __CHACHA20_BLOCK_SIZE, KEY_WORDS(key), nonce, counter++);
+        size_t head = size < __CHACHA20_BLOCK_SIZE - skip ? size : __CHACHA20_BLOCK_SIZE - skip;
+        for (size_t i = 0; i < head; i++) {
+            output[i] = input[i] ^ keystream[skip + i];
+        }
+        volatile uint8_t *wipe = keystream;
+        for (size_t i = 0; i < sizeof(keystream); i++) {
+            wipe[i] = 0;
+        }
+        output += head;
+        input += head;
+        size -= head;
+    }
+    chacha20_xor_stream_key(output, input, size, KEY_WORDS(key), nonce, counter);
+}
+
+// Bulk mode: every chunk is xor-ed into a buffer that stays in L1, mac-ed 
+// from there, and only then streamed out to the output around the caches
+#ifndef PORTABLE_8439_BULK_THRESHOLD
+#define PORTABLE_8439_BULK_THRESHOLD (1 << 20)
+#endif
+#ifdef PORTABLE_8439_SMALL
+// the chunk lives on the stack
+#define BULK_CHUNK (256)
+#else
+#define BULK_CHUNK (4096)
+#endif
+
+#if !defined(PORTABLE_8439_SMALL) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define __HAVE_NONTEMPORAL 1
+#endif
+
+#ifdef __HAVE_NONTEMPORAL
+static void stream_out(uint8_t *restrict dest, const uint8_t *restrict source, size_t size) {
+    // the non-temporal stores need an aligned target, the head & tail are
+    // stored normally
+    size_t head = (16 - PM(dest) % 16) % 16;
+    head = head > size ? size : head;
+    memcpy(dest, source, head);
+    size_t i = head;
+    for (; i + 64 <= size; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(source + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(source + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(source + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(source + i + 48));
+        _mm_stream_si128((__m128i *)(dest + i), a);
+        _mm_stream_si128((__m128i *)(dest + i + 16), b);
+        _mm_stream_si128((__m128i *)(dest + i + 32), c);
+        _mm_stream_si128((__m128i *)(dest + i + 48), d);
+    }
+    for (; i + 16 <= size; i += 16) {
+        _mm_stream_si128((__m128i *)(dest + i), _mm_loadu_si128((const __m128i *)(source + i)));
+    }
+    memcpy(dest + i, source + i, size - i);
+}
+
+static size_t encrypt_bulk(
+    uint8_t *restrict cipher_text,
+    const chacha20_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+) {
+    TRACE_ENTRY(encrypt, plain_text_size, ad_size);
+    STATS_BEGIN(PORTABLE_8439_ENCRYPT, plain_text_size)
+    size_t new_size = plain_text_size + RFC_8439_TAG_SIZE;
+    if (OVERLAPPING(plain_text, plain_text_size, cipher_text, new_size)) {
+        STATS_FAILED(overlap_rejections)
+        TRACE_RETURN(encrypt, -1);
+        return -1;
+    }
+    uint8_t chunk[BULK_CHUNK];
+    poly1305_context poly_ctx;
+    poly1305_begin_mac(&poly_ctx, key, nonce, NULL, ad, ad_size, 20);
+    for (size_t done = 0; done < plain_text_size; done += BULK_CHUNK) {
+        size_t size = plain_text_size - done < BULK_CHUNK ? plain_text_size - done : BULK_CHUNK;
+        chacha20_xor_stream_key(chunk, plain_text + done, size, key, nonce, (uint32_t)(1 + done / __CHACHA20_BLOCK_SIZE));
+        poly1305_update(&poly_ctx, chunk, size);
+        stream_out(cipher_text + done, chunk, size);
+    }
+    poly1305_finish_mac(&poly_ctx, cipher_text + plain_text_size, ad_size, plain_text_size);
+    // the non-temporal stores are weakly ordered, make them visible before we return
+    _mm_sfence();
+    STATS_DONE(plain_text_size)
+    TRACE_RETURN(encrypt, new_size);
+    return new_size;
+}
+
+static size_t decrypt_bulk(
+    uint8_t *restrict plain_text,
+    const chacha20_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+) {
+    TRACE_ENTRY(decrypt, cipher_text_size, ad_size);
+    STATS_BEGIN(PORTABLE_8439_DECRYPT, cipher_text_size)
+    uint8_t actual_mac[RFC_8439_TAG_SIZE];
+    size_t actual_size = cipher_text_size - RFC_8439_TAG_SIZE;
+    if (OVERLAPPING(plain_text, actual_size, cipher_text, cipher_text_size)) {
+        STATS_FAILED(overlap_rejections)
+        TRACE_RETURN(decrypt, -1);
+        return -1;
+    }
+    poly1305_calculate_mac(actual_mac, cipher_text, actual_size, key, nonce, NULL, ad, ad_size, 20);
+    if (!poly1305_verify(cipher_text + actual_size, actual_mac)) {
+        TRACE_AUTH_FAILURE(cipher_text_size);
+        STATS_FAILED(auth_failures)
+        TRACE_RETURN(decrypt, -1);
+        return -1;
+    }
+    uint8_t chunk[BULK_CHUNK];
+    for (size_t done = 0; done < actual_size; done += BULK_CHUNK) {
+        size_t size = actual_size - done < BULK_CHUNK ? actual_size - done : BULK_CHUNK;
+        chacha20_xor_stream_key(chunk, cipher_text + done, size, key, nonce, (uint32_t)(1 + done / __CHACHA20_BLOCK_SIZE));
+        stream_out(plain_text + done, chunk, size);
+    }
+    _mm_sfence();
+    // the last chunk of plain text is still on the stack
+    volatile uint8_t *wipe = chunk;
+    for (size_t i = 0; i < sizeof(chunk); i++) {
+        wipe[i] = 0;
+    }
+    STATS_DONE(actual_size)
+    TRACE_RETURN(decrypt, actual_size);
+    return actual_size;
+}
+#endif
+
+size_t portable_chacha20_poly1305_encrypt_key_bulk(
+    uint8_t *restrict cipher_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+) {
+#ifdef __HAVE_NONTEMPORAL
+    if (plain_text_size >= PORTABLE_8439_BULK_THRESHOLD) {
+        return encrypt_bulk(cipher_text, KEY_WORDS(key), nonce, ad, ad_size, plain_text, plain_text_size);
+    }
+#endif
+    return encrypt_with_key(cipher_text, KEY_WORDS(key), nonce, NULL, ad, ad_size, plain_text, plain_text_size, 20);
+}
+
+size_t portable_chacha20_poly1305_decrypt_key_bulk(
+    uint8_t *restrict plain_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+) {
+#ifdef __HAVE_NONTEMPORAL
+    if (cipher_text_size >= PORTABLE_8439_BULK_THRESHOLD + RFC_8439_TAG_SIZE) {
+        return decrypt_bulk(plain_text, KEY_WORDS(key), nonce, ad, ad_size, cipher_text, cipher_text_size);
+    }
+#endif
+    return decrypt_with_key(plain_text, KEY_WORDS(key), nonce, NULL, ad, ad_size, cipher_text, cipher_text_size, 20);
+}
+
+void portable_chacha20_quic_hp_mask(
+    uint8_t mask[PORTABLE_QUIC_HP_MASK_SIZE],
+    const portable_8439_key *hp_key,
+    const uint8_t sample[PORTABLE_QUIC_HP_SAMPLE_SIZE]
+) {
+    chacha20_quic_hp_mask(mask, KEY_WORDS(hp_key), sample);
+}
+
+void portable_chacha20_quic_hp_mask_batch(
+    uint8_t *masks,
+    const portable_8439_key *hp_key,
+    const uint8_t *const *samples,
+    size_t count
+) {
+    chacha20_quic_hp_mask_batch(masks, KEY_WORDS(hp_key), samples, count);
+}
+
+// TLS 1.3 records: the nonces & poly keys of a group of records are derived
+// together, then every record is sealed or opened with its own poly key
+#ifdef PORTABLE_8439_SMALL
+#define TLS_GROUP (1)
+#else
+#define TLS_GROUP (8)
+#endif
+#define TLS_APPLICATION_DATA (23)
+
+static void tls_nonce(uint8_t nonce[RFC_8439_NONCE_SIZE], const uint8_t iv[RFC_8439_NONCE_SIZE], uint64_t sequence) {
+    memcpy(nonce, iv, RFC_8439_NONCE_SIZE);
+    for (unsigned int i = 0; i < 8; i++) {
+        nonce[RFC_8439_NONCE_SIZE - 1 - i] ^= __u8(sequence >> (8 * i));
+    }
+}
+
+static size_t tls_seal_record(
+    portable_8439_tls_record *record,
+    const chacha20_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t poly_key[__POLY1305_KEY_SIZE]
+) {
+    size_t size = record->input_size;
+    if (size > PORTABLE_TLS_MAX_CIPHER_TEXT - RFC_8439_TAG_SIZE
+        || (OVERLAPPING(record->input, size, record->output, size + PORTABLE_TLS_RECORD_OVERHEAD))) {
+        return -1;
+    }
+    uint8_t *header = record->output;
+    header[0] = TLS_APPLICATION_DATA;
+    header[1] = 0x03;
+    header[2] = 0x03;
+    header[3] = __u8((size + RFC_8439_TAG_SIZE) >> 8);
+    header[4] = __u8(size + RFC_8439_TAG_SIZE);
+    size_t result = encrypt_with_key(header + PORTABLE_TLS_HEADER_SIZE, key, nonce, poly_key, 
+        header, PORTABLE_TLS_HEADER_SIZE, record->input, size, 20);
+    return result == (size_t)-1 ? result : result + PORTABLE_TLS_HEADER_SIZE;
+}
+
+static size_t tls_open_record(
+    portable_8439_tls_record *record,
+    const chacha20_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t poly_key[__POLY1305_KEY_SIZE]
+) {
+    // the version is covered by the tag, like the rest of the header
+    const uint8_t *header = record->input;
+    size_t size = record->input_size;
+    if (size < PORTABLE_TLS_RECORD_OVERHEAD 
+        || size - PORTABLE_TLS_HEADER_SIZE > PORTABLE_TLS_MAX_CIPHER_TEXT
+        || header[0] != TLS_APPLICATION_DATA
+        || (((size_t)header[3] << 8) | header[4]) != size - PORTABLE_TLS_HEADER_SIZE
+        || (OVERLAPPING(record->output, size - PORTABLE_TLS_RECORD_OVERHEAD, record->input, size))) {
+        return -1;
+    }
+    return decrypt_with_key(record->output, key, nonce, poly_key, header, PORTABLE_TLS_HEADER_SIZE,
+        header + PORTABLE_TLS_HEADER_SIZE, size - PORTABLE_TLS_HEADER_SIZE, 20);
+}
+
+static size_t tls_records(
+    portable_8439_tls_record *records,
+    size_t count,
+    const chacha20_key *key,
+    const uint8_t iv[RFC_8439_NONCE_SIZE],
+    uint64_t sequence,
+    int open
+) {
+    uint8_t nonces[TLS_GROUP][RFC_8439_NONCE_SIZE];
+    uint8_t poly_keys[TLS_GROUP][__POLY1305_KEY_SIZE];
+    size_t succeeded = 0;
+    for (size_t first = 0; first < count; first += TLS_GROUP) {
+        size_t group = count - first < TLS_GROUP ? count - first : TLS_GROUP;
+        for (size_t i = 0; i < group; i++) {
+            tls_nonce(nonces[i], iv, sequence + first + i);
+        }
+        rfc8439_keygen_batch(poly_keys[0], key, nonces[0], group);
+        for (size_t i = 0; i < group; i++) {
+            portable_8439_tls_record *record = &records[first + i];
+            if (first + i > UINT64_MAX - sequence) {
+                // the sequence number wrapped, rekey long before that
+                record->result = -1;
+            }
+            else if (open) {
+                record->result = tls_open_record(record, key, nonces[i], poly_keys[i]);
+            }
+            else {
+                record->result = tls_seal_record(record, key, nonces[i], poly_keys[i]);
+            }
+            succeeded += record->result != (size_t)-1;
+        }
+    }
+    volatile uint8_t *wipe = poly_keys[0];
+    for (size_t i = 0; i < sizeof(poly_keys); i++) {
+        wipe[i] = 0;
+    }
+    return succeeded;
+}
+
+size_t portable_chacha20_poly1305_tls_seal(
+    portable_8439_tls_record *records,
+    size_t count,
+    const portable_8439_key *key,
+    const uint8_t iv[RFC_8439_NONCE_SIZE],
+    uint64_t sequence
+) {
+    return tls_records(records, count, KEY_WORDS(key), iv, sequence, 0);
+}
+
+size_t portable_chacha20_poly1305_tls_open(
+    portable_8439_tls_record *records,
+    size_t count,
+    const portable_8439_key *key,
+    const uint8_t iv[RFC_8439_NONCE_SIZE],
+    uint64_t sequence
+) {
+    return tls_records(records, count, KEY_WORDS(key), iv, sequence, 1);
+}
+
+size_t portable_poly1305_backend_count(void) {
+    return poly1305_backend_count();
+}
+
+const char *portable_poly1305_backend_name(size_t index) {
+    const poly1305_backend *backend = poly1305_backend_at(index);
+    return backend == NULL ? NULL : backend->name;
+}
+
+const char *portable_poly1305_backend_current(void) {
+    return poly1305_backend_selected()->name;
+}
+
+int portable_poly1305_backend_select(const char *name) {
+    const poly1305_backend *backend = poly1305_backend_find(name);
+    return backend != NULL && poly1305_backend_select(backend);
+}
+
+double portable_poly1305_backend_benchmark(
+    const char *name,
+    const uint8_t *message,
+    size_t message_size,
+    unsigned long runs
+) {
+    const poly1305_backend *backend = poly1305_backend_find(name);
+    if (backend == NULL) {
+        return -1;
+    }
+    double took = poly1305_backend_benchmark(backend, message, message_size, runs);
+    if (took <= 0) {
+        // clock resolution too coarse for the amount of work
+        return 0;
+    }
+    return (((double)runs * message_size) / took) / (1024 * 1024);
+}
+
+// the fixed size variants are flattened: every call that can be inlined 
+// (in the amalgamation that includes chacha20) is inlined with the constant
+// sizes. The poly1305 backends are called through a pointer, so they stay calls.
+#if defined(__GNUC__) && !defined(PORTABLE_8439_SMALL)
+#   define FIXED_ATTRIBUTES __attribute__((flatten))
+#else
+#   define FIXED_ATTRIBUTES
+#endif
+
+#define FIXED_DEFINE(size, ad_size) \
+    PORTABLE_8439_DECL FIXED_ATTRIBUTES size_t portable_chacha20_poly1305_encrypt_##size##_##ad_size( \
+        uint8_t *restrict cipher_text, \
+        const portable_8439_key *key, \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        const uint8_t *restrict plain_text \
+    ) { \
+        return encrypt_with_key(cipher_text, KEY_WORDS(key), nonce, NULL, ad, ad_size, plain_text, size, 20); \
+    } \
+    PORTABLE_8439_DECL FIXED_ATTRIBUTES size_t portable_chacha20_poly1305_decrypt_##size##_##ad_size( \
+        uint8_t *restrict plain_text, \
+        const portable_8439_key *key, \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        const uint8_t *restrict cipher_text \
+    ) { \
+        return decrypt_with_key(plain_text, KEY_WORDS(key), nonce, NULL, ad, ad_size, cipher_text, size + RFC_8439_TAG_SIZE, 20); \
+    }
+
+PORTABLE_8439_FIXED_SIZES(FIXED_DEFINE)
+
+// the incremental api, the public struct hides the state for the same reason
+// as the key context
+typedef struct stream_state {
+    chacha20_key key;
+    uint8_t nonce[RFC_8439_NONCE_SIZE];
+    uint32_t counter;
+    poly1305_context poly;
+    uint64_t ad_size;
+    uint64_t text_size;
+    // key stream left over from the last partial block, starts at keystream_used
+    uint8_t keystream[__CHACHA20_BLOCK_SIZE];
+    uint32_t keystream_used;
+} stream_state;
+
+#define STREAM_STATE(stream) ((stream_state *)(stream)->opaque)
+typedef char __check_stream_size[sizeof(((portable_8439_stream *)0)->opaque) >= sizeof(stream_state) ? 1 : -1];
+
+void portable_chacha20_poly1305_stream_init(
+    portable_8439_stream *stream,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+) {
+    stream_state *state = STREAM_STATE(stream);
+    state->key = *KEY_WORDS(key);
+    memcpy(state->nonce, nonce, RFC_8439_NONCE_SIZE);
+    state->counter = 1;
+    state->ad_size = ad_size;
+    state->text_size = 0;
+    state->keystream_used = __CHACHA20_BLOCK_SIZE;
+    poly1305_begin_mac(&state->poly, &state->key, nonce, NULL, ad, ad_size, 20);
+}
+
+// same as chacha20_xor_stream_key, but continues where the last call 
+// stopped, also in the middle of a block
+// dest can be source, the rings below en/decrypt in place
+static void stream_xor(stream_state *state, uint8_t *dest, const uint8_t *source, size_t size) {
+    while (size > 0 && state->keystream_used < __CHACHA20_BLOCK_SIZE) {
+        *dest++ = *source++ ^ state->keystream[state->keystream_used++];
+        size--;
+    }
+    size_t full_blocks = size / __CHACHA20_BLOCK_SIZE;
+    if (full_blocks > 0) {
+        chacha20_xor_stream_key(dest, source, full_blocks * __CHACHA20_BLOCK_SIZE, &state->key, state->nonce, state->counter);
+        state->counter += (uint32_t)full_blocks;
+        dest += full_blocks * __CHACHA20_BLOCK_SIZE;
+        source += full_blocks * __CHACHA20_BLOCK_SIZE;
+        size -= full_blocks * __CHACHA20_BLOCK_SIZE;
+    }
+    if (size > 0) {
+        static const uint8_t zero_block[__CHACHA20_BLOCK_SIZE] = { 0 };
+        chacha20_xor_stream_key(state->keystream, zero_block, __CHACHA20_BLOCK_SIZE, &state->key, state->nonce, state->counter++);
+        for (state->keystream_used = 0; state->keystream_used < size; state->keystream_used++) {
+            dest[state->keystream_used] = source[state->keystream_used] ^ state->keystream[state->keystream_used];
+        }
+    }
+}
+
+void portable_chacha20_poly1305_stream_wipe(portable_8439_stream *stream) {
+    volatile uint64_t *words = stream->opaque;
+    for (size_t i = 0; i < sizeof(stream->opaque) / sizeof(stream->opaque[0]); i++) {
+        words[i] = 0;
+    }
+}
+
+void portable_chacha20_poly1305_seal_update(
+    portable_8439_stream *stream,
+    uint8_t *restrict cipher_text,
+    const uint8_t *restrict plain_text,
+    size_t size
+) {
+    stream_state *state = STREAM_STATE(stream);
+    stream_xor(state, cipher_text, plain_text, size);
+    poly1305_update(&state->poly, cipher_text, size);
+    state->text_size += size;
+}
+
+void portable_chacha20_poly1305_seal_final(
+    portable_8439_stream *stream,
+    uint8_t tag[RFC_8439_TAG_SIZE]
+) {
+    stream_state *state = STREAM_STATE(stream);
+    poly1305_finish_mac(&state->poly, tag, state->ad_size, state->text_size);
+    portable_chacha20_poly1305_stream_wipe(stream);
+}
+
+void portable_chacha20_poly1305_open_update(
+    portable_8439_stream *stream,
+    uint8_t *restrict plain_text,
+    const uint8_t *restrict cipher_text,
+    size_t size
+) {
+    stream_state *state = STREAM_STATE(stream);
+    poly1305_update(&state->poly, cipher_text, size);
+    stream_xor(state, plain_text, cipher_text, size);
+    state->text_size += size;
+}
+
+int portable_chacha20_poly1305_open_final(
+    portable_8439_stream *stream,
+    const uint8_t tag[RFC_8439_TAG_SIZE]
+) {
+    stream_state *state = STREAM_STATE(stream);
+    uint8_t actual_mac[RFC_8439_TAG_SIZE];
+    uint64_t size = state->text_size;
+    poly1305_finish_mac(&state->poly, actual_mac, state->ad_size, size);
+    portable_chacha20_poly1305_stream_wipe(stream);
+    if (poly1305_verify(tag, actual_mac)) {
+        return 1;
+    }
+    TRACE_AUTH_FAILURE(size);
+    return 0;
+}
+
+// a message in a ring is at most two segments: from offset to the end of the
+// ring, and the rest from the start of it
+#define RING_FIRST(capacity, offset, size) ((size) < (capacity) - (offset) ? (size) : (capacity) - (offset))
+
+// the tag can wrap as well
+static void ring_read_tag(uint8_t tag[RFC_8439_TAG_SIZE], const uint8_t *ring, size_t capacity, size_t offset) {
+    size_t first = RING_FIRST(capacity, offset, RFC_8439_TAG_SIZE);
+    memcpy(tag, ring + offset, first);
+    memcpy(tag + first, ring, RFC_8439_TAG_SIZE - first);
+}
+
+static void ring_write_tag(uint8_t *ring, size_t capacity, size_t offset, const uint8_t tag[RFC_8439_TAG_SIZE]) {
+    size_t first = RING_FIRST(capacity, offset, RFC_8439_TAG_SIZE);
+    memcpy(ring + offset, tag, first);
+    memcpy(ring, tag + first, RFC_8439_TAG_SIZE - first);
+}
+
+size_t portable_chacha20_poly1305_seal_ring(
+    uint8_t *ring,
+    size_t capacity,
+    size_t offset,
+    size_t plain_text_size,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+) {
+    if (offset >= capacity || capacity < RFC_8439_TAG_SIZE || plain_text_size > capacity - RFC_8439_TAG_SIZE) {
+        return -1;
+    }
+    portable_8439_stream stream;
+    portable_chacha20_poly1305_stream_init(&stream, key, nonce, ad, ad_size);
+    stream_state *state = STREAM_STATE(&stream);
+    size_t first = RING_FIRST(capacity, offset, plain_text_size);
+    stream_xor(state, ring + offset, ring + offset, first);
+    poly1305_update(&state->poly, ring + offset, first);
+    stream_xor(state, ring, ring, plain_text_size - first);
+    poly1305_update(&state->poly, ring, plain_text_size - first);
+
+    uint8_t tag[RFC_8439_TAG_SIZE];
+    poly1305_finish_mac(&state->poly, tag, ad_size, plain_text_size);
+    portable_chacha20_poly1305_stream_wipe(&stream);
+    ring_write_tag(ring, capacity, (offset + plain_text_size) % capacity, tag);
+    return plain_text_size + RFC_8439_TAG_SIZE;
+}
+
+size_t portable_chacha20_poly1305_open_ring(
+    uint8_t *ring,
+    size_t capacity,
+    size_t offset,
+    size_t cipher_text_size,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+) {
+    if (offset >= capacity || cipher_text_size < RFC_8439_TAG_SIZE || cipher_text_size > capacity) {
+        return -1;
+    }
+    size_t size = cipher_text_size - RFC_8439_TAG_SIZE;
+    portable_8439_stream stream;
+    portable_chacha20_poly1305_stream_init(&stream, key, nonce, ad, ad_size);
+    stream_state *state = STREAM_STATE(&stream);
+    // first the mac over both segments, only decrypt when it matches
+    size_t first = RING_FIRST(capacity, offset, size);
+    poly1305_update(&state->poly, ring + offset, first);
+    poly1305_update(&state->poly, ring, size - first);
+    uint8_t actual_mac[RFC_8439_TAG_SIZE], tag[RFC_8439_TAG_SIZE];
+    poly1305_finish_mac(&state->poly, actual_mac, ad_size, size);
+    ring_read_tag(tag, ring, capacity, (offset + size) % capacity);
+    if (!poly1305_verify(tag, actual_mac)) {
+        portable_chacha20_poly1305_stream_wipe(&stream);
+        TRACE_AUTH_FAILURE(cipher_text_size);
+        return -1;
+    }
+    stream_xor(state, ring + offset, ring + offset, first);
+    stream_xor(state, ring, ring, size - first);
+    portable_chacha20_poly1305_stream_wipe(&stream);
+    return size;
+}
+
+// chacha20_xor_stream_key allows dest == source, the mac is written behind
+// the message, so neither needs the overlap check of encrypt/decrypt
+size_t portable_chacha20_poly1305_seal_in_place(
+    uint8_t *message,
+    size_t plain_text_size,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+) {
+    TRACE_ENTRY(encrypt, plain_text_size, ad_size);
+    STATS_BEGIN(PORTABLE_8439_ENCRYPT, plain_text_size)
+    chacha20_xor_stream_key(message, message, plain_text_size, KEY_WORDS(key), nonce, 1);
+    poly1305_calculate_mac(message + plain_text_size, message, plain_text_size, KEY_WORDS(key), nonce, NULL, ad, ad_size, 20);
+    STATS_DONE(plain_text_size)
+    TRACE_RETURN(encrypt, plain_text_size + RFC_8439_TAG_SIZE);
+    return plain_text_size + RFC_8439_TAG_SIZE;
+}
+
+size_t portable_chacha20_poly1305_open_in_place(
+    uint8_t *message,
+    size_t cipher_text_size,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+) {
+    TRACE_ENTRY(decrypt, cipher_text_size, ad_size);
+    STATS_BEGIN(PORTABLE_8439_DECRYPT, cipher_text_size)
+    if (cipher_text_size < RFC_8439_TAG_SIZE) {
+        STATS_FAILED(auth_failures)
+        TRACE_RETURN(decrypt, -1);
+        return -1;
+    }
+    size_t size = cipher_text_size - RFC_8439_TAG_SIZE;
+    uint8_t actual_mac[RFC_8439_TAG_SIZE];
+    poly1305_calculate_mac(actual_mac, message, size, KEY_WORDS(key), nonce, NULL, ad, ad_size, 20);
+    if (!poly1305_verify(message + size, actual_mac)) {
+        TRACE_AUTH_FAILURE(cipher_text_size);
+        STATS_FAILED(auth_failures)
+        TRACE_RETURN(decrypt, -1);
+        return -1;
+    }
+    chacha20_xor_stream_key(message, message, size, KEY_WORDS(key), nonce, 1);
+    STATS_DONE(size)
+    TRACE_RETURN(decrypt, size);
+    return size;
+}
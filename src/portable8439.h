@@ -32,6 +32,10 @@
 #    endif
 #endif
 
+#ifndef PORTABLE_8439_DECL
+#define PORTABLE_8439_DECL
+#endif
+
 #define RFC_8439_TAG_SIZE (16)
 #define RFC_8439_KEY_SIZE (32)
 #define RFC_8439_NONCE_SIZE (12)
@@ -101,4 +105,526 @@ size_t portable_chacha20_poly1305_decrypt(
     const uint8_t *restrict cipher_text,
     size_t cipher_text_size
 );
+
+/*
+    Key context: loads the key once, for when you seal or open many messages
+    with the same key. Same semantics as the functions above, wipe the 
+    context when you are done with the key.
+*/
+typedef struct portable_8439_key {
+    uint32_t opaque[RFC_8439_KEY_SIZE / sizeof(uint32_t)];
+} portable_8439_key;
+
+void portable_chacha20_poly1305_key_init(
+    portable_8439_key *ctx,
+    const uint8_t key[RFC_8439_KEY_SIZE]
+);
+
+void portable_chacha20_poly1305_key_wipe(portable_8439_key *ctx);
+
+size_t portable_chacha20_poly1305_encrypt_key(
+    uint8_t *restrict cipher_text, 
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad, 
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+);
+
+size_t portable_chacha20_poly1305_decrypt_key(
+    uint8_t *restrict plain_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+);
+
+/*
+    XChaCha20-Poly1305 (draft-irtf-cfrg-xchacha): the same AEAD with a 
+    XCHACHA20_POLY1305_NONCE_SIZE (24 bytes) nonce. The first 16 bytes of 
+    the nonce derive a subkey (HChaCha20), the last 8 are the nonce of the 
+    message under that subkey. A nonce this large can be picked at random 
+    for every message, without a shared counter between the writers. The 
+    subkey costs one extra block function per message.
+    Key, tag, arguments and results are the same as the functions above.
+*/
+#define XCHACHA20_POLY1305_NONCE_SIZE (24)
+
+size_t portable_xchacha20_poly1305_encrypt(
+    uint8_t *restrict cipher_text, 
+    const uint8_t key[RFC_8439_KEY_SIZE],
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad, 
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+);
+
+size_t portable_xchacha20_poly1305_decrypt(
+    uint8_t *restrict plain_text,
+    const uint8_t key[RFC_8439_KEY_SIZE],
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+);
+
+size_t portable_xchacha20_poly1305_encrypt_key(
+    uint8_t *restrict cipher_text, 
+    const portable_8439_key *key,
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad, 
+    size_t ad_size,  
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+);
+
+size_t portable_xchacha20_poly1305_decrypt_key(
+    uint8_t *restrict plain_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,  
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+);
+
+/*
+    Reduced round variants: ChaCha12-Poly1305 and ChaCha8-Poly1305, the same
+    construction with 12 or 8 instead of 20 ChaCha rounds, for roughly 1.6x
+    and 2.3x the throughput of the cipher. They are NOT RFC 8439 and don't
+    interoperate with it. Fewer rounds means a smaller security margin, only
+    use them for data that isn't kept long (caches and the like).
+
+    For every X(name, rounds) in PORTABLE_8439_REDUCED_ROUNDS there is a:
+        portable_<name>_poly1305_encrypt
+        portable_<name>_poly1305_decrypt
+        portable_<name>_poly1305_encrypt_key
+        portable_<name>_poly1305_decrypt_key
+    with the same arguments & semantics as the chacha20 functions.
+*/
+#define PORTABLE_8439_REDUCED_ROUNDS(X) X(chacha12, 12) X(chacha8, 8)
+
+#define PORTABLE_8439_REDUCED_DECLARE(name, rounds) \
+    PORTABLE_8439_DECL size_t portable_##name##_poly1305_encrypt( \
+        uint8_t *restrict cipher_text, \
+        const uint8_t key[RFC_8439_KEY_SIZE], \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        size_t ad_size, \
+        const uint8_t *restrict plain_text, \
+        size_t plain_text_size \
+    ); \
+    PORTABLE_8439_DECL size_t portable_##name##_poly1305_decrypt( \
+        uint8_t *restrict plain_text, \
+        const uint8_t key[RFC_8439_KEY_SIZE], \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        size_t ad_size, \
+        const uint8_t *restrict cipher_text, \
+        size_t cipher_text_size \
+    ); \
+    PORTABLE_8439_DECL size_t portable_##name##_poly1305_encrypt_key( \
+        uint8_t *restrict cipher_text, \
+        const portable_8439_key *key, \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        size_t ad_size, \
+        const uint8_t *restrict plain_text, \
+        size_t plain_text_size \
+    ); \
+    PORTABLE_8439_DECL size_t portable_##name##_poly1305_decrypt_key( \
+        uint8_t *restrict plain_text, \
+        const portable_8439_key *key, \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        size_t ad_size, \
+        const uint8_t *restrict cipher_text, \
+        size_t cipher_text_size \
+    );
+
+PORTABLE_8439_REDUCED_ROUNDS(PORTABLE_8439_REDUCED_DECLARE)
+
+/*
+    QUIC header protection with ChaCha20 (RFC 9001 section 5.4.4): the 
+    mask for a packet is computed from the header protection key and a 
+    sample of its cipher text, the first PORTABLE_QUIC_HP_MASK_SIZE bytes of
+    it protect the header.
+
+    - hp_mask: the mask of one sample
+    - hp_mask_batch: count masks (written after each other to masks), for
+        the samples of many packets, several packets per SIMD register
+*/
+#define PORTABLE_QUIC_HP_SAMPLE_SIZE (16)
+#define PORTABLE_QUIC_HP_MASK_SIZE (5)
+
+void portable_chacha20_quic_hp_mask(
+    uint8_t mask[PORTABLE_QUIC_HP_MASK_SIZE],
+    const portable_8439_key *hp_key,
+    const uint8_t sample[PORTABLE_QUIC_HP_SAMPLE_SIZE]
+);
+
+void portable_chacha20_quic_hp_mask_batch(
+    uint8_t *masks,
+    const portable_8439_key *hp_key,
+    const uint8_t *const *samples,
+    size_t count
+);
+
+/*
+    TLS 1.3 record protection (RFC 8446 section 5.2) for
+    TLS_CHACHA20_POLY1305_SHA256, a whole flight of records per call. The 
+    nonce of a record is the iv xor its sequence number, the AD is its 5 
+    byte header. The records get consecutive sequence numbers, the first 
+    one gets sequence.
+
+    - tls_seal: input is the TLSInnerPlaintext (content, content type & 
+        padding), output gets the complete record: header, cipher text and
+        tag, so input_size + PORTABLE_TLS_RECORD_OVERHEAD bytes
+    - tls_open: input is a complete record, output gets the 
+        TLSInnerPlaintext, so input_size - PORTABLE_TLS_RECORD_OVERHEAD bytes
+
+    result is the size written, or -1 for a record that is overlapping, too 
+    large, malformed, or (for open) corrupted. Both return the number of 
+    records that succeeded, in TLS a single failure ends the connection.
+    The poly keys of the records are derived several per SIMD register.
+*/
+#define PORTABLE_TLS_HEADER_SIZE (5)
+#define PORTABLE_TLS_RECORD_OVERHEAD (PORTABLE_TLS_HEADER_SIZE + RFC_8439_TAG_SIZE)
+#define PORTABLE_TLS_MAX_CIPHER_TEXT ((1 << 14) + 256)
+
+typedef struct portable_8439_tls_record {
+    const uint8_t *input;
+    size_t input_size;
+    uint8_t *output;
+    size_t result;
+} portable_8439_tls_record;
+
+size_t portable_chacha20_poly1305_tls_seal(
+    portable_8439_tls_record *records,
+    size_t count,
+    const portable_8439_key *key,
+    const uint8_t iv[RFC_8439_NONCE_SIZE],
+    uint64_t sequence
+);
+
+size_t portable_chacha20_poly1305_tls_open(
+    portable_8439_tls_record *records,
+    size_t count,
+    const portable_8439_key *key,
+    const uint8_t iv[RFC_8439_NONCE_SIZE],
+    uint64_t sequence
+);
+
+/*
+    Incremental seal/open, for messages that don't fit in memory or arrive 
+    in pieces. The result is the same as the one-shot functions: the cipher
+    text is the concatenation of all the update outputs, and the tag is what
+    the one-shot functions append to it.
+
+    - stream_init: start a message, the AD has to be known upfront
+    - seal_update/open_update: en/decrypt the next size bytes, any size is 
+        fine, the chunks don't have to line up with anything. Output & input
+        should not overlap.
+    - seal_final: write the tag for everything passed to seal_update
+    - open_final: returns 1 if the tag matches everything passed to 
+        open_update, 0 otherwise
+    - stream_wipe: drop a stream without finishing it
+    Both final functions wipe the stream.
+
+    Warning: open_update hands out plain text before the tag is checked, so 
+    until open_final returned 1 treat everything it wrote as unauthenticated:
+    don't act on it and throw it away when the tag doesn't match.
+*/
+typedef struct portable_8439_stream {
+    uint64_t opaque[40];
+} portable_8439_stream;
+
+void portable_chacha20_poly1305_stream_init(
+    portable_8439_stream *stream,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+);
+
+void portable_chacha20_poly1305_seal_update(
+    portable_8439_stream *stream,
+    uint8_t *restrict cipher_text,
+    const uint8_t *restrict plain_text,
+    size_t size
+);
+
+void portable_chacha20_poly1305_seal_final(
+    portable_8439_stream *stream,
+    uint8_t tag[RFC_8439_TAG_SIZE]
+);
+
+void portable_chacha20_poly1305_open_update(
+    portable_8439_stream *stream,
+    uint8_t *restrict plain_text,
+    const uint8_t *restrict cipher_text,
+    size_t size
+);
+
+int portable_chacha20_poly1305_open_final(
+    portable_8439_stream *stream,
+    const uint8_t tag[RFC_8439_TAG_SIZE]
+);
+
+void portable_chacha20_poly1305_stream_wipe(portable_8439_stream *stream);
+
+/*
+    Seal/open a message in place in a ring buffer (capacity bytes at ring), 
+    without linearizing it first: the message starts at offset and wraps 
+    around from the end of the ring to its start when it has to. The tag 
+    follows the message in the ring, and wraps just the same.
+
+    - seal_ring: encrypts the plain_text_size bytes at offset and writes the
+        tag after them. Returns plain_text_size + RFC_8439_TAG_SIZE, or -1 if
+        that doesn't fit in the ring (or offset is outside of it).
+    - open_ring: checks the tag of the cipher_text_size bytes (tag included) 
+        at offset, and only if it matches decrypts them in place. Returns 
+        the size of the plain text, -1 when the tag doesn't match (the ring 
+        is left untouched) or the message doesn't fit.
+*/
+size_t portable_chacha20_poly1305_seal_ring(
+    uint8_t *ring,
+    size_t capacity,
+    size_t offset,
+    size_t plain_text_size,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+);
+
+size_t portable_chacha20_poly1305_open_ring(
+    uint8_t *ring,
+    size_t capacity,
+    size_t offset,
+    size_t cipher_text_size,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+);
+
+/*
+    Seal/open a message in place in one contiguous buffer, the cipher text 
+    overwrites the plain text (and the other way around). encrypt/decrypt 
+    reject overlapping buffers, use these instead.
+
+    - seal_in_place: encrypts the plain_text_size bytes at message and writes
+        the tag right after them, so message needs room for 
+        plain_text_size + RFC_8439_TAG_SIZE bytes. Returns that size.
+    - open_in_place: checks the tag at the end of the cipher_text_size bytes
+        at message, and only if it matches decrypts them in place. Returns 
+        the size of the plain text, or -1 when the tag doesn't match (the 
+        message is left untouched) or cipher_text_size is smaller than a tag.
+*/
+size_t portable_chacha20_poly1305_seal_in_place(
+    uint8_t *message,
+    size_t plain_text_size,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+);
+
+size_t portable_chacha20_poly1305_open_in_place(
+    uint8_t *message,
+    size_t cipher_text_size,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size
+);
+
+/*
+    Building blocks to open a large message in parallel (see the batch open
+    of portable8439-offload.h), with a key context:
+    - verify_key: check the tag at the end of cipher_text without decrypting,
+        returns 1 if it matches (0 also for a cipher_text shorter than a tag)
+    - xor_key: en/decrypt size bytes of a message body that start at byte 
+        offset of it, the tag is not involved. Any offset works, a multiple
+        of 64 (a chacha20 block) saves computing a partial block.
+
+    Only write the xor_key output to where it can't be used before the 
+    verify_key of the message returned 1.
+*/
+int portable_chacha20_poly1305_verify_key(
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *ad,
+    size_t ad_size,
+    const uint8_t *cipher_text,
+    size_t cipher_text_size
+);
+
+void portable_chacha20_poly1305_xor_key(
+    uint8_t *restrict output,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    uint64_t offset,
+    const uint8_t *restrict input,
+    size_t size
+);
+
+/*
+    Bulk mode for huge buffers that won't be read again soon: the same as 
+    encrypt_key/decrypt_key, but above PORTABLE_8439_BULK_THRESHOLD bytes 
+    (1MiB by default, -D it to change) the output is written with 
+    non-temporal stores, so it doesn't push the working set of the rest of 
+    the program out of the caches. The mac is calculated on every chunk before
+    it is streamed out, so nothing is read back from memory. Without 
+    non-temporal stores (only SSE2 for now) they are plain encrypt/decrypt.
+*/
+size_t portable_chacha20_poly1305_encrypt_key_bulk(
+    uint8_t *restrict cipher_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,
+    const uint8_t *restrict plain_text,
+    size_t plain_text_size
+);
+
+size_t portable_chacha20_poly1305_decrypt_key_bulk(
+    uint8_t *restrict plain_text,
+    const portable_8439_key *key,
+    const uint8_t nonce[RFC_8439_NONCE_SIZE],
+    const uint8_t *restrict ad,
+    size_t ad_size,
+    const uint8_t *restrict cipher_text,
+    size_t cipher_text_size
+);
+
+/*
+    Fixed size variants of the key context functions, for records of which 
+    the plain text and ad size are known at compile time. With the sizes 
+    as constants the compiler can drop the padding branches, fold the length
+    block of the mac, and unroll the tail of the key stream (most effective
+    in the amalgamated portable8439.c, where everything can be inlined).
+
+    For every X(size, ad_size) in PORTABLE_8439_FIXED_SIZES there is a:
+        portable_chacha20_poly1305_encrypt_<size>_<ad_size>
+        portable_chacha20_poly1305_decrypt_<size>_<ad_size>
+    with the same semantics as the _key variants, minus the size arguments.
+    Size is the plain text size, so the cipher text is size + 
+    RFC_8439_TAG_SIZE bytes. Define PORTABLE_8439_FIXED_SIZES yourself 
+    (for both the library and your code) to get other sizes, for example
+    -D'PORTABLE_8439_FIXED_SIZES(X)=X(64, 13) X(1024, 13)', or none at all
+    with -D'PORTABLE_8439_FIXED_SIZES(X)='.
+*/
+#ifndef PORTABLE_8439_FIXED_SIZES
+#define PORTABLE_8439_FIXED_SIZES(X) X(32, 0) X(48, 0) X(128, 0)
+#endif
+
+#define PORTABLE_8439_FIXED_DECLARE(size, ad_size) \
+    PORTABLE_8439_DECL size_t portable_chacha20_poly1305_encrypt_##size##_##ad_size( \
+        uint8_t *restrict cipher_text, \
+        const portable_8439_key *key, \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        const uint8_t *restrict plain_text \
+    ); \
+    PORTABLE_8439_DECL size_t portable_chacha20_poly1305_decrypt_##size##_##ad_size( \
+        uint8_t *restrict plain_text, \
+        const portable_8439_key *key, \
+        const uint8_t nonce[RFC_8439_NONCE_SIZE], \
+        const uint8_t *restrict ad, \
+        const uint8_t *restrict cipher_text \
+    );
+
+PORTABLE_8439_FIXED_SIZES(PORTABLE_8439_FIXED_DECLARE)
+
+/*
+    Select the poly1305 implementation at runtime.
+
+    All poly1305-donna variants are compiled in: donna-8, donna-16, donna-32
+    and donna-32x2, plus donna-64 and donna-64x4 where 128 bit math is 
+    available. The compile time flags (-DPOLY1305_32BIT, -DPOLY1305_32X2, 
+    ...) only pick the default. These functions allow listing, selecting and
+    measuring them, so you can compare them on the target without 
+    rebuilding. Select a backend before using the library from multiple 
+    threads.
+
+    With PORTABLE_8439_SMALL only the default backend is compiled in (donna-64
+    rather than donna-64x4 on 64 bit), so these functions see a list of one.
+
+    - count & name: list the available backends (name is NULL when out of range)
+    - current: name of the backend new messages will use
+    - select: switch to the backend by name, returns 0 for an unknown name
+    - benchmark: MiB/s of `runs` macs over message with the given backend, 
+        negative for an unknown name
+*/
+size_t portable_poly1305_backend_count(void);
+const char *portable_poly1305_backend_name(size_t index);
+const char *portable_poly1305_backend_current(void);
+int portable_poly1305_backend_select(const char *name);
+double portable_poly1305_backend_benchmark(
+    const char *name,
+    const uint8_t *message,
+    size_t message_size,
+    unsigned long runs
+);
+
+#ifdef PORTABLE_8439_STATS
+/*
+    Instrumentation counters, only available when compiled with 
+    -DPORTABLE_8439_STATS (needs GCC or Clang), without it they compile to
+    nothing.
+
+    Every thread counts into its own block (allocated on first use), so the 
+    hot path has no shared writes. portable_8439_stats_collect sums the 
+    blocks of all threads at the moment of the call. Blocks of threads that
+    have ended are kept, so their counts are not lost.
+
+    - calls: every call, including the failed ones
+    - bytes: plain text bytes of the successful calls (no tag or ad)
+    - auth_failures: decrypts that failed on the tag
+    - overlap_rejections: calls that failed on overlapping buffers
+    - size_histogram: plain text sizes of the successful calls, bucket 0 
+        counts empty messages, bucket i messages of 2^(i-1) up to 
+        2^i - 1 bytes, and the last bucket all messages larger than that
+*/
+#define PORTABLE_8439_STATS_BUCKETS (32)
+
+typedef struct portable_8439_stats {
+    uint64_t encrypt_calls;
+    uint64_t encrypt_bytes;
+    uint64_t decrypt_calls;
+    uint64_t decrypt_bytes;
+    uint64_t auth_failures;
+    uint64_t overlap_rejections;
+    uint64_t size_histogram[PORTABLE_8439_STATS_BUCKETS];
+} portable_8439_stats;
+
+void portable_8439_stats_collect(portable_8439_stats *result);
+
+/*
+    Optional per call timing: when set, encrypt & decrypt read clock at the
+    start and end of every call and report the difference to hook, together
+    with the size of the input (plain text or cipher text).
+    The struct is not copied, it should stay alive until it is replaced,
+    pass NULL to disable the timing again.
+*/
+typedef enum portable_8439_operation {
+    PORTABLE_8439_ENCRYPT,
+    PORTABLE_8439_DECRYPT
+} portable_8439_operation;
+
+typedef struct portable_8439_timing {
+    uint64_t (*clock)(void);
+    void (*hook)(portable_8439_operation operation, size_t size, uint64_t elapsed, void *user_data);
+    void *user_data;
+} portable_8439_timing;
+
+void portable_8439_stats_timing(const portable_8439_timing *timing);
+#endif
 #endif
@@ -0,0 +1,322 @@
+#ifndef PORTABLE_8439_HPP
+#define PORTABLE_8439_HPP
+/*
+ Header-only C++17 layer on top of portable8439.h
+
+ - portable8439::key: RAII key context, loads the key once and wipes it on
+     destruction (move-only)
+ - key::seal & key::open: write into caller provided spans, there are no
+     allocations and no exceptions, a failure is an empty optional
+ - portable8439::message_buffer: move-only heap buffer that always has room
+     for the tag after the payload
+ - portable8439::stream: incremental seal/open of one message, wiped on
+     destruction (see portable8439-stream.hpp for the coroutine adapters)
+
+ Everything is a thin inline wrapper around the C functions.
+*/
+#if __cplusplus < 201703L && (!defined(_MSVC_LANG) || _MSVC_LANG < 201703L)
+#    error "C++17 or newer required"
+#endif
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#if defined(__has_include)
+#    if __has_include(<span>) && __cplusplus > 201703L
+#        include <span>
+#    endif
+#endif
+
+extern "C" {
+#include "portable8439.h"
+}
+
+namespace portable8439 {
+
+constexpr std::size_t key_size = RFC_8439_KEY_SIZE;
+constexpr std::size_t nonce_size = RFC_8439_NONCE_SIZE;
+constexpr std::size_t tag_size = RFC_8439_TAG_SIZE;
+
+#if defined(__cpp_lib_span) && __cpp_lib_span >= 202002L
+template <typename T>
+using span = std::span<T>;
+#else
+// the subset of std::span we need, until we can require C++20
+template <typename T>
+class span {
+public:
+    using element_type = T;
+    using value_type = std::remove_cv_t<T>;
+    using size_type = std::size_t;
+    using pointer = T *;
+    using iterator = T *;
+
+    constexpr span() noexcept = default;
+    constexpr span(T *data, std::size_t size) noexcept : data_(data), size_(size) {}
+    template <std::size_t N>
+    constexpr span(T (&array)[N]) noexcept : data_(array), size_(N) {}
+    // any contiguous container (std::vector, std::array, std::string, span<U>, ...)
+    template <typename C, typename = std::enable_if_t<
+        std::is_convertible_v<decltype(std::declval<C &>().data()), T *>>>
+    constexpr span(C &&container) noexcept : data_(container.data()), size_(container.size()) {}
+
+    constexpr T *data() const noexcept { return data_; }
+    constexpr std::size_t size() const noexcept { return size_; }
+    constexpr bool empty() const noexcept { return size_ == 0; }
+    constexpr T *begin() const noexcept { return data_; }
+    constexpr T *end() const noexcept { return data_ + size_; }
+    constexpr T &operator[](std::size_t index) const noexcept { return data_[index]; }
+    constexpr span first(std::size_t count) const noexcept { return { data_, count }; }
+    constexpr span subspan(std::size_t offset) const noexcept { return { data_ + offset, size_ - offset }; }
+    constexpr span subspan(std::size_t offset, std::size_t count) const noexcept { return { data_ + offset, count }; }
+
+private:
+    T *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+#endif
+
+using key_bytes = std::array<std::uint8_t, key_size>;
+using nonce = std::array<std::uint8_t, nonce_size>;
+
+// maps the PORTABLE_8439_FIXED_SIZES list of the C library to templates,
+// sizes that are not in the list use the generic functions
+template <std::size_t Size, std::size_t AdSize>
+struct fixed_size {
+    static constexpr bool available = false;
+};
+
+#define PORTABLE_8439_FIXED_TEMPLATE(size, ad_size) \
+    template <> \
+    struct fixed_size<size, ad_size> { \
+        static constexpr bool available = true; \
+        static std::size_t encrypt(std::uint8_t *cipher_text, const portable_8439_key *key, \
+                const std::uint8_t *nonce, const std::uint8_t *ad, const std::uint8_t *plain_text) noexcept { \
+            return portable_chacha20_poly1305_encrypt_##size##_##ad_size(cipher_text, key, nonce, ad, plain_text); \
+        } \
+        static std::size_t decrypt(std::uint8_t *plain_text, const portable_8439_key *key, \
+                const std::uint8_t *nonce, const std::uint8_t *ad, const std::uint8_t *cipher_text) noexcept { \
+            return portable_chacha20_poly1305_decrypt_##size##_##ad_size(plain_text, key, nonce, ad, cipher_text); \
+        } \
+    };
+PORTABLE_8439_FIXED_SIZES(PORTABLE_8439_FIXED_TEMPLATE)
+#undef PORTABLE_8439_FIXED_TEMPLATE
+
+class key {
+public:
+    explicit key(const key_bytes &bytes) noexcept {
+        portable_chacha20_poly1305_key_init(&context_, bytes.data());
+    }
+    explicit key(const std::uint8_t (&bytes)[key_size]) noexcept {
+        portable_chacha20_poly1305_key_init(&context_, bytes);
+    }
+    ~key() { portable_chacha20_poly1305_key_wipe(&context_); }
+
+    key(const key &) = delete;
+    key &operator=(const key &) = delete;
+    key(key &&other) noexcept : context_(other.context_) {
+        portable_chacha20_poly1305_key_wipe(&other.context_);
+    }
+    key &operator=(key &&other) noexcept {
+        if (this != &other) {
+            context_ = other.context_;
+            portable_chacha20_poly1305_key_wipe(&other.context_);
+        }
+        return *this;
+    }
+
+    // encrypts plain_text into cipher_text (plain_text.size() + tag_size bytes)
+    // returns the written part of cipher_text, nothing if it's too small or
+    // the buffers overlap
+    std::optional<span<std::uint8_t>> seal(
+        span<std::uint8_t> cipher_text,
+        const nonce &nonce,
+        span<const std::uint8_t> ad,
+        span<const std::uint8_t> plain_text
+    ) const noexcept {
+        if (cipher_text.size() < plain_text.size() + tag_size) {
+            return std::nullopt;
+        }
+        std::size_t written = portable_chacha20_poly1305_encrypt_key(
+            cipher_text.data(), &context_, nonce.data(),
+            ad.data(), ad.size(), plain_text.data(), plain_text.size());
+        if (written == static_cast<std::size_t>(-1)) {
+            return std::nullopt;
+        }
+        return cipher_text.first(written);
+    }
+
+    // decrypts cipher_text into plain_text (cipher_text.size() - tag_size bytes)
+    // returns the written part of plain_text, nothing if the tag didn't match,
+    // the buffer is too small or the buffers overlap
+    std::optional<span<std::uint8_t>> open(
+        span<std::uint8_t> plain_text,
+        const nonce &nonce,
+        span<const std::uint8_t> ad,
+        span<const std::uint8_t> cipher_text
+    ) const noexcept {
+        if (cipher_text.size() < tag_size || plain_text.size() < cipher_text.size() - tag_size) {
+            return std::nullopt;
+        }
+        std::size_t written = portable_chacha20_poly1305_decrypt_key(
+            plain_text.data(), &context_, nonce.data(),
+            ad.data(), ad.size(), cipher_text.data(), cipher_text.size());
+        if (written == static_cast<std::size_t>(-1)) {
+            return std::nullopt;
+        }
+        return plain_text.first(written);
+    }
+
+    // fixed size records, the sizes are checked at compile time, and if 
+    // the library has a specialized version for them, that one is used
+    template <std::size_t Size, std::size_t AdSize>
+    bool seal(
+        std::array<std::uint8_t, Size + tag_size> &cipher_text,
+        const nonce &nonce,
+        const std::array<std::uint8_t, AdSize> &ad,
+        const std::array<std::uint8_t, Size> &plain_text
+    ) const noexcept {
+        std::size_t written;
+        if constexpr (fixed_size<Size, AdSize>::available) {
+            written = fixed_size<Size, AdSize>::encrypt(cipher_text.data(), &context_, nonce.data(), ad.data(), plain_text.data());
+        }
+        else {
+            written = portable_chacha20_poly1305_encrypt_key(cipher_text.data(), &context_, nonce.data(),
+                ad.data(), AdSize, plain_text.data(), Size);
+        }
+        return written != static_cast<std::size_t>(-1);
+    }
+
+    template <std::size_t Size, std::size_t AdSize>
+    bool open(
+        std::array<std::uint8_t, Size> &plain_text,
+        const nonce &nonce,
+        const std::array<std::uint8_t, AdSize> &ad,
+        const std::array<std::uint8_t, Size + tag_size> &cipher_text
+    ) const noexcept {
+        std::size_t written;
+        if constexpr (fixed_size<Size, AdSize>::available) {
+            written = fixed_size<Size, AdSize>::decrypt(plain_text.data(), &context_, nonce.data(), ad.data(), cipher_text.data());
+        }
+        else {
+            written = portable_chacha20_poly1305_decrypt_key(plain_text.data(), &context_, nonce.data(),
+                ad.data(), AdSize, cipher_text.data(), Size + tag_size);
+        }
+        return written != static_cast<std::size_t>(-1);
+    }
+
+    const portable_8439_key *context() const noexcept { return &context_; }
+
+private:
+    portable_8439_key context_;
+};
+
+// one message sealed or opened in pieces, see the incremental functions in
+// portable8439.h. Not copyable or movable, the state stays where it started.
+class stream {
+public:
+    stream(const key &k, const nonce &n, span<const std::uint8_t> ad) noexcept {
+        portable_chacha20_poly1305_stream_init(&context_, k.context(), n.data(), ad.data(), ad.size());
+    }
+    ~stream() { portable_chacha20_poly1305_stream_wipe(&context_); }
+
+    stream(const stream &) = delete;
+    stream &operator=(const stream &) = delete;
+
+    // cipher_text should be at least plain_text.size()
+    void seal_update(span<std::uint8_t> cipher_text, span<const std::uint8_t> plain_text) noexcept {
+        portable_chacha20_poly1305_seal_update(&context_, cipher_text.data(), plain_text.data(), plain_text.size());
+    }
+    void seal_final(std::array<std::uint8_t, tag_size> &tag) noexcept {
+        portable_chacha20_poly1305_seal_final(&context_, tag.data());
+    }
+
+    // the plain text is unauthenticated until open_final returned true
+    void open_update(span<std::uint8_t> plain_text, span<const std::uint8_t> cipher_text) noexcept {
+        portable_chacha20_poly1305_open_update(&context_, plain_text.data(), cipher_text.data(), cipher_text.size());
+    }
+    bool open_final(const std::array<std::uint8_t, tag_size> &tag) noexcept {
+        return portable_chacha20_poly1305_open_final(&context_, tag.data()) != 0;
+    }
+
+private:
+    portable_8439_stream context_;
+};
+
+// a message that owns its memory, with tag_size bytes of headroom behind
+// the payload, so it can always receive the sealed version of a payload of
+// the same capacity. The only allocation happens in the constructor.
+class message_buffer {
+public:
+    explicit message_buffer(std::size_t capacity)
+        : data_(new std::uint8_t[capacity + tag_size]), capacity_(capacity), size_(0) {}
+
+    message_buffer(const message_buffer &) = delete;
+    message_buffer &operator=(const message_buffer &) = delete;
+    message_buffer(message_buffer &&other) noexcept
+        : data_(std::move(other.data_)), capacity_(other.capacity_), size_(other.size_) {
+        other.capacity_ = 0;
+        other.size_ = 0;
+    }
+    message_buffer &operator=(message_buffer &&other) noexcept {
+        data_ = std::move(other.data_);
+        capacity_ = std::exchange(other.capacity_, 0);
+        size_ = std::exchange(other.size_, 0);
+        return *this;
+    }
+
+    // payload capacity, excluding the tag headroom
+    std::size_t capacity() const noexcept { return capacity_; }
+    std::size_t size() const noexcept { return size_; }
+    // false if size exceeds the capacity (including headroom for sealed messages)
+    // or the buffer was moved from
+    bool resize(std::size_t size) noexcept {
+        if (!data_ || size > capacity_ + tag_size) {
+            return false;
+        }
+        size_ = size;
+        return true;
+    }
+
+    std::uint8_t *data() noexcept { return data_.get(); }
+    const std::uint8_t *data() const noexcept { return data_.get(); }
+    span<std::uint8_t> contents() noexcept { return { data_.get(), size_ }; }
+    span<const std::uint8_t> contents() const noexcept { return { data_.get(), size_ }; }
+    // the whole memory, including the tag headroom, empty once moved from
+    span<std::uint8_t> storage() noexcept {
+        return data_ ? span<std::uint8_t>{ data_.get(), capacity_ + tag_size } : span<std::uint8_t>{};
+    }
+
+    // seal contents of plain into this buffer, false if it was moved from
+    bool seal(const key &k, const nonce &n, span<const std::uint8_t> ad, const message_buffer &plain) noexcept {
+        if (!data_) {
+            return false;
+        }
+        auto result = k.seal(storage(), n, ad, plain.contents());
+        size_ = result ? result->size() : 0;
+        return result.has_value();
+    }
+
+    // open contents of sealed into this buffer, false if it was moved from
+    bool open(const key &k, const nonce &n, span<const std::uint8_t> ad, const message_buffer &sealed) noexcept {
+        if (!data_) {
+            return false;
+        }
+        auto result = k.open(storage(), n, ad, sealed.contents());
+        size_ = result ? result->size() : 0;
+        return result.has_value();
+    }
+
+private:
+    std::unique_ptr<std::uint8_t[]> data_;
+    std::size_t capacity_;
+    std::size_t size_;
+};
+
+}
+#endif
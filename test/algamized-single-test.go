@@ -0,0 +1,84 @@
+package main
+
+// #define PORTABLE_8439_IMPLEMENTATION
+// #include "../dist/portable8439-single.h"
+import "C"
+
+import (
+	"bytes"
+	"crypto/rand"
+	"fmt"
+	"log"
+
+	"golang.org/x/crypto/chacha20poly1305"
+)
+
+func bytePointer(ar []byte) *C.uint8_t {
+	return (*C.uint8_t)(&ar[0])
+}
+
+func headerOnlyEncrypt() {
+	fmt.Println("Encrypting plaintext using the header-only C")
+	var key [C.RFC_8439_KEY_SIZE]byte
+	var nonce [C.RFC_8439_NONCE_SIZE]byte
+	rand.Read(key[:])
+	rand.Read(nonce[:])
+
+	var plain [8000]byte
+	var ad [500]byte
+
+	rand.Read(plain[:])
+	rand.Read(ad[:])
+
+	var cipher [len(plain) + C.RFC_8439_TAG_SIZE]byte
+
+	C.portable_chacha20_poly1305_encrypt(bytePointer(cipher[:]),
+		bytePointer(key[:]), bytePointer(nonce[:]),
+		bytePointer(ad[:]), C.size_t(len(ad)),
+		bytePointer(plain[:]), C.size_t(len(plain)))
+
+	fmt.Println("Decrypting cyphertext using go")
+	aead, _ := chacha20poly1305.New(key[:])
+	decrypted, err := aead.Open(nil, nonce[:], cipher[:], ad[:])
+	if err != nil {
+		log.Fatalf("Failure to decrypt: %v", err)
+	}
+
+	if bytes.Equal(plain[:], decrypted[:]) {
+		fmt.Println("Success")
+	} else {
+		log.Fatal("Failure to decrypt")
+	}
+}
+
+func headerOnlyFixedDecrypt() {
+	fmt.Println("Encrypting plaintext using go")
+	var key [C.RFC_8439_KEY_SIZE]byte
+	var nonce [C.RFC_8439_NONCE_SIZE]byte
+	var plain [128]byte
+	rand.Read(key[:])
+	rand.Read(nonce[:])
+	rand.Read(plain[:])
+
+	aead, _ := chacha20poly1305.New(key[:])
+	cipher := aead.Seal(nil, nonce[:], plain[:], nil)
+
+	fmt.Println("Decrypting cyphertext using the header-only C (fixed size)")
+	var k C.portable_8439_key
+	C.portable_chacha20_poly1305_key_init(&k, bytePointer(key[:]))
+	var decrypted [len(plain)]byte
+	size := C.portable_chacha20_poly1305_decrypt_128_0(bytePointer(decrypted[:]),
+		&k, bytePointer(nonce[:]), nil, bytePointer(cipher))
+	C.portable_chacha20_poly1305_key_wipe(&k)
+
+	if size == C.size_t(len(plain)) && bytes.Equal(plain[:], decrypted[:]) {
+		fmt.Println("Success")
+	} else {
+		log.Fatal("Failure to decrypt")
+	}
+}
+
+func main() {
+	headerOnlyEncrypt()
+	headerOnlyFixedDecrypt()
+}
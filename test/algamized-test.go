@@ -51,6 +51,41 @@ func poly1305chacha20Interop() {
 	}
 }
 
+func xchacha20poly1305Interop() {
+	fmt.Println("Encrypting plaintext using C (XChaCha20)")
+	var key [C.RFC_8439_KEY_SIZE]byte
+	var nonce [C.XCHACHA20_POLY1305_NONCE_SIZE]byte
+	rand.Read(key[:])
+	rand.Read(nonce[:])
+
+	var plain [8000]byte
+	var ad [500]byte
+
+	rand.Read(plain[:])
+	rand.Read(ad[:])
+
+	var cipher [len(plain) + C.RFC_8439_TAG_SIZE]byte
+
+	C.portable_xchacha20_poly1305_encrypt(bytePointer(cipher[:]),
+		bytePointer(key[:]), bytePointer(nonce[:]),
+		bytePointer(ad[:]), C.size_t(len(ad)),
+		bytePointer(plain[:]), C.size_t(len(plain)))
+
+	fmt.Println("Decrypting cyphertext using go")
+	aead, _ := chacha20poly1305.NewX(key[:])
+	decrypted, err := aead.Open(nil, nonce[:], cipher[:], ad[:])
+	if err != nil {
+		log.Fatalf("Failure to decrypt: %v", err)
+	}
+
+	if bytes.Equal(plain[:], decrypted[:]) {
+		fmt.Println("Success")
+	} else {
+		log.Fatal("Failure to decrypt")
+	}
+}
+
 func main() {
 	poly1305chacha20Interop()
+	xchacha20poly1305Interop()
 }
@@ -0,0 +1,254 @@
+#define _DEFAULT_SOURCE
+#include "../src/portable8439-channel.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// messages per second and round trip latency between two processes, through
+// the sealed channel and through a plain ring with the same layout
+
+#define MESSAGES (1 << 18)
+#define PINGS (1 << 14)
+#define SLOTS (256)
+#define MAX_SIZE (1024)
+
+#ifndef CLOCK_MONOTONIC_RAW
+#define CLOCK_MONOTONIC_RAW CLOCK_MONOTONIC
+#endif
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// spin for a bit, and then give the other side the core (needed when both
+// share a single core)
+static void backoff(unsigned int *spins) {
+    if (++*spins % 64 == 0) {
+        sched_yield();
+    }
+}
+
+// the unencrypted baseline: counters on their own cache lines, slots of
+// whole cache lines, copy in and read in place
+typedef struct plain_ring {
+    uint64_t produced;
+    uint8_t _pad0[56];
+    uint64_t consumed;
+    uint8_t _pad1[56];
+    struct {
+        uint64_t size;
+        uint8_t message[MAX_SIZE + 56];
+    } slots[SLOTS];
+} plain_ring;
+
+typedef struct endpoint {
+    int sealed;
+    portable_8439_channel channel;
+    plain_ring *plain;
+    uint64_t position;
+    uint64_t other;
+} endpoint;
+
+static void *map_segment(int sealed) {
+    size_t size = sealed ? portable_8439_channel_segment_size(SLOTS, MAX_SIZE) : sizeof(plain_ring);
+    void *segment = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (segment == MAP_FAILED || (sealed && !portable_8439_channel_format(segment, size, SLOTS, MAX_SIZE))) {
+        printf("no shared segment\n");
+        exit(1);
+    }
+    return segment;
+}
+
+static void unmap_segment(int sealed, void *segment) {
+    munmap(segment, sealed ? portable_8439_channel_segment_size(SLOTS, MAX_SIZE) : sizeof(plain_ring));
+}
+
+static void attach(endpoint *e, int sealed, void *segment, portable_8439_channel_side side, uint8_t key_byte) {
+    memset(e, 0, sizeof(endpoint));
+    e->sealed = sealed;
+    if (sealed) {
+        uint8_t key[RFC_8439_KEY_SIZE] = { key_byte };
+        portable_8439_channel_attach(&e->channel, side, segment, portable_8439_channel_segment_size(SLOTS, MAX_SIZE), key);
+    }
+    else {
+        e->plain = segment;
+    }
+}
+
+static void push(endpoint *e, const uint8_t *message, size_t size) {
+    unsigned int spins = 0;
+    if (e->sealed) {
+        while (!portable_8439_channel_send(&e->channel, message, size)) {
+            backoff(&spins);
+        }
+        return;
+    }
+    while (e->position - e->other >= SLOTS) {
+        e->other = __atomic_load_n(&e->plain->consumed, __ATOMIC_ACQUIRE);
+        if (e->position - e->other >= SLOTS) {
+            backoff(&spins);
+        }
+    }
+    e->plain->slots[e->position % SLOTS].size = size;
+    memcpy(e->plain->slots[e->position % SLOTS].message, message, size);
+    __atomic_store_n(&e->plain->produced, ++e->position, __ATOMIC_RELEASE);
+}
+
+static const uint8_t *pull(endpoint *e, size_t *size) {
+    unsigned int spins = 0;
+    if (e->sealed) {
+        const uint8_t *message;
+        int result;
+        while ((result = portable_8439_channel_receive(&e->channel, &message, size)) == 0) {
+            backoff(&spins);
+        }
+        if (result != 1) {
+            printf("sealed message didn't open\n");
+            exit(1);
+        }
+        return message;
+    }
+    while (e->position == e->other) {
+        e->other = __atomic_load_n(&e->plain->produced, __ATOMIC_ACQUIRE);
+        if (e->position == e->other) {
+            backoff(&spins);
+        }
+    }
+    *size = (size_t)e->plain->slots[e->position % SLOTS].size;
+    return e->plain->slots[e->position % SLOTS].message;
+}
+
+static void drop(endpoint *e) {
+    if (e->sealed) {
+        portable_8439_channel_release(&e->channel);
+    }
+    else {
+        __atomic_store_n(&e->plain->consumed, ++e->position, __ATOMIC_RELEASE);
+    }
+}
+
+static void detach(endpoint *e) {
+    if (e->sealed) {
+        portable_8439_channel_wipe(&e->channel);
+    }
+}
+
+static pid_t start_child(void) {
+    fflush(stdout);
+    pid_t child = fork();
+    if (child < 0) {
+        printf("fork failed\n");
+        exit(1);
+    }
+    return child;
+}
+
+static double bench_throughput(int sealed, size_t size) {
+    void *segment = map_segment(sealed);
+    uint8_t message[MAX_SIZE] = { 0 };
+    endpoint e;
+    pid_t child = start_child();
+    if (child == 0) {
+        attach(&e, sealed, segment, PORTABLE_8439_CHANNEL_PRODUCER, 1);
+        for (uint64_t m = 0; m < MESSAGES; m++) {
+            memcpy(message, &m, sizeof(m));
+            push(&e, message, size);
+        }
+        detach(&e);
+        _exit(0);
+    }
+    attach(&e, sealed, segment, PORTABLE_8439_CHANNEL_CONSUMER, 1);
+    double start = now();
+    for (uint64_t m = 0; m < MESSAGES; m++) {
+        size_t received_size;
+        const uint8_t *received = pull(&e, &received_size);
+        uint64_t counter;
+        memcpy(&counter, received, sizeof(counter));
+        if (counter != m || received_size != size) {
+            printf("message %llu out of order\n", (unsigned long long)m);
+            exit(1);
+        }
+        drop(&e);
+    }
+    double took = now() - start;
+    waitpid(child, NULL, 0);
+    detach(&e);
+    unmap_segment(sealed, segment);
+    return MESSAGES / took;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// the child echoes every message back on a second channel (with its own key)
+static void bench_latency(int sealed, size_t size, double *mean, double *p99) {
+    void *ping_segment = map_segment(sealed);
+    void *pong_segment = map_segment(sealed);
+    uint8_t message[MAX_SIZE] = { 0 };
+    endpoint ping, pong;
+    pid_t child = start_child();
+    if (child == 0) {
+        attach(&ping, sealed, ping_segment, PORTABLE_8439_CHANNEL_CONSUMER, 1);
+        attach(&pong, sealed, pong_segment, PORTABLE_8439_CHANNEL_PRODUCER, 2);
+        for (int p = 0; p < PINGS; p++) {
+            size_t received_size;
+            const uint8_t *received = pull(&ping, &received_size);
+            memcpy(message, received, received_size);
+            drop(&ping);
+            push(&pong, message, received_size);
+        }
+        detach(&ping);
+        detach(&pong);
+        _exit(0);
+    }
+    attach(&ping, sealed, ping_segment, PORTABLE_8439_CHANNEL_PRODUCER, 1);
+    attach(&pong, sealed, pong_segment, PORTABLE_8439_CHANNEL_CONSUMER, 2);
+    static double round_trips[PINGS];
+    double total = 0;
+    for (int p = 0; p < PINGS; p++) {
+        double start = now();
+        push(&ping, message, size);
+        size_t received_size;
+        pull(&pong, &received_size);
+        drop(&pong);
+        round_trips[p] = (now() - start) * 1e6;
+        total += round_trips[p];
+    }
+    waitpid(child, NULL, 0);
+    detach(&ping);
+    detach(&pong);
+    unmap_segment(sealed, ping_segment);
+    unmap_segment(sealed, pong_segment);
+    qsort(round_trips, PINGS, sizeof(double), compare_doubles);
+    *mean = total / PINGS;
+    *p99 = round_trips[PINGS * 99 / 100];
+}
+
+int main(void) {
+    printf("%d messages from one process to another, in messages per second\n", MESSAGES);
+    const size_t sizes[] = { 64, 256, MAX_SIZE };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        double plain = bench_throughput(0, sizes[s]);
+        double sealed = bench_throughput(1, sizes[s]);
+        printf("%5zu bytes: plain %9.0f, sealed %9.0f (%+.1f%%)\n",
+            sizes[s], plain, sealed, (sealed - plain) / plain * 100);
+    }
+    printf("Round trips of %d messages, in microseconds\n", PINGS);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        double plain_mean, plain_p99, sealed_mean, sealed_p99;
+        bench_latency(0, sizes[s], &plain_mean, &plain_p99);
+        bench_latency(1, sizes[s], &sealed_mean, &sealed_p99);
+        printf("%5zu bytes: plain mean %6.2f p99 %6.2f, sealed mean %6.2f p99 %6.2f\n",
+            sizes[s], plain_mean, plain_p99, sealed_mean, sealed_p99);
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include "portable8439.hpp"
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+// compares the C++ wrapper with the C key context api, both seal the same 
+// messages, any difference should be within the noise of the measurement
+
+using namespace portable8439;
+using clock_type = std::chrono::steady_clock;
+
+template <typename F>
+static double nanos_per_message(std::size_t messages, F &&seal) {
+    auto start = clock_type::now();
+    for (std::size_t m = 0; m < messages; m++) {
+        seal(m);
+    }
+    std::chrono::duration<double, std::nano> took = clock_type::now() - start;
+    return took.count() / messages;
+}
+
+// fixed size template (specialized C function if in PORTABLE_8439_FIXED_SIZES) vs the generic C call
+template <std::size_t Size, std::size_t AdSize>
+static void bench_fixed(const key &k, const portable_8439_key &c_key) {
+    std::array<std::uint8_t, Size> plain{};
+    std::array<std::uint8_t, AdSize> ad{};
+    std::array<std::uint8_t, Size + tag_size> cipher{};
+    nonce n{};
+    std::size_t messages = 4 * 1024 * 1024;
+    double best_generic = 1e100, best_fixed = 1e100;
+    for (int round = 0; round < 5; round++) {
+        double generic = nanos_per_message(messages, [&](std::size_t m) {
+            n[0] = static_cast<std::uint8_t>(m);
+            portable_chacha20_poly1305_encrypt_key(cipher.data(), &c_key, n.data(), ad.data(), AdSize, plain.data(), Size);
+        });
+        double fixed = nanos_per_message(messages, [&](std::size_t m) {
+            n[0] = static_cast<std::uint8_t>(m);
+            k.seal(cipher, n, ad, plain);
+        });
+        best_generic = generic < best_generic ? generic : best_generic;
+        best_fixed = fixed < best_fixed ? fixed : best_fixed;
+    }
+    std::printf("seal %3zu bytes, ad %2zu: generic %6.1f ns, fixed%s %6.1f ns (%+.1f%%)\n",
+        Size, AdSize, best_generic, fixed_size<Size, AdSize>::available ? "" : " (none)",
+        best_fixed, (best_fixed - best_generic) / best_generic * 100);
+}
+
+int main() {
+    key_bytes raw_key{};
+    nonce n{};
+    std::vector<std::uint8_t> ad(16, 'a'), plain(16 * 1024, 'p'), cipher(16 * 1024 + tag_size);
+    key k(raw_key);
+    portable_8439_key c_key;
+    portable_chacha20_poly1305_key_init(&c_key, raw_key.data());
+
+    for (std::size_t size : { 16, 64, 256, 1024, 16 * 1024 }) {
+        std::size_t messages = (64 * 1024 * 1024) / (size + 64);
+        double best_c = 1e100, best_cpp = 1e100;
+        // interleave the runs, so both see the same frequency scaling & noise
+        for (int round = 0; round < 5; round++) {
+            double c = nanos_per_message(messages, [&](std::size_t m) {
+                n[0] = static_cast<std::uint8_t>(m);
+                portable_chacha20_poly1305_encrypt_key(cipher.data(), &c_key, n.data(), ad.data(), ad.size(), plain.data(), size);
+            });
+            double cpp = nanos_per_message(messages, [&](std::size_t m) {
+                n[0] = static_cast<std::uint8_t>(m);
+                auto sealed = k.seal(cipher, n, ad, span<const std::uint8_t>(plain).first(size));
+                if (!sealed) {
+                    std::printf("seal failed\n");
+                }
+            });
+            best_c = c < best_c ? c : best_c;
+            best_cpp = cpp < best_cpp ? cpp : best_cpp;
+        }
+        std::printf("seal %6zu bytes: C %8.1f ns, C++ %8.1f ns (%+.1f%%)\n",
+            size, best_c, best_cpp, (best_cpp - best_c) / best_c * 100);
+    }
+    bench_fixed<32, 0>(k, c_key);
+    bench_fixed<48, 0>(k, c_key);
+    bench_fixed<128, 0>(k, c_key);
+    portable_chacha20_poly1305_key_wipe(&c_key);
+    return 0;
+}
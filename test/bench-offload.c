@@ -0,0 +1,186 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../src/portable8439-offload.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// seals the same amount of data with 1..2x cpus producer threads, once by
+// calling the library inline on the producers, and once through an offload
+// pool with a worker per cpu. Inline scales until the producers run out of
+// cpus, the offload pool should follow it, minus the cost of the queues
+// (most visible for small messages, where batching has to win it back).
+
+#define TOTAL_BYTES (64 * 1024 * 1024)
+#define WINDOW (64)
+#define MAX_SIZE (16 * 1024)
+
+typedef struct producer {
+    portable_8439_offload *offload; // NULL for inline
+    const portable_8439_key *key;
+    size_t size;
+    size_t messages;
+    pthread_t thread;
+} producer;
+
+typedef struct slot {
+    portable_8439_job job;
+    uint8_t nonce[RFC_8439_NONCE_SIZE];
+    uint8_t cipher[MAX_SIZE + RFC_8439_TAG_SIZE];
+} slot;
+
+static uint8_t plain[MAX_SIZE];
+
+#ifndef CLOCK_MONOTONIC_RAW
+#define CLOCK_MONOTONIC_RAW CLOCK_MONOTONIC
+#endif
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void *inline_producer(void *arg) {
+    producer *self = arg;
+    slot *s = calloc(1, sizeof(slot));
+    for (size_t m = 0; m < self->messages; m++) {
+        memcpy(s->nonce, &m, sizeof(m));
+        portable_chacha20_poly1305_encrypt_key(s->cipher, self->key, s->nonce, NULL, 0, plain, self->size);
+    }
+    free(s);
+    return NULL;
+}
+
+static void submit(producer *self, portable_8439_job *job, portable_8439_completion_queue *queue) {
+    while (!portable_8439_offload_submit(self->offload, job, queue)) {
+        sched_yield();
+    }
+}
+
+static void *offload_producer(void *arg) {
+    producer *self = arg;
+    slot *slots = calloc(WINDOW, sizeof(slot));
+    portable_8439_completion_queue *queue = portable_8439_completion_queue_create(WINDOW);
+    size_t submitted = 0, in_flight = 0;
+    for (size_t i = 0; i < WINDOW && submitted < self->messages; i++, submitted++, in_flight++) {
+        memcpy(slots[i].nonce, &submitted, sizeof(submitted));
+        slots[i].job = (portable_8439_job){
+            .operation = PORTABLE_8439_OFFLOAD_SEAL, .key = self->key, .nonce = slots[i].nonce,
+            .input = plain, .input_size = self->size, .output = slots[i].cipher, .user_data = &slots[i]
+        };
+        submit(self, &slots[i].job, queue);
+    }
+    while (in_flight > 0) {
+        portable_8439_job *done[WINDOW];
+        size_t count = portable_8439_completion_queue_wait(queue, done, WINDOW);
+        in_flight -= count;
+        for (size_t i = 0; i < count && submitted < self->messages; i++, submitted++, in_flight++) {
+            slot *s = done[i]->user_data;
+            memcpy(s->nonce, &submitted, sizeof(submitted));
+            submit(self, &s->job, queue);
+        }
+    }
+    portable_8439_completion_queue_destroy(queue);
+    free(slots);
+    return NULL;
+}
+
+static double run(portable_8439_offload *offload, const portable_8439_key *key, unsigned int producers, size_t size) {
+    producer *threads = calloc(producers, sizeof(producer));
+    double start = now();
+    for (unsigned int p = 0; p < producers; p++) {
+        threads[p].offload = offload;
+        threads[p].key = key;
+        threads[p].size = size;
+        threads[p].messages = TOTAL_BYTES / size / producers;
+        pthread_create(&threads[p].thread, NULL, offload == NULL ? inline_producer : offload_producer, &threads[p]);
+    }
+    for (unsigned int p = 0; p < producers; p++) {
+        pthread_join(threads[p].thread, NULL);
+    }
+    double took = now() - start;
+    free(threads);
+    return (TOTAL_BYTES / (1024.0 * 1024.0)) / took;
+}
+
+// opens TOTAL_BYTES as records of one size, once with a loop on this
+// thread, and once as batches spread over the pool
+static void bench_open_batch(portable_8439_offload *offload, const portable_8439_key *key, size_t size) {
+    size_t count = TOTAL_BYTES / size < 256 ? TOTAL_BYTES / size : 256;
+    uint8_t *sealed = malloc(size + RFC_8439_TAG_SIZE);
+    uint8_t *opened = malloc(count * size);
+    portable_8439_record *records = calloc(count, sizeof(portable_8439_record));
+    uint8_t *verdicts = malloc((count + 7) / 8);
+    uint8_t *source = calloc(1, size);
+    uint8_t nonce[RFC_8439_NONCE_SIZE] = { 0 };
+    if (sealed == NULL || opened == NULL || records == NULL || verdicts == NULL || source == NULL) {
+        printf("allocation failed\n");
+        exit(1);
+    }
+    portable_chacha20_poly1305_encrypt_key(sealed, key, nonce, NULL, 0, source, size);
+    for (size_t r = 0; r < count; r++) {
+        records[r] = (portable_8439_record){
+            .key = key, .nonce = nonce, .cipher_text = sealed, .cipher_text_size = size + RFC_8439_TAG_SIZE,
+            .plain_text = opened + r * size
+        };
+    }
+    size_t rounds = TOTAL_BYTES / size / count;
+    double start = now();
+    for (size_t round = 0; round < rounds; round++) {
+        for (size_t r = 0; r < count; r++) {
+            portable_chacha20_poly1305_decrypt_key(records[r].plain_text, key, nonce, NULL, 0, sealed, size + RFC_8439_TAG_SIZE);
+        }
+    }
+    double serial = (TOTAL_BYTES / (1024.0 * 1024.0)) / (now() - start);
+    start = now();
+    for (size_t round = 0; round < rounds; round++) {
+        if (portable_8439_offload_open_batch(offload, records, count, verdicts) != count) {
+            printf("batch open failed\n");
+            exit(1);
+        }
+    }
+    double batched = (TOTAL_BYTES / (1024.0 * 1024.0)) / (now() - start);
+    printf("%8zu bytes x %3zu: loop %8.1f MiB/s, batch %8.1f MiB/s (%+.0f%%)\n",
+        size, count, serial, batched, (batched - serial) / serial * 100);
+    free(source);
+    free(verdicts);
+    free(records);
+    free(opened);
+    free(sealed);
+}
+
+int main(int argc, char **argv) {
+    // optional argument: the number of workers, default one per cpu
+    long cpus = argc > 1 ? atol(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int workers = cpus > 0 ? (unsigned int)cpus : 1;
+    uint8_t raw_key[RFC_8439_KEY_SIZE] = { 1 };
+    portable_8439_key key;
+    portable_chacha20_poly1305_key_init(&key, raw_key);
+    portable_8439_offload *offload = portable_8439_offload_create(workers, 1024);
+    if (offload == NULL) {
+        printf("Failed to start the offload pool\n");
+        return 1;
+    }
+    printf("Offload pool with %u workers, %d MiB per run\n", workers, TOTAL_BYTES / (1024 * 1024));
+    const size_t sizes[] = { 64, 1024, MAX_SIZE };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (unsigned int producers = 1; producers <= 2 * workers; producers *= 2) {
+            double direct = run(NULL, &key, producers, sizes[s]);
+            double offloaded = run(offload, &key, producers, sizes[s]);
+            printf("%5zu bytes, %2u producers: inline %8.1f MiB/s, offload %8.1f MiB/s (%+.0f%%)\n",
+                sizes[s], producers, direct, offloaded, (offloaded - direct) / direct * 100);
+        }
+    }
+    printf("Batch open\n");
+    const size_t record_sizes[] = { 1024, MAX_SIZE, 4 * 1024 * 1024 };
+    for (size_t s = 0; s < sizeof(record_sizes) / sizeof(record_sizes[0]); s++) {
+        bench_open_batch(offload, &key, record_sizes[s]);
+    }
+    portable_8439_offload_destroy(offload);
+    portable_chacha20_poly1305_key_wipe(&key);
+    return 0;
+}
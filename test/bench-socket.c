@@ -0,0 +1,226 @@
+#define _DEFAULT_SOURCE
+#include "../src/portable8439-socket.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// frames per second through a local socket, sender and receiver in two
+// processes: concatenating every frame into one buffer before a write (and
+// reading header & body with two reads), against the socket writer & reader
+// one frame per call and in batches
+
+#define BATCH (32)
+#define MAX_SIZE (1 << 16)
+#define BUFFER_SIZE (BATCH * (MAX_SIZE + PORTABLE_8439_FRAME_OVERHEAD))
+
+#ifndef CLOCK_MONOTONIC_RAW
+#define CLOCK_MONOTONIC_RAW CLOCK_MONOTONIC
+#endif
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+typedef enum mode {
+    CONCATENATED,
+    SINGLE,
+    BATCHED
+} mode;
+
+static const uint8_t key[RFC_8439_KEY_SIZE] = { 1 };
+static uint8_t plain[MAX_SIZE];
+static uint8_t buffer[BUFFER_SIZE];
+
+static size_t frames_for(size_t size) {
+    return size >= 4096 ? 1 << 14 : 1 << 17;
+}
+
+static int read_all(int fd, uint8_t *target, size_t size) {
+    while (size > 0) {
+        ssize_t received = read(fd, target, size);
+        if (received <= 0) {
+            return 0;
+        }
+        target += received;
+        size -= (size_t)received;
+    }
+    return 1;
+}
+
+static int write_all(int fd, const uint8_t *source, size_t size) {
+    while (size > 0) {
+        ssize_t sent = write(fd, source, size);
+        if (sent <= 0) {
+            return 0;
+        }
+        source += sent;
+        size -= (size_t)sent;
+    }
+    return 1;
+}
+
+static void nonce_for(uint8_t nonce[RFC_8439_NONCE_SIZE], uint64_t counter) {
+    memset(nonce, 0, RFC_8439_NONCE_SIZE);
+    memcpy(nonce + 4, &counter, sizeof(counter));
+}
+
+static void receive(mode m, int fd, size_t size, size_t frames) {
+    static uint8_t opened[MAX_SIZE];
+    if (m == CONCATENATED) {
+        portable_8439_key k;
+        portable_chacha20_poly1305_key_init(&k, key);
+        for (uint64_t f = 0; f < frames; f++) {
+            uint8_t nonce[RFC_8439_NONCE_SIZE];
+            nonce_for(nonce, f);
+            if (!read_all(fd, buffer, PORTABLE_8439_FRAME_HEADER_SIZE)
+                || !read_all(fd, buffer + PORTABLE_8439_FRAME_HEADER_SIZE, size + RFC_8439_TAG_SIZE)
+                || portable_chacha20_poly1305_decrypt_key(opened, &k, nonce, buffer, PORTABLE_8439_FRAME_HEADER_SIZE,
+                    buffer + PORTABLE_8439_FRAME_HEADER_SIZE, size + RFC_8439_TAG_SIZE) != size) {
+                _exit(1);
+            }
+        }
+        portable_chacha20_poly1305_key_wipe(&k);
+        return;
+    }
+    portable_8439_socket_reader reader;
+    portable_8439_socket_reader_init(&reader, fd, key, buffer, BUFFER_SIZE);
+    for (size_t f = 0; f < frames; f++) {
+        const uint8_t *message;
+        size_t received_size;
+        if (portable_8439_socket_read(&reader, &message, &received_size) != 1 || received_size != size) {
+            _exit(1);
+        }
+    }
+    portable_8439_socket_reader_wipe(&reader);
+}
+
+static int send_frames(mode m, int fd, size_t size, size_t frames, int flags) {
+    if (m == CONCATENATED) {
+        portable_8439_key k;
+        portable_chacha20_poly1305_key_init(&k, key);
+        for (uint64_t f = 0; f < frames; f++) {
+            uint8_t nonce[RFC_8439_NONCE_SIZE];
+            nonce_for(nonce, f);
+            buffer[0] = (uint8_t)(size >> 24);
+            buffer[1] = (uint8_t)(size >> 16);
+            buffer[2] = (uint8_t)(size >> 8);
+            buffer[3] = (uint8_t)size;
+            portable_chacha20_poly1305_encrypt_key(buffer + PORTABLE_8439_FRAME_HEADER_SIZE, &k, nonce, buffer,
+                PORTABLE_8439_FRAME_HEADER_SIZE, plain, size);
+            if (!write_all(fd, buffer, size + PORTABLE_8439_FRAME_OVERHEAD)) {
+                return 0;
+            }
+        }
+        portable_chacha20_poly1305_key_wipe(&k);
+        return 1;
+    }
+    portable_8439_socket_writer writer;
+    portable_8439_socket_writer_init(&writer, fd, key, buffer, BUFFER_SIZE, flags);
+    struct iovec batch[BATCH];
+    for (size_t i = 0; i < BATCH; i++) {
+        batch[i] = (struct iovec){ plain, size };
+    }
+    for (size_t f = 0; f < frames; f += (m == BATCHED ? BATCH : 1)) {
+        size_t result = m == BATCHED
+            ? portable_8439_socket_write_frames(&writer, batch, BATCH)
+            : portable_8439_socket_write(&writer, plain, size);
+        if (result == (size_t)-1) {
+            return 0;
+        }
+    }
+    portable_8439_socket_writer_wipe(&writer);
+    return 1;
+}
+
+static double bench(mode m, int pair[2], size_t size, int flags) {
+    size_t frames = frames_for(size);
+    fflush(stdout);
+    pid_t child = fork();
+    if (child < 0) {
+        printf("fork failed\n");
+        exit(1);
+    }
+    if (child == 0) {
+        close(pair[0]);
+        receive(m, pair[1], size, frames);
+        _exit(0);
+    }
+    close(pair[1]);
+    double start = now();
+    int sent = send_frames(m, pair[0], size, frames, flags);
+    int status;
+    waitpid(child, &status, 0);
+    double took = now() - start;
+    close(pair[0]);
+    if (!sent || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("frames didn't arrive\n");
+        exit(1);
+    }
+    return frames / took;
+}
+
+static void unix_pair(int pair[2]) {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        printf("no socketpair\n");
+        exit(1);
+    }
+}
+
+static int tcp_pair(int pair[2]) {
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t length = sizeof(address);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) {
+        return 0;
+    }
+    int connected = bind(listener, (struct sockaddr *)&address, sizeof(address)) == 0
+        && listen(listener, 1) == 0
+        && getsockname(listener, (struct sockaddr *)&address, &length) == 0
+        && (pair[0] = socket(AF_INET, SOCK_STREAM, 0)) >= 0
+        && connect(pair[0], (struct sockaddr *)&address, sizeof(address)) == 0
+        && (pair[1] = accept(listener, NULL, NULL)) >= 0;
+    close(listener);
+    return connected;
+}
+
+int main(void) {
+    printf("Sealed frames through a socketpair, in frames per second\n");
+    const size_t sizes[] = { 64, 1024, 16384 };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int pair[2];
+        unix_pair(pair);
+        double concatenated = bench(CONCATENATED, pair, sizes[s], 0);
+        unix_pair(pair);
+        double single = bench(SINGLE, pair, sizes[s], 0);
+        unix_pair(pair);
+        double batched = bench(BATCHED, pair, sizes[s], 0);
+        printf("%6zu bytes: concatenated %8.0f, writer %8.0f (%+.1f%%), batches of %d %8.0f (%+.1f%%)\n",
+            sizes[s], concatenated, single, (single - concatenated) / concatenated * 100,
+            BATCH, batched, (batched - concatenated) / concatenated * 100);
+    }
+    printf("Sealed frames over TCP loopback, with and without MSG_ZEROCOPY\n");
+    const size_t large[] = { 16384, MAX_SIZE };
+    for (size_t s = 0; s < sizeof(large) / sizeof(large[0]); s++) {
+        int pair[2];
+        if (!tcp_pair(pair)) {
+            printf("no loopback connection\n");
+            return 0;
+        }
+        double copied = bench(SINGLE, pair, large[s], 0);
+        if (!tcp_pair(pair)) {
+            return 0;
+        }
+        double zerocopy = bench(SINGLE, pair, large[s], PORTABLE_8439_SOCKET_ZEROCOPY);
+        printf("%6zu bytes: writer %8.0f, zerocopy %8.0f (%+.1f%%)\n",
+            large[s], copied, zerocopy, (zerocopy - copied) / copied * 100);
+    }
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include "portable8439-stream.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// streams N bytes through: writer thread -> socketpair -> seal_stream ->
+// socketpair -> open_stream (other thread) -> counter. The throughput should
+// not depend on N, and neither should the peak memory (ru_maxrss): the
+// adapters never hold more than a chunk, no matter how long the stream is.
+
+using namespace portable8439;
+using clock_type = std::chrono::steady_clock;
+
+// blocking descriptors, the awaitables complete right away
+struct fd_source {
+    int fd;
+    struct awaiter {
+        int fd;
+        span<std::uint8_t> target;
+        bool await_ready() const noexcept { return true; }
+        void await_suspend(std::coroutine_handle<>) noexcept {}
+        std::size_t await_resume() {
+            ssize_t size;
+            do {
+                size = ::read(fd, target.data(), target.size());
+            } while (size < 0 && errno == EINTR);
+            if (size < 0) {
+                throw std::system_error(errno, std::generic_category(), "read");
+            }
+            return static_cast<std::size_t>(size);
+        }
+    };
+    awaiter read(span<std::uint8_t> target) const noexcept { return { fd, target }; }
+};
+
+static void write_all(int fd, const std::uint8_t *data, std::size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), "write");
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+}
+
+struct fd_sink {
+    int fd;
+    std::suspend_never write(span<const std::uint8_t> bytes) const {
+        write_all(fd, bytes.data(), bytes.size());
+        return {};
+    }
+};
+
+struct counting_sink {
+    std::uint64_t bytes = 0;
+    std::suspend_never write(span<const std::uint8_t> data) noexcept {
+        bytes += data.size();
+        return {};
+    }
+};
+
+static long peak_rss_kib() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void bench(const key &k, std::uint64_t total, std::size_t chunk_size) {
+    int plain_pair[2], sealed_pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, plain_pair) != 0 || socketpair(AF_UNIX, SOCK_STREAM, 0, sealed_pair) != 0) {
+        std::perror("socketpair");
+        std::exit(1);
+    }
+    nonce n{};
+    auto start = clock_type::now();
+
+    std::thread producer([&] {
+        std::vector<std::uint8_t> block(chunk_size, 0x42);
+        for (std::uint64_t left = total; left > 0;) {
+            std::size_t size = left < block.size() ? static_cast<std::size_t>(left) : block.size();
+            write_all(plain_pair[0], block.data(), size);
+            left -= size;
+        }
+        shutdown(plain_pair[0], SHUT_WR);
+    });
+
+    counting_sink opened;
+    bool valid = false;
+    std::thread consumer([&] {
+        fd_source source{ sealed_pair[1] };
+        valid = sync_wait(open_stream(k, n, {}, source, opened, chunk_size));
+    });
+
+    fd_source source{ plain_pair[1] };
+    fd_sink sink{ sealed_pair[0] };
+    sync_wait(seal_stream(k, n, {}, source, sink, chunk_size));
+    shutdown(sealed_pair[0], SHUT_WR);
+
+    producer.join();
+    consumer.join();
+    std::chrono::duration<double> took = clock_type::now() - start;
+    for (int fd : { plain_pair[0], plain_pair[1], sealed_pair[0], sealed_pair[1] }) {
+        close(fd);
+    }
+    if (!valid || opened.bytes != total) {
+        std::printf("stream of %llu bytes didn't survive the roundtrip\n", static_cast<unsigned long long>(total));
+        std::exit(1);
+    }
+    std::printf("%6llu MiB, chunks of %6zu: %8.1f MiB/s, peak rss %6ld KiB\n",
+        static_cast<unsigned long long>(total >> 20), chunk_size,
+        static_cast<double>(total) / (1024 * 1024) / took.count(), peak_rss_kib());
+}
+
+int main(int argc, char **argv) {
+    // largest stream in MiB, default 1 GiB
+    std::uint64_t largest = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1024;
+    key_bytes raw_key{};
+    key k(raw_key);
+    for (std::size_t chunk_size : { 16 * 1024, 64 * 1024 }) {
+        for (std::uint64_t mib = 16; mib <= largest; mib *= 4) {
+            bench(k, mib << 20, chunk_size);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../src/portable8439-transport.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// packets per second on a single core, for typical VPN packet sizes: the
+// bare AEAD with a counter nonce, and the transport session (counters &
+// replay window) one packet at a time and in bursts
+
+#define PACKETS (1 << 18)
+#define BURST (32)
+#define MAX_SIZE (1420)
+
+#ifndef CLOCK_MONOTONIC_RAW
+#define CLOCK_MONOTONIC_RAW CLOCK_MONOTONIC
+#endif
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static uint8_t plain[MAX_SIZE];
+static uint8_t sealed[BURST][MAX_SIZE + RFC_8439_TAG_SIZE];
+static uint8_t opened[BURST][MAX_SIZE];
+
+static double bench_bare(const portable_8439_key *key, size_t size) {
+    uint8_t nonce[RFC_8439_NONCE_SIZE] = { 0 };
+    double start = now();
+    for (uint64_t p = 0; p < PACKETS; p++) {
+        memcpy(nonce + 4, &p, sizeof(p));
+        portable_chacha20_poly1305_encrypt_key(sealed[0], key, nonce, NULL, 0, plain, size);
+        if (portable_chacha20_poly1305_decrypt_key(opened[0], key, nonce, NULL, 0, sealed[0], size + RFC_8439_TAG_SIZE) != size) {
+            printf("bare open failed\n");
+            exit(1);
+        }
+    }
+    return PACKETS / (now() - start);
+}
+
+static double bench_single(const uint8_t raw_key[RFC_8439_KEY_SIZE], size_t size) {
+    portable_8439_transport sender, receiver;
+    portable_8439_transport_init(&sender, raw_key, raw_key);
+    portable_8439_transport_init(&receiver, raw_key, raw_key);
+    double start = now();
+    for (uint64_t p = 0; p < PACKETS; p++) {
+        uint64_t counter;
+        portable_8439_transport_seal(&sender, sealed[0], &counter, NULL, 0, plain, size);
+        if (portable_8439_transport_open(&receiver, opened[0], counter, NULL, 0, sealed[0], size + RFC_8439_TAG_SIZE) != size) {
+            printf("transport open failed\n");
+            exit(1);
+        }
+    }
+    double took = now() - start;
+    portable_8439_transport_wipe(&sender);
+    portable_8439_transport_wipe(&receiver);
+    return PACKETS / took;
+}
+
+static double bench_burst(const uint8_t raw_key[RFC_8439_KEY_SIZE], size_t size) {
+    portable_8439_transport sender, receiver;
+    portable_8439_transport_init(&sender, raw_key, raw_key);
+    portable_8439_transport_init(&receiver, raw_key, raw_key);
+    portable_8439_packet seal[BURST], open[BURST];
+    for (size_t i = 0; i < BURST; i++) {
+        seal[i] = (portable_8439_packet){ .input = plain, .input_size = size, .output = sealed[i] };
+        open[i] = (portable_8439_packet){ .input = sealed[i], .input_size = size + RFC_8439_TAG_SIZE, .output = opened[i] };
+    }
+    double start = now();
+    for (uint64_t p = 0; p < PACKETS; p += BURST) {
+        portable_8439_transport_seal_burst(&sender, seal, BURST);
+        for (size_t i = 0; i < BURST; i++) {
+            open[i].counter = seal[i].counter;
+        }
+        if (portable_8439_transport_open_burst(&receiver, open, BURST) != BURST) {
+            printf("transport burst open failed\n");
+            exit(1);
+        }
+    }
+    double took = now() - start;
+    portable_8439_transport_wipe(&sender);
+    portable_8439_transport_wipe(&receiver);
+    return PACKETS / took;
+}
+
+int main(void) {
+    uint8_t raw_key[RFC_8439_KEY_SIZE] = { 1 };
+    portable_8439_key key;
+    portable_chacha20_poly1305_key_init(&key, raw_key);
+    printf("Seal + open of %d packets on one core, in packets per second\n", PACKETS);
+    const size_t sizes[] = { 64, 512, MAX_SIZE };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        double bare = bench_bare(&key, sizes[s]);
+        double single = bench_single(raw_key, sizes[s]);
+        double burst = bench_burst(raw_key, sizes[s]);
+        printf("%5zu bytes: bare %9.0f, transport %9.0f (%+.1f%%), burst of %d %9.0f (%+.1f%%)\n",
+            sizes[s], bare, single, (single - bare) / bare * 100, BURST, burst, (burst - bare) / bare * 100);
+    }
+    portable_chacha20_poly1305_key_wipe(&key);
+    return 0;
+}
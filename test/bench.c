@@ -1,3 +1,4 @@
+#define _DEFAULT_SOURCE
 #include "../src/portable8439.h"
 #include "../src/chacha-portable/chacha-portable.h"
 #include "../src/poly1305-donna/poly1305-donna.h"
@@ -8,6 +9,11 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include "pcg_random.h"
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 static void fill_crappy_random(void* target, size_t length, pcg32_random_t* rng) {
     if (length >= sizeof(uint32_t)) {
@@ -31,6 +37,8 @@ struct bench_data {
     uint8_t ad[MAX_TEST_SIZE];
     uint8_t key[RFC_8439_KEY_SIZE];
     uint8_t nonce[RFC_8439_NONCE_SIZE];
+    uint8_t xnonce[XCHACHA20_POLY1305_NONCE_SIZE];
+    chacha20_key expanded_key;
     uint8_t cipher[MAX_TEST_SIZE + RFC_8439_TAG_SIZE];
 };
 
@@ -84,11 +92,26 @@ static double median_double_array(const double *array, size_t len) {
 
 BENCH(chacha, "chacha20", chacha20_xor_stream(bd->cipher, bd->plain, test_size, bd->key, bd->nonce, r))
 
+static void poly1305_auth(uint8_t mac[16], const uint8_t *m, size_t bytes, const uint8_t key[32]) {
+    poly1305_context ctx;
+    poly1305_init(&ctx, key);
+    poly1305_update(&ctx, m, bytes);
+    poly1305_finish(&ctx, mac);
+}
+
 BENCH(poly, "poly1305", poly1305_auth(bd->cipher, bd->plain, test_size, bd->key))
 
 #define MIN(a,b) ((a) > (b) ? (b) : (a))
 BENCH(chacha_poly, "chacha20-poly1305", portable_chacha20_poly1305_encrypt(bd->cipher, bd->key, bd->nonce, bd->ad, MIN(test_size, 512), bd->plain, test_size))
 
+BENCH(xchacha_poly, "xchacha20-poly1305", portable_xchacha20_poly1305_encrypt(bd->cipher, bd->key, bd->xnonce, bd->ad, MIN(test_size, 512), bd->plain, test_size))
+
+BENCH(chacha20_key, "chacha20", chacha20_xor_stream_key(bd->cipher, bd->plain, test_size, &bd->expanded_key, bd->nonce, r))
+BENCH(chacha12_key, "chacha12", chacha12_xor_stream_key(bd->cipher, bd->plain, test_size, &bd->expanded_key, bd->nonce, r))
+BENCH(chacha8_key, "chacha8", chacha8_xor_stream_key(bd->cipher, bd->plain, test_size, &bd->expanded_key, bd->nonce, r))
+BENCH(chacha12_poly, "chacha12-poly1305", portable_chacha12_poly1305_encrypt(bd->cipher, bd->key, bd->nonce, bd->ad, MIN(test_size, 512), bd->plain, test_size))
+BENCH(chacha8_poly, "chacha8-poly1305", portable_chacha8_poly1305_encrypt(bd->cipher, bd->key, bd->nonce, bd->ad, MIN(test_size, 512), bd->plain, test_size))
+
 static const size_t test_sizes[] = {
     32, 63, 64, 511, 512, 1024, 8*1024, 32*1024, 64*1024, 128*1024, 512*1024, 1024*1024, MAX_TEST_SIZE
 };
@@ -121,6 +144,16 @@ static void bench_poly(struct bench_data *bd) {
     report_speeds(speeds);
 }
 
+static void bench_poly_backends(struct bench_data *bd) {
+    const poly1305_backend *default_backend = poly1305_backend_selected();
+    for (size_t b = 0; b < poly1305_backend_count(); b++) {
+        poly1305_backend_select(poly1305_backend_at(b));
+        printf("Using poly1305 backend %s\n", poly1305_backend_selected()->name);
+        bench_poly(bd);
+    }
+    poly1305_backend_select(default_backend);
+}
+
 static void bench_chacha_poly(struct bench_data *bd) {
     double speeds[TEST_SIZES_LENGTH];
     printf("Running chacha20-poly1305 benchmarks\n");
@@ -130,22 +163,404 @@ static void bench_chacha_poly(struct bench_data *bd) {
     report_speeds(speeds);
 }
 
+// the speedup of the reduced round variants over the 20 rounds, both for the
+// cipher on its own and for the AEAD (where poly1305 doesn't get faster)
+static void bench_reduced_rounds(struct bench_data *bd) {
+    static const size_t sizes[] = { 64, 1024, 64*1024, 1024*1024 };
+    printf("Running reduced round benchmarks\n");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        double chacha20 = bench__chacha20_key(bd, sizes[i]);
+        double chacha12 = bench__chacha12_key(bd, sizes[i]);
+        double chacha8 = bench__chacha8_key(bd, sizes[i]);
+        double aead20 = bench__chacha_poly(bd, sizes[i]);
+        double aead12 = bench__chacha12_poly(bd, sizes[i]);
+        double aead8 = bench__chacha8_poly(bd, sizes[i]);
+        printf("%zu: chacha12 %.2fx, chacha8 %.2fx, chacha12-poly1305 %.2fx, chacha8-poly1305 %.2fx\n", sizes[i], 
+            chacha12 / chacha20, chacha8 / chacha20, aead12 / aead20, aead8 / aead20);
+    }
+}
+
+// the subkey derivation is a fixed cost per message, so only the small 
+// messages show it
+static void bench_xchacha_poly(struct bench_data *bd) {
+    static const size_t sizes[] = { 32, 64, 512, 1024, 8*1024, 64*1024 };
+    printf("Running xchacha20-poly1305 benchmarks\n");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        double plain = bench__chacha_poly(bd, sizes[i]);
+        double extended = bench__xchacha_poly(bd, sizes[i]);
+        printf("xchacha20-poly1305 %zu: %+.1f%% (%.0f ns per message)\n", sizes[i], (extended - plain) / plain * 100,
+            (sizes[i] / (extended * 1024 * 1024) - sizes[i] / (plain * 1024 * 1024)) * 1e9);
+    }
+
+    chacha20_key key, subkey;
+    chacha20_key_init(&key, bd->key);
+    uint32_t runs = 1 << 20;
+    clock_t tick = clock();
+    for (uint32_t r = 0; r < runs; r++) {
+        bd->xnonce[0] = (uint8_t)r;
+        hchacha20(&subkey, &key, bd->xnonce);
+        // feed the subkey back, so the calls can't be dropped or overlapped
+        key.words[0] ^= subkey.words[0];
+    }
+    double took = (double)(clock() - tick) / CLOCKS_PER_SEC;
+    printf("hchacha20: %.0f ns per subkey\n", took / runs * 1e9);
+}
+
+// ns per packet of the header protection mask: through the generic xor 
+// path, the dedicated mask function, and batches of 64 packets
+#define HP_PACKETS (64)
+#define HP_ROUNDS (1 << 15)
+static void bench_quic_hp(struct bench_data *bd) {
+    printf("Running quic header protection benchmarks\n");
+    portable_8439_key key;
+    portable_chacha20_poly1305_key_init(&key, bd->key);
+    const uint8_t *samples[HP_PACKETS];
+    for (size_t p = 0; p < HP_PACKETS; p++) {
+        samples[p] = bd->plain + p * 1200;
+    }
+    uint8_t masks[HP_PACKETS * PORTABLE_QUIC_HP_MASK_SIZE];
+    const uint8_t zeroes[PORTABLE_QUIC_HP_MASK_SIZE] = { 0 };
+    uint32_t sink = 0;
+    for (int method = 0; method < 3; method++) {
+        clock_t tick = clock();
+        for (uint32_t r = 0; r < HP_ROUNDS; r++) {
+            if (method == 0) {
+                for (size_t p = 0; p < HP_PACKETS; p++) {
+                    uint32_t counter;
+                    memcpy(&counter, samples[p], sizeof(counter));
+                    chacha20_xor_stream_key(masks + p * PORTABLE_QUIC_HP_MASK_SIZE, zeroes, PORTABLE_QUIC_HP_MASK_SIZE, &bd->expanded_key, samples[p] + 4, counter);
+                }
+            }
+            else if (method == 1) {
+                for (size_t p = 0; p < HP_PACKETS; p++) {
+                    portable_chacha20_quic_hp_mask(masks + p * PORTABLE_QUIC_HP_MASK_SIZE, &key, samples[p]);
+                }
+            }
+            else {
+                portable_chacha20_quic_hp_mask_batch(masks, &key, samples, HP_PACKETS);
+            }
+            sink += masks[r % sizeof(masks)];
+        }
+        double took = (double)(clock() - tick) / CLOCKS_PER_SEC;
+        static const char *names[] = { "xor stream", "mask", "mask batch" };
+        printf("quic hp %s: %.1f ns per packet\n", names[method], took / ((double)HP_ROUNDS * HP_PACKETS) * 1e9);
+    }
+    portable_chacha20_poly1305_key_wipe(&key);
+    if (sink == 42) {
+        printf("\n");
+    }
+}
+
+#define TLS_FLIGHT (16)
+#define TLS_FLIGHTS (1 << 14)
+
+// a flight of records sealed one by one (nonce & header by hand) and in one call
+static void bench_tls_records(struct bench_data *bd) {
+    printf("Running tls 1.3 record benchmarks\n");
+    portable_8439_key key;
+    portable_chacha20_poly1305_key_init(&key, bd->key);
+    static const size_t sizes[] = { 64, 256, 1400 };
+    uint32_t sink = 0;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t size = sizes[s];
+        size_t stride = size + PORTABLE_TLS_RECORD_OVERHEAD;
+        portable_8439_tls_record records[TLS_FLIGHT];
+        for (size_t r = 0; r < TLS_FLIGHT; r++) {
+            records[r] = (portable_8439_tls_record){ .input = bd->plain + r * size, .input_size = size, .output = bd->cipher + r * stride };
+        }
+        for (int method = 0; method < 2; method++) {
+            uint64_t sequence = 0;
+            clock_t tick = clock();
+            for (uint32_t f = 0; f < TLS_FLIGHTS; f++) {
+                if (method == 0) {
+                    for (size_t r = 0; r < TLS_FLIGHT; r++, sequence++) {
+                        uint8_t nonce[RFC_8439_NONCE_SIZE];
+                        memcpy(nonce, bd->nonce, sizeof(nonce));
+                        for (int b = 0; b < 8; b++) {
+                            nonce[11 - b] ^= (uint8_t)(sequence >> (8 * b));
+                        }
+                        uint8_t *header = bd->cipher + r * stride;
+                        header[0] = 23;
+                        header[1] = header[2] = 3;
+                        header[3] = (uint8_t)((size + RFC_8439_TAG_SIZE) >> 8);
+                        header[4] = (uint8_t)(size + RFC_8439_TAG_SIZE);
+                        portable_chacha20_poly1305_encrypt_key(header + PORTABLE_TLS_HEADER_SIZE, &key, nonce, header, PORTABLE_TLS_HEADER_SIZE, bd->plain + r * size, size);
+                    }
+                }
+                else {
+                    portable_chacha20_poly1305_tls_seal(records, TLS_FLIGHT, &key, bd->nonce, sequence);
+                    sequence += TLS_FLIGHT;
+                }
+                sink += bd->cipher[f % stride];
+            }
+            double took = (double)(clock() - tick) / CLOCKS_PER_SEC;
+            static const char *names[] = { "one by one", "flight" };
+            printf("tls records of %zu bytes, %s: %.1f ns per record\n", size, names[method], took / ((double)TLS_FLIGHTS * TLS_FLIGHT) * 1e9);
+        }
+    }
+    portable_chacha20_poly1305_key_wipe(&key);
+    if (sink == 42) {
+        printf("\n");
+    }
+}
+
+#define BULK_ROUNDS (64)
+#define BULK_SIZE (2 << 20)
+
+// a cache-sensitive workload next to the encryption of a big buffer: a 
+// random walk over a working set (one step per cache line) after every 
+// encryption, so it finds what the encryption left of it in the caches
+static uint32_t walk(const uint32_t *lines, size_t steps) {
+    uint32_t at = 0;
+    for (size_t i = 0; i < steps; i++) {
+        at = lines[at * 16];
+    }
+    return at;
+}
+
+// a random cycle through all the cache lines of the working set
+static uint32_t *make_walk(size_t working_set, pcg32_random_t *rng) {
+    size_t steps = working_set / 64;
+    uint32_t *lines = malloc(working_set);
+    uint32_t *order = malloc(steps * sizeof(uint32_t));
+    for (size_t i = 0; i < steps; i++) {
+        order[i] = (uint32_t)i;
+    }
+    for (size_t i = steps - 1; i > 0; i--) {
+        size_t j = pcg32_random_r(rng) % (i + 1);
+        uint32_t swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+    for (size_t i = 0; i < steps; i++) {
+        lines[order[i] * 16] = order[(i + 1) % steps];
+    }
+    free(order);
+    return lines;
+}
+
+static const size_t bulk_working_sets[] = { 1 << 20, 4 << 20 };
+
+static void bench_bulk(struct bench_data *bd, pcg32_random_t *rng) {
+    printf("Running bulk (non-temporal) benchmarks\n");
+    portable_8439_key key;
+    portable_chacha20_poly1305_key_init(&key, bd->key);
+    uint32_t sink = 0;
+    for (size_t w = 0; w < sizeof(bulk_working_sets) / sizeof(bulk_working_sets[0]); w++) {
+        size_t steps = bulk_working_sets[w] / 64;
+        uint32_t *lines = make_walk(bulk_working_sets[w], rng);
+        for (int method = 0; method < 3; method++) {
+            double encrypting = 0, walking = 0;
+            for (uint32_t r = 0; r < BULK_ROUNDS; r++) {
+                double start = (double)clock();
+                if (method == 1) {
+                    portable_chacha20_poly1305_encrypt_key(bd->cipher, &key, bd->nonce, NULL, 0, bd->plain, BULK_SIZE);
+                }
+                else if (method == 2) {
+                    portable_chacha20_poly1305_encrypt_key_bulk(bd->cipher, &key, bd->nonce, NULL, 0, bd->plain, BULK_SIZE);
+                }
+                double middle = (double)clock();
+                sink += walk(lines, steps);
+                encrypting += middle - start;
+                walking += (double)clock() - middle;
+            }
+            static const char *names[] = { "alone", "next to encrypt_key", "next to encrypt_key_bulk" };
+            printf("walk of %zu KiB %s: %.1f ns per step", bulk_working_sets[w] / 1024, names[method], walking / CLOCKS_PER_SEC / ((double)BULK_ROUNDS * steps) * 1e9);
+            if (method > 0) {
+                printf(", encrypt %.1f MiB/s", (double)BULK_ROUNDS * BULK_SIZE / (encrypting / CLOCKS_PER_SEC) / (1024 * 1024));
+            }
+            printf("\n");
+        }
+        free(lines);
+    }
+    portable_chacha20_poly1305_key_wipe(&key);
+    if (sink == 42) {
+        printf("\n");
+    }
+}
+
+#ifdef __linux__
+#define CORUN_SECONDS (1.0)
+
+static double cpu_seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+static double wall_seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+// the same walk, but in a second process that runs at the same time as the
+// encryption (on another core, or interleaved on a single one), until the
+// encryption is done. The walker's cost per step is in its own cpu time, so
+// time slicing doesn't count against it
+static void bench_bulk_corunner(struct bench_data *bd, pcg32_random_t *rng) {
+    printf("Running bulk (non-temporal) benchmarks next to a co-running walk\n");
+    // stop flag and the walker's result, shared with the child
+    volatile double *shared = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        printf("no shared memory, skipped\n");
+        return;
+    }
+    portable_8439_key key;
+    portable_chacha20_poly1305_key_init(&key, bd->key);
+    for (size_t w = 0; w < sizeof(bulk_working_sets) / sizeof(bulk_working_sets[0]); w++) {
+        uint32_t *lines = make_walk(bulk_working_sets[w], rng);
+        for (int method = 0; method < 3; method++) {
+            shared[0] = 0;
+            fflush(stdout);
+            pid_t walker = fork();
+            if (walker == 0) {
+                uint32_t at = 0;
+                uint64_t steps = 0;
+                double start = cpu_seconds();
+                while (shared[0] == 0) {
+                    for (int i = 0; i < 4096; i++) {
+                        at = lines[at * 16];
+                    }
+                    steps += 4096;
+                }
+                shared[1] = (cpu_seconds() - start) / (double)steps * 1e9 + (at == 42 ? 1e-12 : 0);
+                _exit(0);
+            }
+            uint64_t encrypted = 0;
+            double start = wall_seconds(), spent = cpu_seconds();
+            while (wall_seconds() - start < CORUN_SECONDS) {
+                if (method == 1) {
+                    portable_chacha20_poly1305_encrypt_key(bd->cipher, &key, bd->nonce, NULL, 0, bd->plain, BULK_SIZE);
+                    encrypted += BULK_SIZE;
+                }
+                else if (method == 2) {
+                    portable_chacha20_poly1305_encrypt_key_bulk(bd->cipher, &key, bd->nonce, NULL, 0, bd->plain, BULK_SIZE);
+                    encrypted += BULK_SIZE;
+                }
+            }
+            spent = cpu_seconds() - spent;
+            shared[0] = 1;
+            waitpid(walker, NULL, 0);
+            static const char *names[] = { "next to a busy loop", "next to encrypt_key", "next to encrypt_key_bulk" };
+            printf("co-running walk of %zu KiB %s: %.1f ns per step", bulk_working_sets[w] / 1024, names[method], shared[1]);
+            if (method > 0) {
+                printf(", encrypt %.1f MiB/s", (double)encrypted / spent / (1024 * 1024));
+            }
+            printf("\n");
+        }
+        free(lines);
+    }
+    portable_chacha20_poly1305_key_wipe(&key);
+    munmap((void *)shared, 4096);
+}
+#endif
+
+#ifdef PORTABLE_8439_STATS
+// compare with the chacha20-poly1305 numbers of `make bench` for the 
+// overhead of the counters, and with the first run here for the timing hook
+static uint64_t monotonic_nanos(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static void sum_elapsed(portable_8439_operation operation, size_t size, uint64_t elapsed, void *user_data) {
+    (void)operation;
+    (void)size;
+    *(uint64_t *)user_data += elapsed;
+}
+
+static void bench_stats(struct bench_data *bd) {
+    uint64_t elapsed = 0;
+    portable_8439_timing timing = { monotonic_nanos, sum_elapsed, &elapsed };
+    portable_8439_stats_timing(&timing);
+    printf("Counters & timing hook enabled\n");
+    bench_chacha_poly(bd);
+    portable_8439_stats_timing(NULL);
+
+    portable_8439_stats stats;
+    portable_8439_stats_collect(&stats);
+    printf("Encrypted %llu messages, %llu MiB, timing hook measured %.1f s\n", 
+        (unsigned long long)stats.encrypt_calls, (unsigned long long)(stats.encrypt_bytes >> 20), elapsed / 1e9);
+}
+#endif
+
+// BENCH_PAGES=thp puts the bench data on transparent huge pages, 
+// BENCH_PAGES=huge on explicit ones (reserve them in 
+// /proc/sys/vm/nr_hugepages first), to see what the TLB misses cost
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define BENCH_DATA_SIZE ((sizeof(struct bench_data) + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE)
+
+static struct bench_data *alloc_bench_data(void) {
+    const char *pages = getenv("BENCH_PAGES");
+#ifdef __linux__
+    if (pages != NULL && strcmp(pages, "huge") == 0) {
+        void *result = mmap(NULL, BENCH_DATA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (result != MAP_FAILED) {
+            printf("Bench data on explicit huge pages\n");
+            return result;
+        }
+        printf("No explicit huge pages available\n");
+        exit(1);
+    }
+    if (pages != NULL && strcmp(pages, "thp") == 0) {
+        void *result = NULL;
+        if (posix_memalign(&result, HUGE_PAGE_SIZE, BENCH_DATA_SIZE) == 0 && madvise(result, BENCH_DATA_SIZE, MADV_HUGEPAGE) == 0) {
+            printf("Bench data on transparent huge pages\n");
+            return result;
+        }
+        printf("Transparent huge pages not available\n");
+        exit(1);
+    }
+#endif
+    if (pages != NULL) {
+        printf("Unsupported BENCH_PAGES=%s\n", pages);
+        exit(1);
+    }
+    return malloc(sizeof(struct bench_data));
+}
+
+static void free_bench_data(struct bench_data *bd) {
+#ifdef __linux__
+    const char *pages = getenv("BENCH_PAGES");
+    if (pages != NULL && strcmp(pages, "huge") == 0) {
+        munmap(bd, BENCH_DATA_SIZE);
+        return;
+    }
+#endif
+    free(bd);
+}
+
 int main(void) {
     srand(time(NULL)); 
     pcg32_random_t rng;
     rng.state = rand();
     rng.inc = rand() | 1;
 
-    struct bench_data *bd = malloc(sizeof(struct bench_data));
+    struct bench_data *bd = alloc_bench_data();
     fill_crappy_random(bd->plain, MAX_TEST_SIZE, &rng);
     fill_crappy_random(bd->ad, MAX_TEST_SIZE, &rng);
     fill_crappy_random(bd->key, RFC_8439_KEY_SIZE, &rng);
     fill_crappy_random(bd->nonce, RFC_8439_NONCE_SIZE, &rng);
+    fill_crappy_random(bd->xnonce, XCHACHA20_POLY1305_NONCE_SIZE, &rng);
+    chacha20_key_init(&bd->expanded_key, bd->key);
 
     bench_chacha(bd);
-    bench_poly(bd);
+    bench_poly_backends(bd);
     bench_chacha_poly(bd);
+    bench_xchacha_poly(bd);
+    bench_reduced_rounds(bd);
+    bench_quic_hp(bd);
+    bench_tls_records(bd);
+    bench_bulk(bd, &rng);
+#ifdef __linux__
+    bench_bulk_corunner(bd, &rng);
+#endif
+#ifdef PORTABLE_8439_STATS
+    bench_stats(bd);
+#endif
 
-    free(bd);
+    free_bench_data(bd);
     return 0;
 }
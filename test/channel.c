@@ -0,0 +1,205 @@
+#define _GNU_SOURCE
+#include "../src/portable8439-channel.h"
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "pcg_random.h"
+
+#define SLOTS (8)
+#define MESSAGE_SIZE (300)
+#define STREAM (20000)
+// the layout of the segment: 3 cache lines of header, slots of whole lines
+#define HEADER_SIZE (192)
+#define SLOT_STRIDE (384)
+
+static void fill_crappy_random(void* target, size_t length, pcg32_random_t* rng) {
+    uint8_t *p = target;
+    for (size_t i = 0; i < length; i++) {
+        p[i] = (uint8_t)pcg32_random_r(rng);
+    }
+}
+
+#define CHECK(condition, ...) \
+    if (!(condition)) { \
+        printf(__VA_ARGS__); \
+        return 1; \
+    }
+
+static void *map_shared(size_t size) {
+    void *segment = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    return segment == MAP_FAILED ? NULL : segment;
+}
+
+static uint8_t *slot_of(uint8_t *segment, size_t counter) {
+    return segment + HEADER_SIZE + (counter % SLOTS) * SLOT_STRIDE;
+}
+
+static int receive_one(portable_8439_channel *consumer, const uint8_t *expected, size_t expected_size) {
+    const uint8_t *message;
+    size_t size;
+    int result = portable_8439_channel_receive(consumer, &message, &size);
+    int matches = result == 1 && size == expected_size && memcmp(message, expected, size) == 0;
+    portable_8439_channel_release(consumer);
+    return matches;
+}
+
+static int test_single_process(pcg32_random_t *rng) {
+    uint8_t key[RFC_8439_KEY_SIZE], messages[SLOTS + 1][MESSAGE_SIZE + 1];
+    fill_crappy_random(key, sizeof(key), rng);
+    fill_crappy_random(messages, sizeof(messages), rng);
+    size_t segment_size = portable_8439_channel_segment_size(SLOTS, MESSAGE_SIZE);
+    uint8_t *segment = map_shared(segment_size);
+    CHECK(segment != NULL && segment_size == HEADER_SIZE + SLOTS * SLOT_STRIDE, "segment size %zu\n", segment_size)
+
+    portable_8439_channel producer, consumer;
+    CHECK(!portable_8439_channel_attach(&producer, PORTABLE_8439_CHANNEL_PRODUCER, segment, segment_size, key), "attached to an unformatted segment\n")
+    CHECK(!portable_8439_channel_format(segment, segment_size - 1, SLOTS, MESSAGE_SIZE), "formatted a segment that's too small\n")
+    CHECK(portable_8439_channel_format(segment, segment_size, SLOTS, MESSAGE_SIZE), "format failed\n")
+    CHECK(!portable_8439_channel_attach(&producer, PORTABLE_8439_CHANNEL_PRODUCER, segment, segment_size - 1, key), "attached to a cut off segment\n")
+    CHECK(portable_8439_channel_attach(&producer, PORTABLE_8439_CHANNEL_PRODUCER, segment, segment_size, key)
+        && portable_8439_channel_attach(&consumer, PORTABLE_8439_CHANNEL_CONSUMER, segment, segment_size, key), "attach failed\n")
+
+    const uint8_t *message;
+    size_t size;
+    CHECK(portable_8439_channel_receive(&consumer, &message, &size) == 0, "received from an empty channel\n")
+    CHECK(!portable_8439_channel_send(&producer, messages[0], MESSAGE_SIZE + 1), "sent a message that's too large\n")
+    CHECK(!portable_8439_channel_send(&consumer, messages[0], 1), "consumer sent\n")
+
+    // fill it up, with both ways of sending
+    for (size_t i = 0; i < SLOTS; i++) {
+        if (i % 2 == 0) {
+            CHECK(portable_8439_channel_send(&producer, messages[i], i * 37), "send %zu failed\n", i)
+        }
+        else {
+            uint8_t *slot = portable_8439_channel_reserve(&producer);
+            CHECK(slot != NULL, "reserve %zu failed\n", i)
+            memcpy(slot, messages[i], i * 37);
+            CHECK(portable_8439_channel_publish(&producer, i * 37), "publish %zu failed\n", i)
+        }
+    }
+    CHECK(portable_8439_channel_reserve(&producer) == NULL && !portable_8439_channel_send(&producer, messages[SLOTS], 1), "sent to a full channel\n")
+    // sealed at rest
+    CHECK(memmem(segment, segment_size, messages[SLOTS - 1], (SLOTS - 1) * 37) == NULL, "plain text in the segment\n")
+
+    for (size_t i = 0; i < SLOTS; i++) {
+        CHECK(receive_one(&consumer, messages[i], i * 37), "message %zu differs\n", i)
+        CHECK(memmem(segment, segment_size, messages[i], i * 37) == NULL || i == 0, "message %zu not wiped\n", i)
+    }
+    CHECK(portable_8439_channel_send(&producer, messages[SLOTS], MESSAGE_SIZE), "send after draining failed\n")
+    CHECK(receive_one(&consumer, messages[SLOTS], MESSAGE_SIZE), "message after the wrap differs\n")
+
+    // a tampered slot doesn't open, and the channel goes on after it
+    CHECK(portable_8439_channel_send(&producer, messages[1], 100), "send failed\n")
+    slot_of(segment, SLOTS + 1)[sizeof(uint64_t) + 5] ^= 1;
+    CHECK(portable_8439_channel_receive(&consumer, &message, &size) == -1 && message == NULL, "tampered slot opened\n")
+    CHECK(portable_8439_channel_receive(&consumer, &message, &size) == -1, "received while holding a slot\n")
+    portable_8439_channel_release(&consumer);
+    CHECK(portable_8439_channel_send(&producer, messages[2], 100) && receive_one(&consumer, messages[2], 100), "channel stuck after a tampered slot\n")
+
+    // neither does an old sealed slot copied over a newer one
+    static uint8_t sealed[SLOT_STRIDE];
+    CHECK(portable_8439_channel_send(&producer, messages[3], 100), "send failed\n")
+    memcpy(sealed, slot_of(segment, SLOTS + 3), SLOT_STRIDE);
+    CHECK(receive_one(&consumer, messages[3], 100), "message differs\n")
+    CHECK(portable_8439_channel_send(&producer, messages[4], 100), "send failed\n")
+    memcpy(slot_of(segment, SLOTS + 4), sealed, SLOT_STRIDE);
+    CHECK(portable_8439_channel_receive(&consumer, &message, &size) == -1, "replayed slot opened\n")
+    portable_8439_channel_release(&consumer);
+
+    // the consumer opens a private copy: a writer that changes the slot once
+    // its tag was checked doesn't change what the consumer sees
+    CHECK(portable_8439_channel_send(&producer, messages[5], 100), "send failed\n")
+    CHECK(portable_8439_channel_receive(&consumer, &message, &size) == 1 && size == 100, "receive failed\n")
+    CHECK(message + size <= segment || message >= segment + segment_size, "message opened in the segment\n")
+    for (size_t i = 0; i < SLOT_STRIDE; i++) {
+        slot_of(segment, SLOTS + 5)[i] ^= 0xff;
+    }
+    CHECK(memcmp(message, messages[5], 100) == 0, "message changed with the slot\n")
+    portable_8439_channel_release(&consumer);
+
+    portable_8439_channel_wipe(&producer);
+    portable_8439_channel_wipe(&consumer);
+    munmap(segment, segment_size);
+    return 0;
+}
+
+static size_t stream_size(size_t i) {
+    return (i * 7919) % (MESSAGE_SIZE + 1);
+}
+
+static void stream_message(uint8_t *message, size_t i) {
+    for (size_t b = 0; b < stream_size(i); b++) {
+        message[b] = (uint8_t)(i + b);
+    }
+}
+
+// a child process produces a stream of messages, the parent checks them
+static int test_processes(pcg32_random_t *rng) {
+    uint8_t key[RFC_8439_KEY_SIZE];
+    fill_crappy_random(key, sizeof(key), rng);
+    size_t segment_size = portable_8439_channel_segment_size(SLOTS, MESSAGE_SIZE);
+    uint8_t *segment = map_shared(segment_size);
+    CHECK(segment != NULL && portable_8439_channel_format(segment, segment_size, SLOTS, MESSAGE_SIZE), "format failed\n")
+
+    fflush(stdout);
+    pid_t child = fork();
+    CHECK(child >= 0, "fork failed\n")
+    if (child == 0) {
+        portable_8439_channel producer;
+        portable_8439_channel_attach(&producer, PORTABLE_8439_CHANNEL_PRODUCER, segment, segment_size, key);
+        uint8_t message[MESSAGE_SIZE];
+        for (size_t i = 0; i < STREAM; i++) {
+            stream_message(message, i);
+            while (!portable_8439_channel_send(&producer, message, stream_size(i))) {
+                sched_yield();
+            }
+        }
+        portable_8439_channel_wipe(&producer);
+        _exit(0);
+    }
+
+    portable_8439_channel consumer;
+    CHECK(portable_8439_channel_attach(&consumer, PORTABLE_8439_CHANNEL_CONSUMER, segment, segment_size, key), "attach failed\n")
+    uint8_t expected[MESSAGE_SIZE];
+    int failed = 0;
+    for (size_t i = 0; i < STREAM && !failed; i++) {
+        const uint8_t *message;
+        size_t size;
+        int result;
+        while ((result = portable_8439_channel_receive(&consumer, &message, &size)) == 0) {
+            sched_yield();
+        }
+        stream_message(expected, i);
+        if (result != 1 || size != stream_size(i) || memcmp(message, expected, size) != 0) {
+            printf("message %zu of the stream differs\n", i);
+            failed = 1;
+        }
+        portable_8439_channel_release(&consumer);
+    }
+    if (failed) {
+        kill(child, SIGKILL);
+    }
+    int status;
+    waitpid(child, &status, 0);
+    portable_8439_channel_wipe(&consumer);
+    munmap(segment, segment_size);
+    return failed || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+int main(void) {
+    printf("Shared memory channel: ");
+    fflush(stdout);
+    srand(time(NULL));
+    pcg32_random_t rng = { (uint64_t)rand() << 32 | (uint64_t)rand(), 5 };
+    int failed = test_single_process(&rng) || test_processes(&rng);
+    if (!failed) {
+        printf("success\n");
+    }
+    return failed;
+}
@@ -0,0 +1,154 @@
+#include "portable8439-stream.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace portable8439;
+
+static std::mt19937 rng(42);
+
+template <typename C>
+static void fill_random(C &target) {
+    for (auto &b : target) {
+        b = static_cast<std::uint8_t>(rng());
+    }
+}
+
+#define CHECK(condition, message) \
+    if (!(condition)) { \
+        std::printf("failed: %s\n", message); \
+        return 1; \
+    }
+
+// hands out the data in random pieces, and when `threaded` is set, completes
+// every other read on a fresh thread, like an event loop would
+struct memory_source {
+    const std::vector<std::uint8_t> &data;
+    bool threaded;
+    std::size_t offset = 0;
+    unsigned reads = 0;
+
+    struct awaiter {
+        memory_source &source;
+        span<std::uint8_t> target;
+        bool await_ready() noexcept { return !source.threaded || ++source.reads % 2 == 0; }
+        void await_suspend(std::coroutine_handle<> waiting) {
+            std::thread([waiting] { waiting.resume(); }).detach();
+        }
+        std::size_t await_resume() noexcept {
+            std::size_t size = std::min<std::size_t>({ target.size(), source.data.size() - source.offset, 1 + rng() % 3000 });
+            if (size > 0) {
+                std::memcpy(target.data(), source.data.data() + source.offset, size);
+            }
+            source.offset += size;
+            return size;
+        }
+    };
+    awaiter read(span<std::uint8_t> target) noexcept { return { *this, target }; }
+};
+
+struct memory_sink {
+    std::vector<std::uint8_t> data;
+
+    std::suspend_never write(span<const std::uint8_t> bytes) {
+        data.insert(data.end(), bytes.begin(), bytes.end());
+        return {};
+    }
+};
+
+static int test_same_as_one_shot() {
+    std::printf("C++ coroutine seal/open matches the one-shot api: ");
+    key_bytes raw_key;
+    nonce n;
+    std::vector<std::uint8_t> ad(20);
+    for (std::size_t size : { 0, 1, 15, 16, 17, 63, 64, 65, 1000, 4096, 100000 }) {
+        for (std::size_t chunk_size : { 1, 7, 64, 1000 }) {
+            fill_random(raw_key);
+            fill_random(n);
+            fill_random(ad);
+            std::vector<std::uint8_t> plain(size), expected(size + tag_size);
+            fill_random(plain);
+            key k(raw_key);
+            k.seal(expected, n, ad, plain);
+
+            memory_source source{ plain, size % 2 == 0 };
+            memory_sink sealed;
+            CHECK(sync_wait(seal_stream(k, n, ad, source, sealed, chunk_size)) == size + tag_size, "sealed size");
+            CHECK(sealed.data == expected, "seal differs from one-shot");
+
+            memory_source sealed_source{ sealed.data, size % 2 == 1 };
+            memory_sink opened;
+            CHECK(sync_wait(open_stream(k, n, ad, sealed_source, opened, chunk_size)), "open failed");
+            CHECK(opened.data == plain, "roundtrip");
+
+            sealed.data[rng() % sealed.data.size()] ^= 1;
+            memory_source tampered{ sealed.data, false };
+            memory_sink ignored;
+            CHECK(!sync_wait(open_stream(k, n, ad, tampered, ignored, chunk_size)), "tampered stream opened");
+        }
+    }
+    std::printf("success\n");
+    return 0;
+}
+
+static int test_truncated() {
+    std::printf("C++ coroutine open of truncated streams: ");
+    key_bytes raw_key;
+    fill_random(raw_key);
+    key k(raw_key);
+    nonce n{};
+    for (std::size_t size = 0; size < tag_size; size++) {
+        std::vector<std::uint8_t> short_stream(size);
+        memory_source source{ short_stream, false };
+        memory_sink opened;
+        CHECK(!sync_wait(open_stream(k, n, {}, source, opened)), "opened a stream shorter than a tag");
+        CHECK(opened.data.empty(), "released data of a stream shorter than a tag");
+    }
+    // the tag of an empty message that ends in a zero byte: cut that byte
+    // off, and the tag read (padded with zeros) still matches, only the
+    // length check can reject it
+    std::array<std::uint8_t, tag_size> tag{};
+    do {
+        fill_random(n);
+        stream state(k, n, {});
+        state.seal_final(tag);
+    } while (tag[tag_size - 1] != 0);
+    for (std::size_t chunk_size : { 1, 7, 1000 }) {
+        std::vector<std::uint8_t> truncated(tag.begin(), tag.end() - 1);
+        memory_source source{ truncated, chunk_size == 7 };
+        memory_sink opened;
+        CHECK(!sync_wait(open_stream(k, n, {}, source, opened, chunk_size)), "opened a stream that lost the last byte of its tag");
+        CHECK(opened.data.empty(), "released data of a truncated stream");
+    }
+    std::printf("success\n");
+    return 0;
+}
+
+static int test_empty_task() {
+    std::printf("C++ coroutine sync_wait of a moved from task: ");
+    key_bytes raw_key{};
+    key k(raw_key);
+    std::vector<std::uint8_t> plain;
+    memory_source source{ plain, false };
+    memory_sink sealed;
+    auto running = seal_stream(k, nonce{}, {}, source, sealed);
+    auto moved = std::move(running);
+    bool thrown = false;
+    try {
+        sync_wait(std::move(running));
+    }
+    catch (const std::invalid_argument &) {
+        thrown = true;
+    }
+    CHECK(thrown, "no exception for a task without a coroutine");
+    CHECK(sync_wait(std::move(moved)) == tag_size, "the moved to task still runs");
+    std::printf("success\n");
+    return 0;
+}
+
+int main() {
+    return test_same_as_one_shot() | test_truncated() | test_empty_task();
+}
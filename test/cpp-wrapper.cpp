@@ -0,0 +1,116 @@
+#include "portable8439.hpp"
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace portable8439;
+
+static std::mt19937 rng(42);
+
+template <typename C>
+static void fill_random(C &target) {
+    for (auto &b : target) {
+        b = static_cast<std::uint8_t>(rng());
+    }
+}
+
+#define CHECK(condition, message) \
+    if (!(condition)) { \
+        std::printf("failed: %s\n", message); \
+        return 1; \
+    }
+
+static int test_same_as_c() {
+    std::printf("C++ seal/open matches the C api: ");
+    key_bytes raw_key;
+    nonce n;
+    std::vector<std::uint8_t> ad(100), plain(1000), cipher(1000 + tag_size), expected(1000 + tag_size), opened(1000);
+    for (std::size_t size = 0; size < plain.size(); size += 7) {
+        fill_random(raw_key);
+        fill_random(n);
+        fill_random(ad);
+        fill_random(plain);
+        key k(raw_key);
+        auto sealed = k.seal(cipher, n, span<const std::uint8_t>(ad).first(size % 100), span<const std::uint8_t>(plain).first(size));
+        CHECK(sealed && sealed->size() == size + tag_size, "seal size");
+        portable_chacha20_poly1305_encrypt(expected.data(), raw_key.data(), n.data(), ad.data(), size % 100, plain.data(), size);
+        CHECK(std::memcmp(sealed->data(), expected.data(), sealed->size()) == 0, "seal differs from C");
+
+        auto result = k.open(opened, n, span<const std::uint8_t>(ad).first(size % 100), *sealed);
+        CHECK(result && result->size() == size, "open size");
+        CHECK(std::memcmp(result->data(), plain.data(), size) == 0, "roundtrip");
+
+        cipher[size / 2] ^= 1;
+        CHECK(!k.open(opened, n, span<const std::uint8_t>(ad).first(size % 100), *sealed), "tampered message opened");
+    }
+    std::printf("success\n");
+    return 0;
+}
+
+static int test_edges() {
+    std::printf("C++ wrapper edge cases: ");
+    key_bytes raw_key;
+    fill_random(raw_key);
+    nonce n{};
+    std::uint8_t plain[64] = { 0 };
+    std::uint8_t cipher[64 + tag_size];
+
+    key k(raw_key);
+    CHECK(!k.seal(span<std::uint8_t>(cipher).first(64 + tag_size - 1), n, {}, plain), "too small cipher buffer");
+    CHECK(!k.open(plain, n, {}, span<const std::uint8_t>(cipher).first(tag_size - 1)), "cipher shorter than tag");
+    CHECK(!k.open(span<std::uint8_t>(plain).first(10), n, {}, cipher), "too small plain buffer");
+    CHECK(k.seal(cipher, n, {}, plain), "seal");
+
+    key moved(std::move(k));
+    CHECK(moved.open(plain, n, {}, cipher), "moved key opens");
+    CHECK(!k.open(plain, n, {}, cipher), "moved-from key was not wiped");
+
+    message_buffer message(64), sealed(64), opened(64);
+    CHECK(message.resize(64) && !message.resize(64 + tag_size + 1), "resize");
+    std::memset(message.data(), 'a', message.size());
+    CHECK(sealed.seal(moved, n, {}, message) && sealed.size() == 64 + tag_size, "seal buffer");
+    message_buffer taken(std::move(sealed));
+    CHECK(sealed.size() == 0 && taken.size() == 64 + tag_size, "move buffer");
+    CHECK(opened.open(moved, n, {}, taken) && opened.size() == 64, "open buffer");
+    CHECK(std::memcmp(opened.data(), message.data(), 64) == 0, "buffer roundtrip");
+    CHECK(sealed.storage().empty() && !sealed.resize(tag_size), "moved-from buffer storage");
+    CHECK(!sealed.seal(moved, n, {}, message) && !sealed.open(moved, n, {}, taken), "moved-from buffer seal/open");
+    std::printf("success\n");
+    return 0;
+}
+
+template <std::size_t Size, std::size_t AdSize>
+static int check_fixed(const key &k) {
+    std::array<std::uint8_t, Size> plain, opened;
+    std::array<std::uint8_t, AdSize> ad;
+    std::array<std::uint8_t, Size + tag_size> cipher, expected;
+    nonce n;
+    fill_random(plain);
+    fill_random(ad);
+    fill_random(n);
+    CHECK(k.seal(cipher, n, ad, plain), "fixed seal");
+    CHECK(k.seal(span<std::uint8_t>(expected), n, ad, plain), "generic seal");
+    CHECK(cipher == expected, "fixed seal differs from generic");
+    CHECK(k.open(opened, n, ad, cipher) && opened == plain, "fixed open");
+    cipher[0] ^= 1;
+    CHECK(!k.open(opened, n, ad, cipher), "fixed open of tampered message");
+    return 0;
+}
+
+static int test_fixed() {
+    std::printf("C++ fixed size seal/open: ");
+    key_bytes raw_key;
+    fill_random(raw_key);
+    key k(raw_key);
+    static_assert(!fixed_size<100, 7>::available, "no fixed version");
+    int result = check_fixed<32, 0>(k) | check_fixed<48, 0>(k) | check_fixed<128, 0>(k) | check_fixed<100, 7>(k);
+    if (result == 0) {
+        std::printf("success\n");
+    }
+    return result;
+}
+
+int main() {
+    return test_same_as_c() | test_edges() | test_fixed();
+}
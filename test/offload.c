@@ -0,0 +1,270 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../src/portable8439-offload.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pcg_random.h"
+
+#define PRODUCERS (4)
+#define WORKERS (3)
+#define WINDOW (16)
+#define MESSAGES (2000)
+#define MAX_SIZE (8192)
+
+typedef struct producer {
+    portable_8439_offload *offload;
+    portable_8439_key key;
+    uint64_t seed;
+    int failed;
+} producer;
+
+typedef struct slot {
+    portable_8439_job job;
+    uint8_t nonce[RFC_8439_NONCE_SIZE];
+    uint8_t ad[32];
+    uint8_t plain[MAX_SIZE];
+    uint8_t sealed[MAX_SIZE + RFC_8439_TAG_SIZE];
+    uint8_t opened[MAX_SIZE];
+    int tampered;
+} slot;
+
+static void fill_crappy_random(void* target, size_t length, pcg32_random_t* rng) {
+    uint8_t *p = target;
+    for (size_t i = 0; i < length; i++) {
+        p[i] = (uint8_t)pcg32_random_r(rng);
+    }
+}
+
+static void prepare_seal(slot *s, const portable_8439_key *key, pcg32_random_t *rng) {
+    // mostly small jobs (batched), some large ones (taken alone)
+    size_t size = pcg32_random_r(rng) % 4 == 0 ? pcg32_random_r(rng) % MAX_SIZE : pcg32_random_r(rng) % 200;
+    fill_crappy_random(s->nonce, sizeof(s->nonce), rng);
+    fill_crappy_random(s->ad, sizeof(s->ad), rng);
+    fill_crappy_random(s->plain, size, rng);
+    s->job = (portable_8439_job){
+        .operation = PORTABLE_8439_OFFLOAD_SEAL, .key = key, .nonce = s->nonce,
+        .ad = s->ad, .ad_size = size % sizeof(s->ad),
+        .input = s->plain, .input_size = size, .output = s->sealed, .user_data = s
+    };
+}
+
+// checks a finished seal against the inline call, and turns it into an open
+static int check_seal(slot *s, const portable_8439_key *key, pcg32_random_t *rng) {
+    uint8_t expected[MAX_SIZE + RFC_8439_TAG_SIZE];
+    size_t size = s->job.input_size;
+    if (s->job.result != size + RFC_8439_TAG_SIZE
+            || portable_chacha20_poly1305_encrypt_key(expected, key, s->nonce, s->ad, s->job.ad_size, s->plain, size) != s->job.result
+            || memcmp(expected, s->sealed, s->job.result) != 0) {
+        printf("offloaded seal of %zu bytes differs\n", size);
+        return 1;
+    }
+    s->tampered = pcg32_random_r(rng) % 8 == 0;
+    if (s->tampered) {
+        s->sealed[pcg32_random_r(rng) % (size + RFC_8439_TAG_SIZE)] ^= 1;
+    }
+    s->job.operation = PORTABLE_8439_OFFLOAD_OPEN;
+    s->job.input = s->sealed;
+    s->job.input_size = size + RFC_8439_TAG_SIZE;
+    s->job.output = s->opened;
+    return 0;
+}
+
+static int check_open(slot *s) {
+    size_t size = s->job.input_size - RFC_8439_TAG_SIZE;
+    if (s->tampered ? s->job.result != (size_t)-1 : (s->job.result != size || memcmp(s->opened, s->plain, size) != 0)) {
+        printf("offloaded open of %zu bytes (tampered: %d) failed\n", size, s->tampered);
+        return 1;
+    }
+    return 0;
+}
+
+// the ring can look full for a moment while a worker is taking a job out of it
+static void submit(producer *self, portable_8439_job *job, portable_8439_completion_queue *queue) {
+    while (!portable_8439_offload_submit(self->offload, job, queue)) {
+        sched_yield();
+    }
+}
+
+static void *producer_main(void *arg) {
+    producer *self = arg;
+    pcg32_random_t rng = { self->seed, 7 };
+    slot *slots = calloc(WINDOW, sizeof(slot));
+    portable_8439_completion_queue *queue = portable_8439_completion_queue_create(WINDOW);
+    if (slots == NULL || queue == NULL) {
+        printf("allocation failed\n");
+        self->failed = 1;
+        return NULL;
+    }
+    size_t started = 0, finished = 0, in_flight = 0;
+    for (size_t i = 0; i < WINDOW && started < MESSAGES; i++, started++) {
+        prepare_seal(&slots[i], &self->key, &rng);
+        submit(self, &slots[i].job, queue);
+        in_flight++;
+    }
+    // the window is full, so the completion queue should refuse more
+    portable_8439_job extra = { .operation = PORTABLE_8439_OFFLOAD_SEAL };
+    if (in_flight == WINDOW && portable_8439_offload_submit(self->offload, &extra, queue)) {
+        printf("submit accepted more jobs than the completion queue holds\n");
+        self->failed = 1;
+    }
+    // after a failure, only wait for the jobs that are still running
+    while (in_flight > 0) {
+        portable_8439_job *done[WINDOW];
+        size_t count = portable_8439_completion_queue_wait(queue, done, WINDOW);
+        for (size_t i = 0; i < count; i++) {
+            slot *s = done[i]->user_data;
+            in_flight--;
+            if (self->failed) {
+                continue;
+            }
+            if (s->job.operation == PORTABLE_8439_OFFLOAD_SEAL) {
+                self->failed |= check_seal(s, &self->key, &rng);
+            }
+            else {
+                self->failed |= check_open(s);
+                finished++;
+                if (started == MESSAGES) {
+                    continue;
+                }
+                prepare_seal(s, &self->key, &rng);
+                started++;
+            }
+            submit(self, &s->job, queue);
+            in_flight++;
+        }
+    }
+    if (!self->failed && finished != MESSAGES) {
+        printf("only %zu of %d messages finished\n", finished, MESSAGES);
+        self->failed = 1;
+    }
+    portable_8439_completion_queue_destroy(queue);
+    free(slots);
+    return NULL;
+}
+
+#define BATCH_RECORDS (40)
+
+// a batch of mostly small records and a few that get split, with tampered
+// ones, one that is too short, and a split one that overlaps its output
+static int test_open_batch(portable_8439_offload *offload, uint64_t seed) {
+    pcg32_random_t rng = { seed, 11 };
+    portable_8439_key key;
+    uint8_t raw_key[RFC_8439_KEY_SIZE];
+    fill_crappy_random(raw_key, sizeof(raw_key), &rng);
+    portable_chacha20_poly1305_key_init(&key, raw_key);
+
+    portable_8439_record records[BATCH_RECORDS];
+    uint8_t *plains[BATCH_RECORDS];
+    uint8_t nonces[BATCH_RECORDS][RFC_8439_NONCE_SIZE];
+    uint8_t ad[32];
+    int expected[BATCH_RECORDS];
+    fill_crappy_random(ad, sizeof(ad), &rng);
+    int failed = 0;
+    for (size_t r = 0; r < BATCH_RECORDS; r++) {
+        size_t size = r % 10 == 3 ? 300 * 1024 + pcg32_random_r(&rng) % (1024 * 1024) : pcg32_random_r(&rng) % 2000;
+        plains[r] = malloc(size + 1);
+        uint8_t *sealed = malloc(size + RFC_8439_TAG_SIZE);
+        // overlapping records decrypt in place
+        uint8_t *output = r == 13 ? sealed : malloc(size + 1);
+        if (plains[r] == NULL || sealed == NULL || output == NULL) {
+            printf("allocation failed\n");
+            return 1;
+        }
+        fill_crappy_random(nonces[r], RFC_8439_NONCE_SIZE, &rng);
+        fill_crappy_random(plains[r], size, &rng);
+        portable_chacha20_poly1305_encrypt_key(sealed, &key, nonces[r], ad, r % sizeof(ad), plains[r], size);
+        expected[r] = 1;
+        if (r % 7 == 5) {
+            sealed[pcg32_random_r(&rng) % (size + RFC_8439_TAG_SIZE)] ^= 1;
+            expected[r] = 0;
+        }
+        records[r] = (portable_8439_record){
+            .key = &key, .nonce = nonces[r], .ad = ad, .ad_size = r % sizeof(ad),
+            .cipher_text = sealed, .cipher_text_size = size + RFC_8439_TAG_SIZE, .plain_text = output
+        };
+    }
+    records[13].cipher_text_size = 300 * 1024 + RFC_8439_TAG_SIZE;
+    expected[13] = 0;
+    records[17].cipher_text_size = RFC_8439_TAG_SIZE - 1;
+    expected[17] = 0;
+
+    uint8_t verdicts[(BATCH_RECORDS + 7) / 8];
+    memset(verdicts, 0xFF, sizeof(verdicts));
+    size_t opened = portable_8439_offload_open_batch(offload, records, BATCH_RECORDS, verdicts);
+    size_t expected_opened = 0;
+    for (size_t r = 0; r < BATCH_RECORDS; r++) {
+        int verdict = (verdicts[r / 8] >> (r % 8)) & 1;
+        expected_opened += expected[r];
+        if (verdict != expected[r]) {
+            printf("batch record %zu of %zu bytes: verdict %d\n", r, records[r].cipher_text_size, verdict);
+            failed = 1;
+        }
+        else if (verdict && memcmp(records[r].plain_text, plains[r], records[r].cipher_text_size - RFC_8439_TAG_SIZE) != 0) {
+            printf("batch record %zu of %zu bytes opened wrong\n", r, records[r].cipher_text_size);
+            failed = 1;
+        }
+        else if (!verdict && r != 13 && records[r].cipher_text_size > 256 * 1024) {
+            // failed split records shouldn't leave plain text behind
+            for (size_t i = 0; i < records[r].cipher_text_size - RFC_8439_TAG_SIZE; i++) {
+                if (records[r].plain_text[i] != 0) {
+                    printf("failed batch record %zu left plain text\n", r);
+                    failed = 1;
+                    break;
+                }
+            }
+        }
+    }
+    if (opened != expected_opened) {
+        printf("batch opened %zu records instead of %zu\n", opened, expected_opened);
+        failed = 1;
+    }
+    for (size_t r = 0; r < BATCH_RECORDS; r++) {
+        if (records[r].plain_text != records[r].cipher_text) {
+            free(records[r].plain_text);
+        }
+        free((uint8_t *)records[r].cipher_text);
+        free(plains[r]);
+    }
+    portable_chacha20_poly1305_key_wipe(&key);
+    return failed;
+}
+
+int main(void) {
+    printf("Offload service with %d producers & %d workers: ", PRODUCERS, WORKERS);
+    fflush(stdout);
+    srand(time(NULL));
+    portable_8439_offload *offload = portable_8439_offload_create(WORKERS, 64);
+    if (offload == NULL) {
+        printf("failed to start\n");
+        return 1;
+    }
+    producer producers[PRODUCERS];
+    pthread_t threads[PRODUCERS];
+    for (int i = 0; i < PRODUCERS; i++) {
+        uint8_t raw_key[RFC_8439_KEY_SIZE];
+        for (size_t b = 0; b < sizeof(raw_key); b++) {
+            raw_key[b] = (uint8_t)rand();
+        }
+        producers[i].offload = offload;
+        portable_chacha20_poly1305_key_init(&producers[i].key, raw_key);
+        producers[i].seed = (uint64_t)rand() << 32 | (uint64_t)rand();
+        producers[i].failed = 0;
+        pthread_create(&threads[i], NULL, producer_main, &producers[i]);
+    }
+    int failed = 0;
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+        failed |= producers[i].failed;
+    }
+    uint64_t seed = (uint64_t)rand() << 32 | (uint64_t)rand();
+    failed |= test_open_batch(offload, seed);
+    failed |= test_open_batch(NULL, seed);
+    portable_8439_offload_destroy(offload);
+    if (!failed) {
+        printf("success\n");
+    }
+    return failed;
+}
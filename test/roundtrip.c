@@ -1,11 +1,15 @@
 #include "../src/portable8439.h"
 #include "../src/chacha-portable/chacha-portable.h"
+#include "../src/poly1305-donna/poly1305-donna.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
 #include <time.h>
 #include <stdlib.h>
 #include "pcg_random.h"
+#ifdef PORTABLE_8439_STATS
+#include <pthread.h>
+#endif
 
 static void fill_crappy_random(void* target, size_t length, pcg32_random_t* rng) {
     if (length >= sizeof(uint32_t)) {
@@ -25,19 +29,23 @@ static void fill_crappy_random(void* target, size_t length, pcg32_random_t* rng)
 #define MAX_TEST_SIZE (4096)
 int test8439(pcg32_random_t* rng) {
     printf("Round trip chacha20-poly1305 sizes 0..4096: ");
-    uint8_t plain[MAX_TEST_SIZE] = { 0};
+    // room to shift the buffers, so we hit every alignment of the pointers
+    uint8_t plain_buffer[MAX_TEST_SIZE + 3] = { 0};
     uint8_t ad[MAX_TEST_SIZE] = { 0 };
-    uint8_t buffer[MAX_TEST_SIZE + RFC_8439_TAG_SIZE] = { 0 };
-    uint8_t buffer2[MAX_TEST_SIZE] = { 0 };
+    uint8_t cipher_buffer[MAX_TEST_SIZE + RFC_8439_TAG_SIZE + 3] = { 0 };
+    uint8_t decrypt_buffer[MAX_TEST_SIZE + 3] = { 0 };
     uint8_t key[RFC_8439_KEY_SIZE] = { 0 };
     uint8_t nonce[RFC_8439_NONCE_SIZE] = { 0 };
 
-    fill_crappy_random(plain, MAX_TEST_SIZE, rng);
+    fill_crappy_random(plain_buffer, sizeof(plain_buffer), rng);
     fill_crappy_random(ad, MAX_TEST_SIZE, rng);
 
     for (int i = 0; i < MAX_TEST_SIZE; i++) {
         fill_crappy_random(key, RFC_8439_KEY_SIZE, rng);
         fill_crappy_random(nonce, RFC_8439_NONCE_SIZE, rng);
+        uint8_t *plain = plain_buffer + (i % 4);
+        uint8_t *buffer = cipher_buffer + ((i / 4) % 4);
+        uint8_t *buffer2 = decrypt_buffer + ((i / 16) % 4);
 
         size_t cipher_size = portable_chacha20_poly1305_encrypt(buffer, key, nonce, ad, i, plain, i);
         if (portable_chacha20_poly1305_decrypt(buffer2, key, nonce, ad, i, buffer, cipher_size) == -1ul) {
@@ -53,10 +61,561 @@ int test8439(pcg32_random_t* rng) {
     return 0;
 }
 
+#define MAX_CHACHA_TEST_BLOCKS (40)
+int test_chacha_blocks(pcg32_random_t* rng) {
+    printf("Compare chacha20 bulk and single block sizes 0..%d: ", MAX_CHACHA_TEST_BLOCKS * 64);
+    uint8_t plain[MAX_CHACHA_TEST_BLOCKS * 64];
+    uint8_t bulk[MAX_CHACHA_TEST_BLOCKS * 64];
+    uint8_t single[MAX_CHACHA_TEST_BLOCKS * 64];
+    uint8_t key[CHACHA20_KEY_SIZE];
+    uint8_t nonce[CHACHA20_NONCE_SIZE];
+
+    for (size_t i = 0; i <= sizeof(plain); i++) {
+        fill_crappy_random(plain, i, rng);
+        fill_crappy_random(key, sizeof(key), rng);
+        fill_crappy_random(nonce, sizeof(nonce), rng);
+        uint32_t counter = pcg32_random_r(rng);
+
+        chacha20_xor_stream(bulk, plain, i, key, nonce, counter);
+        // a single block never takes the wide or interleaved paths
+        for (size_t b = 0; b < i; b += 64) {
+            size_t block = i - b < 64 ? i - b : 64;
+            chacha20_xor_stream(single + b, plain + b, block, key, nonce, counter + (uint32_t)(b / 64));
+        }
+        if (memcmp(bulk, single, i) != 0) {
+            printf("Incorrect key stream at %zu bytes\n", i);
+            return 1;
+        }
+    }
+    printf("success\n");
+    return 0;
+}
+
+static void poly1305_split_mac(uint8_t mac[16], const poly1305_backend *backend, const uint8_t key[32], const uint8_t *msg, size_t size, size_t split) {
+    poly1305_context ctx;
+#ifndef PORTABLE_8439_SMALL
+    ctx.backend = backend;
+#endif
+    backend->init(&ctx, key);
+    backend->update(&ctx, msg, split);
+    backend->update(&ctx, msg + split, size - split);
+    backend->finish(&ctx, mac);
+}
+
+#define MAX_POLY_TEST_SIZE (2048)
+int test_poly_backends(pcg32_random_t* rng) {
+    printf("Compare poly1305 backends sizes 0..2048: ");
+    uint8_t msg[MAX_POLY_TEST_SIZE];
+    uint8_t key[32];
+    uint8_t expected[16];
+    uint8_t actual[16];
+    const poly1305_backend *reference = poly1305_backend_find("donna-8");
+    if (reference == NULL) {
+        // PORTABLE_8439_SMALL only has the default backend
+        printf("skipped, only %s\n", poly1305_backend_selected()->name);
+        return 0;
+    }
+
+    for (int i = 0; i < MAX_POLY_TEST_SIZE; i++) {
+        if (i % 2 == 0) {
+            fill_crappy_random(key, sizeof(key), rng);
+            fill_crappy_random(msg, i, rng);
+        }
+        else {
+            // worst case for the carries
+            memset(key, 0xFF, sizeof(key));
+            memset(msg, 0xFF, i);
+        }
+        poly1305_split_mac(expected, reference, key, msg, i, 0);
+        for (size_t b = 0; b < poly1305_backend_count(); b++) {
+            const poly1305_backend *backend = poly1305_backend_at(b);
+            size_t split = i == 0 ? 0 : pcg32_random_r(rng) % i;
+            poly1305_split_mac(actual, backend, key, msg, i, split);
+            if (memcmp(expected, actual, sizeof(actual)) != 0) {
+                printf("%s differs at %d bytes (split at %zu)\n", backend->name, i, split);
+                return 1;
+            }
+        }
+    }
+    printf("success\n");
+    return 0;
+}
+
+#define FIXED_TEST(size, ad_size) \
+    { \
+        uint8_t cipher[size + RFC_8439_TAG_SIZE], expected[size + RFC_8439_TAG_SIZE], opened[size]; \
+        if (portable_chacha20_poly1305_encrypt_##size##_##ad_size(cipher, &key, nonce, ad, plain) != sizeof(cipher) \
+                || portable_chacha20_poly1305_encrypt_key(expected, &key, nonce, ad, ad_size, plain, size) != sizeof(cipher) \
+                || memcmp(cipher, expected, sizeof(cipher)) != 0) { \
+            printf("encrypt_%d_%d differs\n", size, ad_size); \
+            return 1; \
+        } \
+        if (portable_chacha20_poly1305_decrypt_##size##_##ad_size(opened, &key, nonce, ad, cipher) != size \
+                || memcmp(opened, plain, size) != 0) { \
+            printf("decrypt_%d_%d failed\n", size, ad_size); \
+            return 1; \
+        } \
+        cipher[size] ^= 1; \
+        if (portable_chacha20_poly1305_decrypt_##size##_##ad_size(opened, &key, nonce, ad, cipher) != (size_t)-1) { \
+            printf("decrypt_%d_%d accepted a bad tag\n", size, ad_size); \
+            return 1; \
+        } \
+    }
+
+int test_fixed_sizes(pcg32_random_t* rng) {
+    printf("Fixed size variants: ");
+    uint8_t plain[1024], ad[1024];
+    uint8_t raw_key[RFC_8439_KEY_SIZE], nonce[RFC_8439_NONCE_SIZE];
+    for (int i = 0; i < 100; i++) {
+        fill_crappy_random(plain, sizeof(plain), rng);
+        fill_crappy_random(ad, sizeof(ad), rng);
+        fill_crappy_random(raw_key, sizeof(raw_key), rng);
+        fill_crappy_random(nonce, sizeof(nonce), rng);
+        portable_8439_key key;
+        portable_chacha20_poly1305_key_init(&key, raw_key);
+        PORTABLE_8439_FIXED_SIZES(FIXED_TEST)
+        portable_chacha20_poly1305_key_wipe(&key);
+    }
+    printf("success\n");
+    return 0;
+}
+
+#define STREAM_MAX (4096)
+
+int test_stream(pcg32_random_t* rng) {
+    printf("Incremental seal/open: ");
+    static uint8_t plain[STREAM_MAX], ad[64], expected[STREAM_MAX + RFC_8439_TAG_SIZE], cipher[STREAM_MAX], opened[STREAM_MAX];
+    uint8_t raw_key[RFC_8439_KEY_SIZE], nonce[RFC_8439_NONCE_SIZE], tag[RFC_8439_TAG_SIZE];
+    for (int i = 0; i < 1000; i++) {
+        size_t size = pcg32_random_r(rng) % STREAM_MAX;
+        size_t ad_size = pcg32_random_r(rng) % sizeof(ad);
+        fill_crappy_random(plain, size, rng);
+        fill_crappy_random(ad, ad_size, rng);
+        fill_crappy_random(raw_key, sizeof(raw_key), rng);
+        fill_crappy_random(nonce, sizeof(nonce), rng);
+        portable_8439_key key;
+        portable_chacha20_poly1305_key_init(&key, raw_key);
+        portable_chacha20_poly1305_encrypt_key(expected, &key, nonce, ad, ad_size, plain, size);
+
+        // random chunks, mostly small so they end up in the middle of blocks
+        portable_8439_stream stream;
+        portable_chacha20_poly1305_stream_init(&stream, &key, nonce, ad, ad_size);
+        for (size_t done = 0; done < size;) {
+            size_t chunk = pcg32_random_r(rng) % ((i % 2 == 0) ? 70 : 300);
+            chunk = chunk > size - done ? size - done : chunk;
+            portable_chacha20_poly1305_seal_update(&stream, cipher + done, plain + done, chunk);
+            done += chunk;
+        }
+        portable_chacha20_poly1305_seal_final(&stream, tag);
+        if (memcmp(cipher, expected, size) != 0 || memcmp(tag, expected + size, RFC_8439_TAG_SIZE) != 0) {
+            printf("seal differs from one-shot for %zu bytes\n", size);
+            return 1;
+        }
+
+        portable_chacha20_poly1305_stream_init(&stream, &key, nonce, ad, ad_size);
+        for (size_t done = 0; done < size;) {
+            size_t chunk = pcg32_random_r(rng) % 200;
+            chunk = chunk > size - done ? size - done : chunk;
+            portable_chacha20_poly1305_open_update(&stream, opened + done, cipher + done, chunk);
+            done += chunk;
+        }
+        if (!portable_chacha20_poly1305_open_final(&stream, tag) || memcmp(opened, plain, size) != 0) {
+            printf("open failed for %zu bytes\n", size);
+            return 1;
+        }
+
+        tag[pcg32_random_r(rng) % RFC_8439_TAG_SIZE] ^= 1;
+        portable_chacha20_poly1305_stream_init(&stream, &key, nonce, ad, ad_size);
+        portable_chacha20_poly1305_open_update(&stream, opened, cipher, size);
+        if (portable_chacha20_poly1305_open_final(&stream, tag)) {
+            printf("open accepted a bad tag for %zu bytes\n", size);
+            return 1;
+        }
+        portable_chacha20_poly1305_key_wipe(&key);
+    }
+    printf("success\n");
+    return 0;
+}
+
+#define TLS_FLIGHT (40)
+#define TLS_RECORD_MAX (1500)
+
+// a flight of records against the one-shot api with the nonce & header of RFC 8446 5.2
+int test_tls_records(pcg32_random_t* rng) {
+    printf("TLS 1.3 record flights: ");
+    static uint8_t plain[TLS_FLIGHT][TLS_RECORD_MAX], sealed[TLS_FLIGHT][TLS_RECORD_MAX + PORTABLE_TLS_RECORD_OVERHEAD], 
+        expected[TLS_RECORD_MAX + RFC_8439_TAG_SIZE], opened[TLS_FLIGHT][TLS_RECORD_MAX];
+    uint8_t raw_key[RFC_8439_KEY_SIZE], iv[RFC_8439_NONCE_SIZE];
+    portable_8439_tls_record records[TLS_FLIGHT];
+    for (int i = 0; i < 200; i++) {
+        size_t count = pcg32_random_r(rng) % (TLS_FLIGHT + 1);
+        // small, random, and close to running out of sequence numbers
+        uint64_t sequence = i % 4 == 0 ? pcg32_random_r(rng) % 100 : ((uint64_t)pcg32_random_r(rng) << 32) | pcg32_random_r(rng);
+        sequence = i % 10 == 1 ? UINT64_MAX - pcg32_random_r(rng) % TLS_FLIGHT : sequence;
+        fill_crappy_random(raw_key, sizeof(raw_key), rng);
+        fill_crappy_random(iv, sizeof(iv), rng);
+        portable_8439_key key;
+        portable_chacha20_poly1305_key_init(&key, raw_key);
+        for (size_t r = 0; r < count; r++) {
+            size_t size = pcg32_random_r(rng) % TLS_RECORD_MAX;
+            fill_crappy_random(plain[r], size, rng);
+            records[r] = (portable_8439_tls_record){ .input = plain[r], .input_size = size, .output = sealed[r] };
+        }
+        size_t wrapped = sequence > UINT64_MAX - count ? count - (size_t)(UINT64_MAX - sequence) - 1 : 0;
+        if (portable_chacha20_poly1305_tls_seal(records, count, &key, iv, sequence) != count - wrapped) {
+            printf("seal failed for a flight of %zu\n", count);
+            return 1;
+        }
+        for (size_t r = 0; r < count - wrapped; r++) {
+            uint8_t nonce[RFC_8439_NONCE_SIZE], header[PORTABLE_TLS_HEADER_SIZE];
+            size_t size = records[r].input_size;
+            memcpy(nonce, iv, sizeof(nonce));
+            for (int b = 0; b < 8; b++) {
+                nonce[11 - b] ^= (uint8_t)((sequence + r) >> (8 * b));
+            }
+            header[0] = 23;
+            header[1] = header[2] = 3;
+            header[3] = (uint8_t)((size + RFC_8439_TAG_SIZE) >> 8);
+            header[4] = (uint8_t)(size + RFC_8439_TAG_SIZE);
+            portable_chacha20_poly1305_encrypt_key(expected, &key, nonce, header, sizeof(header), plain[r], size);
+            if (records[r].result != size + PORTABLE_TLS_RECORD_OVERHEAD
+                || memcmp(sealed[r], header, sizeof(header)) != 0
+                || memcmp(sealed[r] + sizeof(header), expected, size + RFC_8439_TAG_SIZE) != 0) {
+                printf("record %zu of %zu bytes differs\n", r, size);
+                return 1;
+            }
+        }
+        count -= wrapped;
+
+        // one corrupted record only fails itself, and so does a wrong length
+        size_t corrupt = count > 0 ? pcg32_random_r(rng) % count : 0;
+        size_t truncate = count > 1 ? (corrupt + 1) % count : count;
+        for (size_t r = 0; r < count; r++) {
+            records[r] = (portable_8439_tls_record){ .input = sealed[r], .input_size = records[r].result, .output = opened[r] };
+        }
+        if (count > 0) {
+            sealed[corrupt][pcg32_random_r(rng) % records[corrupt].input_size] ^= 1;
+        }
+        if (truncate < count) {
+            records[truncate].input_size--;
+        }
+        size_t failed = (count > 0) + (truncate < count);
+        if (portable_chacha20_poly1305_tls_open(records, count, &key, iv, sequence) != count - failed) {
+            printf("open failed for a flight of %zu\n", count);
+            return 1;
+        }
+        for (size_t r = 0; r < count; r++) {
+            size_t size = records[r].input_size - PORTABLE_TLS_RECORD_OVERHEAD;
+            if (r == corrupt || r == truncate) {
+                if (records[r].result != (size_t)-1) {
+                    printf("bad record %zu accepted\n", r);
+                    return 1;
+                }
+            }
+            else if (records[r].result != size || memcmp(opened[r], plain[r], size) != 0) {
+                printf("record %zu of %zu bytes didn't open\n", r, size);
+                return 1;
+            }
+        }
+        portable_chacha20_poly1305_key_wipe(&key);
+    }
+    printf("success\n");
+    return 0;
+}
+
+#define BULK_MAX ((1 << 20) + 70000)
+
+// above the threshold the bulk functions take the non-temporal path, at any
+// alignment of the output it should give the same result as the normal ones
+int test_bulk(pcg32_random_t* rng) {
+    printf("Bulk seal/open: ");
+    uint8_t *plain = malloc(BULK_MAX), *expected = malloc(BULK_MAX + RFC_8439_TAG_SIZE);
+    uint8_t *cipher = malloc(BULK_MAX + RFC_8439_TAG_SIZE + 16), *opened = malloc(BULK_MAX + 16);
+    uint8_t raw_key[RFC_8439_KEY_SIZE], nonce[RFC_8439_NONCE_SIZE], ad[32];
+    fill_crappy_random(plain, BULK_MAX, rng);
+    int failed = 0;
+    for (int i = 0; i < 12 && !failed; i++) {
+        size_t size = i < 2 ? (1 << 20) - 1 + (size_t)i : (1 << 20) + pcg32_random_r(rng) % (BULK_MAX - (1 << 20));
+        size_t shift = pcg32_random_r(rng) % 16;
+        fill_crappy_random(raw_key, sizeof(raw_key), rng);
+        fill_crappy_random(nonce, sizeof(nonce), rng);
+        fill_crappy_random(ad, sizeof(ad), rng);
+        portable_8439_key key;
+        portable_chacha20_poly1305_key_init(&key, raw_key);
+        portable_chacha20_poly1305_encrypt_key(expected, &key, nonce, ad, sizeof(ad), plain, size);
+        if (portable_chacha20_poly1305_encrypt_key_bulk(cipher + shift, &key, nonce, ad, sizeof(ad), plain, size) != size + RFC_8439_TAG_SIZE
+            || memcmp(cipher + shift, expected, size + RFC_8439_TAG_SIZE) != 0) {
+            printf("bulk seal differs for %zu bytes at +%zu\n", size, shift);
+            failed = 1;
+        }
+        else if (portable_chacha20_poly1305_decrypt_key_bulk(opened + shift, &key, nonce, ad, sizeof(ad), expected, size + RFC_8439_TAG_SIZE) != size
+            || memcmp(opened + shift, plain, size) != 0) {
+            printf("bulk open failed for %zu bytes at +%zu\n", size, shift);
+            failed = 1;
+        }
+        else {
+            expected[pcg32_random_r(rng) % size] ^= 1;
+            if (portable_chacha20_poly1305_decrypt_key_bulk(opened, &key, nonce, ad, sizeof(ad), expected, size + RFC_8439_TAG_SIZE) != (size_t)-1) {
+                printf("bulk open accepted a corrupted message of %zu bytes\n", size);
+                failed = 1;
+            }
+        }
+        portable_chacha20_poly1305_key_wipe(&key);
+    }
+    free(plain);
+    free(expected);
+    free(cipher);
+    free(opened);
+    if (!failed) {
+        printf("success\n");
+    }
+    return failed;
+}
+
+#define RING_MAX (3000)
+
+static void ring_put(uint8_t *ring, size_t capacity, size_t offset, const uint8_t *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        ring[(offset + i) % capacity] = data[i];
+    }
+}
+
+static int ring_equals(const uint8_t *ring, size_t capacity, size_t offset, const uint8_t *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (ring[(offset + i) % capacity] != data[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// messages at every position of a ring against the one-shot api on the linearized message
+int test_ring(pcg32_random_t* rng) {
+    printf("Ring buffer seal/open: ");
+    static uint8_t ring[RING_MAX], before[RING_MAX], plain[RING_MAX], expected[RING_MAX];
+    uint8_t raw_key[RFC_8439_KEY_SIZE], nonce[RFC_8439_NONCE_SIZE], ad[20];
+    for (int i = 0; i < 2000; i++) {
+        size_t capacity = RFC_8439_TAG_SIZE + pcg32_random_r(rng) % (RING_MAX - RFC_8439_TAG_SIZE);
+        size_t offset = pcg32_random_r(rng) % capacity;
+        size_t size = pcg32_random_r(rng) % (capacity - RFC_8439_TAG_SIZE + 1);
+        if (i % 4 == 0) {
+            // end right at the wrap point, or wrap just the tag
+            offset = (capacity - size - (i % 8 == 0 ? 0 : pcg32_random_r(rng) % RFC_8439_TAG_SIZE)) % capacity;
+        }
+        fill_crappy_random(ring, capacity, rng);
+        fill_crappy_random(plain, size, rng);
+        fill_crappy_random(raw_key, sizeof(raw_key), rng);
+        fill_crappy_random(nonce, sizeof(nonce), rng);
+        fill_crappy_random(ad, sizeof(ad), rng);
+        portable_8439_key key;
+        portable_chacha20_poly1305_key_init(&key, raw_key);
+        portable_chacha20_poly1305_encrypt_key(expected, &key, nonce, ad, sizeof(ad), plain, size);
+
+        ring_put(ring, capacity, offset, plain, size);
+        memcpy(before, ring, capacity);
+        if (portable_chacha20_poly1305_seal_ring(ring, capacity, offset, size, &key, nonce, ad, sizeof(ad)) != size + RFC_8439_TAG_SIZE
+            || !ring_equals(ring, capacity, offset, expected, size + RFC_8439_TAG_SIZE)) {
+            printf("seal differs for %zu bytes at %zu of %zu\n", size, offset, capacity);
+            return 1;
+        }
+        for (size_t b = size + RFC_8439_TAG_SIZE; b < capacity; b++) {
+            if (ring[(offset + b) % capacity] != before[(offset + b) % capacity]) {
+                printf("seal wrote outside of the message\n");
+                return 1;
+            }
+        }
+
+        // a bad tag leaves the ring alone
+        size_t flip = (offset + pcg32_random_r(rng) % (size + RFC_8439_TAG_SIZE)) % capacity;
+        ring[flip] ^= 1;
+        memcpy(before, ring, capacity);
+        if (portable_chacha20_poly1305_open_ring(ring, capacity, offset, size + RFC_8439_TAG_SIZE, &key, nonce, ad, sizeof(ad)) != (size_t)-1
+            || memcmp(before, ring, capacity) != 0) {
+            printf("open accepted a corrupted message\n");
+            return 1;
+        }
+        ring[flip] ^= 1;
+        if (portable_chacha20_poly1305_open_ring(ring, capacity, offset, size + RFC_8439_TAG_SIZE, &key, nonce, ad, sizeof(ad)) != size
+            || !ring_equals(ring, capacity, offset, plain, size)) {
+            printf("open failed for %zu bytes at %zu of %zu\n", size, offset, capacity);
+            return 1;
+        }
+        if (portable_chacha20_poly1305_seal_ring(ring, capacity, offset, capacity - RFC_8439_TAG_SIZE + 1, &key, nonce, ad, sizeof(ad)) != (size_t)-1
+            || portable_chacha20_poly1305_open_ring(ring, capacity, capacity, size + RFC_8439_TAG_SIZE, &key, nonce, ad, sizeof(ad)) != (size_t)-1) {
+            printf("accepted a message that doesn't fit\n");
+            return 1;
+        }
+        portable_chacha20_poly1305_key_wipe(&key);
+    }
+    printf("success\n");
+    return 0;
+}
+
+// the in place functions against the one-shot api, the same buffer in and out
+int test_in_place(pcg32_random_t* rng) {
+    printf("In place seal/open: ");
+    static uint8_t message[RING_MAX + RFC_8439_TAG_SIZE], plain[RING_MAX], expected[RING_MAX + RFC_8439_TAG_SIZE];
+    uint8_t raw_key[RFC_8439_KEY_SIZE], nonce[RFC_8439_NONCE_SIZE], ad[20];
+    for (int i = 0; i < 500; i++) {
+        size_t size = i < 2 ? (size_t)i : pcg32_random_r(rng) % RING_MAX;
+        fill_crappy_random(plain, size, rng);
+        fill_crappy_random(raw_key, sizeof(raw_key), rng);
+        fill_crappy_random(nonce, sizeof(nonce), rng);
+        fill_crappy_random(ad, sizeof(ad), rng);
+        portable_8439_key key;
+        portable_chacha20_poly1305_key_init(&key, raw_key);
+        portable_chacha20_poly1305_encrypt_key(expected, &key, nonce, ad, sizeof(ad), plain, size);
+
+        memcpy(message, plain, size);
+        if (portable_chacha20_poly1305_seal_in_place(message, size, &key, nonce, ad, sizeof(ad)) != size + RFC_8439_TAG_SIZE
+            || memcmp(message, expected, size + RFC_8439_TAG_SIZE) != 0) {
+            printf("seal differs for %zu bytes\n", size);
+            return 1;
+        }
+
+        // a bad tag leaves the message alone
+        size_t flip = pcg32_random_r(rng) % (size + RFC_8439_TAG_SIZE);
+        message[flip] ^= 1;
+        if (portable_chacha20_poly1305_open_in_place(message, size + RFC_8439_TAG_SIZE, &key, nonce, ad, sizeof(ad)) != (size_t)-1) {
+            printf("open accepted a corrupted message\n");
+            return 1;
+        }
+        message[flip] ^= 1;
+        if (memcmp(message, expected, size + RFC_8439_TAG_SIZE) != 0) {
+            printf("open changed a corrupted message\n");
+            return 1;
+        }
+        if (portable_chacha20_poly1305_open_in_place(message, size + RFC_8439_TAG_SIZE, &key, nonce, ad, sizeof(ad)) != size
+            || memcmp(message, plain, size) != 0) {
+            printf("open failed for %zu bytes\n", size);
+            return 1;
+        }
+        if (portable_chacha20_poly1305_open_in_place(message, RFC_8439_TAG_SIZE - 1, &key, nonce, ad, sizeof(ad)) != (size_t)-1) {
+            printf("open accepted a message shorter than a tag\n");
+            return 1;
+        }
+        portable_chacha20_poly1305_key_wipe(&key);
+    }
+    printf("success\n");
+    return 0;
+}
+
+// pieces of a message body at any offset against the one-shot api
+int test_xor_key(pcg32_random_t* rng) {
+    printf("Verify & xor at offsets: ");
+    static uint8_t plain[RING_MAX], cipher[RING_MAX + RFC_8439_TAG_SIZE], piece[RING_MAX];
+    uint8_t raw_key[RFC_8439_KEY_SIZE], nonce[RFC_8439_NONCE_SIZE], ad[20];
+    for (int i = 0; i < 500; i++) {
+        size_t size = 1 + pcg32_random_r(rng) % (RING_MAX - 1);
+        // aligned, unaligned, and within the first block
+        size_t offset = pcg32_random_r(rng) % size;
+        if (i % 3 == 0) {
+            offset -= offset % 64;
+        }
+        else if (i % 3 == 1) {
+            offset %= 64;
+        }
+        size_t length = pcg32_random_r(rng) % (size - offset + 1);
+        fill_crappy_random(plain, size, rng);
+        fill_crappy_random(raw_key, sizeof(raw_key), rng);
+        fill_crappy_random(nonce, sizeof(nonce), rng);
+        fill_crappy_random(ad, sizeof(ad), rng);
+        portable_8439_key key;
+        portable_chacha20_poly1305_key_init(&key, raw_key);
+        portable_chacha20_poly1305_encrypt_key(cipher, &key, nonce, ad, sizeof(ad), plain, size);
+        if (!portable_chacha20_poly1305_verify_key(&key, nonce, ad, sizeof(ad), cipher, size + RFC_8439_TAG_SIZE)) {
+            printf("verify rejected a valid message of %zu bytes\n", size);
+            return 1;
+        }
+        portable_chacha20_poly1305_xor_key(piece, &key, nonce, offset, cipher + offset, length);
+        if (memcmp(piece, plain + offset, length) != 0) {
+            printf("xor differs for %zu bytes at offset %zu\n", length, offset);
+            return 1;
+        }
+        portable_chacha20_poly1305_key_wipe(&key);
+    }
+    printf("success\n");
+    return 0;
+}
+
+#ifdef PORTABLE_8439_STATS
+#define STATS_THREAD_CALLS (1000)
+static void *stats_thread(void *arg) {
+    uint8_t plain[100] = { 0 };
+    uint8_t cipher[100 + RFC_8439_TAG_SIZE];
+    uint8_t key[RFC_8439_KEY_SIZE] = { 0 };
+    uint8_t nonce[RFC_8439_NONCE_SIZE] = { 0 };
+    for (int i = 0; i < STATS_THREAD_CALLS; i++) {
+        portable_chacha20_poly1305_encrypt(cipher, key, nonce, NULL, 0, plain, sizeof(plain));
+    }
+    return arg;
+}
+
+static uint64_t fake_clock(void) {
+    static uint64_t now = 0;
+    return now += 10;
+}
+
+static void count_timing(portable_8439_operation operation, size_t size, uint64_t elapsed, void *user_data) {
+    (void)operation;
+    (void)size;
+    *(uint64_t *)user_data += elapsed;
+}
+
+int test_stats(void) {
+    printf("Instrumentation counters: ");
+    uint8_t buffer[64 + RFC_8439_TAG_SIZE] = { 0 };
+    uint8_t plain[64] = { 0 };
+    uint8_t key[RFC_8439_KEY_SIZE] = { 0 };
+    uint8_t nonce[RFC_8439_NONCE_SIZE] = { 0 };
+    portable_8439_stats before, after;
+    portable_8439_stats_collect(&before);
+
+    uint64_t elapsed = 0;
+    portable_8439_timing timing = { fake_clock, count_timing, &elapsed };
+    portable_8439_stats_timing(&timing);
+    portable_chacha20_poly1305_encrypt(buffer, key, nonce, NULL, 0, plain, sizeof(plain));
+    portable_chacha20_poly1305_decrypt(plain, key, nonce, NULL, 0, buffer, sizeof(buffer));
+    buffer[0] ^= 1;
+    portable_chacha20_poly1305_decrypt(plain, key, nonce, NULL, 0, buffer, sizeof(buffer));
+    portable_chacha20_poly1305_encrypt(buffer, key, nonce, NULL, 0, buffer + 1, 10);
+    portable_8439_stats_timing(NULL);
+    portable_chacha20_poly1305_encrypt(buffer, key, nonce, NULL, 0, plain, 0);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, stats_thread, NULL) != 0 || pthread_join(thread, NULL) != 0) {
+        printf("failed to run the thread\n");
+        return 1;
+    }
+    portable_8439_stats_collect(&after);
+
+    #define __DIFF(field) (after.field - before.field)
+    if (__DIFF(encrypt_calls) != 3 + STATS_THREAD_CALLS || __DIFF(encrypt_bytes) != 64 + 100 * STATS_THREAD_CALLS
+            || __DIFF(decrypt_calls) != 2 || __DIFF(decrypt_bytes) != 64
+            || __DIFF(auth_failures) != 1 || __DIFF(overlap_rejections) != 1
+            // 0 bytes in bucket 0, 64 & 100 bytes in bucket 7
+            || __DIFF(size_histogram[0]) != 1 || __DIFF(size_histogram[6]) != 0
+            || __DIFF(size_histogram[7]) != 2 + STATS_THREAD_CALLS) {
+        printf("unexpected counters\n");
+        return 1;
+    }
+    if (elapsed != 4 * 10) {
+        printf("unexpected timing %llu\n", (unsigned long long)elapsed);
+        return 1;
+    }
+    printf("success\n");
+    return 0;
+}
+#endif
+
 int main(void) {
     srand(time(NULL)); 
     pcg32_random_t rng;
     rng.state = rand();
     rng.inc = rand() | 1;
-    return test8439(&rng);
+    int result = test8439(&rng) | test_chacha_blocks(&rng) | test_poly_backends(&rng) | test_fixed_sizes(&rng) | test_stream(&rng) | test_tls_records(&rng) | test_bulk(&rng) | test_ring(&rng) | test_in_place(&rng) | test_xor_key(&rng);
+#ifdef PORTABLE_8439_STATS
+    result |= test_stats();
+#endif
+    return result;
 }
\ No newline at end of file
@@ -0,0 +1,250 @@
+#define _DEFAULT_SOURCE
+#include "../src/portable8439-socket.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "pcg_random.h"
+
+#define BUFFER_SIZE (1 << 16)
+#define STREAM (5000)
+#define STREAM_MAX (4000)
+
+static void fill_crappy_random(void* target, size_t length, pcg32_random_t* rng) {
+    uint8_t *p = target;
+    for (size_t i = 0; i < length; i++) {
+        p[i] = (uint8_t)pcg32_random_r(rng);
+    }
+}
+
+#define CHECK(condition, ...) \
+    if (!(condition)) { \
+        printf(__VA_ARGS__); \
+        return 1; \
+    }
+
+static uint8_t writer_buffer[BUFFER_SIZE], reader_buffer[BUFFER_SIZE];
+
+static int read_one(portable_8439_socket_reader *reader, const uint8_t *expected, size_t expected_size) {
+    const uint8_t *message;
+    size_t size;
+    return portable_8439_socket_read(reader, &message, &size) == 1 && size == expected_size && memcmp(message, expected, size) == 0;
+}
+
+static int test_frames(pcg32_random_t *rng) {
+    uint8_t key[RFC_8439_KEY_SIZE], plain[1000];
+    fill_crappy_random(key, sizeof(key), rng);
+    fill_crappy_random(plain, sizeof(plain), rng);
+    int pair[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0, "no socketpair\n")
+    portable_8439_socket_writer writer;
+    portable_8439_socket_reader reader;
+    portable_8439_socket_writer_init(&writer, pair[0], key, writer_buffer, sizeof(plain), 0);
+    portable_8439_socket_reader_init(&reader, pair[1], key, reader_buffer, BUFFER_SIZE);
+
+    // the frame on the wire: length, cipher text & tag of the one-shot api
+    CHECK(portable_8439_socket_write(&writer, plain, 100) == 100, "write failed\n")
+    uint8_t raw[100 + PORTABLE_8439_FRAME_OVERHEAD], opened[100];
+    CHECK(read(pair[1], raw, sizeof(raw)) == sizeof(raw), "frame has the wrong size\n")
+    uint8_t nonce[RFC_8439_NONCE_SIZE] = { 0 };
+    CHECK(raw[0] == 0 && raw[1] == 0 && raw[2] == 0 && raw[3] == 100
+        && portable_chacha20_poly1305_decrypt(opened, key, nonce, raw, PORTABLE_8439_FRAME_HEADER_SIZE,
+            raw + PORTABLE_8439_FRAME_HEADER_SIZE, sizeof(raw) - PORTABLE_8439_FRAME_HEADER_SIZE) == 100
+        && memcmp(opened, plain, 100) == 0, "frame isn't the one-shot seal\n")
+    // the reader expects the first frame
+    CHECK(write(pair[0], raw, sizeof(raw)) == sizeof(raw), "write failed\n")
+    CHECK(read_one(&reader, plain, 100), "first frame differs\n")
+
+    // single frames, gathered frames and a batch, all in the socket at once
+    struct iovec pieces[3] = { { plain, 10 }, { plain + 10, 0 }, { plain + 10, 500 } };
+    CHECK(portable_8439_socket_write(&writer, plain, 0) == 0 && portable_8439_socket_write(&writer, plain, sizeof(plain)) == sizeof(plain)
+        && portable_8439_socket_writev(&writer, pieces, 3) == 510, "write failed\n")
+    struct iovec batch[10];
+    for (size_t i = 0; i < 10; i++) {
+        batch[i] = (struct iovec){ plain + i, i * 11 };
+    }
+    CHECK(portable_8439_socket_write_frames(&writer, batch, 10) == 10, "write frames failed\n")
+    CHECK(read_one(&reader, plain, 0) && read_one(&reader, plain, sizeof(plain)) && read_one(&reader, plain, 510), "frame differs\n")
+    for (size_t i = 0; i < 10; i++) {
+        CHECK(read_one(&reader, plain + i, i * 11), "batch frame %zu differs\n", i)
+    }
+    errno = 0;
+    CHECK(portable_8439_socket_write(&writer, plain, sizeof(plain) + 1) == (size_t)-1 && errno == EMSGSIZE, "frame larger than the buffer sent\n")
+    batch[9].iov_len = 700;
+    CHECK(portable_8439_socket_write_frames(&writer, batch, 10) == (size_t)-1 && errno == EMSGSIZE, "batch larger than the buffer sent\n")
+
+    // a tampered frame doesn't open
+    CHECK(portable_8439_socket_write(&writer, plain, 100) == 100 && read(pair[1], raw, sizeof(raw)) == sizeof(raw), "write failed\n")
+    raw[PORTABLE_8439_FRAME_HEADER_SIZE + 7] ^= 1;
+    CHECK(write(pair[0], raw, sizeof(raw)) == sizeof(raw), "write failed\n")
+    const uint8_t *message;
+    size_t size;
+    errno = 0;
+    CHECK(portable_8439_socket_read(&reader, &message, &size) == -1 && errno == EBADMSG && message == NULL, "tampered frame opened\n")
+
+    portable_8439_socket_writer_wipe(&writer);
+    portable_8439_socket_reader_wipe(&reader);
+    close(pair[0]);
+    close(pair[1]);
+    return 0;
+}
+
+static int test_ends(pcg32_random_t *rng) {
+    uint8_t key[RFC_8439_KEY_SIZE], plain[200];
+    fill_crappy_random(key, sizeof(key), rng);
+    fill_crappy_random(plain, sizeof(plain), rng);
+    const uint8_t *message;
+    size_t size;
+    portable_8439_socket_writer writer;
+    portable_8439_socket_reader reader;
+
+    // a frame that doesn't fit in the buffer of the reader
+    int pair[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0, "no socketpair\n")
+    portable_8439_socket_writer_init(&writer, pair[0], key, writer_buffer, BUFFER_SIZE, 0);
+    portable_8439_socket_reader_init(&reader, pair[1], key, reader_buffer, 100 + PORTABLE_8439_FRAME_OVERHEAD);
+    CHECK(portable_8439_socket_write(&writer, plain, 100) == 100 && portable_8439_socket_write(&writer, plain, 101) == 101, "write failed\n")
+    CHECK(read_one(&reader, plain, 100), "frame that fits differs\n")
+    errno = 0;
+    CHECK(portable_8439_socket_read(&reader, &message, &size) == -1 && errno == EMSGSIZE, "frame larger than the buffer read\n")
+    close(pair[0]);
+    close(pair[1]);
+
+    // closed between frames, and in the middle of one
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0, "no socketpair\n")
+    portable_8439_socket_writer_init(&writer, pair[0], key, writer_buffer, BUFFER_SIZE, 0);
+    portable_8439_socket_reader_init(&reader, pair[1], key, reader_buffer, BUFFER_SIZE);
+    CHECK(portable_8439_socket_write(&writer, plain, 200) == 200, "write failed\n")
+    shutdown(pair[0], SHUT_WR);
+    CHECK(read_one(&reader, plain, 200) && portable_8439_socket_read(&reader, &message, &size) == 0, "end of the stream missed\n")
+    close(pair[0]);
+    close(pair[1]);
+
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0, "no socketpair\n")
+    portable_8439_socket_reader_init(&reader, pair[1], key, reader_buffer, BUFFER_SIZE);
+    CHECK(write(pair[0], "\0\0\0\x10 half a frame", 16) == 16, "write failed\n")
+    shutdown(pair[0], SHUT_WR);
+    errno = 0;
+    CHECK(portable_8439_socket_read(&reader, &message, &size) == -1 && errno == EPIPE, "cut off frame missed\n")
+    portable_8439_socket_writer_wipe(&writer);
+    portable_8439_socket_reader_wipe(&reader);
+    close(pair[0]);
+    close(pair[1]);
+    return 0;
+}
+
+static size_t stream_size(size_t i) {
+    return (i * 7919) % (STREAM_MAX + 1);
+}
+
+static void stream_message(uint8_t *message, size_t i) {
+    for (size_t b = 0; b < stream_size(i); b++) {
+        message[b] = (uint8_t)(i + b);
+    }
+}
+
+// a child process writes a stream of frames (one by one and in batches), the
+// parent reads them with a buffer that just fits the largest frame
+static int test_stream(const char *name, int sender, int receiver, int flags, pcg32_random_t *rng) {
+    uint8_t key[RFC_8439_KEY_SIZE];
+    fill_crappy_random(key, sizeof(key), rng);
+    fflush(stdout);
+    pid_t child = fork();
+    CHECK(child >= 0, "fork failed\n")
+    if (child == 0) {
+        close(receiver);
+        static uint8_t messages[8][STREAM_MAX];
+        portable_8439_socket_writer writer;
+        portable_8439_socket_writer_init(&writer, sender, key, writer_buffer, BUFFER_SIZE, flags);
+        for (size_t i = 0; i < STREAM; i += 8) {
+            struct iovec batch[8];
+            for (size_t m = 0; m < 8; m++) {
+                stream_message(messages[m], i + m);
+                batch[m] = (struct iovec){ messages[m], stream_size(i + m) };
+            }
+            if (i % 16 == 0) {
+                if (portable_8439_socket_write_frames(&writer, batch, 8) != 8) {
+                    _exit(1);
+                }
+            }
+            else {
+                for (size_t m = 0; m < 8; m++) {
+                    if (portable_8439_socket_write(&writer, messages[m], stream_size(i + m)) != stream_size(i + m)) {
+                        _exit(1);
+                    }
+                }
+            }
+        }
+        portable_8439_socket_writer_wipe(&writer);
+        _exit(0);
+    }
+    close(sender);
+    portable_8439_socket_reader reader;
+    portable_8439_socket_reader_init(&reader, receiver, key, reader_buffer, STREAM_MAX + PORTABLE_8439_FRAME_OVERHEAD);
+    static uint8_t expected[STREAM_MAX];
+    int failed = 0;
+    for (size_t i = 0; i < STREAM && !failed; i++) {
+        stream_message(expected, i);
+        if (!read_one(&reader, expected, stream_size(i))) {
+            printf("%s: frame %zu differs\n", name, i);
+            failed = 1;
+        }
+    }
+    const uint8_t *message;
+    size_t size;
+    if (!failed && portable_8439_socket_read(&reader, &message, &size) != 0) {
+        printf("%s: no end of the stream\n", name);
+        failed = 1;
+    }
+    if (failed) {
+        kill(child, SIGKILL);
+    }
+    int status;
+    waitpid(child, &status, 0);
+    portable_8439_socket_reader_wipe(&reader);
+    close(receiver);
+    return failed || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+// a TCP connection over loopback, MSG_ZEROCOPY only works for TCP & UDP
+static int tcp_pair(int pair[2]) {
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t length = sizeof(address);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) {
+        return 0;
+    }
+    int connected = bind(listener, (struct sockaddr *)&address, sizeof(address)) == 0
+        && listen(listener, 1) == 0
+        && getsockname(listener, (struct sockaddr *)&address, &length) == 0
+        && (pair[0] = socket(AF_INET, SOCK_STREAM, 0)) >= 0
+        && connect(pair[0], (struct sockaddr *)&address, sizeof(address)) == 0
+        && (pair[1] = accept(listener, NULL, NULL)) >= 0;
+    close(listener);
+    return connected;
+}
+
+int main(void) {
+    printf("Sealed socket frames: ");
+    fflush(stdout);
+    srand(time(NULL));
+    pcg32_random_t rng = { (uint64_t)rand() << 32 | (uint64_t)rand(), 5 };
+    int unix_pair[2], tcp[2];
+    int failed = test_frames(&rng) || test_ends(&rng)
+        || socketpair(AF_UNIX, SOCK_STREAM, 0, unix_pair) != 0
+        || test_stream("socketpair", unix_pair[0], unix_pair[1], 0, &rng);
+    if (!failed && tcp_pair(tcp)) {
+        failed = test_stream("tcp with zerocopy", tcp[0], tcp[1], PORTABLE_8439_SOCKET_ZEROCOPY, &rng);
+    }
+    if (!failed) {
+        printf("success\n");
+    }
+    return failed;
+}
@@ -9,6 +9,7 @@
 
 /**************************
  * This file contains test vectors extracted from RFC 8439
+ * and draft-irtf-cfrg-xchacha
  **************************/
 
 
@@ -133,18 +134,23 @@ static struct chacha_test_vector chacha_rfc_tests[CHACHA_TEST_VECTORS] = {
 
 static int test_chacha20() {
     printf("Testing chacha20\n");
-    uint8_t buffer[MAX_TEST_SIZE] = {0};
+    uint32_t buffer_words[MAX_TEST_SIZE / sizeof(uint32_t) + 1] = {0};
+    uint32_t plain_words[MAX_TEST_SIZE / sizeof(uint32_t) + 1] = {0};
     for (int i = 0; i < CHACHA_TEST_VECTORS; i++) {
         struct chacha_test_vector t = chacha_rfc_tests[i];
         printf("- %s: ", t.title);
-        chacha20_xor_stream(buffer, t.plain_text, t.size, t.key, t.nonce, t.counter);
-        if (memcmp(buffer, t.cipher_text, t.size) != 0) {
-            printf("failed\n");
-            return -1;
-        }
-        else {
-            printf("success\n");
+        // also shift the buffers, to cover the aligned & unaligned word paths
+        for (size_t offset = 0; offset < sizeof(uint32_t); offset++) {
+            uint8_t *buffer = (uint8_t *)buffer_words + offset;
+            uint8_t *plain = (uint8_t *)plain_words + ((offset * 2) % sizeof(uint32_t));
+            memcpy(plain, t.plain_text, t.size);
+            chacha20_xor_stream(buffer, plain, t.size, t.key, t.nonce, t.counter);
+            if (memcmp(buffer, t.cipher_text, t.size) != 0) {
+                printf("failed (offset %zu)\n", offset);
+                return -1;
+            }
         }
+        printf("success\n");
     }
     return 0;
 }
@@ -214,21 +220,28 @@ static struct poly_test_vector poly_rfc_tests[POLY_TEST_VECTORS] = {
 static int test_poly() {
     printf("Testing poly1305\n");
     uint8_t tag[16] = {0};
-    for (int i = 0; i <POLY_TEST_VECTORS; i++) {
-        struct poly_test_vector t = poly_rfc_tests[i];
-        printf("- %s streaming: ", t.title);
-        poly1305_context ctx;
-        poly1305_init(&ctx, t.key);
-        poly1305_update(&ctx, t.msg, t.size);
-        poly1305_finish(&ctx, tag);
-        if (memcmp(tag, t.tag, 16) != 0) {
-            printf("failed\n");
-            return -1;
-        }
-        else {
-            printf("success\n");
+    const poly1305_backend *default_backend = poly1305_backend_selected();
+    for (size_t b = 0; b < poly1305_backend_count(); b++) {
+        const poly1305_backend *backend = poly1305_backend_at(b);
+        poly1305_backend_select(backend);
+        for (int i = 0; i <POLY_TEST_VECTORS; i++) {
+            struct poly_test_vector t = poly_rfc_tests[i];
+            printf("- %s %s streaming: ", t.title, backend->name);
+            poly1305_context ctx;
+            poly1305_init(&ctx, t.key);
+            poly1305_update(&ctx, t.msg, t.size);
+            poly1305_finish(&ctx, tag);
+            if (memcmp(tag, t.tag, 16) != 0) {
+                printf("failed\n");
+                poly1305_backend_select(default_backend);
+                return -1;
+            }
+            else {
+                printf("success\n");
+            }
         }
     }
+    poly1305_backend_select(default_backend);
     return 0;
 }
 
@@ -369,12 +382,313 @@ static int test_aead() {
     return 0;
 }
 
+static int test_hchacha20() {
+    printf("Testing hchacha20\n");
+    printf("- draft-irtf-cfrg-xchacha 2.2.1: ");
+    const uint8_t key[CHACHA20_KEY_SIZE] = {
+        0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08,0x09,0x0a,0x0b,0x0c,0x0d,0x0e,0x0f,
+        0x10,0x11,0x12,0x13,0x14,0x15,0x16,0x17,0x18,0x19,0x1a,0x1b,0x1c,0x1d,0x1e,0x1f
+    };
+    const uint8_t nonce[HCHACHA20_NONCE_SIZE] = {
+        0x00,0x00,0x00,0x09,0x00,0x00,0x00,0x4a,0x00,0x00,0x00,0x00,0x31,0x41,0x59,0x27
+    };
+    const uint32_t expected[CHACHA20_KEY_SIZE / sizeof(uint32_t)] = {
+        0x423b4182, 0xfe7bb227, 0x50420ed3, 0x737d878a,
+        0xd5e4f9a0, 0x53a8748a, 0x13c42ec1, 0xdcecd326
+    };
+    chacha20_key expanded, subkey;
+    chacha20_key_init(&expanded, key);
+    hchacha20(&subkey, &expanded, nonce);
+    if (memcmp(subkey.words, expected, sizeof(expected)) != 0) {
+        printf("failed\n");
+        return -1;
+    }
+    printf("success\n");
+    return 0;
+}
+
+static int test_xchacha_aead() {
+    printf("Testing xchacha20-poly1305\n");
+    printf("- draft-irtf-cfrg-xchacha A.3.1: ");
+    const uint8_t key[RFC_8439_KEY_SIZE] = {
+        0x80,0x81,0x82,0x83,0x84,0x85,0x86,0x87,0x88,0x89,0x8a,0x8b,0x8c,0x8d,0x8e,0x8f,
+        0x90,0x91,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0x9b,0x9c,0x9d,0x9e,0x9f
+    };
+    const uint8_t nonce[XCHACHA20_POLY1305_NONCE_SIZE] = {
+        0x40,0x41,0x42,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4a,0x4b,0x4c,0x4d,0x4e,0x4f,
+        0x50,0x51,0x52,0x53,0x54,0x55,0x56,0x57
+    };
+    const uint8_t ad[] = {
+        0x50,0x51,0x52,0x53,0xc0,0xc1,0xc2,0xc3,0xc4,0xc5,0xc6,0xc7
+    };
+    const uint8_t plain_text[] = {
+        0x4c,0x61,0x64,0x69,0x65,0x73,0x20,0x61,0x6e,0x64,0x20,0x47,0x65,0x6e,0x74,0x6c,
+        0x65,0x6d,0x65,0x6e,0x20,0x6f,0x66,0x20,0x74,0x68,0x65,0x20,0x63,0x6c,0x61,0x73,
+        0x73,0x20,0x6f,0x66,0x20,0x27,0x39,0x39,0x3a,0x20,0x49,0x66,0x20,0x49,0x20,0x63,
+        0x6f,0x75,0x6c,0x64,0x20,0x6f,0x66,0x66,0x65,0x72,0x20,0x79,0x6f,0x75,0x20,0x6f,
+        0x6e,0x6c,0x79,0x20,0x6f,0x6e,0x65,0x20,0x74,0x69,0x70,0x20,0x66,0x6f,0x72,0x20,
+        0x74,0x68,0x65,0x20,0x66,0x75,0x74,0x75,0x72,0x65,0x2c,0x20,0x73,0x75,0x6e,0x73,
+        0x63,0x72,0x65,0x65,0x6e,0x20,0x77,0x6f,0x75,0x6c,0x64,0x20,0x62,0x65,0x20,0x69,
+        0x74,0x2e
+    };
+    const uint8_t expected[] = {
+        0xbd,0x6d,0x17,0x9d,0x3e,0x83,0xd4,0x3b,0x95,0x76,0x57,0x94,0x93,0xc0,0xe9,0x39,
+        0x57,0x2a,0x17,0x00,0x25,0x2b,0xfa,0xcc,0xbe,0xd2,0x90,0x2c,0x21,0x39,0x6c,0xbb,
+        0x73,0x1c,0x7f,0x1b,0x0b,0x4a,0xa6,0x44,0x0b,0xf3,0xa8,0x2f,0x4e,0xda,0x7e,0x39,
+        0xae,0x64,0xc6,0x70,0x8c,0x54,0xc2,0x16,0xcb,0x96,0xb7,0x2e,0x12,0x13,0xb4,0x52,
+        0x2f,0x8c,0x9b,0xa4,0x0d,0xb5,0xd9,0x45,0xb1,0x1b,0x69,0xb9,0x82,0xc1,0xbb,0x9e,
+        0x3f,0x3f,0xac,0x2b,0xc3,0x69,0x48,0x8f,0x76,0xb2,0x38,0x35,0x65,0xd3,0xff,0xf9,
+        0x21,0xf9,0x66,0x4c,0x97,0x63,0x7d,0xa9,0x76,0x88,0x12,0xf6,0x15,0xc6,0x8b,0x13,
+        0xb5,0x2e,
+        0xc0,0x87,0x59,0x24,0xc1,0xc7,0x98,0x79,0x47,0xde,0xaf,0xd8,0x78,0x0a,0xcf,0x49
+    };
+    uint8_t buffer[sizeof(expected)];
+    portable_8439_key context;
+    portable_chacha20_poly1305_key_init(&context, key);
+    if (portable_xchacha20_poly1305_encrypt(buffer, key, nonce, ad, sizeof(ad), plain_text, sizeof(plain_text)) != sizeof(expected)
+            || memcmp(buffer, expected, sizeof(expected)) != 0) {
+        printf("failed encryption\n");
+        UNEXPECTED_RESULT(expected, buffer, sizeof(expected))
+        return -1;
+    }
+    memset(buffer, 0, sizeof(buffer));
+    if (portable_xchacha20_poly1305_encrypt_key(buffer, &context, nonce, ad, sizeof(ad), plain_text, sizeof(plain_text)) != sizeof(expected)
+            || memcmp(buffer, expected, sizeof(expected)) != 0) {
+        printf("failed encryption with a key context\n");
+        return -1;
+    }
+    if (portable_xchacha20_poly1305_decrypt(buffer, key, nonce, ad, sizeof(ad), expected, sizeof(expected)) != sizeof(plain_text)
+            || memcmp(buffer, plain_text, sizeof(plain_text)) != 0
+            || portable_xchacha20_poly1305_decrypt_key(buffer, &context, nonce, ad, sizeof(ad), expected, sizeof(expected)) != sizeof(plain_text)) {
+        printf("failed decryption\n");
+        return -1;
+    }
+    // the last 8 bytes of the nonce are part of the message nonce, not of the subkey
+    uint8_t other_nonce[XCHACHA20_POLY1305_NONCE_SIZE];
+    memcpy(other_nonce, nonce, sizeof(other_nonce));
+    other_nonce[XCHACHA20_POLY1305_NONCE_SIZE - 1] ^= 1;
+    if (portable_xchacha20_poly1305_decrypt_key(buffer, &context, other_nonce, ad, sizeof(ad), expected, sizeof(expected)) != (size_t)-1) {
+        printf("decrypted with the wrong nonce\n");
+        return -1;
+    }
+    portable_chacha20_poly1305_key_wipe(&context);
+    printf("success\n");
+    return 0;
+}
+
+typedef void (*xor_stream_function)(uint8_t *, const uint8_t *, size_t, const chacha20_key *, const uint8_t *, uint32_t);
+
+static const struct {
+    const char *name;
+    xor_stream_function xor_stream;
+} chacha_variants[] = {
+    { "chacha20", chacha20_xor_stream_key },
+    { "chacha12", chacha12_xor_stream_key },
+    { "chacha8", chacha8_xor_stream_key },
+};
+
+// key stream of an all zero key & nonce, draft-strombergson-chacha-test-vectors TC1
+static const uint8_t chacha12_tc1[64] = {
+    0x9b,0xf4,0x9a,0x6a,0x07,0x55,0xf9,0x53,0x81,0x1f,0xce,0x12,0x5f,0x26,0x83,0xd5,
+    0x04,0x29,0xc3,0xbb,0x49,0xe0,0x74,0x14,0x7e,0x00,0x89,0xa5,0x2e,0xae,0x15,0x5f,
+    0x05,0x64,0xf8,0x79,0xd2,0x7a,0xe3,0xc0,0x2c,0xe8,0x28,0x34,0xac,0xfa,0x8c,0x79,
+    0x3a,0x62,0x9f,0x2c,0xa0,0xde,0x69,0x19,0x61,0x0b,0xe8,0x2f,0x41,0x13,0x26,0xbe
+};
+
+static const uint8_t chacha8_tc1[64] = {
+    0x3e,0x00,0xef,0x2f,0x89,0x5f,0x40,0xd6,0x7f,0x5b,0xb8,0xe8,0x1f,0x09,0xa5,0xa1,
+    0x2c,0x84,0x0e,0xc3,0xce,0x9a,0x7f,0x3b,0x18,0x1b,0xe1,0x88,0xef,0x71,0x1a,0x1e,
+    0x98,0x4c,0xe1,0x72,0xb9,0x21,0x6f,0x41,0x9f,0x44,0x53,0x67,0x45,0x6d,0x56,0x19,
+    0x31,0x4a,0x42,0xa3,0xda,0x86,0xb0,0x01,0x38,0x7b,0xfd,0xb8,0x0e,0x0c,0xfe,0x42
+};
+
+static int test_reduced_rounds() {
+    printf("Testing reduced round chacha\n");
+    const uint8_t zero_key[CHACHA20_KEY_SIZE] = { 0 };
+    const uint8_t zero_nonce[CHACHA20_NONCE_SIZE] = { 0 };
+    const uint8_t zeroes[64] = { 0 };
+    uint8_t buffer[MAX_TEST_SIZE + 64];
+    chacha20_key key;
+    chacha20_key_init(&key, zero_key);
+    printf("- draft-strombergson TC1 (8 & 12 rounds): ");
+    chacha12_xor_stream_key(buffer, zeroes, sizeof(zeroes), &key, zero_nonce, 0);
+    if (memcmp(buffer, chacha12_tc1, sizeof(chacha12_tc1)) != 0) {
+        printf("failed chacha12\n");
+        UNEXPECTED_RESULT(chacha12_tc1, buffer, sizeof(chacha12_tc1))
+        return -1;
+    }
+    chacha8_xor_stream_key(buffer, zeroes, sizeof(zeroes), &key, zero_nonce, 0);
+    if (memcmp(buffer, chacha8_tc1, sizeof(chacha8_tc1)) != 0) {
+        printf("failed chacha8\n");
+        UNEXPECTED_RESULT(chacha8_tc1, buffer, sizeof(chacha8_tc1))
+        return -1;
+    }
+    printf("success\n");
+
+    // a long stream goes through the wide/interleaved kernels, it should 
+    // match the stream of separate single blocks
+    for (size_t v = 0; v < sizeof(chacha_variants) / sizeof(chacha_variants[0]); v++) {
+        printf("- %s multi block: ", chacha_variants[v].name);
+        uint8_t source[MAX_TEST_SIZE + 64], single[64];
+        for (size_t i = 0; i < sizeof(source); i++) {
+            source[i] = (uint8_t)(i * 7);
+        }
+        chacha20_key_init(&key, chacha_rfc_tests[1].key);
+        chacha_variants[v].xor_stream(buffer, source, sizeof(source) - 3, &key, chacha_rfc_tests[1].nonce, 5);
+        for (size_t b = 0; b < sizeof(source) / 64; b++) {
+            size_t size = b == sizeof(source) / 64 - 1 ? 64 - 3 : 64;
+            chacha_variants[v].xor_stream(single, source + b * 64, size, &key, chacha_rfc_tests[1].nonce, (uint32_t)(5 + b));
+            if (memcmp(single, buffer + b * 64, size) != 0) {
+                printf("failed at block %zu\n", b);
+                return -1;
+            }
+        }
+        printf("success\n");
+    }
+    return 0;
+}
+
+typedef size_t (*aead_function)(uint8_t *, const uint8_t *, const uint8_t *, const uint8_t *, size_t, const uint8_t *, size_t);
+
+// RFC8439 2.8.2 inputs, results of a python model of the construction with fewer rounds
+static int test_reduced_aead() {
+    printf("Testing reduced round chacha-poly1305\n");
+    const uint8_t key[RFC_8439_KEY_SIZE] = {
+        0x80,0x81,0x82,0x83,0x84,0x85,0x86,0x87,0x88,0x89,0x8a,0x8b,0x8c,0x8d,0x8e,0x8f,
+        0x90,0x91,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0x9b,0x9c,0x9d,0x9e,0x9f
+    };
+    const uint8_t nonce[RFC_8439_NONCE_SIZE] = {
+        0x07,0x00,0x00,0x00,0x40,0x41,0x42,0x43,0x44,0x45,0x46,0x47
+    };
+    const uint8_t ad[] = {
+        0x50,0x51,0x52,0x53,0xc0,0xc1,0xc2,0xc3,0xc4,0xc5,0xc6,0xc7
+    };
+    const uint8_t plain_text[] = {
+        0x4c,0x61,0x64,0x69,0x65,0x73,0x20,0x61,0x6e,0x64,0x20,0x47,0x65,0x6e,0x74,0x6c,
+        0x65,0x6d,0x65,0x6e,0x20,0x6f,0x66,0x20,0x74,0x68,0x65,0x20,0x63,0x6c,0x61,0x73,
+        0x73,0x20,0x6f,0x66,0x20,0x27,0x39,0x39,0x3a,0x20,0x49,0x66,0x20,0x49,0x20,0x63,
+        0x6f,0x75,0x6c,0x64,0x20,0x6f,0x66,0x66,0x65,0x72,0x20,0x79,0x6f,0x75,0x20,0x6f,
+        0x6e,0x6c,0x79,0x20,0x6f,0x6e,0x65,0x20,0x74,0x69,0x70,0x20,0x66,0x6f,0x72,0x20,
+        0x74,0x68,0x65,0x20,0x66,0x75,0x74,0x75,0x72,0x65,0x2c,0x20,0x73,0x75,0x6e,0x73,
+        0x63,0x72,0x65,0x65,0x6e,0x20,0x77,0x6f,0x75,0x6c,0x64,0x20,0x62,0x65,0x20,0x69,
+        0x74,0x2e
+    };
+    static const uint8_t chacha12_expected[] = {
+        0xbb,0xc9,0x35,0xda,0x15,0x8b,0xf5,0xa6,0xb9,0xdf,0x52,0x59,0xd0,0x3f,0xf5,0xfe,
+        0x6d,0x81,0x2e,0x72,0xad,0x17,0x3a,0x96,0x49,0xf4,0xd4,0xf3,0xfe,0x0c,0x6f,0xe9,
+        0xeb,0x88,0x8a,0xb6,0xc2,0x65,0x36,0x41,0xcb,0x86,0x51,0x6f,0x30,0xc5,0xa5,0x12,
+        0x97,0x62,0x5b,0xd5,0x5c,0x8e,0x83,0x0d,0x92,0xb6,0xa0,0x1c,0xe8,0x85,0x6c,0xcb,
+        0x29,0x20,0x6e,0x79,0x69,0x6e,0xc7,0x4b,0x13,0x27,0x69,0xed,0x27,0x6b,0x72,0x1a,
+        0xaa,0x63,0x86,0x86,0x4e,0x7f,0xc1,0x92,0xee,0x2d,0x68,0x1e,0x36,0x47,0x86,0xa6,
+        0xdb,0x7c,0x1d,0x69,0x1a,0xb8,0xb0,0x38,0x2b,0x60,0xa2,0x37,0x8b,0xd7,0xd4,0xd6,
+        0x31,0xd8,0xba,0x2d,0xed,0x46,0xda,0xca,0x2b,0xd2,0xbb,0xdb,0x67,0xe4,0xa3,0x36,
+        0x3e,0x87
+    };
+    static const uint8_t chacha8_expected[] = {
+        0x92,0xa6,0xd1,0x23,0x9f,0x63,0xd2,0xf5,0x62,0xbd,0x59,0x01,0xd9,0x0d,0xf4,0xfc,
+        0x53,0xf6,0x3a,0x1e,0xc5,0x20,0x1a,0xa8,0x06,0x48,0x19,0x8a,0x64,0x36,0xf7,0x17,
+        0x26,0xd6,0x46,0xa4,0x96,0xea,0x4c,0x0d,0xfa,0x2c,0xcf,0xc9,0x94,0x77,0x0e,0x46,
+        0xe3,0x04,0x82,0x9d,0x1a,0xd7,0x64,0x90,0xdb,0x4c,0x27,0x23,0x5c,0xc6,0xeb,0xbf,
+        0x25,0x00,0x3f,0xd3,0x0d,0xa6,0xc4,0xb7,0x6b,0x7a,0x90,0xa9,0x47,0x22,0x6c,0x01,
+        0x22,0xe9,0x09,0x2f,0xc5,0x56,0x11,0x5f,0xf7,0x2e,0xac,0x3f,0x49,0x70,0xc2,0x39,
+        0xbc,0xee,0xb5,0x5d,0x3f,0x61,0xd8,0x52,0x0c,0x10,0x91,0x31,0xd5,0xa7,0xa1,0x51,
+        0x08,0x64,0xca,0xe9,0x43,0xb1,0xd1,0xd6,0xec,0xfd,0x13,0xef,0xbe,0x36,0xc2,0xe3,
+        0x56,0xe0
+    };
+    const struct {
+        const char *name;
+        aead_function encrypt;
+        aead_function decrypt;
+        const uint8_t *expected;
+    } variants[] = {
+        { "chacha12-poly1305", portable_chacha12_poly1305_encrypt, portable_chacha12_poly1305_decrypt, chacha12_expected },
+        { "chacha8-poly1305", portable_chacha8_poly1305_encrypt, portable_chacha8_poly1305_decrypt, chacha8_expected },
+    };
+    uint8_t buffer[sizeof(plain_text) + RFC_8439_TAG_SIZE];
+    for (size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); v++) {
+        printf("- %s: ", variants[v].name);
+        if (variants[v].encrypt(buffer, key, nonce, ad, sizeof(ad), plain_text, sizeof(plain_text)) != sizeof(buffer)
+                || memcmp(buffer, variants[v].expected, sizeof(buffer)) != 0) {
+            printf("failed encryption\n");
+            UNEXPECTED_RESULT(variants[v].expected, buffer, sizeof(buffer))
+            return -1;
+        }
+        if (variants[v].decrypt(buffer, key, nonce, ad, sizeof(ad), variants[v].expected, sizeof(buffer)) != sizeof(plain_text)
+                || memcmp(buffer, plain_text, sizeof(plain_text)) != 0) {
+            printf("failed decryption\n");
+            return -1;
+        }
+        // the tag of one variant is not valid for another
+        if (portable_chacha20_poly1305_decrypt(buffer, key, nonce, ad, sizeof(ad), variants[v].expected, sizeof(buffer)) != (size_t)-1) {
+            printf("opened as chacha20-poly1305\n");
+            return -1;
+        }
+        printf("success\n");
+    }
+    return 0;
+}
+
+static int test_quic_hp() {
+    printf("Testing quic header protection\n");
+    printf("- RFC9001 A.5: ");
+    const uint8_t hp_key[RFC_8439_KEY_SIZE] = {
+        0x25,0xa2,0x82,0xb9,0xe8,0x2f,0x06,0xf2,0x1f,0x48,0x89,0x17,0xa4,0xfc,0x8f,0x1b,
+        0x73,0x57,0x36,0x85,0x60,0x85,0x97,0xd0,0xef,0xcb,0x07,0x6b,0x0a,0xb7,0xa7,0xa4
+    };
+    const uint8_t sample[PORTABLE_QUIC_HP_SAMPLE_SIZE] = {
+        0x5e,0x5c,0xd5,0x5c,0x41,0xf6,0x90,0x80,0x57,0x5d,0x79,0x99,0xc2,0x5a,0x5b,0xfb
+    };
+    const uint8_t expected[PORTABLE_QUIC_HP_MASK_SIZE] = { 0xae,0xfe,0xfe,0x7d,0x03 };
+    portable_8439_key key;
+    portable_chacha20_poly1305_key_init(&key, hp_key);
+    uint8_t mask[PORTABLE_QUIC_HP_MASK_SIZE];
+    portable_chacha20_quic_hp_mask(mask, &key, sample);
+    if (memcmp(mask, expected, sizeof(expected)) != 0) {
+        printf("failed\n");
+        UNEXPECTED_RESULT(expected, mask, sizeof(expected))
+        return -1;
+    }
+    printf("success\n");
+
+    // the batch (an odd count, so both the SIMD and the single path) should 
+    // match the key stream of chacha20 with the sample as counter & nonce
+    printf("- batch: ");
+    #define HP_BATCH (37)
+    uint8_t samples[HP_BATCH][PORTABLE_QUIC_HP_SAMPLE_SIZE];
+    const uint8_t *sample_pointers[HP_BATCH];
+    uint8_t masks[HP_BATCH * PORTABLE_QUIC_HP_MASK_SIZE];
+    for (size_t p = 0; p < HP_BATCH; p++) {
+        for (size_t i = 0; i < PORTABLE_QUIC_HP_SAMPLE_SIZE; i++) {
+            samples[p][i] = (uint8_t)(p * 31 + i * 7 + (i == 0 ? 0 : p));
+        }
+        sample_pointers[p] = samples[p];
+    }
+    portable_chacha20_quic_hp_mask_batch(masks, &key, sample_pointers, HP_BATCH);
+    for (size_t p = 0; p < HP_BATCH; p++) {
+        const uint8_t zeroes[PORTABLE_QUIC_HP_MASK_SIZE] = { 0 };
+        uint32_t counter = (uint32_t)samples[p][0] | (uint32_t)samples[p][1] << 8 | (uint32_t)samples[p][2] << 16 | (uint32_t)samples[p][3] << 24;
+        chacha20_xor_stream(mask, zeroes, sizeof(mask), hp_key, samples[p] + 4, counter);
+        if (memcmp(masks + p * PORTABLE_QUIC_HP_MASK_SIZE, mask, sizeof(mask)) != 0) {
+            printf("failed at packet %zu\n", p);
+            return -1;
+        }
+    }
+    portable_chacha20_poly1305_key_wipe(&key);
+    printf("success\n");
+    return 0;
+}
+
 
 int main() {
     int result = 0;
     result += test_chacha20();
     result += test_poly();
     result += test_aead();
+    result += test_hchacha20();
+    result += test_xchacha_aead();
+    result += test_reduced_rounds();
+    result += test_reduced_aead();
+    result += test_quic_hp();
     if (result != 0) {
         printf("%d test failed\n", result * -1);
     }
@@ -0,0 +1,224 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../src/portable8439-transport.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pcg_random.h"
+
+#define PACKET_SIZE (100)
+#define BURST (32)
+#define THREADS (4)
+#define STREAM (20000)
+#define COPIES (3)
+
+static void fill_crappy_random(void* target, size_t length, pcg32_random_t* rng) {
+    uint8_t *p = target;
+    for (size_t i = 0; i < length; i++) {
+        p[i] = (uint8_t)pcg32_random_r(rng);
+    }
+}
+
+typedef struct sealed_packet {
+    uint64_t counter;
+    uint8_t cipher[PACKET_SIZE + RFC_8439_TAG_SIZE];
+} sealed_packet;
+
+#define CHECK(condition, ...) \
+    if (!(condition)) { \
+        printf(__VA_ARGS__); \
+        return 1; \
+    }
+
+static int open_one(portable_8439_transport *receiver, const sealed_packet *packet, uint8_t *plain) {
+    return portable_8439_transport_open(receiver, plain, packet->counter, NULL, 0, packet->cipher, sizeof(packet->cipher)) == PACKET_SIZE;
+}
+
+static int test_window(pcg32_random_t *rng) {
+    uint8_t key_a[RFC_8439_KEY_SIZE], key_b[RFC_8439_KEY_SIZE], plain[PACKET_SIZE], opened[PACKET_SIZE];
+    fill_crappy_random(key_a, sizeof(key_a), rng);
+    fill_crappy_random(key_b, sizeof(key_b), rng);
+    fill_crappy_random(plain, sizeof(plain), rng);
+    portable_8439_transport sender, receiver;
+    portable_8439_transport_init(&sender, key_a, key_b);
+    portable_8439_transport_init(&receiver, key_b, key_a);
+
+    #define SEALED (PORTABLE_8439_REPLAY_WINDOW + 200)
+    static sealed_packet packets[SEALED];
+    for (size_t i = 0; i < SEALED; i++) {
+        CHECK(portable_8439_transport_seal(&sender, packets[i].cipher, &packets[i].counter, NULL, 0, plain, sizeof(plain)) == sizeof(packets[i].cipher),
+            "seal failed\n")
+        CHECK(packets[i].counter == i, "counter %llu instead of %zu\n", (unsigned long long)packets[i].counter, i)
+    }
+
+    // the nonce is the counter, little endian after 4 zero bytes
+    uint8_t nonce[RFC_8439_NONCE_SIZE] = { 0, 0, 0, 0, 7 };
+    CHECK(portable_chacha20_poly1305_decrypt(opened, key_a, nonce, NULL, 0, packets[7].cipher, sizeof(packets[7].cipher)) == PACKET_SIZE
+            && memcmp(opened, plain, sizeof(plain)) == 0, "the nonce is not the counter\n")
+
+    CHECK(open_one(&receiver, &packets[5], opened) && memcmp(opened, plain, sizeof(plain)) == 0, "open failed\n")
+    CHECK(!open_one(&receiver, &packets[5], opened), "replay accepted\n")
+    // out of order, inside of the window
+    CHECK(open_one(&receiver, &packets[2], opened), "older packet rejected\n")
+    CHECK(open_one(&receiver, &packets[100], opened), "newer packet rejected\n")
+    CHECK(open_one(&receiver, &packets[40], opened), "packet in between rejected\n")
+    CHECK(!open_one(&receiver, &packets[40], opened), "replay accepted\n")
+
+    // a corrupted packet doesn't use up its counter
+    sealed_packet corrupted = packets[50];
+    corrupted.cipher[3] ^= 1;
+    CHECK(!open_one(&receiver, &corrupted, opened), "corrupted packet accepted\n")
+    CHECK(open_one(&receiver, &packets[50], opened), "counter used up by a corrupted packet\n")
+
+    // the window moves with the largest counter
+    CHECK(open_one(&receiver, &packets[SEALED - 1], opened), "packet far ahead rejected\n")
+    CHECK(!open_one(&receiver, &packets[60], opened), "packet behind the window accepted\n")
+    CHECK(open_one(&receiver, &packets[SEALED - PORTABLE_8439_REPLAY_WINDOW + 1], opened), "packet at the edge of the window rejected\n")
+    for (size_t i = 0; i < SEALED; i++) {
+        CHECK(!open_one(&receiver, &packets[i], opened) || i >= SEALED - PORTABLE_8439_REPLAY_WINDOW, "old packet %zu accepted\n", i)
+    }
+
+    portable_8439_transport_wipe(&sender);
+    portable_8439_transport_wipe(&receiver);
+    return 0;
+}
+
+static int test_burst(pcg32_random_t *rng) {
+    uint8_t key[RFC_8439_KEY_SIZE];
+    fill_crappy_random(key, sizeof(key), rng);
+    portable_8439_transport sender, receiver;
+    portable_8439_transport_init(&sender, key, key);
+    portable_8439_transport_init(&receiver, key, key);
+
+    static uint8_t plain[BURST][PACKET_SIZE], sealed[BURST][PACKET_SIZE + RFC_8439_TAG_SIZE], opened[2 * BURST][PACKET_SIZE];
+    uint8_t ad[BURST];
+    portable_8439_packet packets[2 * BURST];
+    for (size_t i = 0; i < BURST; i++) {
+        fill_crappy_random(plain[i], PACKET_SIZE, rng);
+        ad[i] = (uint8_t)i;
+        packets[i] = (portable_8439_packet){
+            .ad = &ad[i], .ad_size = 1, .input = plain[i], .input_size = i, .output = sealed[i]
+        };
+    }
+    // a packet that fails doesn't stop the rest
+    packets[3].output = (uint8_t *)plain[3] + 1;
+    CHECK(portable_8439_transport_seal_burst(&sender, packets, BURST) == BURST - 1, "seal burst failed\n")
+    for (size_t i = 0; i < BURST; i++) {
+        CHECK(packets[i].counter == i && packets[i].result == (i == 3 ? (size_t)-1 : i + RFC_8439_TAG_SIZE), "seal burst packet %zu\n", i)
+    }
+
+    // the burst to open is shuffled, and every packet appears twice
+    for (size_t i = 0; i < 2 * BURST; i++) {
+        size_t p = i % BURST;
+        packets[i] = (portable_8439_packet){
+            .counter = p, .ad = &ad[p], .ad_size = 1, .input = sealed[p], .input_size = p + RFC_8439_TAG_SIZE, .output = opened[i]
+        };
+    }
+    for (size_t i = 2 * BURST - 1; i > 0; i--) {
+        size_t j = pcg32_random_r(rng) % (i + 1);
+        portable_8439_packet swap = packets[i];
+        packets[i] = packets[j];
+        packets[j] = swap;
+    }
+    CHECK(portable_8439_transport_open_burst(&receiver, packets, 2 * BURST) == BURST - 1, "open burst accepted the wrong amount\n")
+    int seen[BURST] = { 0 };
+    for (size_t i = 0; i < 2 * BURST; i++) {
+        size_t p = (size_t)packets[i].counter;
+        if (packets[i].result != (size_t)-1) {
+            CHECK(packets[i].result == p && memcmp(packets[i].output, plain[p], p) == 0, "open burst packet %zu differs\n", p)
+            seen[p]++;
+        }
+    }
+    for (size_t p = 0; p < BURST; p++) {
+        CHECK(seen[p] == (p == 3 ? 0 : 1), "packet %zu opened %d times\n", p, seen[p])
+    }
+    portable_8439_transport_wipe(&sender);
+    portable_8439_transport_wipe(&receiver);
+    return 0;
+}
+
+// threads open the same stream of packets (every packet a few times, locally
+// shuffled) on one session, every counter should be accepted exactly once
+typedef struct shared_stream {
+    portable_8439_transport receiver;
+    sealed_packet *packets;
+    uint32_t *order;
+    uint32_t accepted[STREAM];
+} shared_stream;
+
+static void *opener(void *arg) {
+    shared_stream *shared = arg;
+    uint8_t opened[PACKET_SIZE];
+    for (size_t i = 0; i < STREAM * COPIES; i++) {
+        const sealed_packet *packet = &shared->packets[shared->order[i]];
+        if (open_one(&shared->receiver, packet, opened)) {
+            __atomic_add_fetch(&shared->accepted[packet->counter], 1, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+static int test_concurrent(pcg32_random_t *rng) {
+    uint8_t key[RFC_8439_KEY_SIZE], plain[PACKET_SIZE];
+    fill_crappy_random(key, sizeof(key), rng);
+    fill_crappy_random(plain, sizeof(plain), rng);
+    shared_stream *shared = calloc(1, sizeof(shared_stream));
+    sealed_packet *packets = calloc(STREAM, sizeof(sealed_packet));
+    uint32_t *order = calloc(STREAM * COPIES, sizeof(uint32_t));
+    CHECK(shared != NULL && packets != NULL && order != NULL, "allocation failed\n")
+    portable_8439_transport sender;
+    portable_8439_transport_init(&sender, key, key);
+    portable_8439_transport_init(&shared->receiver, key, key);
+    for (size_t i = 0; i < STREAM; i++) {
+        portable_8439_transport_seal(&sender, packets[i].cipher, &packets[i].counter, NULL, 0, plain, sizeof(plain));
+        for (size_t c = 0; c < COPIES; c++) {
+            order[i * COPIES + c] = (uint32_t)i;
+        }
+    }
+    // shuffle inside of groups of 64, far less than the window
+    for (size_t i = 0; i < STREAM * COPIES; i++) {
+        size_t group = i - i % 64;
+        size_t j = group + pcg32_random_r(rng) % 64;
+        if (j < STREAM * COPIES) {
+            uint32_t swap = order[i];
+            order[i] = order[j];
+            order[j] = swap;
+        }
+    }
+    shared->packets = packets;
+    shared->order = order;
+
+    pthread_t threads[THREADS];
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&threads[t], NULL, opener, shared);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    int failed = 0;
+    for (size_t i = 0; i < STREAM && !failed; i++) {
+        if (shared->accepted[i] != 1) {
+            printf("counter %zu accepted %u times\n", i, shared->accepted[i]);
+            failed = 1;
+        }
+    }
+    portable_8439_transport_wipe(&sender);
+    portable_8439_transport_wipe(&shared->receiver);
+    free(order);
+    free(packets);
+    free(shared);
+    return failed;
+}
+
+int main(void) {
+    printf("Transport sessions: ");
+    fflush(stdout);
+    srand(time(NULL));
+    pcg32_random_t rng = { (uint64_t)rand() << 32 | (uint64_t)rand(), 5 };
+    int failed = test_window(&rng) || test_burst(&rng) || test_concurrent(&rng);
+    if (!failed) {
+        printf("success\n");
+    }
+    return failed;
+}